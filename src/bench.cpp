@@ -0,0 +1,985 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "btree.h"
+#include "buffer.h"
+#include "compressed_backend.h"
+#include "file.h"
+#include "file_iterator.h"
+#include "filescan.h"
+#include "log_manager.h"
+#include "mem_backend.h"
+#include "page.h"
+#include "page_iterator.h"
+#include "parallel_filescan.h"
+#include "simulated_disk_backend.h"
+#include "zone_map.h"
+#include "exceptions/end_of_file_exception.h"
+#include "exceptions/index_scan_completed_exception.h"
+#include "exceptions/file_not_found_exception.h"
+
+using namespace badgerdb;
+
+namespace {
+
+/**
+ * Record of the test relation: mostly padding, like RECORD in main.cpp.
+ */
+struct BenchRecord {
+  int i;
+  double d;
+  char s[64];
+};
+
+const char* const BENCH_FILE = "bench.rel";
+
+const int NUM_PAGES = 4096;
+
+double secondsSince(const std::chrono::steady_clock::time_point& start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start).count();
+}
+
+double megabytes(const double bytes) {
+  return bytes / (1024.0 * 1024.0);
+}
+
+/**
+ * Prints the simulated time and access pattern of a simulated backend.
+ */
+void reportSimulated(const std::string& label, const std::string& phase,
+                     const SimulatedDiskBackend* simulated) {
+  if (simulated == NULL) {
+    return;
+  }
+  const SimulatedDiskStats stats = simulated->stats();
+  std::cout << label << ": " << phase << " simulated "
+            << stats.elapsed_micros / 1000.0 << " ms, "
+            << stats.sequential_accesses << " sequential / "
+            << stats.random_accesses << " random accesses" << std::endl;
+}
+
+/**
+ * Writes a relation of NUM_PAGES half-full pages, then scans it, reporting
+ * the throughput of both in logical (uncompressed) megabytes per second.
+ */
+void run(const std::string& label, const BackendFactory& factory) {
+  try {
+    File::remove(BENCH_FILE);
+  } catch (const FileNotFoundException&) {
+  }
+
+  CompressedBackend* compressed = NULL;
+  SimulatedDiskBackend* simulated = NULL;
+  const BackendFactory counting =
+      [&](const std::string& name, const bool create_new) {
+        FileBackend* backend = factory(name, create_new);
+        compressed = dynamic_cast<CompressedBackend*>(backend);
+        simulated = dynamic_cast<SimulatedDiskBackend*>(backend);
+        return backend;
+      };
+
+  BenchRecord record;
+  memset(&record, 0, sizeof(record));
+  const double logical_bytes = double(NUM_PAGES) * Page::SIZE;
+
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  {
+    PageFile file = PageFile::create(BENCH_FILE, counting);
+    for (int p = 0; p < NUM_PAGES; ++p) {
+      PageId page_number;
+      Page page = file.allocatePage(page_number);
+      for (int r = 0; r < 40; ++r) {
+        record.i = p * 40 + r;
+        record.d = record.i;
+        sprintf(record.s, "%05d string record", record.i);
+        page.insertRecord(std::string(reinterpret_cast<char*>(&record),
+                                      sizeof(record)));
+      }
+      file.writePage(page_number, page);
+    }
+    file.flushMetadata();
+    if (compressed != NULL) {
+      const CompressionStats stats = compressed->stats();
+      std::cout << label << ": compression ratio "
+                << double(stats.logical_bytes_written) /
+                       stats.physical_bytes_written
+                << std::endl;
+    }
+    reportSimulated(label, "write", simulated);
+  }
+  const double write_seconds = secondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  std::size_t num_records = 0;
+  {
+    PageFile file = PageFile::open(BENCH_FILE, counting);
+    for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+      Page page = *iter;
+      for (PageIterator rec = page.begin(); rec != page.end(); ++rec) {
+        ++num_records;
+      }
+    }
+    reportSimulated(label, "scan", simulated);
+  }
+  const double read_seconds = secondsSince(start);
+
+  std::cout << label << ": write " << megabytes(logical_bytes) / write_seconds
+            << " MB/s, scan " << megabytes(logical_bytes) / read_seconds
+            << " MB/s (" << num_records << " records)" << std::endl;
+
+  File::remove(BENCH_FILE);
+}
+
+/**
+ * Scans the relation the way BTreeIndex builds an index, reading an int key
+ * out of every record, once through copied records and once through views.
+ */
+void runRecordAccess() {
+  try {
+    File::remove(BENCH_FILE);
+  } catch (const FileNotFoundException&) {
+  }
+  {
+    PageFile file = PageFile::create(BENCH_FILE);
+    BenchRecord record;
+    memset(&record, 0, sizeof(record));
+    for (int p = 0; p < NUM_PAGES; ++p) {
+      PageId page_number;
+      Page page = file.allocatePage(page_number);
+      for (int r = 0; r < 40; ++r) {
+        record.i = p * 40 + r;
+        page.insertRecord(std::string(reinterpret_cast<char*>(&record),
+                                      sizeof(record)));
+      }
+      file.writePage(page_number, page);
+    }
+  }
+
+  BufMgr buf_mgr(256);
+  for (int use_view = 0; use_view < 2; ++use_view) {
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    std::size_t num_records = 0;
+    long long key_sum = 0;
+    {
+      FileScan scan(BENCH_FILE, &buf_mgr);
+      try {
+        RecordId rid;
+        while (true) {
+          scan.scanNext(rid);
+          int key;
+          if (use_view) {
+            memcpy(&key, scan.getRecordView().data(), sizeof(key));
+          } else {
+            const std::string record = scan.getRecord();
+            memcpy(&key, record.data(), sizeof(key));
+          }
+          key_sum += key;
+          ++num_records;
+        }
+      } catch (const EndOfFileException&) {
+      }
+    }
+    std::cout << "record access: " << (use_view ? "view" : "copy") << " "
+              << num_records / secondsSince(start) << " records/s (key sum "
+              << key_sum << ")" << std::endl;
+  }
+
+  File::remove(BENCH_FILE);
+}
+
+/**
+ * Scans full relations of slotted and of fixed-length pages, reading only the
+ * int key of each record a record at a time, a batch at a time, projected by
+ * the scan and a page at a time, and reports records per second.
+ */
+void runKeyExtraction() {
+  const std::vector<std::uint16_t> columns = {
+      sizeof(int), offsetof(BenchRecord, d) - sizeof(int), sizeof(double), 64};
+  BufMgr buf_mgr(256);
+  for (int fixed_length = 0; fixed_length < 2; ++fixed_length) {
+    try {
+      File::remove(BENCH_FILE);
+    } catch (const FileNotFoundException&) {
+    }
+    {
+      PageFile file = PageFile::create(BENCH_FILE);
+      BenchRecord record;
+      memset(&record, 0, sizeof(record));
+      const std::size_t num_records = std::size_t(NUM_PAGES) * 40;
+      PageId page_number;
+      Page page = file.allocatePage(page_number);
+      if (fixed_length) {
+        page.setFixedLengthFormat(columns);
+      }
+      for (std::size_t r = 0; r < num_records; ++r) {
+        record.i = r;
+        const std::string data(reinterpret_cast<char*>(&record),
+                               sizeof(record));
+        if (!page.hasSpaceForRecord(data)) {
+          file.writePage(page_number, page);
+          page = file.allocatePage(page_number);
+          if (fixed_length) {
+            page.setFixedLengthFormat(columns);
+          }
+        }
+        page.insertRecord(data);
+      }
+      file.writePage(page_number, page);
+    }
+
+    // Through FileScan, a record at a time.
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    std::size_t num_records = 0;
+    long long key_sum = 0;
+    {
+      FileScan scan(BENCH_FILE, &buf_mgr);
+      try {
+        RecordId rid;
+        while (true) {
+          scan.scanNext(rid);
+          int key;
+          memcpy(&key, scan.getAttributeView(0, sizeof(key)).data(),
+                 sizeof(key));
+          key_sum += key;
+          ++num_records;
+        }
+      } catch (const EndOfFileException&) {
+      }
+    }
+    const double scan_rate = num_records / secondsSince(start);
+
+    // Through FileScan, a batch at a time.
+    start = std::chrono::steady_clock::now();
+    num_records = 0;
+    {
+      FileScan scan(BENCH_FILE, &buf_mgr);
+      const std::size_t max_batch = 256;
+      RecordId rids[max_batch];
+      std::string_view records[max_batch];
+      std::size_t count;
+      while ((count = scan.nextBatch(rids, records, max_batch)) > 0) {
+        for (std::size_t r = 0; r < count; ++r) {
+          int key;
+          memcpy(&key, records[r].data(), sizeof(key));
+          key_sum += key;
+        }
+        num_records += count;
+      }
+    }
+    const double batch_rate = num_records / secondsSince(start);
+
+    // Through FileScan, projecting just the key, a page at a time.
+    start = std::chrono::steady_clock::now();
+    num_records = 0;
+    {
+      FileScan scan(BENCH_FILE, &buf_mgr);
+      const std::size_t max_keys = 256;
+      int keys[max_keys];
+      RecordId rids[max_keys];
+      std::size_t count;
+      while ((count = scan.nextKeys(offsetof(BenchRecord, i), INTEGER, keys,
+                                    rids, max_keys)) > 0) {
+        for (std::size_t k = 0; k < count; ++k) {
+          key_sum += keys[k];
+        }
+        num_records += count;
+      }
+    }
+    const double project_rate = num_records / secondsSince(start);
+
+    // A page at a time, streaming the key column of fixed-length pages.
+    PageFile file = PageFile::open(BENCH_FILE);
+    std::vector<Page> pages;
+    for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+      pages.push_back(*iter);
+    }
+    start = std::chrono::steady_clock::now();
+    num_records = 0;
+    for (int round = 0; round < 10; ++round) {
+      for (std::size_t p = 0; p < pages.size(); ++p) {
+        const Page& page = pages[p];
+        if (fixed_length) {
+          const char* keys = page.getColumnData(0);
+          for (SlotId slot = page.getNextUsedSlot(Page::INVALID_SLOT);
+               slot != Page::INVALID_SLOT; slot = page.getNextUsedSlot(slot)) {
+            int key;
+            memcpy(&key, keys + (slot - 1) * sizeof(key), sizeof(key));
+            key_sum += key;
+            ++num_records;
+          }
+        } else {
+          for (SlotId slot = page.getNextUsedSlot(Page::INVALID_SLOT);
+               slot != Page::INVALID_SLOT; slot = page.getNextUsedSlot(slot)) {
+            int key;
+            memcpy(&key, page.getRecordView({page.page_number(), slot}).data(),
+                   sizeof(key));
+            key_sum += key;
+            ++num_records;
+          }
+        }
+      }
+    }
+    std::cout << "key extraction: " << (fixed_length ? "columns" : "slotted")
+              << " " << scan_rate << " records/s through FileScan, "
+              << batch_rate << " records/s through nextBatch, "
+              << project_rate << " records/s through nextKeys, "
+              << num_records / secondsSince(start)
+              << " records/s a page at a time (key sum " << key_sum << ")"
+              << std::endl;
+  }
+  File::remove(BENCH_FILE);
+}
+
+/**
+ * Scans a relation for the 1% of records whose int key is in a range, by
+ * copying every record and testing it and by a FileScan predicate, and
+ * reports records scanned per second.
+ */
+void runSelectiveScan() {
+  try {
+    File::remove(BENCH_FILE);
+  } catch (const FileNotFoundException&) {
+  }
+  const std::size_t num_records = std::size_t(NUM_PAGES) * 40;
+  // The relation is kept in memory, where the scans find it, so that they
+  // measure the work per record rather than reading pages.
+  {
+    PageFile file = PageFile::create(BENCH_FILE, MemBackend::factory());
+    BenchRecord record;
+    memset(&record, 0, sizeof(record));
+    PageId page_number;
+    Page page = file.allocatePage(page_number);
+    for (std::size_t r = 0; r < num_records; ++r) {
+      record.i = (r * 7919) % num_records;
+      const std::string data(reinterpret_cast<char*>(&record), sizeof(record));
+      if (!page.hasSpaceForRecord(data)) {
+        file.writePage(page_number, page);
+        page = file.allocatePage(page_number);
+      }
+      page.insertRecord(data);
+    }
+    file.writePage(page_number, page);
+  }
+
+  BufMgr buf_mgr(256);
+  const int low = num_records / 2;
+  const int high = low + num_records / 100;
+  double rates[2];
+  std::size_t num_found[2] = {0, 0};
+  for (int pushed_down = 0; pushed_down < 2; ++pushed_down) {
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    FileScan scan(BENCH_FILE, &buf_mgr);
+    if (pushed_down) {
+      scan.setPredicate(offsetof(BenchRecord, i), INTEGER, &low, GTE, &high,
+                        LT);
+    }
+    try {
+      RecordId rid;
+      while (true) {
+        scan.scanNext(rid);
+        if (!pushed_down) {
+          const std::string record = scan.getRecord();
+          const int key =
+              reinterpret_cast<const BenchRecord*>(record.data())->i;
+          if (key < low || key >= high) {
+            continue;
+          }
+        }
+        ++num_found[pushed_down];
+      }
+    } catch (const EndOfFileException&) {
+    }
+    rates[pushed_down] = num_records / secondsSince(start);
+  }
+  std::cout << "selective scan: " << rates[0]
+            << " records/s copying and testing, " << rates[1]
+            << " records/s with a predicate (" << num_found[0] << " and "
+            << num_found[1] << " found)" << std::endl;
+  File::remove(BENCH_FILE);
+}
+
+/**
+ * Runs four overlapping full scans of a relation, started an eighth of the
+ * relation apart and taking a record from each in turn, through a buffer pool
+ * far smaller than the relation, without and with shared sweeps, and reports
+ * the pages read and records per second.
+ */
+void runSharedScans() {
+  try {
+    File::remove(BENCH_FILE);
+  } catch (const FileNotFoundException&) {
+  }
+  const std::size_t num_records = std::size_t(NUM_PAGES) * 40;
+  {
+    PageFile file = PageFile::create(BENCH_FILE);
+    BenchRecord record;
+    memset(&record, 0, sizeof(record));
+    PageId page_number;
+    Page page = file.allocatePage(page_number);
+    for (std::size_t r = 0; r < num_records; ++r) {
+      record.i = r;
+      const std::string data(reinterpret_cast<char*>(&record), sizeof(record));
+      if (!page.hasSpaceForRecord(data)) {
+        file.writePage(page_number, page);
+        page = file.allocatePage(page_number);
+      }
+      page.insertRecord(data);
+    }
+    file.writePage(page_number, page);
+  }
+
+  const int num_scans = 4;
+  for (int shared = 0; shared < 2; ++shared) {
+    BufMgr buf_mgr(64);
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    std::size_t num_scanned = 0;
+    {
+      std::vector<std::unique_ptr<FileScan> > scans;
+      for (int n = 0; n < num_scans; ++n) {
+        scans.emplace_back(new FileScan(BENCH_FILE, &buf_mgr));
+        scans.back()->setShared(shared);
+      }
+      // scan n starts once scan 0 is n eighths of the way through
+      const std::size_t stagger = num_records / 8;
+      for (std::size_t round = 0, num_done = 0; num_done < num_scans;
+           ++round) {
+        num_done = 0;
+        for (int n = 0; n < num_scans && round >= n * stagger; ++n) {
+          try {
+            RecordId rid;
+            scans[n]->scanNext(rid);
+            ++num_scanned;
+          } catch (const EndOfFileException&) {
+            ++num_done;
+          }
+        }
+      }
+    }
+    std::cout << "shared scans: " << num_scans << " scans "
+              << (shared ? "sharing a sweep" : "on their own") << " read "
+              << buf_mgr.getBufStats().diskreads << " pages, "
+              << num_scanned / secondsSince(start) << " records/s"
+              << std::endl;
+  }
+  File::remove(BENCH_FILE);
+}
+
+/**
+ * Estimates how many records of a relation have their key in a range, by a
+ * full scan and by sampling scans of 1% and 5% of the pages, and reports the
+ * estimates, the pages read and the time taken.
+ */
+void runSampling() {
+  try {
+    File::remove(BENCH_FILE);
+  } catch (const FileNotFoundException&) {
+  }
+  const std::size_t num_records = std::size_t(NUM_PAGES) * 40;
+  {
+    PageFile file = PageFile::create(BENCH_FILE);
+    BenchRecord record;
+    memset(&record, 0, sizeof(record));
+    PageId page_number;
+    Page page = file.allocatePage(page_number);
+    for (std::size_t r = 0; r < num_records; ++r) {
+      record.i = (r * 7919) % num_records;
+      const std::string data(reinterpret_cast<char*>(&record), sizeof(record));
+      if (!page.hasSpaceForRecord(data)) {
+        file.writePage(page_number, page);
+        page = file.allocatePage(page_number);
+      }
+      page.insertRecord(data);
+    }
+    file.writePage(page_number, page);
+  }
+
+  const int low = num_records / 4;
+  const int high = low + num_records / 10;
+  const double rates[] = {1.0, 0.05, 0.01};
+  for (const double rate : rates) {
+    BufMgr buf_mgr(256);
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    double estimate = 0;
+    {
+      FileScan scan(BENCH_FILE, &buf_mgr);
+      if (rate < 1) {
+        scan.setSample(FileScan::RESERVOIR, rate, 2024);
+      }
+      scan.setPredicate(offsetof(BenchRecord, i), INTEGER, &low, GTE, &high,
+                        LT);
+      try {
+        RecordId rid;
+        while (true) {
+          scan.scanNext(rid);
+          estimate += scan.getSampleWeight();
+        }
+      } catch (const EndOfFileException&) {
+      }
+    }
+    std::cout << "sampling: " << rate * 100 << "% of pages estimates "
+              << estimate << " of " << high - low << " records in range, "
+              << buf_mgr.getBufStats().diskreads << " pages read, "
+              << secondsSince(start) * 1000 << " ms" << std::endl;
+  }
+  File::remove(BENCH_FILE);
+}
+
+/**
+ * Scans ranges of 0.1%, 1% and 10% of the keys of a relation stored in key
+ * order, without and with a zone map on the key, and reports the pages read
+ * and the time taken.
+ */
+void runZoneMaps() {
+  try {
+    File::remove(BENCH_FILE);
+  } catch (const FileNotFoundException&) {
+  }
+  const std::size_t num_records = std::size_t(NUM_PAGES) * 40;
+  {
+    PageFile file = PageFile::create(BENCH_FILE);
+    BenchRecord record;
+    memset(&record, 0, sizeof(record));
+    PageId page_number;
+    Page page = file.allocatePage(page_number);
+    for (std::size_t r = 0; r < num_records; ++r) {
+      record.i = r;
+      const std::string data(reinterpret_cast<char*>(&record), sizeof(record));
+      if (!page.hasSpaceForRecord(data)) {
+        file.writePage(page_number, page);
+        page = file.allocatePage(page_number);
+      }
+      page.insertRecord(data);
+    }
+    file.writePage(page_number, page);
+  }
+
+  const double fractions[] = {0.001, 0.01, 0.1};
+  for (const bool zone_map : {false, true}) {
+    if (zone_map) {
+      PageFile file = PageFile::open(BENCH_FILE);
+      file.createZoneMap({ZoneAttribute{offsetof(BenchRecord, i), INTEGER, 0}});
+    }
+    for (const double fraction : fractions) {
+      const int low = num_records / 3;
+      const int high = low + int(num_records * fraction);
+      BufMgr buf_mgr(256);
+      const std::chrono::steady_clock::time_point start =
+          std::chrono::steady_clock::now();
+      std::size_t found = 0;
+      {
+        FileScan scan(BENCH_FILE, &buf_mgr);
+        scan.setPredicate(offsetof(BenchRecord, i), INTEGER, &low, GTE, &high,
+                          LT);
+        try {
+          RecordId rid;
+          while (true) {
+            scan.scanNext(rid);
+            ++found;
+          }
+        } catch (const EndOfFileException&) {
+        }
+      }
+      std::cout << "zone maps: " << (zone_map ? "with" : "without") << ", "
+                << fraction * 100 << "% of keys: " << found << " records, "
+                << buf_mgr.getBufStats().diskreads << " pages read, "
+                << secondsSince(start) * 1000 << " ms" << std::endl;
+    }
+  }
+  File::remove(BENCH_FILE);
+}
+
+/**
+ * Scans an in-memory relation with 1, 2, 4 and 8 workers, hashing the string
+ * of every record as a CPU-bound test, and reports records per second.
+ */
+void runParallelScan() {
+  try {
+    File::remove(BENCH_FILE);
+  } catch (const FileNotFoundException&) {
+  }
+  const std::size_t num_records = std::size_t(NUM_PAGES) * 40;
+  {
+    PageFile file = PageFile::create(BENCH_FILE, MemBackend::factory());
+    BenchRecord record;
+    memset(&record, 0, sizeof(record));
+    PageId page_number;
+    Page page = file.allocatePage(page_number);
+    for (std::size_t r = 0; r < num_records; ++r) {
+      record.i = r;
+      sprintf(record.s, "%05d string record", record.i);
+      const std::string data(reinterpret_cast<char*>(&record), sizeof(record));
+      if (!page.hasSpaceForRecord(data)) {
+        file.writePage(page_number, page);
+        page = file.allocatePage(page_number);
+      }
+      page.insertRecord(data);
+    }
+    file.writePage(page_number, page);
+  }
+
+  BufMgr buf_mgr(1024);
+  std::cout << "parallel scan (" << std::thread::hardware_concurrency()
+            << " cores):";
+  for (std::uint32_t workers = 1; workers <= 8; workers *= 2) {
+    std::atomic<std::size_t> num_found(0);
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    ParallelFileScan scan(BENCH_FILE, &buf_mgr, workers);
+    const std::size_t num_scanned = scan.run(
+        [&num_found](const std::uint32_t worker, const Page& page,
+                     const std::vector<RecordId>& rids) {
+          std::size_t found = 0;
+          for (std::size_t r = 0; r < rids.size(); ++r) {
+            const BenchRecord* record = reinterpret_cast<const BenchRecord*>(
+                page.getRecordView(rids[r]).data());
+            std::uint64_t hash = 14695981039346656037ULL;
+            for (int round = 0; round < 8; ++round) {
+              for (std::size_t c = 0; c < sizeof(record->s); ++c) {
+                hash = (hash ^ std::uint8_t(record->s[c])) * 1099511628211ULL;
+              }
+            }
+            found += (hash >> 32) % 100 == 0;
+          }
+          num_found += found;
+        });
+    std::cout << " " << workers << " workers " << num_scanned / secondsSince(start)
+              << " records/s (" << num_found << " found)";
+  }
+  std::cout << std::endl;
+  File::remove(BENCH_FILE);
+}
+
+/**
+ * Fills a page with records and deletes them again in a scattered order,
+ * reporting deletes per second.
+ */
+void runDeletes() {
+  const int rounds = 2000;
+  const std::string record(100, 'x');
+  Page page;
+  std::vector<RecordId> rids;
+  std::size_t num_deletes = 0;
+  const std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    rids.clear();
+    while (page.hasSpaceForRecord(record)) {
+      rids.push_back(page.insertRecord(record));
+    }
+    // Every other record first, then the rest, so most deletes leave holes.
+    for (int pass = 0; pass < 2; ++pass) {
+      for (std::size_t i = pass; i < rids.size(); i += 2) {
+        page.deleteRecord(rids[i]);
+        ++num_deletes;
+      }
+    }
+  }
+  std::cout << "deletes: " << num_deletes / secondsSince(start)
+            << " deletes/s" << std::endl;
+}
+
+/**
+ * Fills pages with BenchRecord tuples and rewrites each with a changed field,
+ * one record at a time and a page at a time, then reports updates per second.
+ */
+void runUpdates() {
+  const int rounds = 2000;
+  BenchRecord tuple;
+  memset(&tuple, 0, sizeof(tuple));
+  Page page;
+  std::vector<RecordId> rids;
+  std::vector<std::string> records;
+  while (page.hasSpaceForRecord(
+      std::string(reinterpret_cast<char*>(&tuple), sizeof(tuple)))) {
+    tuple.i = rids.size();
+    records.push_back(std::string(reinterpret_cast<char*>(&tuple), sizeof(tuple)));
+    rids.push_back(page.insertRecord(records.back()));
+  }
+
+  std::size_t num_updates = 0;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    for (std::size_t r = 0; r < rids.size(); ++r) {
+      reinterpret_cast<BenchRecord*>(&records[r][0])->d = round;
+      page.updateRecord(rids[r], records[r]);
+      ++num_updates;
+    }
+  }
+  const double single_seconds = secondsSince(start);
+
+  std::size_t num_batched = 0;
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    for (std::size_t r = 0; r < rids.size(); ++r) {
+      reinterpret_cast<BenchRecord*>(&records[r][0])->d = round;
+    }
+    page.updateRecords(rids, records);
+    num_batched += rids.size();
+  }
+  std::cout << "updates: " << num_updates / single_seconds
+            << " updates/s, batched " << num_batched / secondsSince(start)
+            << " updates/s" << std::endl;
+
+  // Growing every record left on a page with holes needs compaction, once
+  // per batch but possibly many times one record at a time.
+  const std::string small(60, 'x');
+  const std::string large(80, 'y');
+  double grow_seconds[2] = {0, 0};
+  std::size_t num_grown = 0;
+  for (int round = 0; round < rounds; ++round) {
+    for (int batched = 0; batched < 2; ++batched) {
+      Page holes;
+      std::vector<RecordId> all;
+      while (holes.hasSpaceForRecord(small)) {
+        all.push_back(holes.insertRecord(small));
+      }
+      std::vector<RecordId> left;
+      for (std::size_t r = 0; r < all.size(); ++r) {
+        if (r % 3 == 0 && r + 1 < all.size()) {
+          holes.deleteRecord(all[r]);
+        } else {
+          left.push_back(all[r]);
+        }
+      }
+      const std::vector<std::string> versions(left.size(), large);
+      start = std::chrono::steady_clock::now();
+      if (batched) {
+        holes.updateRecords(left, versions);
+      } else {
+        for (std::size_t r = 0; r < left.size(); ++r) {
+          holes.updateRecord(left[r], versions[r]);
+        }
+      }
+      grow_seconds[batched] += secondsSince(start);
+      if (batched) {
+        num_grown += left.size();
+      }
+    }
+  }
+  std::cout << "growing updates: " << num_grown / grow_seconds[0]
+            << " updates/s, batched " << num_grown / grow_seconds[1]
+            << " updates/s" << std::endl;
+}
+
+/**
+ * Fills pages with 4-byte records and deletes every other one, then reports
+ * iterations over the half-empty pages and inserts reusing their slots per
+ * second.
+ */
+void runSmallRecords() {
+  const int rounds = 500;
+  const std::string record(4, 'x');
+  std::size_t num_inserts = 0;
+  std::size_t num_iterations = 0;
+  std::size_t num_records = 0;
+  double insert_seconds = 0;
+  double iterate_seconds = 0;
+  for (int round = 0; round < rounds; ++round) {
+    Page page;
+    std::vector<RecordId> rids;
+    while (page.hasSpaceForRecord(record)) {
+      rids.push_back(page.insertRecord(record));
+    }
+    for (std::size_t i = 0; i + 1 < rids.size(); i += 2) {
+      page.deleteRecord(rids[i]);
+    }
+
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    for (int i = 0; i < 10; ++i) {
+      for (PageIterator rec = page.begin(); rec != page.end(); ++rec) {
+        ++num_records;
+      }
+      ++num_iterations;
+    }
+    iterate_seconds += secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    while (page.hasSpaceForRecord(record)) {
+      page.insertRecord(record);
+      ++num_inserts;
+    }
+    insert_seconds += secondsSince(start);
+  }
+  std::cout << "small records: " << num_iterations / iterate_seconds
+            << " page iterations/s (" << num_records / num_iterations
+            << " records per page), " << num_inserts / insert_seconds
+            << " inserts/s" << std::endl;
+}
+/**
+ * Writes BENCH_FILE with BenchRecord tuples keyed 0 to num_records - 1.
+ */
+void writeKeyedRelation(const int num_records) {
+  try {
+    File::remove(BENCH_FILE);
+  } catch (const FileNotFoundException&) {
+  }
+  PageFile file = PageFile::create(BENCH_FILE);
+  BenchRecord record;
+  memset(&record, 0, sizeof(record));
+  PageId page_number;
+  Page page = file.allocatePage(page_number);
+  for (int r = 0; r < num_records; ++r) {
+    record.i = r;
+    const std::string data(reinterpret_cast<char*>(&record), sizeof(record));
+    if (!page.hasSpaceForRecord(data)) {
+      file.writePage(page_number, page);
+      page = file.allocatePage(page_number);
+    }
+    page.insertRecord(data);
+  }
+  file.writePage(page_number, page);
+}
+
+/**
+ * Builds a B+Tree index on the int key of a relation, then looks up random
+ * keys and scans random key ranges through it, with a buffer pool of the same
+ * number of bytes whatever the page size.  Run for each page size by
+ * make bench-page-sizes.
+ */
+void runIndex() {
+  const int num_records = 200000;
+  const int num_lookups = 20000;
+  const int num_ranges = 200;
+  const int range_length = 1000;
+  writeKeyedRelation(num_records);
+
+  BufMgr buf_mgr((16 * 1024 * 1024) / Page::SIZE);
+  std::string index_name;
+  std::chrono::steady_clock::time_point start =
+      std::chrono::steady_clock::now();
+  {
+    BTreeIndex index(BENCH_FILE, index_name, &buf_mgr,
+                     offsetof(BenchRecord, i), INTEGER);
+    const double build_seconds = secondsSince(start);
+
+    std::mt19937 random(1);
+    start = std::chrono::steady_clock::now();
+    int num_found = 0;
+    for (int l = 0; l < num_lookups; ++l) {
+      int key = random() % num_records;
+      index.startScan(&key, GTE, &key, LTE);
+      try {
+        RecordId rid;
+        index.scanNext(rid);
+        ++num_found;
+      } catch (const IndexScanCompletedException&) {
+      }
+      index.endScan();
+    }
+    const double lookup_seconds = secondsSince(start);
+
+    start = std::chrono::steady_clock::now();
+    std::size_t num_scanned = 0;
+    for (int r = 0; r < num_ranges; ++r) {
+      int low = random() % (num_records - range_length);
+      int high = low + range_length;
+      index.startScan(&low, GTE, &high, LT);
+      try {
+        RecordId rid;
+        while (true) {
+          index.scanNext(rid);
+          ++num_scanned;
+        }
+      } catch (const IndexScanCompletedException&) {
+      }
+      index.endScan();
+    }
+    const double range_seconds = secondsSince(start);
+
+    std::cout << "index, " << Page::SIZE << "-byte pages: build "
+              << num_records / build_seconds << " records/s, lookup "
+              << num_lookups / lookup_seconds << " keys/s (" << num_found
+              << " found), range scan " << num_scanned / range_seconds
+              << " records/s" << std::endl;
+  }
+  File::remove(index_name);
+  File::remove(BENCH_FILE);
+}
+
+
+/**
+ * Builds an index with a write-ahead log, reporting inserts per second, log
+ * syncs and log bytes per insert.
+ */
+void runLoggedIndex() {
+  const int num_records = 20000;
+  const std::string log_name = std::string(BENCH_FILE) + ".wal";
+  writeKeyedRelation(num_records);
+  ::unlink(log_name.c_str());
+  std::string index_name;
+  {
+    LogManager log(log_name);
+    BufMgr buf_mgr((16 * 1024 * 1024) / Page::SIZE, &log);
+    const std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    {
+      BTreeIndex index(BENCH_FILE, index_name, &buf_mgr,
+                       offsetof(BenchRecord, i), INTEGER);
+    }
+    const double seconds = secondsSince(start);
+    std::cout << "logged index build: " << num_records / seconds
+              << " records/s, " << log.syncCount() << " log syncs, "
+              << double(log.endLsn()) / num_records << " log bytes/record"
+              << std::endl;
+  }
+  ::unlink(log_name.c_str());
+  File::remove(index_name);
+  File::remove(BENCH_FILE);
+}
+
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "index") {
+    runIndex();
+    runLoggedIndex();
+    return 0;
+  }
+  run("disk", [](const std::string& name, const bool create_new) {
+    return new DiskBackend(name, create_new);
+  });
+  run("compressed", CompressedBackend::factory());
+  run("memory", MemBackend::factory());
+  run("hdd", SimulatedDiskBackend::factory(DiskProfile::hdd()));
+  run("nvme", SimulatedDiskBackend::factory(DiskProfile::nvme()));
+  runRecordAccess();
+  runKeyExtraction();
+  runSelectiveScan();
+  runParallelScan();
+  runSharedScans();
+  runSampling();
+  runZoneMaps();
+  runDeletes();
+  runUpdates();
+  runSmallRecords();
+  runIndex();
+  runLoggedIndex();
+  return 0;
+}
@@ -15,7 +15,6 @@
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/file_not_found_exception.h"
-#include "exceptions/end_of_file_exception.h"
 
 
 using namespace std;
@@ -28,7 +27,8 @@ namespace badgerdb
 // This method is the constructor for the BTree and BTreeIndex object
 // -----------------------------------------------------------------------------
 BTreeIndex::BTreeIndex(const std::string & relationName, std::string & outIndexName, BufMgr *bufMgrIn,
-		const int attrByteOffset_, const Datatype attrType) {
+		const int attrByteOffset_, const Datatype attrType,
+		const BackendFactory &indexBackend) {
   //set var from params
   bufMgr = bufMgrIn;
   attrByteOffset = attrByteOffset_;
@@ -44,7 +44,7 @@ BTreeIndex::BTreeIndex(const std::string & relationName, std::string & outIndexN
   indexMetaInfo.attrByteOffset = attrByteOffset;
   indexMetaInfo.attrType = attrType;
   // retrieve file from blob
-  file = new BlobFile(outIndexName, true);
+  file = new BlobFile(outIndexName, true, indexBackend);
 
   //carete a 
   NonLeafNodeInt *newLeafNode;
@@ -56,18 +56,22 @@ BTreeIndex::BTreeIndex(const std::string & relationName, std::string & outIndexN
 
   //starts scan
   FileScan fscan(relationName, bufMgr);
-  try {
-    RecordId scanRid;
-    while (1) {
-      fscan.scanNext(scanRid);
-      std::string recordStr = fscan.getRecord();
-      const char *record = recordStr.c_str();
-      int key = *((int *)(record + attrByteOffset));
-      insertEntry(&key, scanRid);
+  fscan.setReadAhead(FileScan::DEFAULT_READ_AHEAD_PAGES);
+  //projects the keys out a page at a time
+  const size_t maxKeys = 256;
+  int keys[maxKeys];
+  RecordId rids[maxKeys];
+  size_t numKeys;
+  while ((numKeys = fscan.nextKeys(attrByteOffset, INTEGER, keys, rids, maxKeys)) > 0) {
+    for (size_t k = 0; k < numKeys; k++) {
+      insertEntry(&keys[k], rids[k]);
+      // commit between inserts, never in the middle of a split
+      if (bufMgr->commitDue()) {
+        bufMgr->commit();
+      }
     }
-  } catch (const EndOfFileException &) {
-    //reached end of file
   }
+  bufMgr->commit();
 }
 
 
@@ -238,9 +242,10 @@ PageId BTreeIndex::recursiveInsert(PageId origPageId, int key, RecordId rid,
   bool insertToLeft = index < middleIndex;
 
   int splitIndex = middleIndex + insertToLeft;
-  int insertIndex = insertToLeft ? index : index - middleIndex;
+  int insertIndex = insertToLeft ? index : index - splitIndex - 1;
 
-  bool moveKeyUp = !insertToLeft && insertIndex == 0;
+  // the new key lands right at the split, so it is the one moved up
+  bool moveKeyUp = !insertToLeft && index == splitIndex;
 
   //check if key should be moved up or should move to the split index
   midVal = moveKeyUp ? newChildMidVal : origNode->keyArray[splitIndex];
@@ -258,7 +263,13 @@ PageId BTreeIndex::recursiveInsert(PageId origPageId, int key, RecordId rid,
   } else {
     memcpy(&newNode->keyArray, &origNode->keyArray[splitIndex + 1], (newLeafLen - 1) * sizeof(int));
   }
-  memcpy(&newNode->pageNoArray, &origNode->pageNoArray[splitIndex + 1], newLeafLen * sizeof(PageId));
+  if (moveKeyUp) {
+    // the new child is the leftmost child of the new node
+    newNode->pageNoArray[0] = newChildPageId;
+    memcpy(&newNode->pageNoArray[1], &origNode->pageNoArray[splitIndex + 1], newLeafLen * sizeof(PageId));
+  } else {
+    memcpy(&newNode->pageNoArray, &origNode->pageNoArray[splitIndex + 1], newLeafLen * sizeof(PageId));
+  }
   memset(&origNode->keyArray[splitIndex], 0, newLeafLen * sizeof(int));
   memset(&origNode->pageNoArray[splitIndex + 1], 0, newLeafLen * sizeof(PageId));
 
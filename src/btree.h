@@ -20,28 +20,13 @@
 
 namespace badgerdb {
 
-/**
- * @brief Datatype enumeration type.
- */
-enum Datatype { INTEGER = 0, DOUBLE = 1, STRING = 2 };
-
-/**
- * @brief Scan operations enumeration. Passed to BTreeIndex::startScan() method.
- */
-enum Operator {
-  LT,  /* Less Than */
-  LTE, /* Less Than or Equal to */
-  GTE, /* Greater Than or Equal to */
-  GT   /* Greater Than */
-};
-
 /**
  * @brief Number of key slots in B+Tree leaf for INTEGER key.
  */
-//                                                  sibling ptr             key
-//                                                  rid
-const int INTARRAYLEAFSIZE =
-    (Page::SIZE - sizeof(PageId)) / (sizeof(int) + sizeof(RecordId));
+//                                                  level     sibling ptr
+//                                                  key       rid
+const int INTARRAYLEAFSIZE = (Page::SIZE - sizeof(int) - sizeof(PageId)) /
+                             (sizeof(int) + sizeof(RecordId));
 
 /**
  * @brief Number of key slots in B+Tree non-leaf for INTEGER key.
@@ -138,6 +123,10 @@ struct LeafNodeInt {
   PageId rightSibPageNo = 0;
 };
 
+static_assert(sizeof(NonLeafNodeInt) <= Page::SIZE &&
+                  sizeof(LeafNodeInt) <= Page::SIZE,
+              "B+Tree nodes must fit in a page.");
+
 /**
  * @brief BTreeIndex class. It implements a B+ Tree index on a single attribute
  * of a relation. This index supports only one scan at a time.
@@ -242,14 +231,19 @@ class BTreeIndex {
    * index is to be built, in the record
    * @param attrType						Datatype
    * of attribute over which index is built
+   * @param indexBackend        Makes the storage for the index file (a plain
+   * file by default; see CompressedBackend::factory())
    * @throws  BadIndexInfoException     If the index file already exists for
    * the corresponding attribute, but values in metapage(relationName,
    * attribute byte offset, attribute type etc.) do not match with values
    * received through constructor parameters.
+   * With a write-ahead log, the entries of the relation are committed in
+   * batches, whenever BufMgr::commitDue(), and once all are inserted.
    */
   BTreeIndex(const std::string &relationName, std::string &outIndexName,
              BufMgr *bufMgrIn, const int attrByteOffset,
-             const Datatype attrType);
+             const Datatype attrType,
+             const BackendFactory &indexBackend = BackendFactory());
 
   /**
    * BTreeIndex Destructor.
@@ -272,6 +266,9 @@ class BTreeIndex {
    *string
    * @param rid			Record ID of a record whose entry is getting
    *inserted into the index.
+   * With a write-ahead log, the insert and its splits become durable, as one
+   * unit, at the caller's next BufMgr::commit(); until then the pages it
+   * changed stay in the buffer pool.
    **/
   void insertEntry(const void *key, const RecordId rid);
 
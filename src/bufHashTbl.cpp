@@ -7,6 +7,7 @@
 
 #include <memory>
 #include <iostream>
+#include <string>
 #include "buffer.h"
 #include "bufHashTbl.h"
 #include "exceptions/hash_already_present_exception.h"
@@ -15,12 +16,13 @@
 
 namespace badgerdb {
 
-int BufHashTbl::hash(const File* file, const PageId pageNo)
+int BufHashTbl::hash(const FileId fileId, const PageId pageNo)
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
-  return value;
+  // spread file ids apart so that the same page number in different files
+  // lands in different buckets; only the slot part of the id is needed, as
+  // no two open files share a slot
+  std::uint32_t value = std::uint32_t(fileId) * 2654435761u + pageNo;
+  return value % HTSIZE;
 }
 
 BufHashTbl::BufHashTbl(int htSize)
@@ -47,12 +49,12 @@ BufHashTbl::~BufHashTbl()
 
 void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId frameNo)
 {
-  int index = hash(file, pageNo);
+  int index = hash(file->fileId(), pageNo);
 
   hashBucket* tmpBuc = ht[index];
   while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
-  		throw HashAlreadyPresentException(tmpBuc->file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
+    if (tmpBuc->fileId == file->fileId() && tmpBuc->pageNo == pageNo)
+  		throw HashAlreadyPresentException(file->filename(), tmpBuc->pageNo, tmpBuc->frameNo);
     tmpBuc = tmpBuc->next;
   }
 
@@ -60,7 +62,7 @@ void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId fra
   if (!tmpBuc)
   	throw HashTableException();
 
-  tmpBuc->file = (File*) file;
+  tmpBuc->fileId = file->fileId();
   tmpBuc->pageNo = pageNo;
   tmpBuc->frameNo = frameNo;
   tmpBuc->next = ht[index];
@@ -69,10 +71,10 @@ void BufHashTbl::insert(const File* file, const PageId pageNo, const FrameId fra
 
 void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo) 
 {
-  int index = hash(file, pageNo);
+  int index = hash(file->fileId(), pageNo);
   hashBucket* tmpBuc = ht[index];
   while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+    if (tmpBuc->fileId == file->fileId() && tmpBuc->pageNo == pageNo)
     {
       frameNo = tmpBuc->frameNo; // return frameNo by reference
       return;
@@ -84,14 +86,24 @@ void BufHashTbl::lookup(const File* file, const PageId pageNo, FrameId &frameNo)
 }
 
 void BufHashTbl::remove(const File* file, const PageId pageNo) {
+  if (!erase(file->fileId(), pageNo))
+    throw HashNotFoundException(file->filename(), pageNo);
+}
+
+void BufHashTbl::remove(const FileId fileId, const PageId pageNo) {
+  if (!erase(fileId, pageNo))
+    throw HashNotFoundException("file " + std::to_string(fileId), pageNo);
+}
 
-  int index = hash(file, pageNo);
+bool BufHashTbl::erase(const FileId fileId, const PageId pageNo) {
+
+  int index = hash(fileId, pageNo);
   hashBucket* tmpBuc = ht[index];
   hashBucket* prevBuc = NULL;
 
   while (tmpBuc)
 	{
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+    if (tmpBuc->fileId == fileId && tmpBuc->pageNo == pageNo)
 		{
       if(prevBuc) 
 				prevBuc->next = tmpBuc->next;
@@ -99,7 +111,7 @@ void BufHashTbl::remove(const File* file, const PageId pageNo) {
 				ht[index] = tmpBuc->next;
 
       delete tmpBuc;
-      return;
+      return true;
     }
 		else
 		{
@@ -108,7 +120,7 @@ void BufHashTbl::remove(const File* file, const PageId pageNo) {
     }
   }
 
-  throw HashNotFoundException(file->filename(), pageNo);
+  return false;
 }
 
 }
@@ -16,9 +16,9 @@ namespace badgerdb {
 */
 struct hashBucket {
 	/**
-	 * pointer a file object (more on this below)
+	 * identifier of the file the page belongs to
 	 */
-	File *file;
+	FileId fileId;
 
 	/**
 	 * page number within a file
@@ -40,6 +40,9 @@ struct hashBucket {
 /**
 * @brief Hash table class to keep track of pages in the buffer pool
 *
+* Pages are keyed on the FileId of their file, so File objects that refer to
+* the same underlying file share buffer pool frames.
+*
 * @warning This class is not threadsafe.
 */
 class BufHashTbl
@@ -55,13 +58,13 @@ class BufHashTbl
   hashBucket**  ht;
 
 	/**
-	 * returns hash value between 0 and HTSIZE-1 computed using file and pageNo
+	 * returns hash value between 0 and HTSIZE-1 computed using file id and pageNo
 	 *
-	 * @param file   	File object
+	 * @param fileId 	Identifier of the file
 	 * @param pageNo  Page number in the file
 	 * @return  			Hash value.
 	 */
-  int	 hash(const File* file, const PageId pageNo);
+  int	 hash(const FileId fileId, const PageId pageNo);
 
  public:
 	/**
@@ -104,6 +107,26 @@ class BufHashTbl
    * @throws HashNotFoundException if the page entry is not found in the hash table 
 	 */
   void remove(const File* file, const PageId pageNo);  
+
+	/**
+   * Delete entry (fileId,pageNo) from hash table, for frames whose File object
+   * may already have been closed.
+	 *
+	 * @param fileId 	Identifier of the file
+	 * @param pageNo  Page number in the file
+   * @throws HashNotFoundException if the page entry is not found in the hash table 
+	 */
+  void remove(const FileId fileId, const PageId pageNo);
+
+ private:
+	/**
+   * Delete entry (fileId,pageNo) from hash table if it is there.
+	 *
+	 * @param fileId 	Identifier of the file
+	 * @param pageNo  Page number in the file
+	 * @return  			Whether the entry was found.
+	 */
+  bool erase(const FileId fileId, const PageId pageNo);
 };
 
 }
@@ -7,12 +7,16 @@
 
 #include <memory>
 #include <iostream>
+#include <algorithm>
+#include <chrono>
 #include "buffer.h"
+#include "exceptions/badgerdb_exception.h"
 #include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "exceptions/bad_buffer_exception.h"
 #include "exceptions/hash_not_found_exception.h"
+#include "exceptions/invalid_page_exception.h"
 
 namespace badgerdb { 
 
@@ -20,8 +24,8 @@ namespace badgerdb {
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(std::uint32_t bufs)
-	: numBufs(bufs) {
+BufMgr::BufMgr(std::uint32_t bufs, LogManager* log, IoEngine* io)
+	: numBufs(bufs), logMgr(log), ioEngine(io), checkpointStop(false), checkpointInterval(0), checkpointRate(0) {
 	bufDescTable = new BufDesc[bufs];
 
   for (FrameId i = 0; i < bufs; i++) 
@@ -40,15 +44,31 @@ BufMgr::BufMgr(std::uint32_t bufs)
 
 
 BufMgr::~BufMgr() {
+  stopCheckpointer();
+  commit();
+
+  std::unique_lock<std::mutex> lock(bufMutex);
+  // let prefetches and other reads and writes in flight finish
+  for (std::uint32_t i = 0; i < numBufs; i++)
+  {
+    while (bufDescTable[i].ioInProgress)
+      ioDone.wait(lock);
+  }
+
   //Flush out all unwritten pages
+  std::vector<FrameId> dirtyFrames;
   for (std::uint32_t i = 0; i < numBufs; i++) 
   {
   	BufDesc* tmpbuf = &(bufDescTable[i]);
   	if (tmpbuf->valid == true && tmpbuf->dirty == true)
 		{
-			tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
+			if (ioEngine != NULL)
+				dirtyFrames.push_back(i);
+			else
+				writeBack(i);
   	}
   }
+  writeFrames(dirtyFrames, lock);
 
 	delete hashTable;
   delete [] bufDescTable;
@@ -78,12 +98,15 @@ void BufMgr::allocBuf(FrameId & frame)
     // is valid, check referenced bit
     if (! bufDescTable[clockHand].refbit)
     {
-      // check to see if someone has it pinned
-      if (bufDescTable[clockHand].pinCnt == 0)
+      // check to see if someone has it pinned, it holds changes not in the log yet, or the
+      // checkpointer is still writing it
+      if (bufDescTable[clockHand].pinCnt == 0 && !bufDescTable[clockHand].uncommitted &&
+          !bufDescTable[clockHand].ioInProgress)
       {
         // hasn't been referenced and is not pinned, use it
         // remove previous entry from hash table
-        hashTable->remove(bufDescTable[clockHand].file, bufDescTable[clockHand].pageNo);
+        // by id: the frame's File may have been closed since it was read
+        hashTable->remove(bufDescTable[clockHand].fileId, bufDescTable[clockHand].pageNo);
         found = true;
         break;
       }
@@ -106,8 +129,7 @@ void BufMgr::allocBuf(FrameId & frame)
   if (bufDescTable[clockHand].dirty)
   {
     bufStats.diskwrites++;
-    //status = bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo,
-    bufDescTable[clockHand].file->writePage(bufDescTable[clockHand].pageNo, bufPool[clockHand]);
+    writeBack(clockHand);
   }
 
 	//Reset all the BufDesc entry for the frame before returning the frame
@@ -120,45 +142,365 @@ void BufMgr::allocBuf(FrameId & frame)
 	
 void BufMgr::readPage(File* file, const PageId pageNo, Page*& page)
 {
+  std::unique_lock<std::mutex> lock(bufMutex);
   // check to see if it is already in the buffer pool
   // std::cout << "readPage called on file.page " << file << "." << pageNo << endl;
   FrameId frameNo = 0;
-	try
-	{
-  	hashTable->lookup(file, pageNo, frameNo);
+  while (true)
+  {
+    try
+    {
+      hashTable->lookup(file, pageNo, frameNo);
+    }
+    catch(const HashNotFoundException &e) //not in the buffer pool, must allocate a new page
+    {
+      break;
+    }
+    if (bufDescTable[frameNo].reading)
+    {
+      // someone else is reading the page in; look again once a read completes
+      ioDone.wait(lock);
+      continue;
+    }
 
-    // set the referenced bit
+    // set the referenced bit; the page may have been read through another
+    // File object on the same file, so write it back through this one
     bufDescTable[frameNo].refbit = true;
+    bufDescTable[frameNo].file = file;
     bufDescTable[frameNo].pinCnt++;
     page = &bufPool[frameNo];
+    return;
   }
-  catch(const HashNotFoundException &e) //not in the buffer pool, must allocate a new page
+
+  // alloc a new frame and read the page into it, letting other threads use the pool meanwhile
+  frameNo = claimFrame(file, pageNo, true /* pinned */);
+  lock.unlock();
+  try
   {
-    // alloc a new frame
-    allocBuf(frameNo);
+    IoEngine::perform(file->readRequest(pageNo, &bufPool[frameNo]));
+    file->completeRead(pageNo, bufPool[frameNo]);
+  }
+  catch(...)
+  {
+    lock.lock();
+    finishRead(frameNo, false);
+    throw;
+  }
+  lock.lock();
+  finishRead(frameNo, true);
+  page = &bufPool[frameNo];
+}
 
-    // read the page into the new frame
-    bufStats.diskreads++;
-    //status = file->readPage(pageNo, &bufPool[frameNo]);
-    bufPool[frameNo] = file->readPage(pageNo);
+FrameId BufMgr::claimFrame(File* file, const PageId pageNo, const bool pinned)
+{
+  FrameId frameNo;
+  allocBuf(frameNo);
+  bufStats.diskreads++;
 
-    // set up the entry properly
-    bufDescTable[frameNo].Set(file, pageNo);
-    page = &bufPool[frameNo];
+  // set up the entry properly, and insert it in the hash table
+  bufDescTable[frameNo].Set(file, pageNo);
+  bufDescTable[frameNo].pinCnt = pinned ? 1 : 0;
+  bufDescTable[frameNo].reading = true;
+  bufDescTable[frameNo].ioInProgress = true;
+  hashTable->insert(file, pageNo, frameNo);
+  return frameNo;
+}
+
+bool BufMgr::finishRead(FrameId frameNo, bool ok)
+{
+  BufDesc* tmpbuf = &(bufDescTable[frameNo]);
+  if (ok)
+  {
+    tmpbuf->reading = false;
+    tmpbuf->ioInProgress = false;
+  }
+  else
+  {
+    hashTable->remove(tmpbuf->file, tmpbuf->pageNo);
+    tmpbuf->Clear();
+  }
+  ioDone.notify_all();
+  return ok;
+}
+
+void BufMgr::readPages(File* file, const std::vector<PageId>& pageNos, std::vector<Page*>& pages)
+{
+  std::unique_lock<std::mutex> lock(bufMutex);
+  pages.assign(pageNos.size(), NULL);
+  std::vector<FrameId> frames(pageNos.size());
+  std::vector<std::size_t> misses;
+
+  // Pin the pages in the pool and claim frames for the others.
+  std::size_t i = 0;
+  try
+  {
+    for (; i < pageNos.size(); i++)
+    {
+      while (true)
+      {
+        try
+        {
+          hashTable->lookup(file, pageNos[i], frames[i]);
+        }
+        catch(const HashNotFoundException &e)
+        {
+          frames[i] = claimFrame(file, pageNos[i], true /* pinned */);
+          misses.push_back(i);
+          break;
+        }
+        if (bufDescTable[frames[i]].reading)
+        {
+          ioDone.wait(lock);
+          continue;
+        }
+        bufDescTable[frames[i]].refbit = true;
+        bufDescTable[frames[i]].file = file;
+        bufDescTable[frames[i]].pinCnt++;
+        break;
+      }
+    }
+  }
+  catch(...)
+  {
+    // out of frames: let go of what has been pinned or claimed so far
+    std::size_t nextMiss = 0;
+    for (std::size_t j = 0; j < i; j++)
+    {
+      if (nextMiss < misses.size() && misses[nextMiss] == j)
+      {
+        finishRead(frames[j], false);
+        nextMiss++;
+      }
+      else
+        bufDescTable[frames[j]].pinCnt--;
+    }
+    throw;
+  }
+
+  // Read the rest, as one batch if there is an engine.
+  std::vector<bool> valid(pageNos.size(), true);
+  if (ioEngine != NULL)
+  {
+    std::size_t remaining = misses.size();
+    std::vector<IoRequest> requests;
+    for (std::size_t m = 0; m < misses.size(); m++)
+    {
+      const std::size_t n = misses[m];
+      IoRequest request = file->readRequest(pageNos[n], &bufPool[frames[n]]);
+      request.done = [this, file, &pageNos, &frames, &valid, &remaining, n](const bool ok)
+      {
+        bool read = ok;
+        if (read)
+        {
+          try
+          {
+            file->completeRead(pageNos[n], bufPool[frames[n]]);
+          }
+          catch(const BadgerDbException &e)
+          {
+            read = false;
+          }
+        }
+        std::lock_guard<std::mutex> lock(bufMutex);
+        valid[n] = finishRead(frames[n], read);
+        remaining--;
+      };
+      requests.push_back(request);
+    }
+    ioEngine->submit(requests);
+    ioDone.wait(lock, [&remaining] { return remaining == 0; });
+  }
+  else if (!misses.empty())
+  {
+    // Otherwise read each run of consecutive pages with one vectored read, as prefetchPages does.
+    lock.unlock();
+    std::vector<Page*> run;
+    for (std::size_t m = 0; m < misses.size(); m += run.size())
+    {
+      run.clear();
+      do
+        run.push_back(&bufPool[frames[misses[m + run.size()]]]);
+      while (m + run.size() < misses.size() &&
+             pageNos[misses[m + run.size()]] == pageNos[misses[m]] + run.size());
+      try
+      {
+        file->readPages(pageNos[misses[m]], run.size(), &run[0]);
+        continue;
+      }
+      catch(const BadgerDbException &e)
+      {
+      }
+      // some page of the run could not be read: find out which, one page at a time
+      for (std::size_t r = m; r < m + run.size(); r++)
+      {
+        const std::size_t n = misses[r];
+        try
+        {
+          IoEngine::perform(file->readRequest(pageNos[n], &bufPool[frames[n]]));
+          file->completeRead(pageNos[n], bufPool[frames[n]]);
+        }
+        catch(const BadgerDbException &e)
+        {
+          valid[n] = false;
+        }
+      }
+    }
+    lock.lock();
+    for (std::size_t m = 0; m < misses.size(); m++)
+      finishRead(frames[misses[m]], valid[misses[m]]);
+  }
+
+  for (std::size_t n = 0; n < pageNos.size(); n++)
+  {
+    if (!valid[n])
+    {
+      // unpin the others, then report the first page that could not be read
+      for (std::size_t j = 0; j < pageNos.size(); j++)
+      {
+        if (valid[j])
+          bufDescTable[frames[j]].pinCnt--;
+      }
+      throw InvalidPageException(pageNos[n], file->filename());
+    }
+    pages[n] = &bufPool[frames[n]];
+  }
+}
+
+void BufMgr::prefetchPages(File* file, const PageId firstPageNo, std::uint32_t count)
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+  const std::uint32_t maxPages = numBufs / 4 > 0 ? numBufs / 4 : 1;
+  if (count > maxPages)
+    count = maxPages;
+
+  if (ioEngine != NULL)
+  {
+    // Submit the reads of all pages not present and return; each frame becomes valid as its read
+    // completes.
+    std::vector<IoRequest> requests;
+    for (PageId pageNo = firstPageNo; pageNo < firstPageNo + count; pageNo++)
+    {
+      FrameId frameNo = 0;
+      try
+      {
+        hashTable->lookup(file, pageNo, frameNo);
+        continue;
+      }
+      catch(const HashNotFoundException &e)
+      {
+      }
+      try
+      {
+        frameNo = claimFrame(file, pageNo, false /* pinned */);
+      }
+      catch(const BufferExceededException &e)
+      {
+        break;
+      }
+      IoRequest request = file->readRequest(pageNo, &bufPool[frameNo]);
+      request.done = [this, file, pageNo, frameNo](const bool ok)
+      {
+        bool read = ok;
+        if (read)
+        {
+          try
+          {
+            file->completeRead(pageNo, bufPool[frameNo]);
+          }
+          catch(const BadgerDbException &e)
+          {
+            read = false;
+          }
+        }
+        std::lock_guard<std::mutex> lock(bufMutex);
+        finishRead(frameNo, read);
+      };
+      requests.push_back(request);
+    }
+    ioEngine->submit(requests);
+    return;
+  }
+
+  std::vector<FrameId> frames;
+  PageId runStart = firstPageNo;
+  for (PageId pageNo = firstPageNo; pageNo < firstPageNo + count; pageNo++)
+  {
+    FrameId frameNo = 0;
+    try
+    {
+      hashTable->lookup(file, pageNo, frameNo);
 
-    // insert in the hash table
-    hashTable->insert(file, pageNo, frameNo);
+      // already in the buffer pool, so the run stops here
+      readFrames(file, runStart, frames);
+      frames.clear();
+      runStart = pageNo + 1;
+      continue;
+    }
+    catch(const HashNotFoundException &e)
+    {
+    }
+
+    try
+    {
+      allocBuf(frameNo);
+    }
+    catch(const BufferExceededException &e)
+    {
+      break;
+    }
+    // keep the frame pinned until it has been read so that allocBuf does not hand it out again
+    bufDescTable[frameNo].Set(file, pageNo);
+    frames.push_back(frameNo);
   }
+  readFrames(file, runStart, frames);
 }
 
+void BufMgr::readFrames(File* file, const PageId firstPageNo, const std::vector<FrameId>& frames)
+{
+  if (frames.empty())
+    return;
+
+  std::vector<Page*> pages(frames.size());
+  for (std::size_t i = 0; i < frames.size(); i++)
+    pages[i] = &bufPool[frames[i]];
+
+  try
+  {
+    file->readPages(firstPageNo, frames.size(), &pages[0]);
+  }
+  catch(...)
+  {
+    for (std::size_t i = 0; i < frames.size(); i++)
+      bufDescTable[frames[i]].Clear();
+    throw;
+  }
+
+  for (std::size_t i = 0; i < frames.size(); i++)
+  {
+    bufStats.diskreads++;
+    bufDescTable[frames[i]].pinCnt = 0;
+    hashTable->insert(file, firstPageNo + i, frames[i]);
+  }
+}
 
 void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty) 
 {
+  std::lock_guard<std::mutex> lock(bufMutex);
   // lookup in hashtable
   FrameId frameNo = 0;
   hashTable->lookup(file, pageNo, frameNo);
 
-  if (dirty == true) bufDescTable[frameNo].dirty = dirty;
+  if (dirty == true)
+  {
+    bufDescTable[frameNo].dirty = dirty;
+    // Keep the file's zone map (if any) from ruling out the page as changed.
+    file->noteChange(pageNo);
+    if (logMgr != NULL && !bufDescTable[frameNo].uncommitted)
+    {
+      bufDescTable[frameNo].uncommitted = true;
+      uncommittedFrames.push_back(frameNo);
+    }
+  }
 
   // make sure the page is actually pinned
   if (bufDescTable[frameNo].pinCnt == 0)
@@ -170,6 +512,7 @@ void BufMgr::unPinPage(File* file, const PageId pageNo, const bool dirty)
 
 void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page) 
 {
+  std::lock_guard<std::mutex> lock(bufMutex);
   FrameId frameNo;
 
   // alloc a new frame
@@ -178,6 +521,7 @@ void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
   // allocate a new page in the file
 	//std::cerr << "buffer data size:" << bufPool[frameNo].data_.length() << "\n";
   bufPool[frameNo] = file->allocatePage(pageNo);
+  noteUncommittedFile(file);
   page = &bufPool[frameNo];
 
   // set up the entry properly
@@ -189,10 +533,36 @@ void BufMgr::allocPage(File* file, PageId &pageNo, Page*& page)
 
 void BufMgr::flushFile(const File* file) 
 {
+  std::unique_lock<std::mutex> lock(bufMutex);
+
+  // pages of the file must be in the log before they are written back
+  commitChanges();
+
+  if (ioEngine != NULL)
+  {
+    // write the dirty pages as one batch; the loop below finds them clean
+    std::vector<FrameId> dirtyFrames;
+    for (std::uint32_t i = 0; i < numBufs; i++)
+    {
+      const BufDesc& desc = bufDescTable[i];
+      if (desc.file && desc.valid && desc.fileId == file->fileId() && desc.dirty &&
+          desc.pinCnt == 0 && !desc.ioInProgress)
+        dirtyFrames.push_back(i);
+    }
+    writeFrames(dirtyFrames, lock);
+  }
+
   for (std::uint32_t i = 0; i < numBufs; i++)
 	{
   	BufDesc* tmpbuf = &(bufDescTable[i]);
-  	if(tmpbuf->file && tmpbuf->valid == true && tmpbuf->file == file)
+  	if (tmpbuf->ioInProgress && tmpbuf->fileId == file->fileId())
+		{
+			// the page is being read or written; look at the frame again once it is done
+			ioDone.wait(lock);
+			i--;
+			continue;
+		}
+  	if(tmpbuf->file && tmpbuf->valid == true && tmpbuf->fileId == file->fileId())
 		{
 	    if (tmpbuf->pinCnt > 0)
   			throw PagePinnedException(file->filename(), tmpbuf->pageNo, tmpbuf->frameNo);
@@ -200,24 +570,45 @@ void BufMgr::flushFile(const File* file)
 	    if (tmpbuf->dirty == true)
 			{
 				//if ((status = tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]))) != OK)
-				tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[i]);
-				tmpbuf->dirty = false;
+				writeBack(i);
     	}
 
     	hashTable->remove(file,tmpbuf->pageNo);
     	tmpbuf->Clear();
   	}
-		else if (tmpbuf->valid == false && tmpbuf->file == file)
+		else if (tmpbuf->valid == false && tmpbuf->file && tmpbuf->fileId == file->fileId())
   		throw BadBufferException(tmpbuf->frameNo, tmpbuf->dirty, tmpbuf->valid, tmpbuf->refbit);
   }
 }
 
+std::vector<PageRemap> BufMgr::compactFile(PageFile* file)
+{
+	// Compaction renumbers pages, so no frame may keep a copy under its old number.
+	flushFile(file);
+	if (logMgr == NULL)
+		return file->compact();
+
+	// Nor may the log hold images of the file's pages under their old numbers, for recovery to write
+	// into the compacted file: a checkpoint moves recovery past them. The compacted file then has to
+	// be on disk before its pages are logged under their new numbers.
+	checkpoint();
+	std::vector<PageRemap> remap = file->compact();
+	File::sync(file->filename());
+	return remap;
+}
+
 void BufMgr::disposePage(File* file, const PageId pageNo)
 {
 	//Deallocate from file altogether
   //See if it is in the buffer pool
+  std::unique_lock<std::mutex> lock(bufMutex);
   FrameId frameNo = 0;
   hashTable->lookup(file, pageNo, frameNo);
+  while (bufDescTable[frameNo].ioInProgress)
+  {
+    ioDone.wait(lock);
+    hashTable->lookup(file, pageNo, frameNo);
+  }
 
 	// clear the page
 	bufDescTable[frameNo].Clear();
@@ -226,10 +617,307 @@ void BufMgr::disposePage(File* file, const PageId pageNo)
 
   // deallocate it in the file	
   file->deletePage(pageNo);
+  noteUncommittedFile(file);
+}
+
+bool BufMgr::commitDue()
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+  return uncommittedFrames.size() >= numBufs / 2;
+}
+
+Lsn BufMgr::commit()
+{
+  std::lock_guard<std::mutex> lock(bufMutex);
+  return commitChanges();
+}
+
+Lsn BufMgr::commitChanges()
+{
+  if (logMgr == NULL)
+    return 0;
+  if (uncommittedFrames.empty() && uncommittedFiles.empty())
+    return logMgr->lastCommitLsn();
+
+  for (std::size_t i = 0; i < uncommittedFrames.size(); i++)
+  {
+    BufDesc* tmpbuf = &(bufDescTable[uncommittedFrames[i]]);
+    // the frame may have been disposed of or logged already
+    if (!tmpbuf->valid || !tmpbuf->uncommitted)
+      continue;
+    tmpbuf->lsn = logMgr->logPage(tmpbuf->file->filename(), tmpbuf->pageNo, bufPool[uncommittedFrames[i]]);
+    if (tmpbuf->recLsn == 0)
+      tmpbuf->recLsn = tmpbuf->lsn;
+    tmpbuf->uncommitted = false;
+    noteUncommittedFile(tmpbuf->file);
+  }
+  uncommittedFrames.clear();
+
+  for (std::size_t i = 0; i < uncommittedFiles.size(); i++)
+  {
+    logMgr->logMetadata(uncommittedFiles[i]->filename(), uncommittedFiles[i]->metadataImage());
+    // the metadata reaches the file when the file is closed or at the next checkpoint
+    if (std::find(unsyncedFiles.begin(), unsyncedFiles.end(), uncommittedFiles[i]->filename()) == unsyncedFiles.end())
+      unsyncedFiles.push_back(uncommittedFiles[i]->filename());
+  }
+  uncommittedFiles.clear();
+  allCommitted.notify_all();
+
+  return logMgr->commit();
+}
+
+void BufMgr::writeBack(FrameId frameNo)
+{
+  BufDesc* tmpbuf = &(bufDescTable[frameNo]);
+  if (logMgr != NULL)
+    logMgr->flush(tmpbuf->lsn);
+  tmpbuf->file->writePage(tmpbuf->pageNo, bufPool[frameNo]);
+  tmpbuf->dirty = false;
+  tmpbuf->recLsn = 0;
+  if (logMgr != NULL &&
+      std::find(unsyncedFiles.begin(), unsyncedFiles.end(), tmpbuf->file->filename()) == unsyncedFiles.end())
+    unsyncedFiles.push_back(tmpbuf->file->filename());
+}
+
+void BufMgr::writeFrames(const std::vector<FrameId>& frames, std::unique_lock<std::mutex>& lock)
+{
+  if (frames.empty())
+    return;
+
+  // Copies of the pages are written, so the frames can be used (and changed) meanwhile.
+  std::vector<Page> images(frames.size());
+  std::vector<IoRequest> requests;
+  Lsn maxLsn = 0;
+  for (std::size_t i = 0; i < frames.size(); i++)
+  {
+    BufDesc* tmpbuf = &(bufDescTable[frames[i]]);
+    requests.push_back(tmpbuf->file->writeRequest(tmpbuf->pageNo, bufPool[frames[i]], &images[i]));
+    maxLsn = std::max(maxLsn, tmpbuf->lsn);
+  }
+  if (logMgr != NULL)
+    logMgr->flush(maxLsn);
+
+  std::size_t remaining = frames.size();
+  for (std::size_t i = 0; i < frames.size(); i++)
+  {
+    BufDesc* tmpbuf = &(bufDescTable[frames[i]]);
+    tmpbuf->dirty = false;
+    tmpbuf->recLsn = 0;
+    tmpbuf->ioInProgress = true;
+    if (logMgr != NULL &&
+        std::find(unsyncedFiles.begin(), unsyncedFiles.end(), tmpbuf->file->filename()) == unsyncedFiles.end())
+      unsyncedFiles.push_back(tmpbuf->file->filename());
+
+    const FrameId frameNo = frames[i];
+    requests[i].done = [this, frameNo, &remaining](const bool ok)
+    {
+      std::lock_guard<std::mutex> lock(bufMutex);
+      bufDescTable[frameNo].ioInProgress = false;
+      remaining--;
+      ioDone.notify_all();
+    };
+  }
+  ioEngine->submit(requests);
+  ioDone.wait(lock, [&remaining] { return remaining == 0; });
+}
+
+void BufMgr::checkpoint()
+{
+  runCheckpoint(false /* background */);
+}
+
+void BufMgr::runCheckpoint(const bool background)
+{
+  std::lock_guard<std::mutex> runLock(checkpointRunMutex);
+
+  // Pick the pages to write and sort them by file and page, so the writes are
+  // mostly sequential. Frames holding uncommitted changes are left alone.
+  std::vector<FrameId> frames;
+  Lsn maxLsn = 0;
+  {
+    std::lock_guard<std::mutex> lock(bufMutex);
+    for (FrameId i = 0; i < numBufs; i++)
+    {
+      const BufDesc& desc = bufDescTable[i];
+      if (desc.valid && desc.dirty && !desc.uncommitted && !desc.ioInProgress)
+      {
+        frames.push_back(i);
+        maxLsn = std::max(maxLsn, desc.lsn);
+      }
+    }
+    std::sort(frames.begin(), frames.end(), [this](FrameId a, FrameId b) {
+      const BufDesc& x = bufDescTable[a];
+      const BufDesc& y = bufDescTable[b];
+      return x.fileId < y.fileId || (x.fileId == y.fileId && x.pageNo < y.pageNo);
+    });
+  }
+
+  // One log flush covers the WAL rule for (almost) all of them.
+  if (logMgr != NULL)
+    logMgr->flush(maxLsn);
+
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (std::size_t n = 0; n < frames.size(); n++)
+  {
+    {
+      std::unique_lock<std::mutex> lock(checkpointMutex);
+      if (checkpointRate > 0 && !checkpointStop)
+      {
+        // page n is due n / checkpointRate seconds after the start
+        const std::chrono::steady_clock::time_point due =
+            start + std::chrono::microseconds(n * 1000000 / checkpointRate);
+        checkpointWake.wait_until(lock, due, [this] { return checkpointStop; });
+      }
+    }
+
+    // Write a copy of the page, so it can be used (and changed) meanwhile.
+    Page copy;
+    File* file;
+    PageId pageNo;
+    Lsn lsn;
+    BufDesc* tmpbuf = &(bufDescTable[frames[n]]);
+    {
+      std::lock_guard<std::mutex> lock(bufMutex);
+      if (!tmpbuf->valid || !tmpbuf->dirty || tmpbuf->uncommitted || tmpbuf->ioInProgress)
+        continue;
+      copy = bufPool[frames[n]];
+      file = tmpbuf->file;
+      pageNo = tmpbuf->pageNo;
+      lsn = tmpbuf->lsn;
+      tmpbuf->dirty = false;
+      tmpbuf->recLsn = 0;
+      tmpbuf->ioInProgress = true;
+      bufStats.diskwrites++;
+      if (std::find(unsyncedFiles.begin(), unsyncedFiles.end(), file->filename()) == unsyncedFiles.end())
+        unsyncedFiles.push_back(file->filename());
+    }
+
+    try
+    {
+      if (logMgr != NULL)
+        logMgr->flush(lsn);
+      file->writePage(pageNo, copy);
+    }
+    catch(const BadgerDbException &e)
+    {
+      // the page was deleted from the file behind the buffer manager's back
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(bufMutex);
+      tmpbuf->ioInProgress = false;
+    }
+    ioDone.notify_all();
+  }
+
+  if (logMgr == NULL)
+    return;
+
+  // Wait for a moment when no change is half done, then write out all file
+  // metadata and find the oldest change that is still only in the log. The
+  // background checkpointer gives up waiting when it is stopped.
+  Lsn redoLsn = 0;
+  std::vector<std::string> filenames;
+  {
+    std::unique_lock<std::mutex> lock(bufMutex);
+    allCommitted.wait(lock, [this, background] {
+      if (uncommittedFrames.empty() && uncommittedFiles.empty())
+        return true;
+      std::lock_guard<std::mutex> stopLock(checkpointMutex);
+      return background && checkpointStop;
+    });
+    if (!uncommittedFrames.empty() || !uncommittedFiles.empty())
+      return;
+
+    File::flushAllMetadata();
+    redoLsn = logMgr->endLsn();
+    for (FrameId i = 0; i < numBufs; i++)
+    {
+      if (bufDescTable[i].valid && bufDescTable[i].recLsn != 0)
+        redoLsn = std::min(redoLsn, bufDescTable[i].recLsn);
+    }
+    filenames.swap(unsyncedFiles);
+  }
+  if (redoLsn == 0)
+    return;
+
+  // Files written and closed since the last checkpoint are synced by name.
+  File::syncAll();
+  for (std::size_t i = 0; i < filenames.size(); i++)
+  {
+    if (File::exists(filenames[i]))
+      File::sync(filenames[i]);
+  }
+  logMgr->checkpoint(redoLsn);
+}
+
+void BufMgr::startCheckpointer(std::uint32_t intervalMillis, std::uint32_t pagesPerSecond)
+{
+  stopCheckpointer();
+  {
+    std::lock_guard<std::mutex> lock(checkpointMutex);
+    checkpointStop = false;
+    checkpointInterval = intervalMillis;
+    checkpointRate = pagesPerSecond;
+  }
+  checkpointThread = std::thread(&BufMgr::checkpointLoop, this);
+}
+
+void BufMgr::stopCheckpointer()
+{
+  if (!checkpointThread.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(checkpointMutex);
+    checkpointStop = true;
+  }
+  checkpointWake.notify_all();
+  {
+    // a checkpoint waiting for changes to be committed looks at the flag under bufMutex
+    std::lock_guard<std::mutex> lock(bufMutex);
+  }
+  allCommitted.notify_all();
+  checkpointThread.join();
+}
+
+void BufMgr::checkpointLoop()
+{
+  std::unique_lock<std::mutex> lock(checkpointMutex);
+  while (!checkpointStop)
+  {
+    checkpointWake.wait_for(lock, std::chrono::milliseconds(checkpointInterval),
+                            [this] { return checkpointStop; });
+    if (checkpointStop)
+      break;
+
+    lock.unlock();
+    try
+    {
+      runCheckpoint(true /* background */);
+    }
+    catch(const BadgerDbException &e)
+    {
+      // a file went away under the checkpoint; the next one starts afresh
+    }
+    lock.lock();
+  }
+}
+
+void BufMgr::noteUncommittedFile(File* file)
+{
+  if (logMgr == NULL)
+    return;
+  for (std::size_t i = 0; i < uncommittedFiles.size(); i++)
+  {
+    if (uncommittedFiles[i]->fileId() == file->fileId())
+      return;
+  }
+  uncommittedFiles.push_back(file);
 }
 
 void BufMgr::printSelf(void) 
 {
+  std::lock_guard<std::mutex> lock(bufMutex);
   BufDesc* tmpbuf;
 	int validFrames = 0;
   
@@ -9,7 +9,14 @@
 
 #include "file.h"
 #include "bufHashTbl.h"
+#include "log_manager.h"
+#include "io_engine.h"
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace badgerdb {
 
@@ -27,10 +34,16 @@ class BufDesc {
 
  private:
 	/**
-   * Pointer to file to which corresponding frame is assigned
+   * Pointer to file object through which the frame was last requested; used
+   * to write the page back
 	 */
   File* file;
 
+	/**
+   * Identifier of file to which corresponding frame is assigned
+	 */
+  FileId fileId;
+
 	/**
    * Page within file to which corresponding frame is assigned
 	 */
@@ -61,6 +74,36 @@ class BufDesc {
 	 */
   bool refbit;
 
+	/**
+   * True if the page changed since the last commit, so its image is not in the log yet.
+   * Such frames are not written back (or evicted) until the next commit.
+	 */
+  bool uncommitted;
+
+	/**
+   * LSN of the last log record holding an image of the page; the log must be durable up to
+   * here before the page may be written back
+	 */
+  Lsn lsn;
+
+	/**
+   * LSN of the first image of the page logged since it was last written back, or 0 if the file
+   * holds every logged change to the page. Recovery must replay the log from here.
+	 */
+  Lsn recLsn;
+
+	/**
+   * True while the page is read into the frame or a copy of it is written back (by the checkpointer
+   * or a batched flush); the frame is not reused until then
+	 */
+  bool ioInProgress;
+
+	/**
+   * True while the page is read into the frame; the frame is in the hash table, but its contents
+   * are only valid once the read completes
+	 */
+  bool reading;
+
 	/**
    * Initialize buffer frame for a new user
 	 */
@@ -68,10 +111,16 @@ class BufDesc {
 	{
     pinCnt = 0;
 		file = NULL;
+		fileId = 0;
 		pageNo = Page::INVALID_NUMBER;
     dirty = false;
     refbit = false;
 		valid = false;
+		uncommitted = false;
+		lsn = 0;
+		recLsn = 0;
+		ioInProgress = false;
+		reading = false;
   };
 
 	/**
@@ -84,11 +133,17 @@ class BufDesc {
   void Set(File* filePtr, PageId pageNum)
 	{ 
 		file = filePtr;
+		fileId = filePtr->fileId();
     pageNo = pageNum;
     pinCnt = 1;
     dirty = false;
     valid = true;
     refbit = true;
+    uncommitted = false;
+    lsn = 0;
+    recLsn = 0;
+    ioInProgress = false;
+    reading = false;
   }
 
   void Print()
@@ -172,7 +227,7 @@ class BufMgr
   std::uint32_t numBufs;
 	
 	/**
-   * Hash table mapping (File, page) to frame
+   * Hash table mapping (FileId, page) to frame
 	 */
   BufHashTbl *hashTable;
 
@@ -186,6 +241,115 @@ class BufMgr
 	 */
   BufStats bufStats;
 
+	/**
+   * Write-ahead log, or NULL if changes are not logged
+	 */
+  LogManager* logMgr;
+
+	/**
+   * Engine for asynchronous, batched reads and writes, or NULL to do I/O synchronously
+	 */
+  IoEngine* ioEngine;
+
+	/**
+   * Frames changed since the last commit (see BufDesc::uncommitted)
+	 */
+  std::vector<FrameId> uncommittedFrames;
+
+	/**
+   * Files whose metadata changed since the last commit through allocPage() or disposePage()
+	 */
+  std::vector<File*> uncommittedFiles;
+
+	/**
+   * Names of files written to since the last checkpoint, which has to sync them
+	 */
+  std::vector<std::string> unsyncedFiles;
+
+	/**
+   * Guards the buffer pool, its descriptors and the hash table; BufMgr may be used from several threads
+	 */
+  std::mutex bufMutex;
+
+	/**
+   * Signalled whenever a read into a frame or a write of a frame completes
+	 */
+  std::condition_variable ioDone;
+
+	/**
+   * Signalled whenever a commit leaves no change uncommitted, for a checkpoint waiting on it
+	 */
+  std::condition_variable allCommitted;
+
+	/**
+   * Background thread running checkpoints, if started
+	 */
+  std::thread checkpointThread;
+
+	/**
+   * Guards the checkpointer's settings and its stop flag
+	 */
+  std::mutex checkpointMutex;
+
+	/**
+   * Wakes the checkpointer early when it is to stop
+	 */
+  std::condition_variable checkpointWake;
+
+	/**
+   * Set to make the checkpointer stop
+	 */
+  bool checkpointStop;
+
+	/**
+   * Milliseconds between the start of one background checkpoint and the next
+	 */
+  std::uint32_t checkpointInterval;
+
+	/**
+   * Maximum pages per second the checkpointer writes, or 0 for no limit
+	 */
+  std::uint32_t checkpointRate;
+
+	/**
+   * Held for the whole of a checkpoint, so two never overlap
+	 */
+  std::mutex checkpointRunMutex;
+
+	/**
+	 * Implements commit() for callers holding bufMutex.
+	 *
+	 * @return	LSN of the commit record, or 0 without a log
+	 */
+  Lsn commitChanges();
+
+	/**
+	 * Body of the background checkpointer thread.
+	 */
+  void checkpointLoop();
+
+	/**
+	 * Implements checkpoint().
+	 *
+	 * @param background	Whether the background checkpointer runs it, which stops waiting for changes
+	 *			to be committed (and records no checkpoint) once it is asked to stop
+	 */
+  void runCheckpoint(const bool background);
+
+	/**
+	 * Writes a frame back to its file, forcing the log first as far as the WAL rule requires.
+	 *
+	 * @param frameNo	Frame to write back
+	 */
+  void writeBack(FrameId frameNo);
+
+	/**
+	 * Remembers that the metadata of the file changed since the last commit.
+	 *
+	 * @param file   	File object
+	 */
+  void noteUncommittedFile(File* file);
+
 	/**
    * Advance clock to next frame in the buffer pool
 	 */
@@ -202,6 +366,47 @@ class BufMgr
 	 */
   void allocBuf(FrameId & frame);
 
+	/**
+	 * Reads a run of consecutive pages of a file into frames already assigned to them with a single
+	 * vectored read, then makes the frames available (unpinned) in the hash table.
+	 *
+	 * @param file   	File object
+	 * @param firstPageNo	Page number of first page in the run
+	 * @param frames	Frames assigned to the pages of the run, in page order
+	 */
+  void readFrames(File* file, const PageId firstPageNo, const std::vector<FrameId>& frames);
+
+	/**
+	 * Claims a frame for a page that is about to be read into it: the frame goes into the hash table
+	 * marked as being read, so other users of the page wait for the read instead of starting another.
+	 *
+	 * @param file   	File object
+	 * @param pageNo	Page number in the file
+	 * @param pinned	Whether the frame stays pinned once the read completes
+	 * @return	The frame
+	 * @throws BufferExceededException If no frame can be allocated
+	 */
+  FrameId claimFrame(File* file, const PageId pageNo, const bool pinned);
+
+	/**
+	 * Completes a read into a frame claimed by claimFrame(), making the frame valid, or dropping it if
+	 * the read failed. Called with bufMutex held.
+	 *
+	 * @param frameNo	Frame read into
+	 * @param ok		Whether the bytes were read
+	 * @return	True if the frame is valid
+	 */
+  bool finishRead(FrameId frameNo, bool ok);
+
+	/**
+	 * Writes dirty frames back as one batch through the I/O engine and waits for the writes,
+	 * releasing the lock meanwhile. Called with bufMutex held through <lock>.
+	 *
+	 * @param frames	Dirty, unpinned frames to write back
+	 * @param lock		Lock on bufMutex
+	 */
+  void writeFrames(const std::vector<FrameId>& frames, std::unique_lock<std::mutex>& lock);
+
  public:
 	/**
    * Actual buffer pool from which frames are allocated
@@ -210,8 +415,16 @@ class BufMgr
 
 	/**
    * Constructor of BufMgr class
-	 */
-  BufMgr(std::uint32_t bufs);
+   *
+   * @param bufs	Number of frames in the buffer pool
+   * @param log	Write-ahead log recording changes to pages, or NULL to not log them. With a log, pages
+   *		changed since the last commit() stay in the buffer pool until they are committed, and no
+   *		frame can be allocated while all of them hold such pages.
+   * @param io	Engine for asynchronous I/O, or NULL. With an engine, prefetches run in the
+   *		background, and readPages() and flushFile() submit their reads and writes as one batch.
+   *		The engine must outlive the buffer manager.
+	 */
+  BufMgr(std::uint32_t bufs, LogManager* log = NULL, IoEngine* io = NULL);
 	
 	/**
    * Destructor of BufMgr class
@@ -221,7 +434,8 @@ class BufMgr
 	/**
 	 * Reads the given page from the file into a frame and returns the pointer to page.
 	 * If the requested page is already present in the buffer pool pointer to that frame is returned
-	 * otherwise a new frame is allocated from the buffer pool for reading the page.
+	 * otherwise a new frame is allocated from the buffer pool for reading the page. The read itself
+	 * happens without holding up other users of the buffer pool.
 	 *
 	 * @param file   	File object
 	 * @param PageNo  Page number in the file to be read
@@ -229,6 +443,32 @@ class BufMgr
 	 */
   void readPage(File* file, const PageId PageNo, Page*& page);
 
+	/**
+	 * Reads a run of consecutive pages of the file into the buffer pool ahead of their use, issuing one
+	 * vectored read for each stretch of pages not already present. Pages are left unpinned. At most a
+	 * quarter of the pool is used by one call, so a prefetch cannot push out the whole working set.
+	 * With an I/O engine the reads are submitted as one batch and the call returns without waiting.
+	 *
+	 * @param file   	File object
+	 * @param firstPageNo	Page number of first page to read
+	 * @param count		Number of pages to read
+	 */
+  void prefetchPages(File* file, const PageId firstPageNo, std::uint32_t count);
+
+	/**
+	 * Reads a set of pages of the file and pins them, like readPage() for each. The pages not in the
+	 * buffer pool are read as one batch: with an I/O engine they are submitted together and read
+	 * concurrently, which suits lookups of many scattered pages (index probes, say); without one,
+	 * each run of consecutive pages is read with one vectored read.
+	 *
+	 * @param file   	File object
+	 * @param pageNos	Page numbers to read
+	 * @param pages		Set to the pages, in the order of <pageNos>
+	 * @throws InvalidPageException If a page does not exist in the file; no page is left pinned
+	 * @throws BufferExceededException If the pages do not fit into the buffer pool
+	 */
+  void readPages(File* file, const std::vector<PageId>& pageNos, std::vector<Page*>& pages);
+
 	/**
 	 * Unpin a page from memory since it is no longer required for it to remain in memory.
 	 *
@@ -250,7 +490,7 @@ class BufMgr
   void allocPage(File* file, PageId &PageNo, Page*& page); 
 
 	/**
-	 * Writes out all dirty pages of the file to disk.
+	 * Writes out all dirty pages of the file to disk, as one batch if there is an I/O engine.
 	 * All the frames assigned to the file need to be unpinned from buffer pool before this function can be successfully called.
 	 * Otherwise Error returned.
 	 *
@@ -260,6 +500,58 @@ class BufMgr
 	 */
   void flushFile(const File* file);
 
+	/**
+	 * Writes out and drops all pages of the file from the buffer pool, then compacts the file on disk
+	 * (see PageFile::compact). Record IDs held by callers must be translated through the returned remapping.
+	 * With a log, a checkpoint is taken first so that recovery never replays the file's pages under their
+	 * old numbers, and the compacted file is synced; a crash during compaction still leaves the file
+	 * half compacted.
+	 *
+	 * @param file   	File object
+	 * @return	The pages that moved, sorted by old page number
+   * @throws  PagePinnedException If any page of the file is pinned in the buffer pool 
+	 */
+  std::vector<PageRemap> compactFile(PageFile* file);
+
+	/**
+	 * Makes all changes since the last commit atomic: appends the images of the pages changed since
+	 * then and the metadata of their files to the write-ahead log, followed by a commit record. The
+	 * commit becomes durable with the log's next group fsync. Does nothing without a log.
+	 *
+	 * @return	LSN of the commit record, or 0 without a log
+	 */
+  Lsn commit();
+
+	/**
+	 * Returns true once half the frames hold pages changed since the last commit. Such frames cannot
+	 * be evicted, so a caller making many changes commits when this returns true.
+	 */
+  bool commitDue();
+
+	/**
+	 * Takes a fuzzy checkpoint. Pages that are dirty and committed are written back in file and page
+	 * order without holding up other users of the buffer pool, no faster than the rate given to
+	 * startCheckpointer(). Then, once no change is left uncommitted, all file metadata is written, the files
+	 * are synced, and a checkpoint is recorded in the log: recovery only replays the log from the
+	 * oldest change that is still not in its file. Without a log only the pages are written.
+	 * Waits for other threads to commit their changes, so the calling thread must have committed its own.
+	 */
+  void checkpoint();
+
+	/**
+	 * Starts a background thread taking a checkpoint every <intervalMillis> milliseconds, so the
+	 * number of dirty pages (and the work left for shutdown and recovery) stays bounded.
+	 *
+	 * @param intervalMillis	Milliseconds between checkpoints
+	 * @param pagesPerSecond	Maximum pages written per second, or 0 for no limit
+	 */
+  void startCheckpointer(std::uint32_t intervalMillis, std::uint32_t pagesPerSecond = 0);
+
+	/**
+	 * Stops the background checkpointer, waiting for a checkpoint in progress to finish.
+	 */
+  void stopCheckpointer();
+
 	/**
 	 * Delete page from file and also from buffer pool if present.
 	 * Since the page is entirely deleted from file, its unnecessary to see if the page is dirty.
@@ -0,0 +1,343 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "compressed_backend.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+
+#include "file.h"
+
+namespace badgerdb {
+
+/**
+ * Identifies a compressed file's map ("BDBC").
+ */
+static const std::uint32_t MAP_MAGIC = 0x43424442;
+
+/**
+ * Size of the header at the start of the map: the magic number and padding.
+ */
+static const off_t MAP_HEADER_SIZE = 8;
+
+/**
+ * Shortest run of equal bytes worth coding as a run.
+ */
+static const std::size_t MIN_RUN = 4;
+
+/**
+ * Longest run a single run code covers.
+ */
+static const std::size_t MAX_RUN = 0x7fff + MIN_RUN;
+
+/**
+ * Longest literal a single literal code covers.
+ */
+static const std::size_t MAX_LITERAL = 0x80;
+
+static std::string mapName(const std::string& filename) {
+  return filename + ".cmap";
+}
+
+CompressedBackend::CompressedBackend(const std::string& filename,
+                                     const bool create_new)
+    : filename_(filename),
+      data_(filename, create_new),
+      map_(mapName(filename), create_new),
+      data_end_(0) {
+  memset(&stats_, 0, sizeof(stats_));
+  if (create_new) {
+    const std::uint32_t header[2] = {MAP_MAGIC, 0};
+    map_.write(0 /* offset */, header, sizeof(header));
+    return;
+  }
+
+  // Load the map, and collect the gaps between used slots as free slots.
+  const off_t map_size = map_.size();
+  if (map_size > MAP_HEADER_SIZE) {
+    slots_.resize((map_size - MAP_HEADER_SIZE) / sizeof(Slot));
+    map_.read(MAP_HEADER_SIZE, &slots_[0], slots_.size() * sizeof(Slot));
+  }
+  std::vector<Slot> used;
+  for (std::size_t i = 0; i < slots_.size(); ++i) {
+    if (slots_[i].capacity > 0) {
+      used.push_back(slots_[i]);
+    }
+  }
+  std::sort(used.begin(), used.end(), [](const Slot& a, const Slot& b) {
+    return a.offset < b.offset;
+  });
+  for (std::size_t i = 0; i < used.size(); ++i) {
+    if (used[i].offset > data_end_) {
+      free_slots_.insert(std::make_pair(std::uint32_t(used[i].offset - data_end_),
+                                        data_end_));
+    }
+    data_end_ = std::max<std::uint64_t>(data_end_,
+                                        used[i].offset + used[i].capacity);
+  }
+}
+
+CompressedBackend::~CompressedBackend() {
+}
+
+BackendFactory CompressedBackend::factory() {
+  return [](const std::string& filename, const bool create_new) {
+    return new CompressedBackend(filename, create_new);
+  };
+}
+
+bool CompressedBackend::isCompressed(const std::string& filename) {
+  return File::exists(mapName(filename));
+}
+
+void CompressedBackend::remove(const std::string& filename) {
+  ::unlink(mapName(filename).c_str());
+}
+
+off_t CompressedBackend::blockStart(const std::size_t block) {
+  if (block == 0) {
+    return 0;
+  }
+  return sizeof(FileHeader) + off_t(block - 1) * Page::SIZE;
+}
+
+std::size_t CompressedBackend::blockLength(const std::size_t block) {
+  return block == 0 ? sizeof(FileHeader) : Page::SIZE;
+}
+
+std::size_t CompressedBackend::blockAt(const off_t offset) {
+  if (offset < off_t(sizeof(FileHeader))) {
+    return 0;
+  }
+  return (offset - sizeof(FileHeader)) / Page::SIZE + 1;
+}
+
+void CompressedBackend::read(const off_t offset, void* data,
+                             const std::size_t length) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  char* out = static_cast<char*>(data);
+  char block_data[Page::SIZE];
+  off_t position = offset;
+  while (position < offset + off_t(length)) {
+    const std::size_t block = blockAt(position);
+    const off_t start = blockStart(block);
+    const off_t end = std::min<off_t>(start + blockLength(block),
+                                      offset + length);
+    loadBlock(block, block_data);
+    memcpy(out + (position - offset), block_data + (position - start),
+           end - position);
+    position = end;
+  }
+  stats_.logical_bytes_read += length;
+}
+
+void CompressedBackend::write(const off_t offset, const void* data,
+                              const std::size_t length) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const char* in = static_cast<const char*>(data);
+  char block_data[Page::SIZE];
+  off_t position = offset;
+  while (position < offset + off_t(length)) {
+    const std::size_t block = blockAt(position);
+    const off_t start = blockStart(block);
+    const off_t end = std::min<off_t>(start + blockLength(block),
+                                      offset + length);
+    if (position == start && end - start == off_t(blockLength(block))) {
+      // The whole block is replaced.
+      storeBlock(block, in + (position - offset));
+    } else {
+      // Part of the block changes (page links, say): read, patch, store.
+      loadBlock(block, block_data);
+      memcpy(block_data + (position - start), in + (position - offset),
+             end - position);
+      storeBlock(block, block_data);
+    }
+    position = end;
+  }
+  stats_.logical_bytes_written += length;
+}
+
+void CompressedBackend::truncate(const off_t length) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::size_t num_blocks = length > 0 ? blockAt(length - 1) + 1 : 0;
+  if (num_blocks > 0 &&
+      blockStart(num_blocks - 1) + off_t(blockLength(num_blocks - 1)) !=
+          length) {
+    // Zero the cut-off end of the last block.
+    char block_data[Page::SIZE];
+    loadBlock(num_blocks - 1, block_data);
+    const off_t start = blockStart(num_blocks - 1);
+    memset(block_data + (length - start), 0,
+           blockLength(num_blocks - 1) - (length - start));
+    storeBlock(num_blocks - 1, block_data);
+  }
+  for (std::size_t block = num_blocks; block < slots_.size(); ++block) {
+    releaseSlot(slots_[block]);
+  }
+  if (num_blocks < slots_.size()) {
+    slots_.resize(num_blocks);
+    map_.truncate(MAP_HEADER_SIZE + off_t(num_blocks) * sizeof(Slot));
+  }
+}
+
+off_t CompressedBackend::size() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::size_t block = slots_.size();
+  while (block > 0 && slots_[block - 1].length == 0) {
+    --block;
+  }
+  return block == 0 ? 0 : blockStart(block - 1) + blockLength(block - 1);
+}
+
+void CompressedBackend::sync() {
+  data_.sync();
+  map_.sync();
+}
+
+CompressionStats CompressedBackend::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void CompressedBackend::loadBlock(const std::size_t block, char* out) {
+  const std::size_t length = blockLength(block);
+  if (block >= slots_.size() || slots_[block].length == 0) {
+    memset(out, 0, length);
+    return;
+  }
+  const Slot& slot = slots_[block];
+  stats_.physical_bytes_read += slot.length;
+  if (slot.length == length) {
+    data_.read(slot.offset, out, length);
+    return;
+  }
+  char compressed[Page::SIZE];
+  data_.read(slot.offset, compressed, slot.length);
+  decompress(compressed, slot.length, out, length);
+}
+
+void CompressedBackend::storeBlock(const std::size_t block, const char* data) {
+  const std::size_t length = blockLength(block);
+  std::string compressed;
+  compress(data, length, compressed);
+  const char* bytes = compressed.data();
+  if (compressed.size() >= length) {
+    // Incompressible: store the block as it is.
+    compressed.clear();
+    bytes = data;
+  }
+  const std::uint32_t stored = compressed.empty() ? length : compressed.size();
+
+  if (block >= slots_.size()) {
+    Slot unused = {0, 0, 0};
+    slots_.resize(block + 1, unused);
+  }
+  Slot& slot = slots_[block];
+  if (slot.capacity < stored) {
+    // Move to the smallest free slot that fits, or to the end of the file.
+    releaseSlot(slot);
+    const std::uint32_t capacity =
+        (stored + SLOT_UNIT - 1) / SLOT_UNIT * SLOT_UNIT;
+    std::multimap<std::uint32_t, std::uint64_t>::iterator free_slot =
+        free_slots_.lower_bound(capacity);
+    if (free_slot != free_slots_.end()) {
+      slot.offset = free_slot->second;
+      slot.capacity = free_slot->first;
+      free_slots_.erase(free_slot);
+    } else {
+      slot.offset = data_end_;
+      slot.capacity = capacity;
+      data_end_ += capacity;
+    }
+  }
+  slot.length = stored;
+  data_.write(slot.offset, bytes, stored);
+  stats_.physical_bytes_written += stored;
+  writeSlot(block);
+}
+
+void CompressedBackend::releaseSlot(const Slot& slot) {
+  if (slot.capacity > 0) {
+    free_slots_.insert(std::make_pair(slot.capacity, slot.offset));
+  }
+}
+
+void CompressedBackend::writeSlot(const std::size_t block) {
+  map_.write(MAP_HEADER_SIZE + off_t(block) * sizeof(Slot), &slots_[block],
+             sizeof(Slot));
+}
+
+void CompressedBackend::compress(const char* data, const std::size_t length,
+                                 std::string& out) {
+  // Codes: a byte c < 0x80 is followed by c + 1 literal bytes; a byte c >=
+  // 0x80 and the byte after it give a run length ((c & 0x7f) << 8 | next) +
+  // MIN_RUN, followed by the repeated byte.
+  out.clear();
+  std::size_t literal_start = 0;
+  std::size_t i = 0;
+  while (i < length) {
+    std::size_t run = 1;
+    while (i + run < length && run < MAX_RUN && data[i + run] == data[i]) {
+      ++run;
+    }
+    if (run < MIN_RUN) {
+      ++i;
+      if (i - literal_start == MAX_LITERAL) {
+        out.push_back(char(MAX_LITERAL - 1));
+        out.append(data + literal_start, MAX_LITERAL);
+        literal_start = i;
+      }
+      continue;
+    }
+    if (i > literal_start) {
+      out.push_back(char(i - literal_start - 1));
+      out.append(data + literal_start, i - literal_start);
+    }
+    const std::size_t code = run - MIN_RUN;
+    out.push_back(char(0x80 | (code >> 8)));
+    out.push_back(char(code & 0xff));
+    out.push_back(data[i]);
+    i += run;
+    literal_start = i;
+  }
+  if (length > literal_start) {
+    out.push_back(char(length - literal_start - 1));
+    out.append(data + literal_start, length - literal_start);
+  }
+}
+
+void CompressedBackend::decompress(const char* data, const std::size_t length,
+                                   char* out, const std::size_t out_length) {
+  const unsigned char* in = reinterpret_cast<const unsigned char*>(data);
+  std::size_t i = 0;
+  std::size_t done = 0;
+  while (i < length && done < out_length) {
+    const unsigned char code = in[i++];
+    if (code < 0x80) {
+      const std::size_t count =
+          std::min<std::size_t>({std::size_t(code) + 1, length - i,
+                                 out_length - done});
+      memcpy(out + done, in + i, count);
+      i += count;
+      done += count;
+    } else if (i + 1 < length) {
+      const std::size_t count = std::min<std::size_t>(
+          ((std::size_t(code & 0x7f) << 8) | in[i]) + MIN_RUN,
+          out_length - done);
+      memset(out + done, in[i + 1], count);
+      i += 2;
+      done += count;
+    } else {
+      break;
+    }
+  }
+  // A damaged block still decodes to a whole one.
+  memset(out + done, 0, out_length - done);
+}
+
+}
@@ -0,0 +1,236 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "file_backend.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Byte counts of a compressed file, for judging the compression ratio.
+ */
+struct CompressionStats {
+  /**
+   * Bytes of pages (and header) written, before compression.
+   */
+  std::uint64_t logical_bytes_written;
+
+  /**
+   * Compressed bytes written to disk.
+   */
+  std::uint64_t physical_bytes_written;
+
+  /**
+   * Bytes of pages (and header) read, after decompression.
+   */
+  std::uint64_t logical_bytes_read;
+
+  /**
+   * Compressed bytes read from disk.
+   */
+  std::uint64_t physical_bytes_read;
+};
+
+/**
+ * @brief Backend storing each page of a file compressed.
+ *
+ * The file's byte space is split into blocks the way File lays it out: the
+ * file header, then one block per page.  Every block is compressed on its own
+ * and stored in a slot of the data file (named like the file), a multiple of
+ * SLOT_UNIT bytes long.  A block that still fits its slot after a change is
+ * rewritten in place; otherwise it moves to a free slot or the end of the data
+ * file, and its old slot is reused later.  The slot of every block is kept in
+ * a map next to the data file (named <filename>.cmap), which is also how a
+ * compressed file is recognised when it is opened.
+ *
+ * Blocks never written read as zeroes, and blocks that do not compress are
+ * stored as they are.  The compressor is a run-length coder: pages are mostly
+ * zero fill and padding, which it shrinks to a few bytes per run.
+ */
+class CompressedBackend : public FileBackend {
+ public:
+  /**
+   * Granularity of slots in the data file, in bytes.
+   */
+  static const std::uint32_t SLOT_UNIT = 256;
+
+  /**
+   * Opens (or creates, truncating it) the compressed file with the given name.
+   *
+   * @param filename    Name of the file.
+   * @param create_new  Whether to create the file.
+   * @throws  FileNotFoundException   If the file cannot be opened.
+   */
+  CompressedBackend(const std::string& filename, const bool create_new);
+
+  /**
+   * Closes the data file and the map.
+   */
+  ~CompressedBackend();
+
+  void read(const off_t offset, void* data, const std::size_t length);
+
+  void write(const off_t offset, const void* data, const std::size_t length);
+
+  void truncate(const off_t length);
+
+  off_t size();
+
+  void sync();
+
+  /**
+   * Returns the byte counts of the file since it was opened.
+   */
+  CompressionStats stats() const;
+
+  /**
+   * Makes a backend factory for creating compressed files.
+   */
+  static BackendFactory factory();
+
+  /**
+   * Returns true if the file with the given name is stored compressed.
+   *
+   * @param filename  Name of the file.
+   */
+  static bool isCompressed(const std::string& filename);
+
+  /**
+   * Deletes the map of a compressed file (the data file is left to the
+   * caller).
+   *
+   * @param filename  Name of the file.
+   */
+  static void remove(const std::string& filename);
+
+  /**
+   * Compresses a block.
+   *
+   * @param data    Bytes to compress.
+   * @param length  Number of bytes.
+   * @param out     Set to the compressed bytes.
+   */
+  static void compress(const char* data, const std::size_t length,
+                       std::string& out);
+
+  /**
+   * Decompresses a block.
+   *
+   * @param data    Compressed bytes.
+   * @param length  Number of compressed bytes.
+   * @param out     Buffer the block is decompressed into.
+   * @param out_length  Length of the block.
+   */
+  static void decompress(const char* data, const std::size_t length,
+                         char* out, const std::size_t out_length);
+
+ private:
+  /**
+   * Location of a block in the data file, as stored in the map.
+   */
+  struct Slot {
+    /**
+     * Offset of the slot in the data file.
+     */
+    std::uint64_t offset;
+
+    /**
+     * Number of bytes stored in the slot; 0 if the block was never written.
+     * Equal to the block's length if the block is stored uncompressed.
+     */
+    std::uint32_t length;
+
+    /**
+     * Size of the slot, a multiple of SLOT_UNIT.
+     */
+    std::uint32_t capacity;
+  };
+
+  /**
+   * Returns the offset of a block in the file's byte space.
+   */
+  static off_t blockStart(const std::size_t block);
+
+  /**
+   * Returns the length of a block.
+   */
+  static std::size_t blockLength(const std::size_t block);
+
+  /**
+   * Returns the block holding the given offset.
+   */
+  static std::size_t blockAt(const off_t offset);
+
+  /**
+   * Reads and decompresses a block; callers hold mutex_.
+   */
+  void loadBlock(const std::size_t block, char* out);
+
+  /**
+   * Compresses a block and stores it in a slot; callers hold mutex_.
+   */
+  void storeBlock(const std::size_t block, const char* data);
+
+  /**
+   * Gives a slot back for reuse; callers hold mutex_.
+   */
+  void releaseSlot(const Slot& slot);
+
+  /**
+   * Writes the map entry of a block; callers hold mutex_.
+   */
+  void writeSlot(const std::size_t block);
+
+  /**
+   * Name of the file.
+   */
+  std::string filename_;
+
+  /**
+   * Holds the slots.
+   */
+  DiskBackend data_;
+
+  /**
+   * Holds the map.
+   */
+  DiskBackend map_;
+
+  /**
+   * Slot of every block, indexed by block.
+   */
+  std::vector<Slot> slots_;
+
+  /**
+   * Unused slots in the data file: offset by size.
+   */
+  std::multimap<std::uint32_t, std::uint64_t> free_slots_;
+
+  /**
+   * End of the data file.
+   */
+  std::uint64_t data_end_;
+
+  /**
+   * Byte counts since the file was opened.
+   */
+  CompressionStats stats_;
+
+  /**
+   * Guards everything above.
+   */
+  mutable std::mutex mutex_;
+};
+
+}
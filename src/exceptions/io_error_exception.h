@@ -0,0 +1,54 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when reading, writing or syncing a file
+ *        fails.
+ */
+class IoErrorException : public BadgerDbException {
+ public:
+  /**
+   * Constructs an I/O error exception for the given file.
+   *
+   * @param name        Name of file the operation was on.
+   * @param operation   Operation that failed, e.g. "read".
+   * @param error       errno of the failure, or 0 if it was a short transfer.
+   */
+  IoErrorException(const std::string& name, const std::string& operation,
+                   const int error);
+
+  /**
+   * Returns the name of the file that caused this exception.
+   */
+  virtual const std::string& filename() const { return filename_; }
+
+  /**
+   * Returns the errno of the failure, or 0 if it was a short transfer.
+   */
+  virtual int error() const { return error_; }
+
+ protected:
+  /**
+   * Name of file that caused this exception.
+   */
+  const std::string filename_;
+
+  /**
+   * errno of the failure.
+   */
+  const int error_;
+};
+
+}
@@ -0,0 +1,23 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "page_format_exception.h"
+
+#include <sstream>
+#include <string>
+
+namespace badgerdb {
+
+PageFormatException::PageFormatException(const PageId page_num,
+                                         const std::string& reason)
+    : BadgerDbException(""), page_number_(page_num) {
+  std::stringstream ss;
+  ss << "Page " << page_number_ << " does not allow this: " << reason;
+  message_.assign(ss.str());
+}
+
+}
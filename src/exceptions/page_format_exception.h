@@ -0,0 +1,44 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a page is used in a way its format
+ *        does not allow, such as inserting a record of the wrong length into a
+ *        page of fixed-length records.
+ */
+class PageFormatException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a page format exception for the given page.
+   *
+   * @param page_num  Number of the page.
+   * @param reason    What the page's format does not allow.
+   */
+  PageFormatException(const PageId page_num, const std::string& reason);
+
+  /**
+   * Returns the page number of the page that caused this exception.
+   */
+  PageId page_number() const { return page_number_; }
+
+ protected:
+  /**
+   * Page number of the page that caused this exception.
+   */
+  const PageId page_number_;
+};
+
+}
@@ -7,24 +7,40 @@
 
 #include "file.h"
 
-#include <fstream>
+#include <sys/stat.h>
+#include <cstring>
+#include <algorithm>
 #include <iostream>
-#include <memory>
 #include <string>
-#include <cstdio>
+#include <cstddef>
 #include <cassert>
+#include <memory>
 
 #include "exceptions/file_exists_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
 #include "exceptions/invalid_page_exception.h"
 #include "file_iterator.h"
+#include "mem_backend.h"
 #include "page.h"
 
 namespace badgerdb {
 
-File::StreamMap File::open_streams_;
-File::CountMap File::open_counts_;
+std::vector<File::OpenFile*> File::open_files_;
+std::mutex File::open_files_mutex_;
+std::uint32_t File::num_opens_ = 0;
+
+static_assert(offsetof(PageHeader, next_page_number) ==
+                  offsetof(PageHeader, current_page_number) + sizeof(PageId) &&
+              offsetof(PageHeader, prev_page_number) ==
+                  offsetof(PageHeader, next_page_number) + sizeof(PageId),
+              "Page link fields must be contiguous in the page header.");
+static_assert(offsetof(PageLinkImage, prev_page_number) ==
+                  offsetof(PageLinkImage, current_page_number) +
+                      2 * sizeof(PageId),
+              "Link images must match the layout of the page header fields.");
+static_assert(sizeof(Page) == Page::SIZE,
+              "Page must be read and written as a single block.");
 
 void File::remove(const std::string& filename) {
   if (!exists(filename)) {
@@ -33,25 +49,31 @@ void File::remove(const std::string& filename) {
   if (isOpen(filename)) {
     throw FileOpenException(filename);
   }
-  std::remove(filename.c_str());
+  FileBackend::remove(filename);
+  if (ZoneMap::exists(filename)) {
+    ZoneMap::remove(filename);
+  }
+  if (PageDirectory::exists(filename)) {
+    PageDirectory::remove(filename);
+  }
 }
 
 bool File::isOpen(const std::string& filename) {
-  if (!exists(filename)) {
-    return false;
+  std::lock_guard<std::mutex> lock(open_files_mutex_);
+  for (std::size_t i = 0; i < open_files_.size(); ++i) {
+    if (open_files_[i] != NULL && open_files_[i]->filename == filename) {
+      return true;
+    }
   }
-  return open_counts_.find(filename) != open_counts_.end();
+  return false;
 }
 
 bool File::exists(const std::string& filename) {
-	std::fstream file(filename);
-	if(file)
-	{
-		file.close();
-		return true;
-	}
-
-	return false;
+  if (MemBackend::exists(filename)) {
+    return true;
+  }
+  struct stat file_stat;
+  return ::stat(filename.c_str(), &file_stat) == 0;
 }
 
 File::~File() {
@@ -60,251 +82,538 @@ File::~File() {
 
 
 PageId File::getFirstPageNo() {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
   const FileHeader& header = readHeader();
   return header.first_used_page;
 }
 
-File::File(const std::string& name, const bool create_new) : filename_(name) {
-  openIfNeeded(create_new);
+File::File(const std::string& name, const bool create_new,
+           const BackendFactory& backend)
+    : open_file_(NULL), file_id_(0) {
+  openIfNeeded(name, create_new, backend);
 
   if (create_new) {
     // File starts with 1 page (the header).
     FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+                         0 /* num_free_pages */, 0 /* first_free_page */,
+                         0 /* last_used_page */};
     writeHeader(header);
   }
 }
 
-void File::openIfNeeded(const bool create_new) {
-  if (open_counts_.find(filename_) != open_counts_.end()) {	//exists an entry already
-    ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
-  } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
-    const bool already_exists = exists(filename_);
-    if (create_new) {
-      // Error if we try to overwrite an existing file.
-      if (already_exists) {
-        throw FileExistsException(filename_);
-      }
-      // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
-    } else {
-      // Error if we try to open a file that doesn't exist.
-      if (!already_exists) {
-        throw FileNotFoundException(filename_);
+File::File(const File& other) : open_file_(NULL), file_id_(0) {
+  attach(other);
+}
+
+void File::openIfNeeded(const std::string& name, const bool create_new,
+                        const BackendFactory& backend) {
+  std::lock_guard<std::mutex> lock(open_files_mutex_);
+  std::size_t free_slot = open_files_.size();
+  for (std::size_t slot = 0; slot < open_files_.size(); ++slot) {
+    OpenFile* entry = open_files_[slot];
+    if (entry == NULL) {
+      if (free_slot == open_files_.size()) {
+        free_slot = slot;
       }
+    } else if (entry->filename == name) {	//exists an entry already
+      ++entry->open_count;
+      open_file_ = entry;
+      file_id_ = entry->id;
+      return;
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
-    open_counts_[filename_] = 1;
   }
-}
 
-void File::close() {
-	if(open_counts_[filename_] > 0)
-  	--open_counts_[filename_];
+  const bool already_exists = exists(name);
+  if (create_new) {
+    // Error if we try to overwrite an existing file.
+    if (already_exists) {
+      throw FileExistsException(name);
+    }
+  } else {
+    // Error if we try to open a file that doesn't exist.
+    if (!already_exists) {
+      throw FileNotFoundException(name);
+    }
+  }
+  FileBackend* storage = backend ? backend(name, create_new)
+                                 : FileBackend::open(name, create_new);
+
+  OpenFile* entry = new OpenFile();
+  entry->filename = name;
+  entry->backend = storage;
+  entry->open_count = 1;
+  entry->id = (FileId(++num_opens_) << 32) | free_slot;
+  if (free_slot == open_files_.size()) {
+    open_files_.push_back(entry);
+  } else {
+    open_files_[free_slot] = entry;
+  }
+  open_file_ = entry;
+  file_id_ = entry->id;
 
-  stream_.reset();
-	assert(open_counts_[filename_] >= 0);
+  if (!create_new) {
+    readBytes(0 /* offset */, &entry->metadata.header, sizeof(FileHeader));
+    if (ZoneMap::exists(name)) {
+      entry->zone_map = new ZoneMap(name, false /* create_new */);
+    }
+  } else {
+    // Left behind by an earlier file of the same name.
+    if (ZoneMap::exists(name)) {
+      ZoneMap::remove(name);
+    }
+    if (PageDirectory::exists(name)) {
+      PageDirectory::remove(name);
+    }
+  }
+}
 
-  if (open_counts_[filename_] == 0) {
-    open_streams_.erase(filename_);
-    open_counts_.erase(filename_);
+void File::attach(const File& other) {
+  std::lock_guard<std::mutex> lock(open_files_mutex_);
+  ++other.open_file_->open_count;
+  open_file_ = other.open_file_;
+  file_id_ = other.file_id_;
+}
+
+void File::close() {
+  if (open_file_ == NULL) {
+    return;
   }
+  std::lock_guard<std::mutex> lock(open_files_mutex_);
+	assert(open_file_->open_count > 0);
+  if (--open_file_->open_count == 0) {
+    writeMetadata(*open_file_);
+    delete open_file_->zone_map;
+    delete open_file_->directory;
+    delete open_file_->backend;
+    open_files_[std::uint32_t(file_id_)] = NULL;
+    delete open_file_;
+  }
+  open_file_ = NULL;
 }
 
 FileHeader File::readHeader() const {
-  FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
-  return header;
+  return open_file_->metadata.header;
 }
 
 void File::writeHeader(const FileHeader& header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
-  stream_->flush();
+  open_file_->metadata.header = header;
+  open_file_->metadata.header_dirty = true;
+}
+
+void File::readBytes(const off_t offset, void* data,
+                     const std::size_t length) const {
+  open_file_->backend->read(offset, data, length);
+}
+
+void File::writeBytes(const off_t offset, const void* data,
+                      const std::size_t length) {
+  open_file_->backend->write(offset, data, length);
+}
+
+void File::readPages(const PageId first, const std::uint32_t count,
+                     Page* dst) const {
+  std::vector<Page*> pages(count);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    pages[i] = &dst[i];
+  }
+  readPages(first, count, &pages[0]);
+}
+
+void File::readPageRun(const PageId first, const std::uint32_t count,
+                       Page* const* dst) const {
+  open_file_->backend->readv(pagePosition(first),
+                             reinterpret_cast<void* const*>(dst), Page::SIZE,
+                             count);
+}
+
+IoRequest File::readRequest(const PageId page_number, Page* page) const {
+  IoRequest request;
+  request.backend = open_file_->backend;
+  request.write = false;
+  request.offset = pagePosition(page_number);
+  request.buffer = page;
+  request.length = Page::SIZE;
+  return request;
+}
+
+void File::noteChange(const PageId page_number) {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  if (open_file_->zone_map != NULL) {
+    open_file_->zone_map->forget(page_number);
+  }
+}
+
+void File::flushMetadata() {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  writeMetadata(*open_file_);
+}
+
+void File::writeMetadata(OpenFile& entry) {
+  FileMetadata& metadata = entry.metadata;
+  for (std::size_t i = 0; i < metadata.dirty_links.size(); ++i) {
+    const PageId page_number = metadata.dirty_links[i];
+    PageLinks& links = metadata.links[page_number];
+    if (!links.dirty) {
+      // Already written back along with the rest of the page.
+      continue;
+    }
+    const PageId fields[3] = {
+        links.used ? page_number : Page::INVALID_NUMBER,
+        links.next_page_number, links.prev_page_number};
+    entry.backend->write(pagePosition(page_number) +
+                             offsetof(PageHeader, current_page_number),
+                         fields, sizeof(fields));
+    links.dirty = false;
+  }
+  metadata.dirty_links.clear();
+
+  if (metadata.header_dirty) {
+    entry.backend->write(0 /* offset */, &metadata.header,
+                         sizeof(FileHeader));
+    metadata.header_dirty = false;
+  }
+
+  if (entry.zone_map != NULL) {
+    entry.zone_map->flush();
+  }
+  if (entry.directory != NULL) {
+    entry.directory->flush(metadata.header);
+  }
 }
 
 
+MetadataImage File::metadataImage() const {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  const FileMetadata& metadata = open_file_->metadata;
+  MetadataImage image;
+  image.header = metadata.header;
+  for (std::size_t i = 0; i < metadata.dirty_links.size(); ++i) {
+    const PageId page_number = metadata.dirty_links[i];
+    const PageLinks& links = metadata.links[page_number];
+    if (!links.dirty) {
+      continue;
+    }
+    const PageLinkImage link = {
+        page_number, links.used ? page_number : Page::INVALID_NUMBER,
+        links.next_page_number, links.prev_page_number};
+    image.links.push_back(link);
+  }
+  return image;
+}
+
+void File::redoPage(const std::string& filename, const PageId page_number,
+                    const Page& page) {
+  std::unique_ptr<FileBackend> backend(
+      FileBackend::open(filename, false /* create_new */));
+  Page image = page;
+  if (backend->size() >= pagePosition(page_number) + off_t(Page::SIZE)) {
+    backend->read(pagePosition(page_number) +
+                      offsetof(PageHeader, current_page_number),
+                  &image.header_.current_page_number, 3 * sizeof(PageId));
+  }
+  backend->write(pagePosition(page_number), &image, Page::SIZE);
+  // The zone map cannot vouch for pages written behind its back, nor the
+  // page directory for their links.
+  if (ZoneMap::exists(filename)) {
+    ZoneMap::remove(filename);
+  }
+  if (PageDirectory::exists(filename)) {
+    PageDirectory::remove(filename);
+  }
+}
+
+void File::redoMetadata(const std::string& filename,
+                        const MetadataImage& image) {
+  std::unique_ptr<FileBackend> backend(
+      FileBackend::open(filename, false /* create_new */));
+  for (std::size_t i = 0; i < image.links.size(); ++i) {
+    const PageLinkImage& link = image.links[i];
+    backend->write(pagePosition(link.page_number) +
+                       offsetof(PageHeader, current_page_number),
+                   &link.current_page_number, 3 * sizeof(PageId));
+  }
+  backend->write(0 /* offset */, &image.header, sizeof(FileHeader));
+  if (PageDirectory::exists(filename)) {
+    PageDirectory::remove(filename);
+  }
+}
+
+void File::sync(const std::string& filename) {
+  std::unique_ptr<FileBackend> backend(
+      FileBackend::open(filename, false /* create_new */));
+  backend->sync();
+}
 
+void File::flushAllMetadata() {
+  std::lock_guard<std::mutex> lock(open_files_mutex_);
+  for (std::size_t i = 0; i < open_files_.size(); ++i) {
+    if (open_files_[i] != NULL) {
+      std::lock_guard<std::mutex> file_lock(open_files_[i]->mutex);
+      writeMetadata(*open_files_[i]);
+    }
+  }
+}
 
+void File::syncAll() {
+  std::lock_guard<std::mutex> lock(open_files_mutex_);
+  for (std::size_t i = 0; i < open_files_.size(); ++i) {
+    if (open_files_[i] != NULL) {
+      open_files_[i]->backend->sync();
+    }
+  }
+}
 
-PageFile PageFile::create(const std::string& filename) {
-  return PageFile(filename, true /* create_new */);
+PageFile PageFile::create(const std::string& filename,
+                       const BackendFactory& backend) {
+  return PageFile(filename, true /* create_new */, backend);
 }
 
-PageFile PageFile::open(const std::string& filename) {
-  return PageFile(filename, false /* create_new */);
+PageFile PageFile::open(const std::string& filename,
+                     const BackendFactory& backend) {
+  return PageFile(filename, false /* create_new */, backend);
 }
 
-PageFile::PageFile(const std::string& name, const bool create_new)
-: File(name, create_new)
+PageFile::PageFile(const std::string& name, const bool create_new,
+                   const BackendFactory& backend)
+: File(name, create_new, backend)
 {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  if (open_file_->directory == NULL) {
+    openDirectory(create_new);
+  }
 }
 
 PageFile::~PageFile() {
 }
 
 PageFile::PageFile(const PageFile& other)
-: File(other.filename_, false /* create_new */)
+: File(other)
 {
 }
 
 PageFile& PageFile::operator=(const PageFile& rhs) {
   // This accounts for self-assignment and assignment of a File object for the
   // same file.
-  close();	//close my file and associate me with the new one
-  filename_ = rhs.filename_;
-  openIfNeeded(false /* create_new */);
+  if (open_file_ != rhs.open_file_) {
+    close();	//close my file and associate me with the new one
+    attach(rhs);
+  }
   return *this;
 }
 
 Page PageFile::allocatePage(PageId &new_page_number) {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
   FileHeader header = readHeader();
   Page new_page;
-  Page existing_page;
+  PageId prev_page_number;
+  PageId next_page_number;
   if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
-    new_page.set_page_number(header.first_free_page);
-		new_page_number = new_page.page_number();
-    header.first_free_page = new_page.next_page_number();
+    // Reuse the page at the head of the free list.
+    new_page_number = header.first_free_page;
+    header.first_free_page = pageLinks(new_page_number).next_page_number;
     --header.num_free_pages;
 
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page later
-      // than the one we just allocated, so add the new page to the head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
-    } else {
-      // New page is reused from somewhere after the beginning, so we need to
-      // find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
-    }
-
     assert((header.num_free_pages == 0) ==
            (header.first_free_page == Page::INVALID_NUMBER));
+    findUsedNeighbours(header, new_page_number, prev_page_number,
+                       next_page_number);
+  } else {
+    new_page_number = header.num_pages;
+    ++header.num_pages;
+    prev_page_number = header.last_used_page;
+    next_page_number = Page::INVALID_NUMBER;
   }
-	else
-	{
-    new_page.set_page_number(header.num_pages);
-		new_page_number = new_page.page_number();
+  new_page.set_page_number(new_page_number);
+  new_page.set_prev_page_number(prev_page_number);
+  new_page.set_next_page_number(next_page_number);
 
-    if (header.first_used_page == Page::INVALID_NUMBER)
-		{
-      header.first_used_page = new_page.page_number();
-    }
-		else
-		{
-      // If we have pages allocated, we need to add the new page to the tail
-      // of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
-      }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
-    }
-    ++header.num_pages;
+  // Link the new page in between its neighbours in page number order.
+  if (prev_page_number == Page::INVALID_NUMBER) {
+    header.first_used_page = new_page_number;
+  } else {
+    pageLinks(prev_page_number).next_page_number = new_page_number;
+    markLinksDirty(prev_page_number);
   }
-  writePage(new_page_number, new_page.header_, new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page.header_, existing_page);
+  if (next_page_number == Page::INVALID_NUMBER) {
+    header.last_used_page = new_page_number;
+  } else {
+    pageLinks(next_page_number).prev_page_number = new_page_number;
+    markLinksDirty(next_page_number);
+  }
+
+  std::vector<PageLinks>& links = open_file_->metadata.links;
+  if (new_page_number >= links.size()) {
+    links.resize(new_page_number + 1, PageLinks());
   }
+  PageLinks& new_links = links[new_page_number];
+  new_links.used = true;
+  new_links.loaded = true;
+  new_links.dirty = false;
+  new_links.next_page_number = next_page_number;
+  new_links.prev_page_number = prev_page_number;
+  open_file_->directory->setUsed(new_page_number, true);
+
+  writePage(new_page_number, new_page.header_, new_page);
   writeHeader(header);
+  if (open_file_->zone_map != NULL) {
+    open_file_->zone_map->setEmpty(new_page_number);
+  }
 
   return new_page;
 }
 
 Page PageFile::readPage(const PageId page_number) const {
-  FileHeader header = readHeader();
-
-	if (page_number >= header.num_pages)
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+	if (page_number >= open_file_->metadata.header.num_pages)
 	{
-		throw InvalidPageException(page_number, filename_);
+		throw InvalidPageException(page_number, filename());
 	}
 	return readPage(page_number, false /* allow_free */);
 }
 
 Page PageFile::readPage(const PageId page_number, const bool allow_free) const {
   Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&page.header_), sizeof(PageHeader));
-  stream_->read(&page.data_[0], Page::DATA_SIZE);
-  if (!allow_free && !page.isUsed()) {
-    throw InvalidPageException(page_number, filename_);
+  readBytes(pagePosition(page_number), &page, Page::SIZE);
+  if (!applyPageLinks(page_number, page) && !allow_free) {
+    throw InvalidPageException(page_number, filename());
   }
 
   return page;
 }
 
+void PageFile::readPages(const PageId first, const std::uint32_t count,
+                         Page* const* dst) const {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  if (first == Page::INVALID_NUMBER ||
+      first + count > open_file_->metadata.header.num_pages) {
+    throw InvalidPageException(first + count - 1, filename());
+  }
+  readPageRun(first, count, dst);
+  for (std::uint32_t i = 0; i < count; ++i) {
+    if (!applyPageLinks(first + i, *dst[i])) {
+      throw InvalidPageException(first + i, filename());
+    }
+  }
+}
+
+bool PageFile::applyPageLinks(const PageId page_number, Page& page) const {
+  std::vector<PageLinks>& all_links = open_file_->metadata.links;
+  if (page_number >= all_links.size()) {
+    all_links.resize(page_number + 1, PageLinks());
+  }
+  PageLinks& links = all_links[page_number];
+  if (!links.loaded) {
+    links.used = page.header_.current_page_number != Page::INVALID_NUMBER;
+    links.loaded = true;
+    links.dirty = false;
+    links.next_page_number = page.header_.next_page_number;
+    links.prev_page_number = page.header_.prev_page_number;
+  } else {
+    // The cached links may not have been written back yet.
+    page.header_.current_page_number =
+        links.used ? page_number : Page::INVALID_NUMBER;
+    page.header_.next_page_number = links.next_page_number;
+    page.header_.prev_page_number = links.prev_page_number;
+  }
+  return links.used;
+}
+
 void PageFile::writePage(const PageId new_page_number, const Page& new_page) {
-	PageHeader header = readPageHeader(new_page_number);
-	if (header.current_page_number == Page::INVALID_NUMBER)
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+	PageLinks& links = pageLinks(new_page_number);
+	if (!links.used)
 	{
 		// Page has been deleted since it was read.
-		throw InvalidPageException(new_page_number, filename_);
+		throw InvalidPageException(new_page_number, filename());
 	}
-	// Page on disk may have had its next page pointer updated since it was read;
-	// we don't modify that, but we do keep all the other modifications to the
-	// page header.
-	const PageId next_page_number = header.next_page_number;
-	header = new_page.header_;
-	header.next_page_number = next_page_number;
+	// The page's links in the used list may have been updated since it was
+	// read; we don't modify those, but we do keep all the other modifications
+	// to the page header.  Writing the whole page also writes back its links.
+	PageHeader header = new_page.header_;
+	header.next_page_number = links.next_page_number;
+	header.prev_page_number = links.prev_page_number;
+	links.dirty = false;
 	writePage(new_page_number, header, new_page);
+	if (open_file_->zone_map != NULL)
+	{
+		open_file_->zone_map->set(new_page_number, new_page);
+	}
+}
+
+void PageFile::completeRead(const PageId page_number, Page& page) const {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  if (page_number >= open_file_->metadata.header.num_pages ||
+      !applyPageLinks(page_number, page)) {
+    throw InvalidPageException(page_number, filename());
+  }
+}
+
+IoRequest PageFile::writeRequest(const PageId page_number, const Page& page,
+                                 Page* image) {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  PageLinks& links = pageLinks(page_number);
+  if (!links.used) {
+    throw InvalidPageException(page_number, filename());
+  }
+  // As in writePage(), the links come from the cache.
+  *image = page;
+  image->header_.next_page_number = links.next_page_number;
+  image->header_.prev_page_number = links.prev_page_number;
+  links.dirty = false;
+  if (open_file_->zone_map != NULL) {
+    open_file_->zone_map->set(page_number, page);
+  }
+
+  IoRequest request = readRequest(page_number, image);
+  request.write = true;
+  return request;
 }
 
 void PageFile::deletePage(const PageId page_number) {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
   FileHeader header = readHeader();
+  if (page_number >= header.num_pages) {
+    throw InvalidPageException(page_number, filename());
+  }
+  const PageLinks page_links = pageLinks(page_number);
+  if (!page_links.used) {
+    throw InvalidPageException(page_number, filename());
+  }
 
-  Page existing_page = readPage(page_number);
-  Page previous_page;
-  // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
+  // Unlink the page from the used list by pointing its neighbours (or the file
+  // header, at either end of the list) at each other.
+  const PageId prev_page_number = page_links.prev_page_number;
+  const PageId next_page_number = page_links.next_page_number;
+  if (prev_page_number == Page::INVALID_NUMBER) {
+    header.first_used_page = next_page_number;
   } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
-      }
-    }
+    pageLinks(prev_page_number).next_page_number = next_page_number;
+    markLinksDirty(prev_page_number);
+  }
+  if (next_page_number == Page::INVALID_NUMBER) {
+    header.last_used_page = prev_page_number;
+  } else {
+    pageLinks(next_page_number).prev_page_number = prev_page_number;
+    markLinksDirty(next_page_number);
   }
-  // Clear the page and add it to the head of the free list.
-  existing_page.initialize();
-  existing_page.set_next_page_number(header.first_free_page);
+
+  // Add the page to the head of the free list.
+  PageLinks& free_links = pageLinks(page_number);
+  free_links.used = false;
+  free_links.next_page_number = header.first_free_page;
+  free_links.prev_page_number = Page::INVALID_NUMBER;
+  markLinksDirty(page_number);
+  open_file_->directory->setUsed(page_number, false);
   header.first_free_page = page_number;
   ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page.header_, previous_page);
-  }
-  writePage(page_number, existing_page.header_, existing_page);
   writeHeader(header);
+  if (open_file_->zone_map != NULL) {
+    open_file_->zone_map->forget(page_number);
+  }
 }
 
 FileIterator PageFile::begin() {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
   const FileHeader& header = readHeader();
   return FileIterator(this, header.first_used_page);
 }
@@ -315,52 +624,319 @@ FileIterator PageFile::end() {
 
 void PageFile::writePage(const PageId page_number, const PageHeader& header,
                      const Page& new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char*>(&header), sizeof(PageHeader));
-  stream_->write(&new_page.data_[0], Page::DATA_SIZE);
-  stream_->flush();
+  Page page = new_page;
+  page.header_ = header;
+  writeBytes(pagePosition(page_number), &page, Page::SIZE);
+}
+
+std::vector<PageRemap> PageFile::compact() {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  FileMetadata& metadata = open_file_->metadata;
+  const FileHeader header = readHeader();
+
+  // The used list decides the new order; page i of the list moves to page i.
+  std::vector<PageId> order;
+  for (PageId page_number = header.first_used_page;
+       page_number != Page::INVALID_NUMBER;
+       page_number = pageLinks(page_number).next_page_number) {
+    order.push_back(page_number);
+  }
+  const PageId num_used = order.size();
+  const PageId unused = Page::INVALID_NUMBER;
+  std::vector<PageId> destination(header.num_pages, unused);
+  for (PageId i = 0; i < num_used; ++i) {
+    destination[order[i]] = i + 1;
+  }
+  PageDirectory& directory = *open_file_->directory;
+  directory.clear();
+  for (PageId page_number = 1; page_number <= num_used; ++page_number) {
+    directory.setUsed(page_number, true);
+  }
+
+  // Move pages along chains of displacement: a page is only overwritten after
+  // its own contents have been picked up, so each page is read once and
+  // written once and at most two pages are held in memory.
+  std::vector<bool> picked_up(header.num_pages, false);
+  Page carried;
+  Page displaced;
+  for (PageId i = 0; i < num_used; ++i) {
+    PageId page_number = order[i];
+    if (destination[page_number] == page_number || picked_up[page_number]) {
+      continue;
+    }
+    readBytes(pagePosition(page_number), &carried, Page::SIZE);
+    picked_up[page_number] = true;
+    while (true) {
+      const PageId target = destination[page_number];
+      const bool occupied = destination[target] != Page::INVALID_NUMBER &&
+                            destination[target] != target &&
+                            !picked_up[target];
+      if (occupied) {
+        readBytes(pagePosition(target), &displaced, Page::SIZE);
+        picked_up[target] = true;
+      }
+      carried.header_.current_page_number = target;
+      carried.header_.prev_page_number =
+          target > 1 ? target - 1 : Page::INVALID_NUMBER;
+      carried.header_.next_page_number =
+          target < num_used ? target + 1 : Page::INVALID_NUMBER;
+      writeBytes(pagePosition(target), &carried, Page::SIZE);
+      if (!occupied) {
+        break;
+      }
+      std::swap(carried, displaced);
+      page_number = target;
+    }
+  }
+
+  // Pages that stayed put may still need their links rewritten.
+  std::vector<PageRemap> remap;
+  for (PageId page_number = 1; page_number < header.num_pages; ++page_number) {
+    const PageId target = destination[page_number];
+    if (target == Page::INVALID_NUMBER) {
+      continue;
+    }
+    if (target != page_number) {
+      const PageRemap moved = {page_number, target};
+      remap.push_back(moved);
+      continue;
+    }
+    const PageId fields[3] = {
+        target, target > 1 ? target - 1 : Page::INVALID_NUMBER,
+        target < num_used ? target + 1 : Page::INVALID_NUMBER};
+    writeBytes(pagePosition(target) + offsetof(PageHeader, current_page_number),
+               fields, sizeof(fields));
+  }
+
+  // Every page now matches the (rebuilt) link cache on disk.
+  metadata.links.assign(num_used + 1, PageLinks());
+  for (PageId page_number = 1; page_number <= num_used; ++page_number) {
+    PageLinks& links = metadata.links[page_number];
+    links.used = true;
+    links.loaded = true;
+    links.dirty = false;
+    links.prev_page_number =
+        page_number > 1 ? page_number - 1 : Page::INVALID_NUMBER;
+    links.next_page_number =
+        page_number < num_used ? page_number + 1 : Page::INVALID_NUMBER;
+  }
+  metadata.dirty_links.clear();
+
+  const FileHeader new_header = {
+      num_used + 1 /* num_pages */,
+      num_used > 0 ? 1 : Page::INVALID_NUMBER /* first_used_page */,
+      0 /* num_free_pages */, Page::INVALID_NUMBER /* first_free_page */,
+      num_used /* last_used_page */};
+  writeHeader(new_header);
+  if (open_file_->zone_map != NULL) {
+    open_file_->zone_map->remap(remap, num_used + 1);
+  }
+  writeMetadata(*open_file_);
+  open_file_->backend->truncate(pagePosition(num_used + 1));
+
+  return remap;
+}
+
+RecordId PageFile::remapRecordId(const std::vector<PageRemap>& remap,
+                                 const RecordId& record_id) {
+  std::size_t low = 0;
+  std::size_t high = remap.size();
+  while (low < high) {
+    const std::size_t middle = (low + high) / 2;
+    if (remap[middle].old_page_number < record_id.page_number) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  RecordId remapped = record_id;
+  if (low < remap.size() && remap[low].old_page_number == record_id.page_number) {
+    remapped.page_number = remap[low].new_page_number;
+  }
+  return remapped;
+}
+
+void PageFile::createZoneMap(const std::vector<ZoneAttribute>& attributes) {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  delete open_file_->zone_map;
+  open_file_->zone_map = NULL;
+  std::unique_ptr<ZoneMap> zone_map(
+      new ZoneMap(filename(), true /* create_new */, attributes));
+  for (PageId page_number = readHeader().first_used_page;
+       page_number != Page::INVALID_NUMBER;
+       page_number = pageLinks(page_number).next_page_number) {
+    zone_map->set(page_number, readPage(page_number, false /* allow_free */));
+  }
+  zone_map->flush();
+  open_file_->zone_map = zone_map.release();
+}
+
+void PageFile::dropZoneMap() {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  delete open_file_->zone_map;
+  open_file_->zone_map = NULL;
+  if (ZoneMap::exists(filename())) {
+    ZoneMap::remove(filename());
+  }
+}
+
+bool PageFile::hasZoneMap() const {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  return open_file_->zone_map != NULL;
+}
+
+bool PageFile::mayMatch(const PageId page_number,
+                        const ScanPredicate& predicate) const {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  return open_file_->zone_map == NULL ||
+         open_file_->zone_map->mayMatch(page_number, predicate);
 }
 
 PageHeader PageFile::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char*>(&header), sizeof(PageHeader));
+  readBytes(pagePosition(page_number), &header, sizeof(PageHeader));
   return header;
 }
 
+PageLinks& PageFile::pageLinks(const PageId page_number) const {
+  std::vector<PageLinks>& links = open_file_->metadata.links;
+  if (page_number >= links.size()) {
+    links.resize(page_number + 1, PageLinks());
+  }
+  PageLinks& entry = links[page_number];
+  if (!entry.loaded) {
+    const PageDirectory& directory = *open_file_->directory;
+    if (directory.isUsed(page_number)) {
+      // The used list is in page number order.
+      entry.used = true;
+      entry.next_page_number = directory.nextUsed(page_number);
+      entry.prev_page_number = directory.prevUsed(page_number);
+    } else {
+      const PageHeader header = readPageHeader(page_number);
+      entry.used = false;
+      entry.next_page_number = header.next_page_number;
+      entry.prev_page_number = header.prev_page_number;
+    }
+    entry.loaded = true;
+    entry.dirty = false;
+  }
+  return entry;
+}
+
+bool PageFile::isUsed(const PageId page_number) const {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  return page_number != Page::INVALID_NUMBER &&
+         page_number < readHeader().num_pages &&
+         open_file_->directory->isUsed(page_number);
+}
+
+void PageFile::openDirectory(const bool create_new) {
+  const FileHeader header = readHeader();
+  std::unique_ptr<PageDirectory> directory(
+      new PageDirectory(filename(), create_new, header));
+  if (!create_new && !directory->complete()) {
+    // Missing, unclean or stale (e.g. the file was recovered from the log):
+    // read every page header once to rebuild it.
+    directory->clear();
+    std::vector<PageLinks>& links = open_file_->metadata.links;
+    links.resize(std::max<std::size_t>(links.size(), header.num_pages),
+                 PageLinks());
+    for (PageId page_number = 1; page_number < header.num_pages;
+         ++page_number) {
+      const PageHeader page_header = readPageHeader(page_number);
+      PageLinks& entry = links[page_number];
+      entry.used = page_header.current_page_number != Page::INVALID_NUMBER;
+      entry.loaded = true;
+      entry.dirty = false;
+      entry.next_page_number = page_header.next_page_number;
+      entry.prev_page_number = page_header.prev_page_number;
+      if (entry.used) {
+        directory->setUsed(page_number, true);
+      }
+    }
+  }
+  open_file_->directory = directory.release();
+}
+
+void PageFile::findUsedNeighbours(const FileHeader& header,
+                                  const PageId page_number, PageId& prev,
+                                  PageId& next) const {
+  prev = Page::INVALID_NUMBER;
+  next = Page::INVALID_NUMBER;
+  if (header.first_used_page == Page::INVALID_NUMBER) {
+    return;
+  }
+  if (page_number < header.first_used_page) {
+    next = header.first_used_page;
+    return;
+  }
+  if (page_number > header.last_used_page) {
+    prev = header.last_used_page;
+    return;
+  }
+  // The used list is in page number order, so any used page near it leads
+  // to the place through its links.
+  const PageId near = open_file_->directory->usedPageNear(page_number);
+  if (near < page_number) {
+    prev = near;
+    next = pageLinks(prev).next_page_number;
+  } else {
+    next = near;
+    prev = pageLinks(next).prev_page_number;
+  }
+}
+
+PageId PageFile::nextPageNumber(const PageId page_number) const {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  return pageLinks(page_number).next_page_number;
+}
+
+void PageFile::markLinksDirty(const PageId page_number) {
+  PageLinks& entry = open_file_->metadata.links[page_number];
+  if (!entry.dirty) {
+    entry.dirty = true;
+    open_file_->metadata.dirty_links.push_back(page_number);
+  }
+}
+
 
 
 
-BlobFile BlobFile::create(const std::string& filename) {
-  return BlobFile(filename, true /* create_new */);
+BlobFile BlobFile::create(const std::string& filename,
+                       const BackendFactory& backend) {
+  return BlobFile(filename, true /* create_new */, backend);
 }
 
-BlobFile BlobFile::open(const std::string& filename) {
-  return BlobFile(filename, false /* create_new */);
+BlobFile BlobFile::open(const std::string& filename,
+                     const BackendFactory& backend) {
+  return BlobFile(filename, false /* create_new */, backend);
 }
 
-BlobFile::BlobFile(const std::string& name, const bool create_new)
-: File(name, create_new) {
+BlobFile::BlobFile(const std::string& name, const bool create_new,
+                   const BackendFactory& backend)
+: File(name, create_new, backend) {
 }
 
 BlobFile::~BlobFile() {
 }
 
 BlobFile::BlobFile(const BlobFile& other)
-: File(other.filename_, false /* create_new */)
+: File(other)
 {
 }
 
 BlobFile& BlobFile::operator=(const BlobFile& rhs) {
   // This accounts for self-assignment and assignment of a File object for the
   // same file.
-  close();	//close my file and associate me with the new one
-  filename_ = rhs.filename_;
-  openIfNeeded(false /* create_new */);
+  if (open_file_ != rhs.open_file_) {
+    close();	//close my file and associate me with the new one
+    attach(rhs);
+  }
   return *this;
 }
 
 Page BlobFile::allocatePage(PageId &new_page_number) {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
   FileHeader header = readHeader();
 	Page new_page;
 
@@ -380,20 +956,33 @@ Page BlobFile::allocatePage(PageId &new_page_number) {
 
 Page BlobFile::readPage(const PageId page_number) const {
 	Page page;
-	stream_->seekg(pagePosition(page_number), std::ios::beg);
-	stream_->read(reinterpret_cast<char*>(&page), Page::SIZE);
+	readBytes(pagePosition(page_number), &page, Page::SIZE);
 	return page;
 }
 
+void BlobFile::readPages(const PageId first, const std::uint32_t count,
+                         Page* const* dst) const {
+	readPageRun(first, count, dst);
+}
+
 void BlobFile::writePage(const PageId new_page_number, const Page& new_page) {
-	stream_->seekp(pagePosition(new_page_number), std::ios::beg);
-	stream_->write(reinterpret_cast<const char*>(&new_page), Page::SIZE);
-	stream_->flush();
+	writeBytes(pagePosition(new_page_number), &new_page, Page::SIZE);
+}
+
+void BlobFile::completeRead(const PageId page_number, Page& page) const {
+}
+
+IoRequest BlobFile::writeRequest(const PageId page_number, const Page& page,
+                                 Page* image) {
+  *image = page;
+  IoRequest request = readRequest(page_number, image);
+  request.write = true;
+  return request;
 }
 
 //delePage should not be called for a blob_file, not supported
 void BlobFile::deletePage(const PageId page_number) {
-	throw InvalidPageException(page_number, filename_);
+	throw InvalidPageException(page_number, filename());
 }
 
 }
@@ -7,17 +7,56 @@
 
 #pragma once
 
-#include <fstream>
+#include <sys/types.h>
+#include <cstdint>
+#include <mutex>
 #include <string>
-#include <map>
-#include <memory>
+#include <vector>
 
+#include "file_backend.h"
+#include "io_engine.h"
 #include "page.h"
+#include "page_directory.h"
+#include "zone_map.h"
 
 namespace badgerdb {
 
 class FileIterator;
 
+/**
+ * @brief In-memory copy of the link fields of a page header.
+ *
+ * These are the only parts of a page header the file itself changes when
+ * pages are allocated and deleted, so they are cached per page and written
+ * back lazily rather than rewriting neighbouring pages on every change.
+ */
+struct PageLinks {
+  /**
+   * Whether the page is in use (as opposed to being on the free list).
+   */
+  bool used;
+
+  /**
+   * Whether this entry has been filled in from disk yet.
+   */
+  bool loaded;
+
+  /**
+   * Whether this entry has changed since it was last written to disk.
+   */
+  bool dirty;
+
+  /**
+   * Number of the next page in the used list (or free list, for free pages).
+   */
+  PageId next_page_number;
+
+  /**
+   * Number of the previous page in the used list.
+   */
+  PageId prev_page_number;
+};
+
 /**
  * @brief Header metadata for files on disk which contain pages.
  */
@@ -42,6 +81,12 @@ struct FileHeader {
    */
   PageId first_free_page;
 
+  /**
+   * Page number of the last used page in the file.  Pages that grow the file
+   * are appended to the used list here.
+   */
+  PageId last_used_page;
+
   /**
    * Returns true if this file header is equal to the other.
    *
@@ -52,23 +97,73 @@ struct FileHeader {
     return num_pages == rhs.num_pages &&
         num_free_pages == rhs.num_free_pages &&
         first_used_page == rhs.first_used_page &&
-        first_free_page == rhs.first_free_page;
+        first_free_page == rhs.first_free_page &&
+        last_used_page == rhs.last_used_page;
   }
 };
 
+/**
+ * @brief Link fields of one page header, as they are to be written to disk.
+ */
+struct PageLinkImage {
+  /**
+   * Number of the page the fields belong to.
+   */
+  PageId page_number;
+
+  /**
+   * Value of the page's current_page_number field (invalid for free pages).
+   */
+  PageId current_page_number;
+
+  /**
+   * Value of the page's next_page_number field.
+   */
+  PageId next_page_number;
+
+  /**
+   * Value of the page's prev_page_number field.
+   */
+  PageId prev_page_number;
+};
+
+/**
+ * @brief File metadata that has not been written to disk yet: the file header
+ *        and the page links changed since they were last written.
+ *
+ * Captured by the write-ahead log at commit and applied again by recovery.
+ */
+struct MetadataImage {
+  /**
+   * The file header.
+   */
+  FileHeader header;
+
+  /**
+   * Page links changed since they were last written to disk.
+   */
+  std::vector<PageLinkImage> links;
+};
+
 /**
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
- * fixed-sized pages, and they never deallocate space (though they do reuse
- * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * The File class wraps a descriptor for an underlying file on disk.  Files
+ * contain fixed-sized pages, and they never deallocate space (though they do
+ * reuse deleted pages if possible).  If multiple File objects refer to the same
+ * underlying file, they will share the descriptor in memory.
  * If a file that has already been opened (possibly by another query), then the File class
- * detects this (by looking in the open_streams_ map) and just returns a file object with
- * the already created stream for the file without actually opening the UNIX file again. 
+ * detects this (by looking in the open_files_ table) and just returns a file object with
+ * the already open descriptor for the file without actually opening the UNIX file again.
+ * Every open underlying file is identified by a FileId, made of its index in the
+ * open_files_ table and a count of opens that tells apart files that used the
+ * same index at different times.
  *
- * @warning This class is not threadsafe.
+ * Operations that use or change a file's cached metadata hold a per-file
+ * mutex, so pages of the same file may be read and written from several
+ * threads (a checkpointer writing pages while a query reads others, say).
+ * Opening and closing File objects is guarded by the open_files_ table's mutex.
  */
 
 
@@ -80,12 +175,16 @@ class File {
    *
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param backend     Makes the storage for the file; by default a new file is
+   *                    a plain file and an existing one is opened in the
+   *                    format it was created with.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  File(const std::string& name, const bool create_new);
+  File(const std::string& name, const bool create_new,
+       const BackendFactory& backend = BackendFactory());
 
   /**
    * Deletes an existing file.
@@ -134,6 +233,32 @@ class File {
    */
   virtual Page readPage(const PageId page_number) const = 0;
 
+  /**
+   * Reads a run of consecutive pages from the file into an array of pages
+   * with a single vectored read.
+   *
+   * @param first   Number of first page to read.
+   * @param count   Number of pages to read.
+   * @param dst     Array of at least <count> pages to read into.
+   * @throws  InvalidPageException  If any page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPages(const PageId first, const std::uint32_t count,
+                 Page* dst) const;
+
+  /**
+   * Reads a run of consecutive pages from the file into separate pages (such
+   * as buffer pool frames) with a single vectored read.
+   *
+   * @param first   Number of first page to read.
+   * @param count   Number of pages to read.
+   * @param dst     Array of <count> pointers to the pages to read into.
+   * @throws  InvalidPageException  If any page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  virtual void readPages(const PageId first, const std::uint32_t count,
+                         Page* const* dst) const = 0;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -150,21 +275,139 @@ class File {
    */
   virtual void deletePage(const PageId page_number) = 0;
 
+  /**
+   * Describes the read of a page's bytes from storage, for I/O done outside
+   * the file (e.g. by an IoEngine).  Once the bytes are in, completeRead()
+   * turns them into the page readPage() would have returned.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @return  The read, without a completion callback.
+   */
+  IoRequest readRequest(const PageId page_number, Page* page) const;
+
+  /**
+   * Finishes a page read through readRequest().
+   *
+   * @param page_number   Number of page read.
+   * @param page          Page holding the bytes read.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  virtual void completeRead(const PageId page_number, Page& page) const = 0;
+
+  /**
+   * Describes the write of a page, for I/O done outside the file.  <image> is
+   * set to the bytes writePage() would write; it is what gets written, so it
+   * must stay untouched until the write completes.  The file's metadata must
+   * not be flushed before then either.
+   *
+   * @param page_number   Number of page to write.
+   * @param page          Page to write.
+   * @param image         Set to the bytes to write.
+   * @return  The write, without a completion callback.
+   * @throws  InvalidPageException  If the page is not currently used.
+   */
+  virtual IoRequest writeRequest(const PageId page_number, const Page& page,
+                                 Page* image) = 0;
+
   /**
    * Returns the name of the file this object represents.
    *
    * @return Name of file.
    */
-  const std::string& filename() const { return filename_; }
+  const std::string& filename() const { return open_file_->filename; }
 
- 	/**
+  /**
+   * Returns the identifier of the underlying file.  All File objects open on
+   * the same underlying file share the same identifier.
+   *
+   * @return  Identifier of file.
+   */
+  FileId fileId() const { return file_id_; }
+
+  /**
+   * Drops the zone map entry of a page that was changed in memory (in a
+   * buffer pool, say), so that scans reading either the page on disk or the
+   * changed one do not skip it.  The entry is set from the page's records
+   * again when the page is written, rather than on every change.  Does
+   * nothing if the file has no zone map.
+   *
+   * @param page_number   Number of the page.
+   */
+  void noteChange(const PageId page_number);
+
+  /**
    * Returns pageid of first page in the file.
    *
    * @return  Iterator at first page of file.
    */
 	PageId getFirstPageNo();
 
+  /**
+   * Writes the cached file header and any page links changed since they were
+   * last written back to disk.  This happens automatically when the last File
+   * object for the underlying file is closed.
+   */
+  void flushMetadata();
+
+  /**
+   * Returns the metadata that flushMetadata() would write to disk right now,
+   * without writing it.
+   *
+   * @return  The file header and the changed page links.
+   */
+  MetadataImage metadataImage() const;
+
+  /**
+   * Writes a page image from the write-ahead log back into a file during
+   * recovery.  The link fields already on disk are kept, since the file
+   * maintains them separately (see redoMetadata()); the image's own are only
+   * used when the page does not exist on disk yet.  The file must not be open.
+   *
+   * @param filename      Name of the file.
+   * @param page_number   Number of the page.
+   * @param page          Page image.
+   */
+  static void redoPage(const std::string& filename, const PageId page_number,
+                       const Page& page);
+
+  /**
+   * Writes a metadata image from the write-ahead log back into a file during
+   * recovery.  The file must not be open.
+   *
+   * @param filename  Name of the file.
+   * @param image     Metadata image.
+   */
+  static void redoMetadata(const std::string& filename,
+                           const MetadataImage& image);
+
+  /**
+   * Forces everything written to a file so far onto stable storage.
+   *
+   * @param filename  Name of the file.
+   */
+  static void sync(const std::string& filename);
+
+  /**
+   * Writes the cached metadata of every open file to disk (see
+   * flushMetadata()).
+   */
+  static void flushAllMetadata();
+
+  /**
+   * Forces everything written to every open file so far onto stable storage.
+   */
+  static void syncAll();
+
  protected:
+  /**
+   * Constructs a file object sharing the underlying file of another one.
+   *
+   * @param other File object to copy.
+   */
+  File(const File& other);
+
   /**
    * Returns the position of the page with the given number in the file (as an
    * offset from the beginning of the file).
@@ -172,70 +415,216 @@ class File {
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+  static off_t pagePosition(const PageId page_number) {
+    return sizeof(FileHeader) + (off_t(page_number - 1) * Page::SIZE);
   }
 
   /**
-   * Opens the underlying file named in filename_.
+   * Opens the underlying file with the given name.
    * This method only opens the file if no other File objects exist that access
-   * the same filesystem file; otherwise, it reuses the existing stream.
+   * the same filesystem file; otherwise, it reuses the existing descriptor.
    *
+   * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param backend     Makes the storage for the file if it is not open yet.
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  void openIfNeeded(const bool create_new);
+  void openIfNeeded(const std::string& name, const bool create_new,
+                    const BackendFactory& backend);
 
   /**
-   * Closes the underlying file stream in <stream_>.
+   * Makes this object refer to the same underlying file as another one.
+   *
+   * @param other File object whose underlying file to share.
+   */
+  void attach(const File& other);
+
+  /**
+   * Closes the underlying file descriptor.
    * This method only closes the file if no other File objects exist that access
-   * the same file.
+   * the same file, in which case the cached metadata is flushed first.
    */
   void close();
 
   /**
-   * Reads the header for this file from disk.
+   * Returns the header for this file.  The header is read from disk when the
+   * file is opened and served from memory afterwards.
    *
    * @return  The file header.
    */
   FileHeader readHeader() const;
 
   /**
-   * Writes the given header to the disk as the header for this file.
+   * Replaces the header for this file.  The new header is written back to
+   * disk by flushMetadata().
    *
    * @param header  File header to write.
    */
   void writeHeader(const FileHeader& header);
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream> > StreamMap;
-  typedef std::map<std::string, int> CountMap;
+  /**
+   * Reads bytes from the underlying file.  Any part of the range past the end
+   * of the file reads as zeroes.
+   *
+   * @param offset  Offset in file to read from.
+   * @param data    Buffer to read into.
+   * @param length  Number of bytes to read.
+   */
+  void readBytes(const off_t offset, void* data, const std::size_t length) const;
+
+  /**
+   * Writes bytes to the underlying file, extending it if necessary.
+   *
+   * @param offset  Offset in file to write at.
+   * @param data    Bytes to write.
+   * @param length  Number of bytes to write.
+   */
+  void writeBytes(const off_t offset, const void* data,
+                  const std::size_t length);
+
+  /**
+   * Reads a run of consecutive pages from the underlying file with as few
+   * vectored reads as possible.  No bounds checking is performed.
+   *
+   * @param first   Number of first page to read.
+   * @param count   Number of pages to read.
+   * @param dst     Array of <count> pointers to the pages to read into.
+   */
+  void readPageRun(const PageId first, const std::uint32_t count,
+                   Page* const* dst) const;
 
   /**
-   * Streams for opened files.
+   * @brief Metadata cached in memory for an open file, shared by every File
+   *        object that refers to it.
    */
-  static StreamMap open_streams_;
+  struct FileMetadata {
+    /**
+     * Cached copy of the file header.
+     */
+    FileHeader header;
+
+    /**
+     * Whether the header has changed since it was last written to disk.
+     */
+    bool header_dirty;
+
+    /**
+     * Cached page links, indexed by page number.
+     */
+    std::vector<PageLinks> links;
+
+    /**
+     * Numbers of pages whose entry in <links> is dirty.
+     */
+    std::vector<PageId> dirty_links;
+  };
 
   /**
-   * Counts for opened files.
+   * @brief Entry in the open file table for one open underlying file.
    */
-  static CountMap open_counts_;
+  struct OpenFile {
+    /**
+     * Name of the file.
+     */
+    std::string filename;
+
+    /**
+     * FileId of the file while it stays open.
+     */
+    FileId id;
+
+    /**
+     * Storage of the file.
+     */
+    FileBackend* backend;
+
+    /**
+     * Number of File objects referring to the file.
+     */
+    int open_count;
+
+    /**
+     * Cached metadata for the file.
+     */
+    FileMetadata metadata;
+
+    /**
+     * Zone map of the file, or NULL if it has none.
+     */
+    ZoneMap* zone_map;
+
+    /**
+     * Page directory of the file, or NULL if it is not a PageFile.
+     */
+    PageDirectory* directory;
+
+    /**
+     * Guards <metadata>, <zone_map> and <directory>.  Taken after
+     * open_files_mutex_ when both are needed.
+     */
+    std::mutex mutex;
+  };
 
   /**
-   * Name of the file this object represents.
+   * Open files, indexed by the slot (low 32 bits) of their FileId.  Slots of
+   * closed files are NULL and are reused by the next file opened.
    */
-  std::string filename_;
+  static std::vector<OpenFile*> open_files_;
 
   /**
-   * Stream for underlying filesystem object.
+   * Number of files opened so far; the high 32 bits of each new FileId, so
+   * that pages a buffer pool still holds for a closed file are never taken
+   * for pages of the next file opened in its slot.
    */
-  std::shared_ptr<std::fstream> stream_;
+  static std::uint32_t num_opens_;
+
+  /**
+   * Guards open_files_ and the open counts of its entries.
+   */
+  static std::mutex open_files_mutex_;
+
+  /**
+   * Writes the cached metadata of an open file back to disk, like
+   * flushMetadata(), for callers already holding the entry's mutex.
+   *
+   * @param entry   Entry in open_files_ of the file.
+   */
+  static void writeMetadata(OpenFile& entry);
+
+  /**
+   * Entry in open_files_ of the file this object represents.
+   */
+  OpenFile* open_file_;
+
+  /**
+   * Identifier of the file this object represents.
+   */
+  FileId file_id_;
 
   friend class FileIterator;
 };
 
+/**
+ * @brief Records that compaction moved a page to a new page number.
+ *
+ * Slots are preserved when a page moves, so a record with ID
+ * {old_page_number, slot} has ID {new_page_number, slot} afterwards.
+ */
+struct PageRemap {
+  /**
+   * Number of the page before compaction.
+   */
+  PageId old_page_number;
+
+  /**
+   * Number of the page after compaction.
+   */
+  PageId new_page_number;
+};
+
 class PageFile : public File {
  public:
 
@@ -243,33 +632,40 @@ class PageFile : public File {
    * Creates a new file.
    *
    * @param filename  Name of the file.
+   * @param backend   Makes the storage for the file (a plain file by default).
    * @throws  FileExistsException     If the requested file already exists.
    */
-  static PageFile create(const std::string& filename);
+  static PageFile create(const std::string& filename,
+                       const BackendFactory& backend = BackendFactory());
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
-	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
-	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
-	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * It first checks if the file is already open. If so, then the new File object created uses the same descriptor to read to or write fom
+	 * that already open file. Reference count (open_count in the file's open_files_ entry) is incremented whenever an already open file is
+	 * opened again. Otherwise the UNIX file is actually opened, and a new entry for it is added to the open_files_ table, which
+	 * assigns the file its FileId.
    *
    * @param filename  Name of the file.
+   * @param backend   Makes the storage for the file if it is not open yet (by
+   *                  default, in the format the file was created with).
    * @throws  FileNotFoundException   If the requested file doesn't exist.
    */
-  static PageFile open(const std::string& filename);
+  static PageFile open(const std::string& filename,
+                     const BackendFactory& backend = BackendFactory());
 
   /**
    * Constructs a file object representing a file on the filesystem.
    *
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param backend     Makes the storage for the file (see File::File()).
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  PageFile(const std::string& name, const bool create_new);
+  PageFile(const std::string& name, const bool create_new,
+           const BackendFactory& backend = BackendFactory());
 
   /**
    * Copy constructor.
@@ -294,7 +690,9 @@ class PageFile : public File {
   ~PageFile();
 
   /**
-   * Allocates a new page in the file.
+   * Allocates a new page in the file.  A free page is reused if one exists.
+   * Either way the page is linked into the used list in page number order, so
+   * iterators visit pages in physical order.
    *
    * @return The new page.
    */
@@ -310,6 +708,21 @@ class PageFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  using File::readPages;
+
+  /**
+   * Reads a run of consecutive pages from the file into separate pages with a
+   * single vectored read.
+   *
+   * @param first   Number of first page to read.
+   * @param count   Number of pages to read.
+   * @param dst     Array of <count> pointers to the pages to read into.
+   * @throws  InvalidPageException  If any page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPages(const PageId first, const std::uint32_t count,
+                 Page* const* dst) const override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -320,12 +733,34 @@ class PageFile : public File {
   void writePage(const PageId page_number, const Page& new_page) override;
 
   /**
-   * Deletes a page from the file.
+   * Deletes a page from the file.  The page is unlinked from the used list
+   * through its previous and next pointers and pushed onto the free list, so
+   * the cost does not depend on the size of the file.
    *
    * @param page_number   Number of page to delete.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
    */
   void deletePage(const PageId page_number) override;
 
+  /**
+   * Finishes a page read through readRequest(), applying the cached page
+   * links.
+   */
+  void completeRead(const PageId page_number, Page& page) const override;
+
+  IoRequest writeRequest(const PageId page_number, const Page& page,
+                         Page* image) override;
+
+  /**
+   * Returns whether the given page is a used page of the file, as pages an
+   * iterator visits are.
+   *
+   * @param page_number   Number of the page.
+   * @return  Whether the page exists and is in use.
+   */
+  bool isUsed(const PageId page_number) const;
+
   /**
    * Returns an iterator at the first page in the file.
    *
@@ -341,14 +776,75 @@ class PageFile : public File {
    */
   FileIterator end();
 
+  /**
+   * Compacts the file in place: used pages are moved so that they occupy
+   * pages 1 to n contiguously, in the order of the used list, and the space
+   * of free pages is returned to the filesystem.  Afterwards the used list
+   * follows physical order again, so scans read the file sequentially.
+   *
+   * Pages are moved with their slots intact; the returned remapping tells
+   * callers (such as indexes holding RecordIds) where each moved page went.
+   * None of the file's pages may be cached in a buffer pool while this runs;
+   * BufMgr::compactFile flushes them first.
+   *
+   * @return  The pages that moved, sorted by old page number.
+   */
+  std::vector<PageRemap> compact();
+
+  /**
+   * Builds a zone map of the file (see ZoneMap), replacing any it has, by
+   * reading every used page.  From then on the zone map is kept up to date as
+   * pages are allocated, written and deleted, and as pages changed in a
+   * buffer pool are released (see File::noteChange()); it is dropped if
+   * recovery writes pages of the file.
+   *
+   * Pages changed in a buffer pool but not written yet are not seen; flush
+   * the file from buffer pools first (BufMgr::flushFile).
+   *
+   * @param attributes  Attributes to keep the bounds of on each page.
+   * @throws  BadScanParamException   If a STRING attribute has no length.
+   */
+  void createZoneMap(const std::vector<ZoneAttribute>& attributes);
+
+  /**
+   * Deletes the file's zone map, if it has one.
+   */
+  void dropZoneMap();
+
+  /**
+   * Returns whether the file has a zone map.
+   */
+  bool hasZoneMap() const;
+
+  /**
+   * Returns whether a page may hold records a predicate matches: false only
+   * if the file's zone map rules that out.
+   *
+   * @param page_number   Number of the page.
+   * @param predicate     The predicate.
+   */
+  bool mayMatch(const PageId page_number, const ScanPredicate& predicate) const;
+
+  /**
+   * Translates a record ID through a remapping returned by compact().
+   *
+   * @param remap       Remapping returned by compact().
+   * @param record_id   Record ID from before compaction.
+   * @return  ID of the same record after compaction.
+   */
+  static RecordId remapRecordId(const std::vector<PageRemap>& remap,
+                                const RecordId& record_id);
+
  private:
 
   /**
-   * Reads a page from the file.  If <allow_free> is not set, an exception
-   * will be thrown if the page read from disk is not currently in use.
+   * Reads a page from the file with a single read of its header and data.  If
+   * <allow_free> is not set, an exception will be thrown if the page is not
+   * currently in use.  The link fields of the returned page are taken from
+   * the link cache, which may be newer than what is on disk.
    *
-   * No bounds checking is performed; the underlying file stream will throw
-   * an exception if the page is past the end of the file.
+   * No bounds checking is performed; a page past the end of the file reads
+   * as a free page.
    *
    * @param page_number   Number of page to read.
    * @param allow_free    Whether to allow reading a free (unused) page.
@@ -358,6 +854,17 @@ class PageFile : public File {
    */
   Page readPage(const PageId page_number, const bool allow_free) const;
 
+  /**
+   * Brings a page just read from disk and the link cache in line with each
+   * other: fills the cache from the page the first time the page is seen, and
+   * otherwise overwrites the page's link fields with the cached ones.
+   *
+   * @param page_number   Number of page that was read.
+   * @param page          Page as read from disk.
+   * @return  Whether the page is in use.
+   */
+  bool applyPageLinks(const PageId page_number, Page& page) const;
+
   /**
    * Writes a page into the file at the given page number with the given header.
    * This does not ensure that the number in the header equals the position on
@@ -379,6 +886,56 @@ class PageFile : public File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
+  /**
+   * Opens the page directory of the file, or rebuilds it from the page
+   * headers (filling the link cache along the way) if it is not complete.
+   * Called with the file's mutex held.
+   *
+   * @param create_new  Whether the file was just created.
+   */
+  void openDirectory(const bool create_new);
+
+  /**
+   * Returns the cached links of the given page, filling them in the first
+   * time the page is seen: from the page directory for a used page, and from
+   * its header on disk for a free page, whose next link is the free list's.
+   * No bounds checking is performed.
+   *
+   * @param page_number   Number of page whose links are requested.
+   * @return  Cached links of the page.
+   */
+  PageLinks& pageLinks(const PageId page_number) const;
+
+  /**
+   * Finds where in the used list a page that is not in it belongs: between
+   * the used pages nearest to it below and above, found in the page
+   * directory.
+   *
+   * @param header        The file header.
+   * @param page_number   Number of the page.
+   * @param prev          Set to the used page before it, or
+   *                      Page::INVALID_NUMBER if it goes at the head.
+   * @param next          Set to the used page after it, or
+   *                      Page::INVALID_NUMBER if it goes at the tail.
+   */
+  void findUsedNeighbours(const FileHeader& header, const PageId page_number,
+                          PageId& prev, PageId& next) const;
+
+  /**
+   * Returns the number of the page after the given one in the used list.
+   *
+   * @param page_number   Number of a used page.
+   * @return  Number of the next used page, or Page::INVALID_NUMBER.
+   */
+  PageId nextPageNumber(const PageId page_number) const;
+
+  /**
+   * Marks the cached links of the given page as needing to be written back.
+   *
+   * @param page_number   Number of page whose links changed.
+   */
+  void markLinksDirty(const PageId page_number);
+
   friend class FileIterator;
 };
 
@@ -389,21 +946,26 @@ class BlobFile : public File {
    * Creates a new BlobFile.
    *
    * @param filename  Name of the file.
+   * @param backend   Makes the storage for the file (a plain file by default).
    * @throws  FileExistsException     If the requested file already exists.
    */
-  static BlobFile create(const std::string& filename);
+  static BlobFile create(const std::string& filename,
+                       const BackendFactory& backend = BackendFactory());
 
   /**
    * Opens the file named fileName and returns the corresponding File object.
-	 * It first checks if the file is already open. If so, then the new File object created uses the same input-output stream to read to or write fom
-	 * that already open file. Reference count (open_counts_ static variable inside the File object) is incremented whenever an already open file is
-	 * opened again. Otherwise the UNIX file is actually opened. The fileName and the stream associated with this File object are inserted into the
-	 * open_streams_ map.
+	 * It first checks if the file is already open. If so, then the new File object created uses the same descriptor to read to or write fom
+	 * that already open file. Reference count (open_count in the file's open_files_ entry) is incremented whenever an already open file is
+	 * opened again. Otherwise the UNIX file is actually opened, and a new entry for it is added to the open_files_ table, which
+	 * assigns the file its FileId.
    *
    * @param filename  Name of the file.
+   * @param backend   Makes the storage for the file if it is not open yet (by
+   *                  default, in the format the file was created with).
    * @throws  FileNotFoundException   If the requested file doesn't exist.
    */
-  static BlobFile open(const std::string& filename);
+  static BlobFile open(const std::string& filename,
+                     const BackendFactory& backend = BackendFactory());
 
   /**
    * Constructs a file object representing a file on the filesystem.
@@ -412,12 +974,14 @@ class BlobFile : public File {
    * @see File::open()
    * @param name        Name of file.
    * @param create_new  Whether to create a new file.
+   * @param backend     Makes the storage for the file (see File::File()).
    * @throws  FileExistsException     If the underlying file exists and
    *                                  create_new is true.
    * @throws  FileNotFoundException   If the underlying file doesn't exist and
    *                                  create_new is false.
    */
-  BlobFile(const std::string& name, const bool create_new);
+  BlobFile(const std::string& name, const bool create_new,
+           const BackendFactory& backend = BackendFactory());
 
   /**
    * Copy constructor.
@@ -458,6 +1022,21 @@ class BlobFile : public File {
    */
   Page readPage(const PageId page_number) const override;
 
+  using File::readPages;
+
+  /**
+   * Reads a run of consecutive pages from the file into separate pages with a
+   * single vectored read.
+   *
+   * @param first   Number of first page to read.
+   * @param count   Number of pages to read.
+   * @param dst     Array of <count> pointers to the pages to read into.
+   * @throws  InvalidPageException  If any page doesn't exist in the file or is
+   *                                not currently used.
+   */
+  void readPages(const PageId first, const std::uint32_t count,
+                 Page* const* dst) const override;
+
   /**
    * Writes a page into the file at the given page number.
    * No bounds checking is performed.
@@ -473,6 +1052,11 @@ class BlobFile : public File {
    * @param page_number   Number of page to delete.
    */
   void deletePage(const PageId page_number) override;
+
+  void completeRead(const PageId page_number, Page& page) const override;
+
+  IoRequest writeRequest(const PageId page_number, const Page& page,
+                         Page* image) override;
 };
 
 }
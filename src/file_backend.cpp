@@ -0,0 +1,178 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "file_backend.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <climits>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+#include "compressed_backend.h"
+#include "mem_backend.h"
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/io_error_exception.h"
+
+namespace badgerdb {
+
+FileBackend::~FileBackend() {
+}
+
+void FileBackend::readv(const off_t offset, void* const* buffers,
+                        const std::size_t buffer_length,
+                        const std::uint32_t count) {
+  for (std::uint32_t i = 0; i < count; ++i) {
+    read(offset + off_t(i) * buffer_length, buffers[i], buffer_length);
+  }
+}
+
+int FileBackend::descriptor() const {
+  return -1;
+}
+
+FileBackend* FileBackend::open(const std::string& filename,
+                               const bool create_new) {
+  if (!create_new && MemBackend::exists(filename)) {
+    return new MemBackend(filename, false /* create_new */);
+  }
+  if (!create_new && CompressedBackend::isCompressed(filename)) {
+    return new CompressedBackend(filename, false /* create_new */);
+  }
+  return new DiskBackend(filename, create_new);
+}
+
+void FileBackend::remove(const std::string& filename) {
+  if (MemBackend::exists(filename)) {
+    MemBackend::remove(filename);
+    return;
+  }
+  if (CompressedBackend::isCompressed(filename)) {
+    CompressedBackend::remove(filename);
+  }
+  ::unlink(filename.c_str());
+}
+
+DiskBackend::DiskBackend(const std::string& filename, const bool create_new)
+    : filename_(filename), fd_(-1) {
+  int flags = O_RDWR;
+  if (create_new) {
+    // New files have to be truncated on open.
+    flags |= O_CREAT | O_TRUNC;
+  }
+  fd_ = ::open(filename.c_str(), flags, 0644);
+  if (fd_ < 0) {
+    throw FileNotFoundException(filename);
+  }
+}
+
+DiskBackend::~DiskBackend() {
+  ::close(fd_);
+}
+
+void DiskBackend::read(const off_t offset, void* data,
+                       const std::size_t length) {
+  char* buffer = static_cast<char*>(data);
+  std::size_t done = 0;
+  while (done < length) {
+    const ssize_t result =
+        ::pread(fd_, buffer + done, length - done, offset + done);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result < 0) {
+      throw IoErrorException(filename_, "read", errno);
+    }
+    if (result == 0) {
+      // Past the end of the file.
+      memset(buffer + done, 0, length - done);
+      break;
+    }
+    done += result;
+  }
+}
+
+void DiskBackend::readv(const off_t offset, void* const* buffers,
+                        const std::size_t buffer_length,
+                        const std::uint32_t count) {
+  std::uint32_t done = 0;
+  while (done < count) {
+    // Ranges are read straight into their buffers, IOV_MAX at a time.
+    struct iovec iov[IOV_MAX];
+    const std::uint32_t batch = std::min<std::uint32_t>(count - done, IOV_MAX);
+    for (std::uint32_t i = 0; i < batch; ++i) {
+      iov[i].iov_base = buffers[done + i];
+      iov[i].iov_len = buffer_length;
+    }
+    const std::size_t length = std::size_t(batch) * buffer_length;
+    const off_t batch_offset = offset + off_t(done) * buffer_length;
+    ssize_t result;
+    do {
+      result = ::preadv(fd_, iov, batch, batch_offset);
+    } while (result < 0 && errno == EINTR);
+    if (result < 0) {
+      throw IoErrorException(filename_, "read", errno);
+    }
+    if (std::size_t(result) < length) {
+      // Short read (or past the end of the file): finish the rest of the
+      // batch range by range.
+      for (std::uint32_t i = result / buffer_length; i < batch; ++i) {
+        read(batch_offset + off_t(i) * buffer_length, buffers[done + i],
+             buffer_length);
+      }
+    }
+    done += batch;
+  }
+}
+
+void DiskBackend::write(const off_t offset, const void* data,
+                        const std::size_t length) {
+  const char* buffer = static_cast<const char*>(data);
+  std::size_t done = 0;
+  while (done < length) {
+    const ssize_t result =
+        ::pwrite(fd_, buffer + done, length - done, offset + done);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      throw IoErrorException(filename_, "write", result < 0 ? errno : 0);
+    }
+    done += result;
+  }
+}
+
+void DiskBackend::truncate(const off_t length) {
+  while (::ftruncate(fd_, length) < 0) {
+    if (errno != EINTR) {
+      throw IoErrorException(filename_, "truncate", errno);
+    }
+  }
+}
+
+off_t DiskBackend::size() {
+  struct stat file_stat;
+  if (::fstat(fd_, &file_stat) != 0) {
+    throw IoErrorException(filename_, "stat", errno);
+  }
+  return file_stat.st_size;
+}
+
+void DiskBackend::sync() {
+  if (::fsync(fd_) != 0) {
+    throw IoErrorException(filename_, "sync", errno);
+  }
+}
+
+int DiskBackend::descriptor() const {
+  return fd_;
+}
+
+}
@@ -0,0 +1,167 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace badgerdb {
+
+/**
+ * @brief Storage underneath a File: a flat, byte-addressed space the file's
+ *        header and pages are laid out in.
+ *
+ * The plain implementation is a file in the filesystem (DiskBackend); others
+ * store the same bytes differently, e.g. compressed or in memory.  Backends must allow
+ * reads and writes of different ranges from several threads at once.
+ */
+class FileBackend {
+ public:
+  /**
+   * Closes the storage.
+   */
+  virtual ~FileBackend();
+
+  /**
+   * Reads bytes.  Any part of the range past the end reads as zeroes.
+   *
+   * @param offset  Offset to read from.
+   * @param data    Buffer to read into.
+   * @param length  Number of bytes to read.
+   */
+  virtual void read(const off_t offset, void* data,
+                    const std::size_t length) = 0;
+
+  /**
+   * Reads a run of equally sized, consecutive ranges into separate buffers.
+   * The default reads them one by one.
+   *
+   * @param offset          Offset of the first range.
+   * @param buffers         Array of <count> buffers to read into.
+   * @param buffer_length   Length of each range.
+   * @param count           Number of ranges.
+   */
+  virtual void readv(const off_t offset, void* const* buffers,
+                     const std::size_t buffer_length,
+                     const std::uint32_t count);
+
+  /**
+   * Writes bytes, extending the storage if necessary.
+   *
+   * @param offset  Offset to write at.
+   * @param data    Bytes to write.
+   * @param length  Number of bytes to write.
+   */
+  virtual void write(const off_t offset, const void* data,
+                     const std::size_t length) = 0;
+
+  /**
+   * Cuts the storage off at the given length.
+   *
+   * @param length  New length.
+   */
+  virtual void truncate(const off_t length) = 0;
+
+  /**
+   * Returns the length of the storage.
+   */
+  virtual off_t size() = 0;
+
+  /**
+   * Forces everything written so far onto stable storage.
+   */
+  virtual void sync() = 0;
+
+  /**
+   * Returns a descriptor through which the bytes can be read and written
+   * directly at their offsets (see IoEngine), or -1 if there is none.
+   */
+  virtual int descriptor() const;
+
+  /**
+   * Opens the storage of a file in whatever format it was created with, or
+   * creates a file in the plain format.  Existence is not checked; File does
+   * that before calling this.
+   *
+   * @param filename    Name of the file.
+   * @param create_new  Whether to create the file.
+   * @return  New backend; the caller owns it.
+   */
+  static FileBackend* open(const std::string& filename, const bool create_new);
+
+  /**
+   * Deletes the storage of a file, in whatever format.
+   *
+   * @param filename  Name of the file.
+   */
+  static void remove(const std::string& filename);
+};
+
+/**
+ * @brief Makes the backend for a file: called with the file's name and whether
+ *        the file is to be created.
+ */
+typedef std::function<FileBackend*(const std::string& filename,
+                                   const bool create_new)> BackendFactory;
+
+/**
+ * @brief Backend storing the bytes as they are in a file in the filesystem.
+ *
+ * Failed reads, writes and syncs throw IoErrorException; only the part of a
+ * read past the end of the file reads as zeroes.
+ */
+class DiskBackend : public FileBackend {
+ public:
+  /**
+   * Opens (or creates, truncating it) the file with the given name.
+   *
+   * @param filename    Name of the file.
+   * @param create_new  Whether to create the file.
+   * @throws  FileNotFoundException   If the file cannot be opened.
+   */
+  DiskBackend(const std::string& filename, const bool create_new);
+
+  /**
+   * Closes the file.
+   */
+  ~DiskBackend();
+
+  void read(const off_t offset, void* data, const std::size_t length);
+
+  /**
+   * Reads the ranges with as few vectored reads as possible.
+   */
+  void readv(const off_t offset, void* const* buffers,
+             const std::size_t buffer_length, const std::uint32_t count);
+
+  void write(const off_t offset, const void* data, const std::size_t length);
+
+  void truncate(const off_t length);
+
+  off_t size();
+
+  void sync();
+
+  int descriptor() const;
+
+ private:
+  /**
+   * Name of the file.
+   */
+  std::string filename_;
+
+  /**
+   * Descriptor of the file.
+   */
+  int fd_;
+};
+
+}
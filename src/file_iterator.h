@@ -39,8 +39,7 @@ class FileIterator {
   FileIterator(PageFile* file)
       : file_(file) {
     assert(file_ != NULL);
-    const FileHeader& header = file_->readHeader();
-    current_page_number_ = header.first_used_page;
+    current_page_number_ = file_->getFirstPageNo();
   }
 
   /**
@@ -60,8 +59,7 @@ class FileIterator {
    */
 	inline FileIterator& operator++() {
     assert(file_ != NULL);
-    const PageHeader& header = file_->readPageHeader(current_page_number_);
-    current_page_number_ = header.next_page_number;
+    current_page_number_ = file_->nextPageNumber(current_page_number_);
 
 		return *this;
 	}
@@ -72,8 +70,7 @@ class FileIterator {
 		FileIterator tmp = *this;   // copy ourselves
 
     assert(file_ != NULL);
-    const PageHeader& header = file_->readPageHeader(current_page_number_);
-    current_page_number_ = header.next_page_number;
+    current_page_number_ = file_->nextPageNumber(current_page_number_);
 
 		return tmp;
 	}
@@ -85,12 +82,12 @@ class FileIterator {
    * @return    True if other iterator is equal to this one.
    */
 	inline bool operator==(const FileIterator& rhs) const {
-    return file_->filename() == rhs.file_->filename() &&
+    return file_->fileId() == rhs.file_->fileId() &&
         current_page_number_ == rhs.current_page_number_;
   }
 
 	inline bool operator!=(const FileIterator& rhs) const {
-    return (file_->filename() != rhs.file_->filename()) ||
+    return (file_->fileId() != rhs.file_->fileId()) ||
         (current_page_number_ != rhs.current_page_number_);
   }
 
@@ -103,6 +100,17 @@ class FileIterator {
 	inline Page operator*() const
   { return file_->readPage(current_page_number_); }
 
+  /**
+   * Returns the number of the page the iterator is currently pointing to,
+   * without reading the page from the file.
+   *
+   * @return  Number of current page.
+   */
+	PageId getCurrentPageNo() const
+	{
+		return current_page_number_;
+	}
+
  private:
   /**
    * File we're iterating over.
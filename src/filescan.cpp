@@ -6,10 +6,35 @@
  */
 
 #include "filescan.h"
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include "exceptions/bad_scan_param_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/invalid_page_exception.h"
 
 namespace badgerdb { 
 
+std::map<std::pair<const BufMgr*, FileId>, FileScan::Sweep> FileScan::sweeps;
+std::mutex FileScan::sweepsMutex;
+
+namespace {
+
+/**
+ * Bytes of a token of FileScan::getResumeToken().
+ */
+struct ResumeToken
+{
+  static const std::uint32_t MAGIC = 0x5343414e;  // "SCAN"
+
+  std::uint32_t magic;
+  PageId        page_number;
+  SlotId        slot_number;
+  bool          finished;
+};
+
+}
+
 FileScan::FileScan(const std::string &name, BufMgr *bufferMgr)
 {
   file = new PageFile(name, false);	//dont create new file
@@ -17,6 +42,30 @@ FileScan::FileScan(const std::string &name, BufMgr *bufferMgr)
 	curDirtyFlag = false;
   curPage = NULL;
 	filePageIter = file->begin();
+	attrPageNo = Page::INVALID_NUMBER;
+	attrOffset = 0;
+	attrLength = 0;
+	attrData = NULL;
+	attrWidth = 0;
+	readAheadPages = 0;
+	readAheadFirst = Page::INVALID_NUMBER;
+	readAheadLast = Page::INVALID_NUMBER;
+	shared = false;
+	sweepStart = Page::INVALID_NUMBER;
+	wrapped = false;
+	inSweep = false;
+	startPage = Page::INVALID_NUMBER;
+	startSlot = Page::INVALID_SLOT;
+	startFinished = false;
+	pageBudget = 0;
+	pagesRead = 0;
+	resumePage = Page::INVALID_NUMBER;
+	sampleMethod = BERNOULLI;
+	sampleRate = 0;
+	sampleSeed = 0;
+	nextSample = 0;
+	sampleWeight = 1;
+	nextMatch = 0;
 }
 
 FileScan::~FileScan()
@@ -24,18 +73,24 @@ FileScan::~FileScan()
   // generally must unpin last page of the scan
   if (curPage != NULL)
   {
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
+    bufMgr->unPinPage(file, filePageIter.getCurrentPageNo(), curDirtyFlag);
     curPage = NULL;
 		curDirtyFlag = false;
     filePageIter = file->begin();
   }
-  bufMgr->flushFile(file);
+  // the pages are still in use while other scans share the sweep
+  if (!(inSweep && leaveSweep()))
+    bufMgr->flushFile(file);
   delete file;
 }
 
 void FileScan::scanNext(RecordId& outRid)
 {
-  std::string rec;
+  if (predicate)
+  {
+    scanNextMatch(outRid);
+    return;
+  }
 
   if (filePageIter == file->end())
 	{
@@ -43,30 +98,9 @@ void FileScan::scanNext(RecordId& outRid)
 	}
 
   // special case of the first record of the first page of the file
-  if (curPage == NULL)
+  if (curPage == NULL && !nextPage())
   {
-    // need to get the first page of the file
-		filePageIter = file->begin();
-    if(filePageIter == file->end())
-		{
-			throw EndOfFileException();
-		}
-	 
-		// read the first page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage); 
-		curDirtyFlag = false;
-
-		// get the first record off the page
-    pageRecordIter = curPage->begin(); 
-
-		if(pageRecordIter != curPage->end()) 
-		{
-		  // get pointer to record
-		  rec = *pageRecordIter;
-
-			outRid = pageRecordIter.getCurrentRecord();
-			return;
-		}
+    throw EndOfFileException();
   }
 
 	// Loop, looking for a record that satisfied the predicate.
@@ -75,33 +109,237 @@ void FileScan::scanNext(RecordId& outRid)
 
   while (pageRecordIter == curPage->end())
   {
-    // unpin the current page
-    bufMgr->unPinPage(file, (*filePageIter).page_number(), curDirtyFlag);
+    // move on to the next page of the file
+    if (!nextPage())
+    {
+			throw EndOfFileException();
+    }
+    pageRecordIter++;
+  }
+
+	// return rid of the record
+	outRid = pageRecordIter.getCurrentRecord();
+	return;
+}
+
+void FileScan::scanNextMatch(RecordId& outRid)
+{
+  if (filePageIter == file->end())
+  {
+    throw EndOfFileException();
+  }
+
+  if (curPage == NULL && !nextPage())
+  {
+    throw EndOfFileException();
+  }
+
+  while (nextMatch == matchSlots.size())
+  {
+    if (!nextPage())
+    {
+      throw EndOfFileException();
+    }
+  }
+
+  const RecordId rid = {curPage->page_number(), matchSlots[nextMatch++], 0};
+  pageRecordIter = PageIterator(curPage, rid);
+  outRid = rid;
+}
+
+std::size_t FileScan::nextBatch(RecordId* rids, std::string_view* recs, const std::size_t max)
+{
+  const std::size_t count = nextRecordIds(rids, max);
+  if (count == 0)
+    return 0;
+  if (curPage->isFixedLength())
+    batchBuffer.resize(count * curPage->getRecordLength());
+  curPage->gatherRecords(rids, count, recs, batchBuffer.data());
+  return count;
+}
+
+std::size_t FileScan::nextKeys(const std::size_t attrByteOffset, const Datatype attrType,
+                               void* keys, RecordId* rids, const std::size_t max,
+                               const std::size_t attrLength)
+{
+  const std::size_t length = attrType == INTEGER ? sizeof(int)
+                           : attrType == DOUBLE ? sizeof(double) : attrLength;
+  if (length == 0)
+    throw BadScanParamException();
+  const std::size_t count = nextRecordIds(rids, max);
+  if (count > 0)
+    curPage->gatherAttribute(rids, count, attrByteOffset, length, static_cast<char*>(keys));
+  return count;
+}
+
+std::size_t FileScan::nextRecordIds(RecordId* rids, const std::size_t max)
+{
+  if (max == 0 || filePageIter == file->end())
+    return 0;
+  if (curPage == NULL && !nextPage())
+    return 0;
+
+  std::size_t count = 0;
+  while (true)
+  {
+    const PageId pageNo = curPage->page_number();
+    if (predicate)
+    {
+      for (; count < max && nextMatch < matchSlots.size(); count++)
+        rids[count] = {pageNo, matchSlots[nextMatch++], 0};
+    }
+    else
+    {
+      for (SlotId slot = curPage->getNextUsedSlot(pageRecordIter.getCurrentRecord().slot_number);
+           slot != Page::INVALID_SLOT && count < max; slot = curPage->getNextUsedSlot(slot))
+        rids[count++] = {pageNo, slot, 0};
+    }
+    if (count > 0)
+      break;
+    if (!nextPage())
+      return 0;
+  }
+
+  pageRecordIter = PageIterator(curPage, rids[count - 1]);
+  return count;
+}
+
+bool FileScan::nextPage()
+{
+  SlotId after = Page::INVALID_SLOT;
+  if (curPage == NULL)
+  {
+    if (sampleRate > 0)
+    {
+      chooseSample();
+      filePageIter = samplePages.empty() ? file->end() : FileIterator(file, samplePages[nextSample++]);
+    }
+    else if (shared)
+    {
+      filePageIter = FileIterator(file, joinSweep());
+    }
+    else if (startPage != Page::INVALID_NUMBER)
+    {
+      if (!file->isUsed(startPage))
+        throw InvalidPageException(startPage, file->filename());
+      filePageIter = FileIterator(file, startPage);
+      after = startSlot;
+    }
+    else
+    {
+      filePageIter = file->begin();
+    }
+  }
+  else
+  {
+    bufMgr->unPinPage(file, filePageIter.getCurrentPageNo(), curDirtyFlag);
     curPage = NULL;
     curDirtyFlag = false;
+    advancePage();
+  }
+  // skip the pages the file's zone map rules out, without reading them
+  while (predicate && filePageIter != file->end() &&
+         !file->mayMatch(filePageIter.getCurrentPageNo(), *predicate))
+  {
+    advancePage();
+    after = Page::INVALID_SLOT;
+  }
+  if (filePageIter != file->end() && pageBudget != 0 && pagesRead == pageBudget)
+  {
+    // out of budget: end here, remembering where to carry on
+    resumePage = filePageIter.getCurrentPageNo();
+    filePageIter = file->end();
+  }
+  if (filePageIter == file->end())
+    return false;
+
+  readAhead();
+  bufMgr->readPage(file, filePageIter.getCurrentPageNo(), curPage);
+  pagesRead++;
+  attrPageNo = Page::INVALID_NUMBER;
+  if (inSweep)
+  {
+    std::lock_guard<std::mutex> lock(sweepsMutex);
+    sweeps[std::make_pair(bufMgr, file->fileId())].position = filePageIter.getCurrentPageNo();
+  }
+  if (predicate)
+    filterPage(after);
+  else
+    pageRecordIter = PageIterator(curPage, RecordId{curPage->page_number(), after, 0});
+  return true;
+}
 
-    filePageIter++;
-    if (filePageIter == file->end())
+void FileScan::advancePage()
+{
+  if (sampleRate > 0)
+  {
+    filePageIter = nextSample == samplePages.size() ? file->end()
+                 : FileIterator(file, samplePages[nextSample++]);
+    return;
+  }
+  filePageIter++;
+  if (shared)
+  {
+    // wrap around for the pages before the one the scan joined the sweep at
+    if (filePageIter == file->end() && !wrapped)
     {
-      curPage = NULL;
-			throw EndOfFileException();
+      filePageIter = file->begin();
+      wrapped = true;
     }
+    if (wrapped && filePageIter.getCurrentPageNo() == sweepStart)
+      filePageIter = file->end();
+  }
+}
 
-    // read the next page of the file
-    bufMgr->readPage(file, (*filePageIter).page_number(), curPage);
+PageId FileScan::joinSweep()
+{
+  std::lock_guard<std::mutex> lock(sweepsMutex);
+  Sweep& sweep = sweeps[std::make_pair(bufMgr, file->fileId())];
+  if (sweep.numScans == 0)
+    sweep.position = file->getFirstPageNo();
+  sweep.numScans++;
+  inSweep = true;
+  sweepStart = sweep.position;
+  // starting at the first page leaves nothing to wrap around for
+  wrapped = sweepStart == file->getFirstPageNo();
+  return sweepStart;
+}
 
-    // get the first record off the page
-    pageRecordIter = curPage->begin(); 
-  }
+bool FileScan::leaveSweep()
+{
+  std::lock_guard<std::mutex> lock(sweepsMutex);
+  inSweep = false;
+  const std::pair<const BufMgr*, FileId> key(bufMgr, file->fileId());
+  if (--sweeps[key].numScans > 0)
+    return true;
+  sweeps.erase(key);
+  return false;
+}
 
-  // curRec points at a valid record
-  // see if the record satisfies the scan's predicate 
-  // get a pointer to the record
-  rec = *pageRecordIter;
+void FileScan::filterPage(const SlotId start)
+{
+  predicate->select(*curPage, start, matchSlots, predicateValues);
+  nextMatch = 0;
+  // until a match is returned, the iterator is before the page's first record
+  pageRecordIter = PageIterator(curPage, RecordId{curPage->page_number(), start, 0});
+}
 
-	// return rid of the record
-	outRid = pageRecordIter.getCurrentRecord();
-	return;
+void FileScan::setPredicate(const std::size_t attrByteOffset, const Datatype attrType,
+                            const void* lowVal, const Operator lowOp,
+                            const void* highVal, const Operator highOp,
+                            const std::size_t attrLength)
+{
+  predicate.reset(new ScanPredicate(attrByteOffset, attrType, lowVal, lowOp,
+                                    highVal, highOp, attrLength));
+  if (curPage != NULL)
+    filterPage(pageRecordIter.getCurrentRecord().slot_number);
+}
+
+void FileScan::clearPredicate()
+{
+  predicate.reset();
+  matchSlots.clear();
+  nextMatch = 0;
 }
 
 // returns pointer to the current record.  page is left pinned
@@ -111,10 +349,194 @@ std::string FileScan::getRecord()
   return *pageRecordIter;
 }
 
+std::string_view FileScan::getRecordView()
+{
+  if (curPage->isFixedLength())
+  {
+    recordBuffer = *pageRecordIter;
+    return recordBuffer;
+  }
+  return pageRecordIter.view();
+}
+
+std::string_view FileScan::getAttributeView(const std::size_t offset,
+                                            const std::size_t length)
+{
+  const RecordId rid = pageRecordIter.getCurrentRecord();
+  if (!curPage->isFixedLength())
+  {
+    return curPage->getAttributeView(rid, offset, length);
+  }
+  if (attrPageNo != curPage->page_number() || attrOffset != offset || attrLength != length)
+  {
+    // look up the column once per page
+    const std::uint16_t column = curPage->findColumn(offset, length);
+    if (column == curPage->getNumColumns())
+    {
+      return curPage->getAttributeView(rid, offset, length);  // throws
+    }
+    attrPageNo = curPage->page_number();
+    attrOffset = offset;
+    attrLength = length;
+    attrWidth = curPage->getColumn(column).width;
+    attrData = curPage->getColumnData(column) + offset - curPage->getColumn(column).record_offset;
+  }
+  return std::string_view(attrData + (rid.slot_number - 1) * attrWidth, length);
+}
+
 // mark current page of scan dirty
 void FileScan::markDirty()
 {
   curDirtyFlag = true;
 }
 
+void FileScan::setReadAhead(const std::uint32_t numPages)
+{
+  readAheadPages = numPages;
+}
+
+void FileScan::setShared(const bool shared)
+{
+  this->shared = shared;
+}
+
+void FileScan::startAtPage(const PageId pageNo)
+{
+  startPage = pageNo;
+  startSlot = Page::INVALID_SLOT;
+}
+
+void FileScan::startAt(const std::string& token)
+{
+  ResumeToken position;
+  if (token.size() != sizeof(position))
+    throw BadScanParamException();
+  memcpy(&position, token.data(), sizeof(position));
+  if (position.magic != ResumeToken::MAGIC)
+    throw BadScanParamException();
+  startPage = position.page_number;
+  startSlot = position.slot_number;
+  startFinished = position.finished;
+  if (startFinished)
+    filePageIter = file->end();
+}
+
+std::string FileScan::getResumeToken() const
+{
+  ResumeToken position;
+  memset(&position, 0, sizeof(position));  // no stray padding bytes
+  position.magic = ResumeToken::MAGIC;
+  position.page_number = startPage;
+  position.slot_number = startSlot;
+  position.finished = startFinished;
+  if (curPage != NULL)
+  {
+    // carry on after the current record
+    position.page_number = curPage->page_number();
+    position.slot_number = pageRecordIter.getCurrentRecord().slot_number;
+  }
+  else if (filePageIter == file->end() && (pagesRead > 0 || startFinished))
+  {
+    position.page_number = resumePage;
+    position.slot_number = Page::INVALID_SLOT;
+    position.finished = resumePage == Page::INVALID_NUMBER;
+  }
+  return std::string(reinterpret_cast<const char*>(&position), sizeof(position));
+}
+
+void FileScan::setPageBudget(const std::uint32_t numPages)
+{
+  pageBudget = numPages;
+}
+
+bool FileScan::reachedEnd() const
+{
+  return curPage == NULL && filePageIter == file->end() &&
+         resumePage == Page::INVALID_NUMBER;
+}
+
+void FileScan::setSample(const SampleMethod method, const double rate,
+                         const std::uint64_t seed)
+{
+  if (!(rate > 0 && rate <= 1))
+    throw BadScanParamException();
+  sampleMethod = method;
+  sampleRate = rate;
+  sampleSeed = seed;
+}
+
+double FileScan::getSampleWeight() const
+{
+  return sampleWeight;
+}
+
+void FileScan::chooseSample()
+{
+  // the used list comes from the file's page directory, so listing it reads
+  // no pages; only the pages chosen are read, as the scan reaches them
+  std::vector<PageId> pageNos;
+  for (FileIterator iter = file->begin(); iter != file->end(); ++iter)
+    pageNos.push_back(iter.getCurrentPageNo());
+
+  // the generator's own output rather than a distribution of the standard
+  // library, so that a seed picks the same pages with any library
+  std::mt19937_64 random(sampleSeed);
+  samplePages.clear();
+  nextSample = 0;
+  if (sampleMethod == BERNOULLI)
+  {
+    for (std::size_t i = 0; i < pageNos.size(); i++)
+    {
+      if ((random() >> 11) * (1.0 / (std::uint64_t(1) << 53)) < sampleRate)
+        samplePages.push_back(pageNos[i]);
+    }
+    sampleWeight = 1 / sampleRate;
+    return;
+  }
+
+  const std::size_t numSampled = std::min(pageNos.size(), std::max<std::size_t>(
+      1, std::size_t(sampleRate * pageNos.size() + 0.5)));
+  std::vector<std::size_t> reservoir;
+  for (std::size_t i = 0; i < pageNos.size(); i++)
+  {
+    if (i < numSampled)
+    {
+      reservoir.push_back(i);
+      continue;
+    }
+    const std::size_t j = random() % (i + 1);
+    if (j < numSampled)
+      reservoir[j] = i;
+  }
+  std::sort(reservoir.begin(), reservoir.end());
+  for (std::size_t i = 0; i < reservoir.size(); i++)
+    samplePages.push_back(pageNos[reservoir[i]]);
+  sampleWeight = numSampled == 0 ? 1 : double(pageNos.size()) / numSampled;
+}
+
+void FileScan::readAhead()
+{
+  const PageId pageNo = filePageIter.getCurrentPageNo();
+  // a sampling scan skips most of the run
+  if (readAheadPages <= 1 || sampleRate > 0 ||
+      (pageNo >= readAheadFirst && pageNo <= readAheadLast))
+    return;
+
+  // follow the used list for as long as it runs through consecutive pages,
+  // but not past the page budget or onto pages the zone map rules out
+  const std::uint32_t maxPages = pageBudget == 0 ? readAheadPages
+                               : std::min(readAheadPages, pageBudget - pagesRead);
+  std::uint32_t count = 1;
+  FileIterator runIter = filePageIter;
+  for (++runIter; count < maxPages && runIter != file->end() &&
+                  runIter.getCurrentPageNo() == pageNo + count &&
+                  (!predicate || file->mayMatch(pageNo + count, *predicate)); ++runIter)
+    count++;
+
+  readAheadFirst = pageNo;
+  readAheadLast = pageNo + count - 1;
+  if (count > 1)
+    bufMgr->prefetchPages(file, pageNo, count);
+}
+
 }
@@ -8,12 +8,18 @@
 
 #pragma once
 
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <utility>
+#include <vector>
 #include "types.h"
 #include "page.h"
 #include "buffer.h"
 #include "file_iterator.h"
 #include "page_iterator.h"
+#include "scan_predicate.h"
 
 namespace badgerdb {
 
@@ -23,6 +29,14 @@ namespace badgerdb {
 class FileScan
 {
  public:
+  /**
+   * Ways of choosing the pages of a sampling scan; see setSample().
+   */
+  enum SampleMethod
+  {
+    BERNOULLI,
+    RESERVOIR
+  };
 
   FileScan(const std::string &name, BufMgr *bufMgr);
 
@@ -34,9 +48,204 @@ class FileScan
   //read current record, returning pointer and length
   std::string getRecord();
 
+  /**
+   * Returns the current record without copying it.  The view points into the
+   * pinned page of the scan and is valid until the next call to scanNext().
+   * Records of pages of fixed-length records are gathered from the columns
+   * into a buffer of the scan instead.
+   */
+  std::string_view getRecordView();
+
+  /**
+   * Returns part of the current record, such as one attribute, without
+   * copying it; valid until the next call to scanNext().  On pages of
+   * fixed-length records the part is read from its column, so a scan reading
+   * just one attribute streams through that column only.
+   *
+   * @param offset  Offset of the part in the record.
+   * @param length  Length of the part.
+   */
+  std::string_view getAttributeView(const std::size_t offset,
+                                    const std::size_t length);
+
+  /**
+   * Returns the next records of the scan a page's worth at a time: up to
+   * <max> records that meet the predicate, if one is set, all from the same
+   * page.  The views are valid until the next call to nextBatch() or
+   * scanNext(), like those of getRecordView().  Afterwards the last record
+   * returned is the current one, so scanNext(), getRecord() and markDirty()
+   * carry on from it.
+   *
+   * @param rids  Receives the IDs of the records.
+   * @param recs  Receives the records.
+   * @param max   Largest number of records to return.
+   * @return  Number of records returned; 0 once the scan reaches the end of
+   *          the file (or if <max> is 0).
+   */
+  std::size_t nextBatch(RecordId* rids, std::string_view* recs,
+                        const std::size_t max);
+
+  /**
+   * Projecting form of nextBatch(): copies just one attribute of the next
+   * records into a column of the caller's, with the records' IDs alongside,
+   * and builds no record at all.  On pages of fixed-length records the
+   * values are read from the attribute's column.
+   *
+   * @param attrByteOffset  Byte offset of the attribute in the record.
+   * @param attrType        Type of the attribute.
+   * @param keys            Receives the values, back to back, each as long
+   *                        as the attribute (an int or a double for INTEGER
+   *                        and DOUBLE attributes).
+   * @param rids            Receives the IDs of the records.
+   * @param max             Largest number of records to return.
+   * @param attrLength      Length of a STRING attribute.
+   * @return  Number of records returned; 0 once the scan reaches the end of
+   *          the file (or if <max> is 0).
+   * @throws  BadScanParamException   If a STRING attribute has no length.
+   * @throws  PageFormatException     If a record has no such attribute.
+   */
+  std::size_t nextKeys(const std::size_t attrByteOffset, const Datatype attrType,
+                       void* keys, RecordId* rids, const std::size_t max,
+                       const std::size_t attrLength = 0);
+
   //marks current page of scan dirty
   void markDirty();
 
+  /**
+   * Makes the scan return only records whose attribute at <attrByteOffset>
+   * is within the given bounds, which work as for BTreeIndex::startScan()
+   * except that either may be NULL for none.  The records of a page are
+   * tested together, straight from the page's bytes, when the scan reaches
+   * it.  Records before the current one are not affected.  Pages the file's
+   * zone map (see PageFile::createZoneMap()) rules out are skipped without
+   * being read.
+   *
+   * @param attrByteOffset  Byte offset of the attribute in the record.
+   * @param attrType        Type of the attribute.
+   * @param lowVal          Low bound, or NULL for none.
+   * @param lowOp           GT or GTE.
+   * @param highVal         High bound, or NULL for none.
+   * @param highOp          LT or LTE.
+   * @param attrLength      Length of a STRING attribute.
+   * @throws  BadOpcodesException     If an operator does not fit its bound.
+   * @throws  BadScanrangeException   If the low bound is above the high one.
+   * @throws  BadScanParamException   If a STRING attribute has no length.
+   */
+  void setPredicate(const std::size_t attrByteOffset, const Datatype attrType,
+                    const void* lowVal, const Operator lowOp,
+                    const void* highVal, const Operator highOp,
+                    const std::size_t attrLength = 0);
+
+  /**
+   * Makes the scan return every record again.
+   */
+  void clearPredicate();
+
+  /**
+   * Number of pages read ahead by default in read-ahead mode (256 KB).
+   */
+  static const std::uint32_t DEFAULT_READ_AHEAD_PAGES = (256 * 1024) / Page::SIZE;
+
+  /**
+   * Turns on read-ahead mode: whenever the scan reaches a page that starts a
+   * run of physically consecutive used pages, up to <numPages> pages of the
+   * run are read into the buffer pool with one vectored read.  Zero turns
+   * read-ahead off, which is the default.
+   *
+   * @param numPages  Maximum number of pages to read ahead at once.
+   */
+  void setReadAhead(const std::uint32_t numPages);
+
+  /**
+   * Makes the scan share its sweep of the file with the other shared scans of
+   * the file through the same buffer manager.  Rather than from the first
+   * page, the scan starts at the page the sweep in progress (if any) has
+   * reached, so it reads the pages other scans are reading while they are
+   * still in the buffer pool; at the end of the file it wraps around to pick
+   * up the pages before that.  Records come in file order from where the
+   * scan joined.  The file's pages are flushed from the buffer pool only once
+   * the last scan of the sweep is destroyed.  Must be called before the scan
+   * returns its first record.
+   *
+   * @param shared  Whether to share the sweep.
+   */
+  void setShared(const bool shared);
+
+  /**
+   * Makes the scan start at the first record of the given page rather than
+   * at the first page of the file.  Must be called before the scan returns
+   * its first record; a shared scan starts where its sweep is instead.
+   *
+   * @param pageNo  Number of a used page of the file.
+   * @throws  InvalidPageException  From the first scanNext() or nextBatch(),
+   *                                if the page is not a used page.
+   */
+  void startAtPage(const PageId pageNo);
+
+  /**
+   * Makes the scan start where the scan that returned the token was, so that
+   * it returns the records that scan would have returned next.  Must be
+   * called before the scan returns its first record.
+   *
+   * @param token   Token from getResumeToken().
+   * @throws  BadScanParamException   If the token is not one.
+   * @throws  InvalidPageException    From the first scanNext() or
+   *                                  nextBatch(), if the page the token is
+   *                                  on is no longer a used page.
+   */
+  void startAt(const std::string& token);
+
+  /**
+   * Returns a token of where the scan is, for another scan of the file to
+   * resume from with startAt(), in this process or another.  Tokens are
+   * plain bytes; one stays good until the page it is on is deleted or the
+   * file is compacted.  Positions are in file order, so the token of a shared
+   * scan does not cover the pages it would have wrapped around for.
+   */
+  std::string getResumeToken() const;
+
+  /**
+   * Makes the scan end, as if at the end of the file, once it has read the
+   * given number of pages; getResumeToken() then tells where to carry on.
+   * Zero, the default, means no limit.
+   *
+   * @param numPages  Largest number of pages to read.
+   */
+  void setPageBudget(const std::uint32_t numPages);
+
+  /**
+   * Returns whether the scan has reached the end of the file, rather than
+   * the end of its page budget.
+   */
+  bool reachedEnd() const;
+
+  /**
+   * Makes the scan read a random sample of the file's pages, in file order,
+   * rather than all of them.  BERNOULLI takes each page with probability
+   * <rate>; RESERVOIR takes exactly <rate> of the pages (rounded, and at
+   * least one), chosen by reservoir sampling over the page list.  The same
+   * seed picks the same pages of the same file.  Every record of a sampled
+   * page is returned, with the weight getSampleWeight() gives, so that
+   * counts and sums over the sample, each record counted <weight> times,
+   * estimate those over the file.  Must be called before the scan returns
+   * its first record; a sampling scan ignores setShared() and start
+   * positions.
+   *
+   * @param method  How to choose the pages.
+   * @param rate    Share of the pages to read, in (0, 1].
+   * @param seed    Seed of the random choice.
+   * @throws  BadScanParamException   If the rate is out of range.
+   */
+  void setSample(const SampleMethod method, const double rate,
+                 const std::uint64_t seed);
+
+  /**
+   * Returns the number of records of the file each record returned stands
+   * for: the inverse of the chance of its page being sampled, or 1 if the
+   * scan does not sample.  Known once the scan has returned a record.
+   */
+  double getSampleWeight() const;
+
  private:
   /**
    * File which is being scanned.
@@ -60,6 +269,184 @@ class FileScan
    * True if page has been updated
    */
   bool  	      curDirtyFlag;
+
+  /**
+   * Holds the current record of a page of fixed-length records for
+   * getRecordView().
+   */
+  std::string   recordBuffer;
+
+  /**
+   * Column of the current page getAttributeView() last read from, so that
+   * reading the same attribute of the next records of a page of fixed-length
+   * records is a matter of stepping through the column: page number, the
+   * part of the record asked for, the start of that part's values and the
+   * column width.
+   */
+  PageId        attrPageNo;
+  std::size_t   attrOffset;
+  std::size_t   attrLength;
+  const char*   attrData;
+  std::uint16_t attrWidth;
+
+  /**
+   * Maximum number of pages to read ahead at once; zero if read-ahead is off.
+   */
+  std::uint32_t readAheadPages;
+
+  /**
+   * First and last page numbers of the run most recently read ahead.
+   */
+  PageId        readAheadFirst;
+  PageId        readAheadLast;
+
+  /**
+   * Page the scan starts at, or Page::INVALID_NUMBER for the first page of
+   * the file, and the slot on it to start after, or Page::INVALID_SLOT for
+   * none.  startFinished is set if the scan starts at the end of the file.
+   */
+  PageId        startPage;
+  SlotId        startSlot;
+  bool          startFinished;
+
+  /**
+   * Largest number of pages to read, or zero for no limit, and the number
+   * read so far.
+   */
+  std::uint32_t pageBudget;
+  std::uint32_t pagesRead;
+
+  /**
+   * Page to resume at after running out of budget; Page::INVALID_NUMBER if
+   * the scan has not.
+   */
+  PageId        resumePage;
+
+  /**
+   * How the pages of a sampling scan are chosen, the share of pages to read
+   * (zero if the scan does not sample) and the seed.
+   */
+  SampleMethod  sampleMethod;
+  double        sampleRate;
+  std::uint64_t sampleSeed;
+
+  /**
+   * Pages a sampling scan reads, in file order, the index of the next one and
+   * the weight of their records.
+   */
+  std::vector<PageId> samplePages;
+  std::size_t   nextSample;
+  double        sampleWeight;
+
+  /**
+   * Chooses the pages of a sampling scan.
+   */
+  void chooseSample();
+
+  /**
+   * Whether the scan shares its sweep of the file.
+   */
+  bool          shared;
+
+  /**
+   * Page a shared scan started at, and whether it has wrapped around past the
+   * end of the file since; the scan ends when it gets back to that page.
+   */
+  PageId        sweepStart;
+  bool          wrapped;
+
+  /**
+   * Whether the scan is counted among the scans of its file's sweep, which it
+   * is from its first page until it is destroyed.
+   */
+  bool          inSweep;
+
+  /**
+   * Progress of the shared scans of a file through one buffer manager: the
+   * page most recently read by one of them and the number of scans.
+   */
+  struct Sweep
+  {
+    PageId        position;
+    std::uint32_t numScans;
+  };
+
+  /**
+   * Sweeps in progress, by buffer manager and file, and the mutex guarding
+   * them.
+   */
+  static std::map<std::pair<const BufMgr*, FileId>, Sweep> sweeps;
+  static std::mutex sweepsMutex;
+
+  /**
+   * Joins the sweep of the file, returning the page to start at.
+   */
+  PageId joinSweep();
+
+  /**
+   * Leaves the sweep of the file, returning whether other scans are left in
+   * it.
+   */
+  bool leaveSweep();
+
+  /**
+   * Condition records must meet to be returned; none if NULL.
+   */
+  std::unique_ptr<ScanPredicate> predicate;
+
+  /**
+   * Slots of the records of the current page that meet the predicate, and
+   * the index of the next one to return.
+   */
+  std::vector<SlotId> matchSlots;
+  std::size_t   nextMatch;
+
+  /**
+   * Attribute values of a batch of records being tested.
+   */
+  std::vector<char> predicateValues;
+
+  /**
+   * Holds the records of a batch from a page of fixed-length records for
+   * nextBatch().
+   */
+  std::vector<char> batchBuffer;
+
+  /**
+   * Moves the scan on by up to <max> records of one page, as nextBatch()
+   * does, and returns their IDs.
+   */
+  std::size_t nextRecordIds(RecordId* rids, const std::size_t max);
+
+  /**
+   * Unpins the current page and reads the next one of the file, returning
+   * false and leaving no page pinned at the end of the file.
+   */
+  bool nextPage();
+
+  /**
+   * Moves the file iterator on to the next page the scan visits: the next
+   * sampled page, or the next page of the file, wrapping around for a
+   * shared scan.
+   */
+  void advancePage();
+
+  /**
+   * Tests the records of the current page after slot <start> against the
+   * predicate and keeps the slots of those that meet it.
+   */
+  void filterPage(const SlotId start);
+
+  /**
+   * scanNext() with a predicate.
+   */
+  void scanNextMatch(RecordId& outRid);
+
+  /**
+   * Reads ahead the run of consecutive used pages starting at the page the
+   * file iterator is on, unless that page was already part of the last run.
+   */
+  void readAhead();
 };
 
 }
@@ -0,0 +1,344 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "io_engine.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "exceptions/badgerdb_exception.h"
+
+namespace badgerdb {
+
+IoEngine::~IoEngine() {
+}
+
+IoEngine* IoEngine::create(const std::uint32_t queue_depth,
+                           const std::uint32_t num_threads,
+                           const bool allow_uring) {
+  if (allow_uring) {
+    try {
+      return new UringIoEngine(queue_depth, num_threads);
+    } catch (const BadgerDbException&) {
+      // No io_uring in this kernel (or it is not allowed); use threads.
+    }
+  }
+  return new ThreadPoolIoEngine(num_threads);
+}
+
+void IoEngine::perform(const IoRequest& request) {
+  if (request.write) {
+    request.backend->write(request.offset, request.buffer, request.length);
+  } else {
+    request.backend->read(request.offset, request.buffer, request.length);
+  }
+}
+
+ThreadPoolIoEngine::ThreadPoolIoEngine(const std::uint32_t num_threads)
+    : pending_(0), stop_(false) {
+  for (std::uint32_t i = 0; i < std::max<std::uint32_t>(num_threads, 1); ++i) {
+    threads_.push_back(std::thread(&ThreadPoolIoEngine::work, this));
+  }
+}
+
+ThreadPoolIoEngine::~ThreadPoolIoEngine() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_ready_.notify_all();
+  for (std::size_t i = 0; i < threads_.size(); ++i) {
+    threads_[i].join();
+  }
+}
+
+void ThreadPoolIoEngine::submit(const std::vector<IoRequest>& requests) {
+  if (requests.empty()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.insert(queue_.end(), requests.begin(), requests.end());
+    pending_ += requests.size();
+  }
+  work_ready_.notify_all();
+}
+
+void ThreadPoolIoEngine::drain() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_.wait(lock, [this] { return pending_ == 0; });
+}
+
+void ThreadPoolIoEngine::work() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    work_ready_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+    if (queue_.empty()) {
+      // Stopping, and everything queued has been started.
+      return;
+    }
+    const IoRequest request = queue_.front();
+    queue_.pop_front();
+    lock.unlock();
+
+    bool ok = true;
+    try {
+      perform(request);
+    } catch (const BadgerDbException&) {
+      ok = false;
+    }
+    if (request.done) {
+      request.done(ok);
+    }
+
+    lock.lock();
+    if (--pending_ == 0) {
+      idle_.notify_all();
+    }
+  }
+}
+
+struct UringIoEngine::InFlight {
+  /**
+   * The request.
+   */
+  IoRequest request;
+
+  /**
+   * Vector of the request's buffer, read by the kernel.
+   */
+  struct iovec iov;
+};
+
+UringIoEngine::UringIoEngine(const std::uint32_t queue_depth,
+                             const std::uint32_t num_threads)
+    : ring_fd_(-1),
+      sq_ring_(MAP_FAILED),
+      cq_ring_(MAP_FAILED),
+      sqes_(MAP_FAILED),
+      in_flight_(0),
+      fallback_(num_threads) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring_fd_ = syscall(__NR_io_uring_setup, std::max<std::uint32_t>(queue_depth, 1),
+                     &params);
+  if (ring_fd_ < 0) {
+    throw BadgerDbException("io_uring is not available");
+  }
+
+  sq_entries_ = params.sq_entries;
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+  sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+  cq_ring_ = single_mmap ? sq_ring_
+                         : mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, ring_fd_,
+                                IORING_OFF_CQ_RING);
+  sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+  sqes_ = mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+  if (sq_ring_ == MAP_FAILED || cq_ring_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+    if (sqes_ != MAP_FAILED) {
+      munmap(sqes_, sqes_size_);
+    }
+    if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+      munmap(cq_ring_, cq_ring_size_);
+    }
+    if (sq_ring_ != MAP_FAILED) {
+      munmap(sq_ring_, sq_ring_size_);
+    }
+    ::close(ring_fd_);
+    throw BadgerDbException("io_uring rings cannot be mapped");
+  }
+
+  char* sq = static_cast<char*>(sq_ring_);
+  sq_head_ = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.head);
+  sq_tail_ = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.tail);
+  sq_mask_ = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.ring_mask);
+  sq_array_ = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.array);
+  char* cq = static_cast<char*>(cq_ring_);
+  cq_head_ = reinterpret_cast<std::uint32_t*>(cq + params.cq_off.head);
+  cq_tail_ = reinterpret_cast<std::uint32_t*>(cq + params.cq_off.tail);
+  cq_mask_ = reinterpret_cast<std::uint32_t*>(cq + params.cq_off.ring_mask);
+  cqes_ = cq + params.cq_off.cqes;
+
+  reaper_ = std::thread(&UringIoEngine::reap, this);
+}
+
+UringIoEngine::~UringIoEngine() {
+  drain();
+  {
+    // Wake the completion thread with a no-op entry and let it stop.
+    std::lock_guard<std::mutex> lock(mutex_);
+    const std::uint32_t tail = *sq_tail_;
+    const std::uint32_t index = tail & *sq_mask_;
+    struct io_uring_sqe* sqe =
+        static_cast<struct io_uring_sqe*>(sqes_) + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_NOP;
+    sqe->user_data = 0;
+    sq_array_[index] = index;
+    __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    while (enter(1, 0, 0) < 0 && (errno == EINTR || errno == EAGAIN)) {
+    }
+  }
+  reaper_.join();
+  munmap(sqes_, sqes_size_);
+  if (cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  munmap(sq_ring_, sq_ring_size_);
+  ::close(ring_fd_);
+}
+
+void UringIoEngine::submit(const std::vector<IoRequest>& requests) {
+  std::vector<IoRequest> overflow;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::uint32_t queued = 0;
+    for (std::size_t i = 0; i < requests.size(); ++i) {
+      const IoRequest& request = requests[i];
+      const int fd = request.backend->descriptor();
+      const std::uint32_t used =
+          *sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+      if (fd < 0 || in_flight_ >= sq_entries_ || used >= sq_entries_) {
+        overflow.push_back(request);
+        continue;
+      }
+      InFlight* in_flight = new InFlight();
+      in_flight->request = request;
+      in_flight->iov.iov_base = request.buffer;
+      in_flight->iov.iov_len = request.length;
+
+      const std::uint32_t tail = *sq_tail_;
+      const std::uint32_t index = tail & *sq_mask_;
+      struct io_uring_sqe* sqe =
+          static_cast<struct io_uring_sqe*>(sqes_) + index;
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = request.write ? IORING_OP_WRITEV : IORING_OP_READV;
+      sqe->fd = fd;
+      sqe->off = request.offset;
+      sqe->addr = reinterpret_cast<std::uint64_t>(&in_flight->iov);
+      sqe->len = 1;
+      sqe->user_data = reinterpret_cast<std::uint64_t>(in_flight);
+      sq_array_[index] = index;
+      __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+      ++queued;
+      ++in_flight_;
+    }
+
+    // One system call submits the whole batch.
+    while (queued > 0) {
+      const int submitted = enter(queued, 0, 0);
+      if (submitted < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+          std::this_thread::yield();
+          continue;
+        }
+        break;
+      }
+      queued -= std::min<std::uint32_t>(submitted, queued);
+    }
+
+    // The kernel refused the rest of the batch: take its entries back off the
+    // submission queue and have the thread pool do them instead, so their
+    // completions still run.
+    if (queued > 0) {
+      const std::uint32_t tail = *sq_tail_;
+      for (std::uint32_t i = tail - queued; i != tail; ++i) {
+        const struct io_uring_sqe* sqe =
+            static_cast<const struct io_uring_sqe*>(sqes_) + (i & *sq_mask_);
+        InFlight* in_flight = reinterpret_cast<InFlight*>(sqe->user_data);
+        overflow.push_back(in_flight->request);
+        delete in_flight;
+      }
+      __atomic_store_n(sq_tail_, tail - queued, __ATOMIC_RELEASE);
+      in_flight_ -= queued;
+      if (in_flight_ == 0) {
+        idle_.notify_all();
+      }
+    }
+  }
+  fallback_.submit(overflow);
+}
+
+void UringIoEngine::drain() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return in_flight_ == 0; });
+  }
+  fallback_.drain();
+}
+
+void UringIoEngine::reap() {
+  while (true) {
+    if (enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+      std::this_thread::yield();
+    }
+    std::uint32_t head = *cq_head_;
+    const std::uint32_t tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+      const struct io_uring_cqe* cqe =
+          static_cast<const struct io_uring_cqe*>(cqes_) + (head & *cq_mask_);
+      InFlight* in_flight = reinterpret_cast<InFlight*>(cqe->user_data);
+      const int result = cqe->res;
+      ++head;
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+      if (in_flight == NULL) {
+        // The no-op entry of the destructor.
+        return;
+      }
+
+      // Failed and short transfers (such as reads past the end of the file)
+      // are finished synchronously.
+      IoRequest& request = in_flight->request;
+      bool ok = true;
+      const std::size_t done = result > 0 ? result : 0;
+      if (done < request.length) {
+        IoRequest rest = request;
+        rest.offset += done;
+        rest.buffer = static_cast<char*>(request.buffer) + done;
+        rest.length -= done;
+        try {
+          perform(rest);
+        } catch (const BadgerDbException&) {
+          ok = false;
+        }
+      }
+      if (request.done) {
+        request.done(ok);
+      }
+      delete in_flight;
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (--in_flight_ == 0) {
+        idle_.notify_all();
+      }
+    }
+  }
+}
+
+int UringIoEngine::enter(const std::uint32_t to_submit,
+                         const std::uint32_t min_complete,
+                         const std::uint32_t flags) {
+  return syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags,
+                 NULL, 0);
+}
+
+}
@@ -0,0 +1,287 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "file_backend.h"
+
+namespace badgerdb {
+
+/**
+ * @brief One read or write for an IoEngine.
+ */
+struct IoRequest {
+  /**
+   * Storage to read from or write to.
+   */
+  FileBackend* backend;
+
+  /**
+   * Whether this is a write.
+   */
+  bool write;
+
+  /**
+   * Offset in the storage.
+   */
+  off_t offset;
+
+  /**
+   * Buffer to read into or write from; must stay valid until completion.
+   */
+  void* buffer;
+
+  /**
+   * Number of bytes.
+   */
+  std::size_t length;
+
+  /**
+   * Called once the request has completed, with false if it failed.  Runs on
+   * one of the engine's threads, never inside submit().
+   */
+  std::function<void(const bool ok)> done;
+};
+
+/**
+ * @brief Runs reads and writes asynchronously, many per submission.
+ *
+ * submit() hands over a batch of requests and returns at once; each request's
+ * completion callback runs later on an engine thread.  Callbacks may take
+ * locks held by the thread calling submit() (BufMgr's, say), so submit()
+ * never waits for a request to complete.  Reads past the end of the storage
+ * read as zeroes, as with FileBackend::read().
+ *
+ * create() picks the io_uring engine, which hands a whole batch to the kernel
+ * with a single system call, and falls back to a pool of threads doing plain
+ * synchronous I/O where io_uring is not available.
+ */
+class IoEngine {
+ public:
+  virtual ~IoEngine();
+
+  /**
+   * Starts a batch of requests.
+   *
+   * @param requests  Requests to start.
+   */
+  virtual void submit(const std::vector<IoRequest>& requests) = 0;
+
+  /**
+   * Waits until every request submitted so far has completed (and its
+   * callback has returned).  Must not be called from a callback.
+   */
+  virtual void drain() = 0;
+
+  /**
+   * Returns the name of the engine, for reports.
+   */
+  virtual const char* name() const = 0;
+
+  /**
+   * Makes the best engine available.
+   *
+   * @param queue_depth   Number of requests the engine keeps in flight.
+   * @param num_threads   Number of threads of the thread pool engine.
+   * @param allow_uring   Whether io_uring may be used.
+   * @return  New engine; the caller owns it.
+   */
+  static IoEngine* create(const std::uint32_t queue_depth = 64,
+                          const std::uint32_t num_threads = 4,
+                          const bool allow_uring = true);
+
+  /**
+   * Does a request synchronously through its backend.
+   *
+   * @param request   Request to do; its callback is not called.
+   */
+  static void perform(const IoRequest& request);
+};
+
+/**
+ * @brief Engine running requests on a pool of threads with synchronous I/O.
+ */
+class ThreadPoolIoEngine : public IoEngine {
+ public:
+  /**
+   * Starts the threads.
+   *
+   * @param num_threads   Number of threads.
+   */
+  explicit ThreadPoolIoEngine(const std::uint32_t num_threads);
+
+  /**
+   * Completes the requests still queued and stops the threads.
+   */
+  ~ThreadPoolIoEngine();
+
+  void submit(const std::vector<IoRequest>& requests);
+
+  void drain();
+
+  const char* name() const { return "threads"; }
+
+ private:
+  /**
+   * Body of the threads.
+   */
+  void work();
+
+  /**
+   * Guards the queue and the counters.
+   */
+  std::mutex mutex_;
+
+  /**
+   * Signalled when requests are queued or the pool is to stop.
+   */
+  std::condition_variable work_ready_;
+
+  /**
+   * Signalled when the last pending request completes.
+   */
+  std::condition_variable idle_;
+
+  /**
+   * Requests not yet started.
+   */
+  std::deque<IoRequest> queue_;
+
+  /**
+   * Requests submitted but not completed.
+   */
+  std::size_t pending_;
+
+  /**
+   * Set to stop the threads.
+   */
+  bool stop_;
+
+  /**
+   * The threads.
+   */
+  std::vector<std::thread> threads_;
+};
+
+/**
+ * @brief Engine handing requests to the kernel through an io_uring.
+ *
+ * Requests on backends with a descriptor are queued on the ring, and each
+ * submit() enters the kernel once for the whole batch.  A completion thread
+ * reaps the results and runs the callbacks.  Requests on backends without a
+ * descriptor (compressed or in-memory files), requests beyond what the ring
+ * holds and requests the kernel refuses to take go to a thread pool instead.
+ */
+class UringIoEngine : public IoEngine {
+ public:
+  /**
+   * Sets up the ring.
+   *
+   * @param queue_depth   Number of requests the ring holds.
+   * @param num_threads   Number of threads of the fallback pool.
+   * @throws  BadgerDbException   If io_uring is not available.
+   */
+  UringIoEngine(const std::uint32_t queue_depth,
+                const std::uint32_t num_threads);
+
+  /**
+   * Completes the requests in flight and tears down the ring.
+   */
+  ~UringIoEngine();
+
+  void submit(const std::vector<IoRequest>& requests);
+
+  void drain();
+
+  const char* name() const { return "io_uring"; }
+
+ private:
+  /**
+   * A request on the ring, with the vector the kernel reads it through.
+   */
+  struct InFlight;
+
+  /**
+   * Body of the completion thread.
+   */
+  void reap();
+
+  /**
+   * Enters the kernel to submit queued entries and/or wait for completions.
+   */
+  int enter(const std::uint32_t to_submit, const std::uint32_t min_complete,
+            const std::uint32_t flags);
+
+  /**
+   * Descriptor of the ring.
+   */
+  int ring_fd_;
+
+  /**
+   * Mapped submission queue ring, completion queue ring and entry array.
+   */
+  void* sq_ring_;
+  void* cq_ring_;
+  void* sqes_;
+  std::size_t sq_ring_size_;
+  std::size_t cq_ring_size_;
+  std::size_t sqes_size_;
+
+  /**
+   * Pointers into the mapped rings.
+   */
+  std::uint32_t* sq_head_;
+  std::uint32_t* sq_tail_;
+  std::uint32_t* sq_mask_;
+  std::uint32_t* sq_array_;
+  std::uint32_t* cq_head_;
+  std::uint32_t* cq_tail_;
+  std::uint32_t* cq_mask_;
+  void* cqes_;
+
+  /**
+   * Number of entries of the submission queue.
+   */
+  std::uint32_t sq_entries_;
+
+  /**
+   * Guards the submission queue and the counters.
+   */
+  std::mutex mutex_;
+
+  /**
+   * Signalled when the last request in flight completes.
+   */
+  std::condition_variable idle_;
+
+  /**
+   * Requests on the ring and not yet reaped.
+   */
+  std::uint32_t in_flight_;
+
+  /**
+   * Runs requests the ring does not take.
+   */
+  ThreadPoolIoEngine fallback_;
+
+  /**
+   * The completion thread.
+   */
+  std::thread reaper_;
+};
+
+}
@@ -0,0 +1,422 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "log_manager.h"
+
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "exceptions/file_not_found_exception.h"
+#include "exceptions/io_error_exception.h"
+
+namespace badgerdb {
+
+/**
+ * Identifies a BadgerDB log file ("BDBL").
+ */
+static const std::uint32_t LOG_MAGIC = 0x4c424442;
+
+/**
+ * FNV-1a hash of a byte range, continuing from the given hash value.
+ */
+static std::uint32_t checksum(const void* data, const std::size_t length,
+                              std::uint32_t hash = 2166136261u) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (std::size_t i = 0; i < length; ++i) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+/**
+ * Appends the bytes of a value to a record payload.
+ */
+template <typename T>
+static void appendValue(std::string& payload, const T& value) {
+  payload.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+/**
+ * Appends a length-prefixed string to a record payload.
+ */
+static void appendString(std::string& payload, const std::string& value) {
+  appendValue(payload, std::uint32_t(value.size()));
+  payload.append(value);
+}
+
+/**
+ * Reads a value from a record payload, advancing the position.
+ */
+template <typename T>
+static bool readValue(const std::string& payload, std::size_t& position,
+                      T& value) {
+  if (payload.size() - position < sizeof(T)) {
+    return false;
+  }
+  memcpy(&value, payload.data() + position, sizeof(T));
+  position += sizeof(T);
+  return true;
+}
+
+/**
+ * Reads a length-prefixed string from a record payload, advancing the
+ * position.
+ */
+static bool readString(const std::string& payload, std::size_t& position,
+                       std::string& value) {
+  std::uint32_t length;
+  if (!readValue(payload, position, length) ||
+      payload.size() - position < length) {
+    return false;
+  }
+  value.assign(payload, position, length);
+  position += length;
+  return true;
+}
+
+LogManager::LogManager(const std::string& filename,
+                       const std::uint32_t async_commit_group)
+    : filename_(filename),
+      fd_(-1),
+      base_lsn_(0),
+      written_lsn_(0),
+      durable_lsn_(0),
+      end_lsn_(0),
+      last_commit_lsn_(0),
+      checkpoint_lsn_(0),
+      async_commit_group_(async_commit_group),
+      pending_commits_(0),
+      syncing_(false),
+      sync_count_(0) {
+  fd_ = ::open(filename_.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd_ < 0) {
+    throw FileNotFoundException(filename_);
+  }
+  recover();
+}
+
+LogManager::~LogManager() {
+  try {
+    flush();
+  } catch (const IoErrorException&) {
+    // No commit was reported durable past what made it to disk.
+  }
+  ::close(fd_);
+}
+
+Lsn LogManager::logPage(const std::string& filename, const PageId page_number,
+                        const Page& page) {
+  std::string payload;
+  payload.reserve(sizeof(std::uint32_t) + filename.size() + sizeof(PageId) +
+                  Page::SIZE);
+  appendString(payload, filename);
+  appendValue(payload, page_number);
+  payload.append(reinterpret_cast<const char*>(&page), Page::SIZE);
+  std::lock_guard<std::mutex> lock(mutex_);
+  return append(PAGE_RECORD, payload);
+}
+
+Lsn LogManager::logMetadata(const std::string& filename,
+                            const MetadataImage& image) {
+  std::string payload;
+  appendString(payload, filename);
+  appendValue(payload, image.header);
+  appendValue(payload, std::uint32_t(image.links.size()));
+  for (std::size_t i = 0; i < image.links.size(); ++i) {
+    appendValue(payload, image.links[i]);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  return append(METADATA_RECORD, payload);
+}
+
+Lsn LogManager::commit() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  const Lsn lsn = append(COMMIT_RECORD, std::string());
+  last_commit_lsn_ = lsn;
+  if (async_commit_group_ == 0 || ++pending_commits_ >= async_commit_group_) {
+    waitDurable(lock, lsn);
+  }
+  return lsn;
+}
+
+Lsn LogManager::checkpoint(const Lsn redo_lsn) {
+  std::string payload;
+  appendValue(payload, redo_lsn);
+  std::unique_lock<std::mutex> lock(mutex_);
+  const Lsn lsn = append(CHECKPOINT_RECORD, payload);
+  waitDurable(lock, lsn);
+  if (redo_lsn <= checkpoint_lsn_) {
+    return lsn;
+  }
+  writeFileHeader(redo_lsn);
+  checkpoint_lsn_ = redo_lsn;
+
+  // Nothing before the redo LSN is read again; give its space back, keeping
+  // the file header and whole blocks only.
+  const off_t block = 4096;
+  const off_t release_end =
+      (off_t(sizeof(LogFileHeader) + (redo_lsn - base_lsn_)) / block) * block;
+  if (release_end > block) {
+    ::fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, block,
+                release_end - block);
+  }
+  return lsn;
+}
+
+void LogManager::flush() {
+  Lsn lsn;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lsn = end_lsn_;
+  }
+  flush(lsn);
+}
+
+void LogManager::flush(const Lsn lsn) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  waitDurable(lock, lsn);
+}
+
+void LogManager::waitDurable(std::unique_lock<std::mutex>& lock,
+                             const Lsn lsn) {
+  while (durable_lsn_ < lsn) {
+    if (syncing_) {
+      // The fsync in progress may not cover the LSN; then the next one will.
+      synced_.wait(lock);
+      continue;
+    }
+    syncing_ = true;
+    try {
+      writeBuffer();
+    } catch (const IoErrorException&) {
+      syncing_ = false;
+      synced_.notify_all();
+      throw;
+    }
+    const Lsn written = written_lsn_;
+    pending_commits_ = 0;
+
+    // Appends may carry on while the log is forced to disk.
+    lock.unlock();
+    const int error = ::fdatasync(fd_) != 0 ? errno : 0;
+    lock.lock();
+    syncing_ = false;
+    synced_.notify_all();
+    if (error != 0) {
+      throw IoErrorException(filename_, "sync", error);
+    }
+    if (written > durable_lsn_) {
+      durable_lsn_ = written;
+    }
+    ++sync_count_;
+  }
+}
+
+Lsn LogManager::durableLsn() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return durable_lsn_;
+}
+
+Lsn LogManager::endLsn() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return end_lsn_;
+}
+
+Lsn LogManager::lastCommitLsn() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return last_commit_lsn_;
+}
+
+Lsn LogManager::checkpointLsn() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return checkpoint_lsn_;
+}
+
+std::uint32_t LogManager::syncCount() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sync_count_;
+}
+
+Lsn LogManager::append(const RecordType type, const std::string& payload) {
+  LogRecordHeader header;
+  header.type = type;
+  header.length = payload.size();
+  header.lsn = end_lsn_ + sizeof(LogRecordHeader) + payload.size();
+  header.checksum = 0;
+  header.padding = 0;
+  header.checksum = checksum(payload.data(), payload.size(),
+                             checksum(&header, sizeof(LogRecordHeader)));
+
+  buffer_.append(reinterpret_cast<const char*>(&header),
+                 sizeof(LogRecordHeader));
+  buffer_.append(payload);
+  end_lsn_ = header.lsn;
+  if (buffer_.size() >= BUFFER_SIZE) {
+    writeBuffer();
+  }
+  return end_lsn_;
+}
+
+void LogManager::writeBuffer() {
+  const off_t offset = sizeof(LogFileHeader) + (written_lsn_ - base_lsn_);
+  std::size_t done = 0;
+  while (done < buffer_.size()) {
+    const ssize_t result = ::pwrite(fd_, buffer_.data() + done,
+                                    buffer_.size() - done, offset + done);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      throw IoErrorException(filename_, "write", result < 0 ? errno : 0);
+    }
+    done += result;
+  }
+  written_lsn_ = end_lsn_;
+  buffer_.clear();
+}
+
+void LogManager::writeFileHeader(const Lsn checkpoint_lsn) {
+  LogFileHeader file_header;
+  file_header.magic = LOG_MAGIC;
+  file_header.padding = 0;
+  file_header.base_lsn = base_lsn_;
+  file_header.checkpoint_lsn = checkpoint_lsn;
+  const ssize_t result = ::pwrite(fd_, &file_header, sizeof(LogFileHeader), 0);
+  if (result != ssize_t(sizeof(LogFileHeader))) {
+    throw IoErrorException(filename_, "write", result < 0 ? errno : 0);
+  }
+  if (::fdatasync(fd_) != 0) {
+    throw IoErrorException(filename_, "sync", errno);
+  }
+}
+
+bool LogManager::readRecord(const off_t offset, LogRecordHeader& header,
+                            std::string& payload) const {
+  if (::pread(fd_, &header, sizeof(LogRecordHeader), offset) !=
+      ssize_t(sizeof(LogRecordHeader))) {
+    return false;
+  }
+  struct stat file_stat;
+  if (::fstat(fd_, &file_stat) != 0 ||
+      header.length > file_stat.st_size - offset - sizeof(LogRecordHeader)) {
+    // Torn header: the length cannot be trusted.
+    return false;
+  }
+  payload.resize(header.length);
+  if (header.length > 0 &&
+      ::pread(fd_, &payload[0], header.length,
+              offset + sizeof(LogRecordHeader)) != ssize_t(header.length)) {
+    return false;
+  }
+  LogRecordHeader unsummed = header;
+  unsummed.checksum = 0;
+  return header.checksum ==
+         checksum(payload.data(), payload.size(),
+                  checksum(&unsummed, sizeof(LogRecordHeader)));
+}
+
+void LogManager::recover() {
+  LogFileHeader file_header;
+  if (::pread(fd_, &file_header, sizeof(LogFileHeader), 0) !=
+          ssize_t(sizeof(LogFileHeader)) ||
+      file_header.magic != LOG_MAGIC) {
+    // New (or unusable) log: nothing to recover.
+    file_header.magic = LOG_MAGIC;
+    file_header.padding = 0;
+    file_header.base_lsn = 0;
+    file_header.checkpoint_lsn = 0;
+  }
+  struct stat file_stat;
+  ::fstat(fd_, &file_stat);
+  if (file_header.checkpoint_lsn < file_header.base_lsn ||
+      file_header.checkpoint_lsn - file_header.base_lsn >
+          Lsn(file_stat.st_size)) {
+    file_header.checkpoint_lsn = file_header.base_lsn;
+  }
+
+  // Everything before the last checkpoint is in the data files already.  Find
+  // the end of the last commit record; anything after it belongs to changes
+  // that never committed.
+  const off_t start = sizeof(LogFileHeader) +
+                      (file_header.checkpoint_lsn - file_header.base_lsn);
+  off_t end = start;
+  off_t commit_end = start;
+  LogRecordHeader header;
+  std::string payload;
+  while (readRecord(end, header, payload)) {
+    end += sizeof(LogRecordHeader) + header.length;
+    if (header.type == COMMIT_RECORD) {
+      commit_end = end;
+    }
+  }
+
+  std::vector<std::string> recovered;
+  for (off_t offset = start; offset < commit_end;
+       offset += sizeof(LogRecordHeader) + header.length) {
+    readRecord(offset, header, payload);
+    std::size_t position = 0;
+    std::string filename;
+    if (header.type == COMMIT_RECORD || header.type == CHECKPOINT_RECORD ||
+        !readString(payload, position, filename) || !File::exists(filename)) {
+      // Files removed after they were logged are not brought back.
+      continue;
+    }
+    if (header.type == PAGE_RECORD) {
+      PageId page_number;
+      if (!readValue(payload, position, page_number) ||
+          payload.size() - position != Page::SIZE) {
+        continue;
+      }
+      Page page;
+      memcpy(&page, payload.data() + position, Page::SIZE);
+      File::redoPage(filename, page_number, page);
+    } else if (header.type == METADATA_RECORD) {
+      MetadataImage image;
+      std::uint32_t num_links;
+      if (!readValue(payload, position, image.header) ||
+          !readValue(payload, position, num_links)) {
+        continue;
+      }
+      image.links.resize(num_links);
+      for (std::uint32_t i = 0; i < num_links; ++i) {
+        readValue(payload, position, image.links[i]);
+      }
+      File::redoMetadata(filename, image);
+    }
+    if (std::find(recovered.begin(), recovered.end(), filename) ==
+        recovered.end()) {
+      recovered.push_back(filename);
+    }
+  }
+  for (std::size_t i = 0; i < recovered.size(); ++i) {
+    File::sync(recovered[i]);
+  }
+
+  // The data files now hold everything committed, so the log starts over.
+  // LSNs carry on from the end of what was read, dropped tail included.
+  base_lsn_ = file_header.base_lsn + (end - sizeof(LogFileHeader));
+  written_lsn_ = base_lsn_;
+  durable_lsn_ = base_lsn_;
+  end_lsn_ = base_lsn_;
+  last_commit_lsn_ = base_lsn_;
+  checkpoint_lsn_ = base_lsn_;
+  while (::ftruncate(fd_, 0) < 0) {
+    if (errno != EINTR) {
+      throw IoErrorException(filename_, "truncate", errno);
+    }
+  }
+  writeFileHeader(checkpoint_lsn_);
+}
+
+}
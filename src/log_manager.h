@@ -0,0 +1,372 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "file.h"
+#include "page.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Log sequence number: the position just past a record in the log.
+ *
+ * LSNs only grow, also across recovery, so a larger LSN is always a later
+ * record.
+ */
+typedef std::uint64_t Lsn;
+
+/**
+ * @brief Header preceding every record in the log.
+ */
+struct LogRecordHeader {
+  /**
+   * Kind of record (one of LogManager::RecordType).
+   */
+  std::uint32_t type;
+
+  /**
+   * Number of payload bytes following the header.
+   */
+  std::uint32_t length;
+
+  /**
+   * LSN of the record, i.e. its end position in the log.
+   */
+  Lsn lsn;
+
+  /**
+   * Checksum over the header (with this field zero) and the payload, so a
+   * record torn by a crash is recognised as the end of the log.
+   */
+  std::uint32_t checksum;
+
+  /**
+   * Padding to keep the size of the header a multiple of 8 bytes.
+   */
+  std::uint32_t padding;
+};
+
+/**
+ * @brief Write-ahead log of page-level redo records.
+ *
+ * The buffer manager appends an image of each page changed since the last
+ * commit, and of each file's changed metadata, followed by a commit record.
+ * Records are collected in a log buffer and forced to disk together.  commit()
+ * returns once its commit record is durable; of the threads waiting for the
+ * log to reach disk one at a time forces it, and its fsync covers everything
+ * appended until then, so commits arriving meanwhile share the next one
+ * (group commit).  With asynchronous commit, which has to be asked for,
+ * commit() only forces the log every async_commit_group commits and a crash
+ * may lose the commits since; a commit is durable once durableLsn() has
+ * reached its LSN, and flush() forces this early.  Failing to write or sync
+ * the log throws IoErrorException and leaves durableLsn() where it was.
+ *
+ * Pages must not be written back to their files before the log is durable up
+ * to the last record for them (the WAL rule); BufMgr takes care of this.
+ *
+ * A checkpoint (see BufMgr::checkpoint) records the LSN from which the log is
+ * needed to redo committed changes that may not be in the data files yet;
+ * the log before it is released.
+ *
+ * Constructing a LogManager runs recovery: every change from the last
+ * checkpoint up to the last commit record in the log is written into the data
+ * files, changes after it are dropped, and the log starts over empty.  It
+ * must therefore be constructed before any of the logged files are opened.
+ * Files must not be removed and created again under the same name while the
+ * log still holds records for them.
+ *
+ * All methods may be called from several threads.  Forcing the log to disk
+ * does not block threads appending to it.
+ */
+class LogManager {
+ public:
+  /**
+   * Kinds of records in the log.
+   */
+  enum RecordType {
+    /**
+     * Image of a page: file name, page number and page contents.
+     */
+    PAGE_RECORD = 1,
+
+    /**
+     * File metadata: file name, header and changed page links.
+     */
+    METADATA_RECORD = 2,
+
+    /**
+     * Commit: all records before it survive a crash.
+     */
+    COMMIT_RECORD = 3,
+
+    /**
+     * Checkpoint: LSN from which recovery has to replay the log.
+     */
+    CHECKPOINT_RECORD = 4
+  };
+
+  /**
+   * Size at which the log buffer is written out to the log file.
+   */
+  static const std::uint32_t BUFFER_SIZE = 1024 * 1024;
+
+  /**
+   * Opens (or creates) a log and recovers the files it covers.
+   *
+   * @param filename            Name of the log file.
+   * @param async_commit_group  Zero for commits that wait until they are
+   *                            durable; otherwise commit asynchronously,
+   *                            forcing the log every this many commits.
+   * @throws  IoErrorException  If the log cannot be written or synced.
+   */
+  LogManager(const std::string& filename,
+             const std::uint32_t async_commit_group = 0);
+
+  /**
+   * Forces the rest of the log to disk and closes it.  Commits that cannot
+   * be forced to disk here are lost, as the log was never durable up to them.
+   */
+  ~LogManager();
+
+  /**
+   * Appends the image of a page.
+   *
+   * @param filename      Name of the file the page belongs to.
+   * @param page_number   Number of the page.
+   * @param page          Contents of the page.
+   * @return  LSN of the record.
+   */
+  Lsn logPage(const std::string& filename, const PageId page_number,
+              const Page& page);
+
+  /**
+   * Appends the changed metadata of a file.
+   *
+   * @param filename  Name of the file.
+   * @param image     Metadata to log.
+   * @return  LSN of the record.
+   */
+  Lsn logMetadata(const std::string& filename, const MetadataImage& image);
+
+  /**
+   * Appends a commit record and waits until it is durable; with asynchronous
+   * commit, only forces the log if this completes a group of commits.
+   *
+   * @return  LSN of the commit record.
+   * @throws  IoErrorException  If the log cannot be written or synced.
+   */
+  Lsn commit();
+
+  /**
+   * Records a completed checkpoint: all committed changes logged before
+   * <redo_lsn> are on stable storage in the data files, so recovery starts
+   * replaying there.  Log space before it is released to the filesystem.
+   *
+   * @param redo_lsn  LSN from which the log is needed for recovery.
+   * @return  LSN of the checkpoint record.
+   * @throws  IoErrorException  If the log cannot be written or synced.
+   */
+  Lsn checkpoint(const Lsn redo_lsn);
+
+  /**
+   * Forces the log to disk at least up to the given LSN.
+   *
+   * @param lsn   LSN that must be durable when this returns.
+   * @throws  IoErrorException  If the log cannot be written or synced.
+   */
+  void flush(const Lsn lsn);
+
+  /**
+   * Forces the whole log to disk.
+   *
+   * @throws  IoErrorException  If the log cannot be written or synced.
+   */
+  void flush();
+
+  /**
+   * Returns the LSN up to which the log is on stable storage.
+   */
+  Lsn durableLsn() const;
+
+  /**
+   * Returns the LSN of the last record appended.
+   */
+  Lsn endLsn() const;
+
+  /**
+   * Returns the LSN of the last commit record appended.
+   */
+  Lsn lastCommitLsn() const;
+
+  /**
+   * Returns the LSN from which recovery would replay the log now.
+   */
+  Lsn checkpointLsn() const;
+
+  /**
+   * Returns the number of times the log has been forced to disk.
+   */
+  std::uint32_t syncCount() const;
+
+ private:
+  /**
+   * Header at the start of the log file.
+   */
+  struct LogFileHeader {
+    /**
+     * Identifies the file as a BadgerDB log.
+     */
+    std::uint32_t magic;
+
+    /**
+     * Padding to keep base_lsn 8-byte aligned.
+     */
+    std::uint32_t padding;
+
+    /**
+     * LSN of the first byte after this header.
+     */
+    Lsn base_lsn;
+
+    /**
+     * LSN of the record recovery starts at (the last checkpoint's redo LSN).
+     */
+    Lsn checkpoint_lsn;
+  };
+
+  /**
+   * Replays the log into the data files from the last checkpoint up to the
+   * last commit record, then empties the log.
+   */
+  void recover();
+
+  /**
+   * Reads the record at the given offset of the log file, checking it.
+   *
+   * @param offset    Offset of the record in the log file.
+   * @param header    Set to the record header.
+   * @param payload   Set to the record payload.
+   * @return  False if there is no complete, intact record at the offset.
+   */
+  bool readRecord(const off_t offset, LogRecordHeader& header,
+                  std::string& payload) const;
+
+  /**
+   * Appends a record to the log buffer, writing the buffer out if it is full.
+   *
+   * @param type      Kind of record.
+   * @param payload   Payload of the record.
+   * @return  LSN of the record.
+   */
+  Lsn append(const RecordType type, const std::string& payload);
+
+  /**
+   * Waits until the log is durable up to the given LSN, forcing it to disk
+   * unless another thread is doing so already.
+   *
+   * @param lock  Lock held on mutex_; released while forcing or waiting.
+   * @param lsn   LSN that must be durable when this returns.
+   */
+  void waitDurable(std::unique_lock<std::mutex>& lock, const Lsn lsn);
+
+  /**
+   * Writes the log buffer to the end of the log file.  On failure the buffer
+   * is kept, to be written again.
+   */
+  void writeBuffer();
+
+  /**
+   * Writes the log file header and syncs it.
+   *
+   * @param checkpoint_lsn  LSN of the record recovery is to start at.
+   */
+  void writeFileHeader(const Lsn checkpoint_lsn);
+
+  /**
+   * Guards all members but the descriptor, which is used without it to force
+   * the log to disk.
+   */
+  mutable std::mutex mutex_;
+
+  /**
+   * Name of the log file.
+   */
+  std::string filename_;
+
+  /**
+   * Descriptor of the log file.
+   */
+  int fd_;
+
+  /**
+   * Records appended but not yet written to the log file.
+   */
+  std::string buffer_;
+
+  /**
+   * LSN of the first byte of the log file after its header.
+   */
+  Lsn base_lsn_;
+
+  /**
+   * LSN up to which the log has been written to the log file.
+   */
+  Lsn written_lsn_;
+
+  /**
+   * LSN up to which the log file is on stable storage.
+   */
+  Lsn durable_lsn_;
+
+  /**
+   * LSN of the last record appended.
+   */
+  Lsn end_lsn_;
+
+  /**
+   * LSN of the last commit record appended.
+   */
+  Lsn last_commit_lsn_;
+
+  /**
+   * LSN from which recovery replays the log.
+   */
+  Lsn checkpoint_lsn_;
+
+  /**
+   * Commits per fsync of the log with asynchronous commit, or zero.
+   */
+  std::uint32_t async_commit_group_;
+
+  /**
+   * Commits appended since the log was last forced to disk.
+   */
+  std::uint32_t pending_commits_;
+
+  /**
+   * Whether a thread is forcing the log to disk.
+   */
+  bool syncing_;
+
+  /**
+   * Signalled whenever a thread is done forcing the log to disk.
+   */
+  std::condition_variable synced_;
+
+  /**
+   * Number of times the log has been forced to disk.
+   */
+  std::uint32_t sync_count_;
+};
+
+}
@@ -5,20 +5,43 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <set>
+#include <thread>
 #include <vector>
 #include "btree.h"
 #include "page.h"
+#include "page_directory.h"
 #include "filescan.h"
 #include "page_iterator.h"
 #include "file_iterator.h"
+#include "log_manager.h"
+#include "compressed_backend.h"
+#include "mem_backend.h"
+#include "simulated_disk_backend.h"
+#include "io_engine.h"
+#include "parallel_filescan.h"
+#include "zone_map.h"
 #include "exceptions/insufficient_space_exception.h"
 #include "exceptions/index_scan_completed_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/no_such_key_found_exception.h"
 #include "exceptions/bad_scanrange_exception.h"
 #include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_scan_param_exception.h"
+#include "exceptions/buffer_exceeded_exception.h"
 #include "exceptions/scan_not_initialized_exception.h"
 #include "exceptions/end_of_file_exception.h"
+#include "exceptions/page_format_exception.h"
+#include "exceptions/invalid_page_exception.h"
+#include "exceptions/invalid_record_exception.h"
+#include "exceptions/io_error_exception.h"
 
 #define checkPassFail(a, b) 																				\
 {																																		\
@@ -82,6 +105,38 @@ void test6();
 void test7();
 void test8();
 void test9();
+void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
+void test18();
+void test19();
+void test20();
+void test21();
+void test22();
+void test23();
+void test24();
+void test25();
+void test26();
+void test27();
+void test28();
+void test29();
+void test30();
+void test31();
+void test32();
+void test33();
+void test34();
+void test35();
+void test36();
+int predicateScan(std::size_t offset, Datatype type, const void *lowVal,
+                  Operator lowOp, const void *highVal, Operator highOp,
+                  std::size_t length, int low, int high, bool &inRange);
+int createRelation(int numRecords, bool fixedLength = false, int deleteEvery = 0);
+int recordsPerPage();
 
 void createRelationForward_with_size(int size);
 void createRelationBackward_with_size(int size);
@@ -164,6 +219,33 @@ int main(int argc, char **argv)
     test7();
     test8();
     test9();
+    test10();
+    test11();
+    test12();
+    test13();
+    test14();
+    test15();
+    test16();
+    test17();
+    test18();
+    test19();
+    test20();
+    test21();
+    test22();
+    test23();
+    test24();
+    test25();
+    test26();
+    test27();
+    test28();
+    test29();
+    test30();
+    test31();
+    test32();
+    test33();
+    test34();
+    test35();
+    test36();
 
 	delete bufMgr;
 
@@ -279,6 +361,2278 @@ void test9() {
     deleteRelation();
 }
 
+/*
+ * page deletion and free page reuse test
+ */
+void test10() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test10_deletePage_and_reuse" << std::endl;
+
+    createRelationForward();
+
+    // Delete the head, the tail and every third page in between, then count
+    // the used pages left in the file.
+    std::vector<PageId> pages;
+    for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter) {
+        pages.push_back((*iter).page_number());
+    }
+    int numDeleted = 0;
+    for (size_t i = 0; i < pages.size(); i++) {
+        if (i == 0 || i == pages.size() - 1 || i % 3 == 1) {
+            file1->deletePage(pages[i]);
+            numDeleted++;
+        }
+    }
+    int numUsed = 0;
+    for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter) {
+        numUsed++;
+    }
+    checkPassFail(numUsed, (int)pages.size() - numDeleted);
+
+    // Freed pages are handed out again before the file grows.
+    for (int i = 0; i < numDeleted; i++) {
+        PageId new_page_number;
+        file1->allocatePage(new_page_number);
+        bool reused = new_page_number <= pages.back();
+        checkPassFail(reused, true);
+    }
+    // Reused pages take their old places in the used list, so iteration is
+    // still in page number order and visits every page again.
+    std::vector<PageId> reusedPages;
+    for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter) {
+        reusedPages.push_back((*iter).page_number());
+    }
+    const bool inOrder = reusedPages == pages;
+    checkPassFail(inOrder, true);
+
+    // Links are right in both directions after deleting a page between two
+    // reused ones and reusing it once more.
+    file1->deletePage(pages[2]);
+    PageId again;
+    file1->allocatePage(again);
+    checkPassFail(again, pages[2]);
+    const Page middle = file1->readPage(again);
+    const bool linked = middle.prev_page_number() == pages[1] &&
+                        middle.next_page_number() == pages[3];
+    checkPassFail(linked, true);
+
+    deleteRelation();
+}
+
+void test11() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test11_compact" << std::endl;
+
+    createRelationForward();
+
+    // Punch holes into the file and refill some of them.
+    std::vector<PageId> pages;
+    for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter) {
+        pages.push_back((*iter).page_number());
+    }
+    for (size_t i = 0; i < pages.size(); i++) {
+        if (i % 3 == 0) {
+            file1->deletePage(pages[i]);
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        PageId new_page_number;
+        Page new_page = file1->allocatePage(new_page_number);
+        new_page.insertRecord("refilled page");
+        file1->writePage(new_page_number, new_page);
+    }
+
+    std::vector<RecordId> rids;
+    std::vector<std::string> records;
+    for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter) {
+        Page page = *iter;
+        for (PageIterator rec = page.begin(); rec != page.end(); ++rec) {
+            rids.push_back(rec.getCurrentRecord());
+            records.push_back(*rec);
+        }
+    }
+
+    std::vector<PageRemap> remap = file1->compact();
+
+    // Used pages are now 1..n in list order, and every record is found under
+    // its remapped ID.
+    PageId expected = 1;
+    for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter) {
+        checkPassFail((*iter).page_number(), expected);
+        expected++;
+    }
+    bool allFound = true;
+    for (size_t i = 0; i < rids.size(); i++) {
+        RecordId rid = PageFile::remapRecordId(remap, rids[i]);
+        if (file1->readPage(rid.page_number).getRecord(rid) != records[i]) {
+            allFound = false;
+        }
+    }
+    checkPassFail(allFound, true);
+
+    // The compacted layout survives closing and reopening the file.
+    delete file1;
+    file1 = new PageFile(relationName, false);
+    int numUsed = 0;
+    for (FileIterator iter = file1->begin(); iter != file1->end(); ++iter) {
+        numUsed++;
+    }
+    checkPassFail(numUsed, (int)(expected - 1));
+
+    deleteRelation();
+}
+
+void test12() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test12_wal_recovery" << std::endl;
+
+    const std::string logName = "relA.wal";
+    const int numPages = 40;
+    deleteRelation();
+    ::unlink(logName.c_str());
+
+    // The child commits a batch of pages, changes more without committing and
+    // then dies without flushing anything but the log.
+    pid_t pid = fork();
+    if (pid == 0) {
+        LogManager log(logName);
+        BufMgr mgr(16, &log);
+        PageFile file = PageFile::create(relationName);
+        for (int i = 0; i < numPages; i++) {
+            PageId pageNo;
+            Page* page;
+            mgr.allocPage(&file, pageNo, page);
+            char record[32];
+            sprintf(record, "committed %d", i);
+            page->insertRecord(record);
+            mgr.unPinPage(&file, pageNo, true);
+            // uncommitted pages cannot be evicted, so commit as the pool fills
+            if (mgr.commitDue()) {
+                mgr.commit();
+            }
+        }
+        mgr.commit();
+
+        Page* page;
+        mgr.readPage(&file, file.getFirstPageNo(), page);
+        page->insertRecord("uncommitted");
+        mgr.unPinPage(&file, file.getFirstPageNo(), true);
+        PageId pageNo;
+        mgr.allocPage(&file, pageNo, page);
+        mgr.unPinPage(&file, pageNo, true);
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+
+    // Recovery brings back exactly the committed pages.
+    {
+        LogManager log(logName);
+        PageFile file = PageFile::open(relationName);
+        int pagesFound = 0;
+        bool recordsMatch = true;
+        for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+            Page page = *iter;
+            char record[32];
+            sprintf(record, "committed %d", pagesFound);
+            int numRecords = 0;
+            for (PageIterator rec = page.begin(); rec != page.end(); ++rec) {
+                if (*rec != record) {
+                    recordsMatch = false;
+                }
+                numRecords++;
+            }
+            if (numRecords != 1) {
+                recordsMatch = false;
+            }
+            pagesFound++;
+        }
+        checkPassFail(pagesFound, numPages);
+        checkPassFail(recordsMatch, true);
+    }
+    File::remove(relationName);
+    ::unlink(logName.c_str());
+
+    // A pool full of uncommitted pages refuses to allocate a frame rather
+    // than commit changes that may be half done.
+    {
+        LogManager log(logName);
+        BufMgr mgr(4, &log);
+        PageFile file = PageFile::create(relationName);
+        bool exceeded = false;
+        try {
+            for (int i = 0; i < 5; i++) {
+                PageId pageNo;
+                Page* page;
+                mgr.allocPage(&file, pageNo, page);
+                mgr.unPinPage(&file, pageNo, true);
+            }
+        } catch (const BufferExceededException &e) {
+            exceeded = true;
+        }
+        checkPassFail(exceeded, true);
+        const bool nothingCommitted = log.lastCommitLsn() == 0;
+        checkPassFail(nothingCommitted, true);
+        mgr.flushFile(&file);
+    }
+    File::remove(relationName);
+    ::unlink(logName.c_str());
+}
+
+void test13() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test13_checkpoint_recovery" << std::endl;
+
+    const std::string logName = "relA.wal";
+    const int numPages = 60;
+    ::unlink(logName.c_str());
+
+    // The child commits pages while the checkpointer runs, takes a checkpoint,
+    // commits one more change and dies.
+    pid_t pid = fork();
+    if (pid == 0) {
+        LogManager log(logName, 4 /* async_commit_group */);
+        BufMgr mgr(16, &log);
+        mgr.startCheckpointer(1 /* intervalMillis */, 5000 /* pagesPerSecond */);
+        PageFile file = PageFile::create(relationName);
+        for (int i = 0; i < numPages; i++) {
+            PageId pageNo;
+            Page* page;
+            mgr.allocPage(&file, pageNo, page);
+            char record[32];
+            sprintf(record, "committed %d", i);
+            page->insertRecord(record);
+            mgr.unPinPage(&file, pageNo, true);
+            mgr.commit();
+        }
+        mgr.checkpoint();
+        const bool checkpointed = log.checkpointLsn() > 0;
+
+        Page* page;
+        mgr.readPage(&file, file.getFirstPageNo(), page);
+        page->insertRecord("after checkpoint");
+        mgr.unPinPage(&file, file.getFirstPageNo(), true);
+        mgr.commit();
+        log.flush();
+        _exit(checkpointed ? 0 : 1);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    const bool childDone = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    checkPassFail(childDone, true);
+
+    {
+        LogManager log(logName);
+        PageFile file = PageFile::open(relationName);
+        int pagesFound = 0;
+        int recordsFound = 0;
+        for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+            Page page = *iter;
+            for (PageIterator rec = page.begin(); rec != page.end(); ++rec) {
+                recordsFound++;
+            }
+            pagesFound++;
+        }
+        checkPassFail(pagesFound, numPages);
+        checkPassFail(recordsFound, numPages + 1);
+    }
+
+    File::remove(relationName);
+    ::unlink(logName.c_str());
+}
+
+void test14() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test14_compressed_file" << std::endl;
+
+    const int numPages = 50;
+    deleteRelation();
+
+    // Keep hold of the backend the file is created with to read its counters.
+    CompressedBackend* backend = NULL;
+    const BackendFactory factory =
+        [&backend](const std::string& name, const bool create_new) {
+            backend = new CompressedBackend(name, create_new);
+            return backend;
+        };
+    std::vector<std::string> records;
+    {
+        PageFile file = PageFile::create(relationName, factory);
+        for (int i = 0; i < numPages; i++) {
+            PageId pageNo;
+            Page* page;
+            bufMgr->allocPage(&file, pageNo, page);
+            for (int j = 0; j <= i % 5; j++) {
+                char record[32];
+                sprintf(record, "%05d compressed record", i * 5 + j);
+                page->insertRecord(record);
+                records.push_back(record);
+            }
+            bufMgr->unPinPage(&file, pageNo, true);
+        }
+        bufMgr->flushFile(&file);
+        file.flushMetadata();
+
+        // Mostly empty pages shrink to a fraction of their size.
+        const CompressionStats stats = backend->stats();
+        const bool compressed =
+            stats.logical_bytes_written > 2 * stats.physical_bytes_written;
+        checkPassFail(compressed, true);
+    }
+
+    // Reopened without a factory, the file is recognised as compressed.
+    {
+        PageFile file = PageFile::open(relationName);
+        size_t found = 0;
+        bool recordsMatch = true;
+        for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+            Page page = *iter;
+            for (PageIterator rec = page.begin(); rec != page.end(); ++rec) {
+                if (found >= records.size() || *rec != records[found]) {
+                    recordsMatch = false;
+                }
+                found++;
+            }
+        }
+        checkPassFail(found, records.size());
+        checkPassFail(recordsMatch, true);
+    }
+
+    File::remove(relationName);
+    checkPassFail(CompressedBackend::isCompressed(relationName), false);
+}
+
+void test15() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test15_memory_file" << std::endl;
+
+    const int numPages = 40;
+    deleteRelation();
+
+    // An unbounded in-memory file never touches the disk, and can be opened
+    // again by name for a scan.
+    {
+        PageFile file = PageFile::create(relationName, MemBackend::factory());
+        for (int i = 0; i < numPages; i++) {
+            PageId pageNo;
+            Page* page;
+            bufMgr->allocPage(&file, pageNo, page);
+            page->insertRecord("in memory");
+            bufMgr->unPinPage(&file, pageNo, true);
+        }
+        bufMgr->flushFile(&file);
+    }
+    struct stat fileStat;
+    bool onDisk = ::stat(relationName.c_str(), &fileStat) == 0;
+    checkPassFail(onDisk, false);
+    checkPassFail(File::exists(relationName), true);
+    {
+        FileScan scan(relationName, bufMgr);
+        int numRecords = 0;
+        try {
+            RecordId rid;
+            while (true) {
+                scan.scanNext(rid);
+                numRecords++;
+            }
+        } catch (const EndOfFileException &e) {
+        }
+        checkPassFail(numRecords, numPages);
+    }
+    File::remove(relationName);
+    checkPassFail(File::exists(relationName), false);
+    checkPassFail(MemBackend::bytesInUse(), 0);
+
+    // A capped file spills to disk once it outgrows its capacity, and is
+    // found there afterwards.
+    {
+        PageFile file = PageFile::create(
+            relationName, MemBackend::factory(16 * Page::SIZE));
+        for (int i = 0; i < numPages; i++) {
+            PageId pageNo;
+            Page* page;
+            bufMgr->allocPage(&file, pageNo, page);
+            page->insertRecord("spilled");
+            bufMgr->unPinPage(&file, pageNo, true);
+        }
+        bufMgr->flushFile(&file);
+    }
+    onDisk = ::stat(relationName.c_str(), &fileStat) == 0;
+    checkPassFail(onDisk, true);
+    checkPassFail(MemBackend::exists(relationName), false);
+    {
+        PageFile file = PageFile::open(relationName);
+        int numUsed = 0;
+        for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+            numUsed++;
+        }
+        checkPassFail(numUsed, numPages);
+    }
+    File::remove(relationName);
+}
+
+void test16() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test16_simulated_disk" << std::endl;
+
+    const int numPages = 10;
+    deleteRelation();
+
+    // One page takes 1000us to transfer, and a seek 5000us more.
+    DiskProfile profile = DiskProfile::hdd();
+    profile.seek_micros = 5000;
+    profile.access_micros = 0;
+    profile.bandwidth = Page::SIZE * 1000;
+    profile.jitter_micros = 0;
+
+    // Keep hold of the backend the file is created with to read its counters.
+    SimulatedDiskBackend* backend = NULL;
+    const BackendFactory factory =
+        [&backend, &profile](const std::string& name, const bool create_new) {
+            backend = new SimulatedDiskBackend(
+                FileBackend::open(name, create_new), profile);
+            return backend;
+        };
+    {
+        PageFile file = PageFile::create(relationName, factory);
+        std::vector<PageId> pages;
+        for (int i = 0; i < numPages; i++) {
+            PageId pageNo;
+            Page page = file.allocatePage(pageNo);
+            page.insertRecord("simulated");
+            file.writePage(pageNo, page);
+            pages.push_back(pageNo);
+        }
+
+        // Reading forward seeks once; reading backward seeks for every page.
+        SimulatedDiskStats before = backend->stats();
+        for (int i = 0; i < numPages; i++) {
+            file.readPage(pages[i]);
+        }
+        SimulatedDiskStats after = backend->stats();
+        checkPassFail(after.reads - before.reads, (std::uint64_t)numPages);
+        checkPassFail(after.random_accesses - before.random_accesses,
+                      (std::uint64_t)1);
+        checkPassFail(after.elapsed_micros - before.elapsed_micros,
+                      (std::uint64_t)(numPages * 1000 + 5000));
+
+        before = after;
+        for (int i = numPages - 1; i >= 0; i--) {
+            file.readPage(pages[i]);
+        }
+        after = backend->stats();
+        checkPassFail(after.random_accesses - before.random_accesses,
+                      (std::uint64_t)numPages);
+        checkPassFail(after.elapsed_micros - before.elapsed_micros,
+                      (std::uint64_t)(numPages * 6000));
+
+        // Without an I/O engine, a buffer pool reads each run of consecutive
+        // pages of a batch with one access.
+        BufMgr mgr(16);
+        const std::vector<PageId> batch = {pages[0], pages[1], pages[2],
+                                           pages[5], pages[6]};
+        std::vector<Page*> read;
+        before = backend->stats();
+        mgr.readPages(&file, batch, read);
+        after = backend->stats();
+        checkPassFail(after.reads - before.reads, (std::uint64_t)2);
+        bool allRead = true;
+        for (std::size_t i = 0; i < batch.size(); i++) {
+            allRead = allRead && read[i]->page_number() == batch[i];
+            mgr.unPinPage(&file, batch[i], false);
+        }
+        checkPassFail(allRead, true);
+        mgr.flushFile(&file);
+    }
+
+    // The same accesses with the same jitter seed take the same time.
+    profile.jitter_micros = 500;
+    std::uint64_t elapsed[2];
+    for (int run = 0; run < 2; run++) {
+        File::remove(relationName);
+        PageFile file = PageFile::create(relationName, factory);
+        for (int i = 0; i < numPages; i++) {
+            PageId pageNo;
+            Page page = file.allocatePage(pageNo);
+            file.writePage(pageNo, page);
+        }
+        elapsed[run] = backend->stats().elapsed_micros;
+    }
+    checkPassFail(elapsed[0], elapsed[1]);
+
+    File::remove(relationName);
+}
+
+void test17() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test17_io_engine" << std::endl;
+
+    const int numPages = 32;
+    for (int engineNo = 0; engineNo < 2; engineNo++) {
+        IoEngine* engine = IoEngine::create(64, 4, engineNo == 0);
+        std::cout << "engine " << engine->name() << std::endl;
+        deleteRelation();
+
+        std::vector<PageId> pages;
+        {
+            PageFile file = PageFile::create(relationName);
+            for (int i = 0; i < numPages; i++) {
+                PageId pageNo;
+                Page page = file.allocatePage(pageNo);
+                page.insertRecord("page " + std::to_string(i));
+                file.writePage(pageNo, page);
+                pages.push_back(pageNo);
+            }
+        }
+
+        {
+            BufMgr mgr(16, NULL, engine);
+            PageFile file = PageFile::open(relationName);
+
+            // Prefetched pages are found in the pool once their reads complete.
+            mgr.prefetchPages(&file, pages[0], 4);
+            bool allRead = true;
+            for (int i = 0; i < 4; i++) {
+                Page* page;
+                mgr.readPage(&file, pages[i], page);
+                allRead = allRead && page->getRecord(RecordId{pages[i], 1}) ==
+                                         "page " + std::to_string(i);
+                mgr.unPinPage(&file, pages[i], false);
+            }
+            checkPassFail(allRead, true);
+
+            // A batch of scattered pages, some of them in the pool already.
+            std::vector<PageId> batch;
+            for (int i = 2; i < numPages; i += 5) {
+                batch.push_back(pages[i]);
+            }
+            std::vector<Page*> read;
+            mgr.readPages(&file, batch, read);
+            allRead = read.size() == batch.size();
+            for (std::size_t i = 0; i < batch.size(); i++) {
+                allRead = allRead && read[i]->getRecord(RecordId{batch[i], 1}) ==
+                                         "page " + std::to_string(2 + 5 * i);
+                read[i]->insertRecord("updated");
+                mgr.unPinPage(&file, batch[i], true);
+            }
+            checkPassFail(allRead, true);
+
+            // The dirty pages go out as one batch.
+            mgr.flushFile(&file);
+        }
+
+        {
+            PageFile file = PageFile::open(relationName);
+            int numUpdated = 0;
+            for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+                Page page = *iter;
+                for (PageIterator rec = page.begin(); rec != page.end(); ++rec) {
+                    if (*rec == "updated") {
+                        numUpdated++;
+                    }
+                }
+            }
+            checkPassFail(numUpdated, (numPages - 2 + 4) / 5);
+        }
+
+        // Point lookups of several threads on a pool smaller than the file.
+        {
+            BufMgr mgr(8, NULL, engine);
+            PageFile file = PageFile::open(relationName);
+            std::atomic<int> numWrong(0);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < 4; t++) {
+                threads.push_back(std::thread([&, t] {
+                    for (int n = 0; n < 200; n++) {
+                        const int i = (n * 7 + t * 13) % numPages;
+                        Page* page;
+                        mgr.readPage(&file, pages[i], page);
+                        if (page->getRecord(RecordId{pages[i], 1}) !=
+                            "page " + std::to_string(i)) {
+                            numWrong++;
+                        }
+                        mgr.unPinPage(&file, pages[i], false);
+                    }
+                }));
+            }
+            for (std::size_t t = 0; t < threads.size(); t++) {
+                threads[t].join();
+            }
+            checkPassFail(numWrong.load(), 0);
+            mgr.flushFile(&file);
+        }
+
+        delete engine;
+    }
+    File::remove(relationName);
+}
+
+void test18() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test18_record_views" << std::endl;
+
+    deleteRelation();
+    const int numRecords = 50;
+    {
+        PageFile file = PageFile::create(relationName);
+        PageId pageNo;
+        Page page = file.allocatePage(pageNo);
+        for (int i = 0; i < numRecords; i++) {
+            page.insertRecord("record " + std::to_string(i));
+        }
+        file.writePage(pageNo, page);
+
+        // Views see the same bytes as copies, in the page itself.
+        bool same = true;
+        bool inPage = true;
+        for (PageIterator iter = page.begin(); iter != page.end(); ++iter) {
+            const std::string_view view = iter.view();
+            same = same && view == *iter;
+            inPage = inPage && view.data() >= reinterpret_cast<const char*>(&page) &&
+                     view.data() + view.size() <=
+                         reinterpret_cast<const char*>(&page) + Page::SIZE;
+        }
+        checkPassFail(same, true);
+        checkPassFail(inPage, true);
+    }
+
+    // A scan hands out views into the pinned page.
+    {
+        FileScan scan(relationName, bufMgr);
+        int numSeen = 0;
+        bool same = true;
+        try {
+            RecordId rid;
+            while (true) {
+                scan.scanNext(rid);
+                same = same && scan.getRecordView() == scan.getRecord() &&
+                       scan.getRecordView() == "record " + std::to_string(numSeen);
+                numSeen++;
+            }
+        } catch (const EndOfFileException &e) {
+        }
+        checkPassFail(numSeen, numRecords);
+        checkPassFail(same, true);
+    }
+    File::remove(relationName);
+}
+
+void test19() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test19_lazy_compaction" << std::endl;
+
+    Page page;
+    std::vector<RecordId> rids;
+    std::vector<std::string> records;
+    for (int i = 0; page.hasSpaceForRecord(std::string(100, 'a')); i++) {
+        records.push_back(std::string(100, 'a' + i % 26));
+        rids.push_back(page.insertRecord(records.back()));
+    }
+
+    // Deleting every other record (but the last, whose slot would go too)
+    // leaves holes that still count as free.
+    const std::uint16_t freeBefore = page.getFreeSpace();
+    std::uint16_t numDeleted = 0;
+    for (std::size_t i = 0; i + 1 < rids.size(); i += 2) {
+        page.deleteRecord(rids[i]);
+        numDeleted++;
+    }
+    const std::uint16_t freed = page.getFreeSpace() - freeBefore;
+    checkPassFail(freed, (std::uint16_t)(numDeleted * 100));
+
+    // A record larger than any hole is placed after compacting the page, and
+    // the records left are unchanged.
+    const std::string big(Page::SIZE / 8, 'z');
+    RecordId bigRid = page.insertRecord(big);
+    bool intact = page.getRecord(bigRid) == big;
+    for (std::size_t i = 1; i < rids.size(); i += 2) {
+        intact = intact && page.getRecord(rids[i]) == records[i];
+    }
+    checkPassFail(intact, true);
+
+    // Growing a record also compacts when needed.
+    const std::string bigger(Page::SIZE / 4, 'y');
+    page.updateRecord(rids[1], bigger);
+    intact = page.getRecord(rids[1]) == bigger && page.getRecord(bigRid) == big;
+    for (std::size_t i = 3; i < rids.size(); i += 2) {
+        intact = intact && page.getRecord(rids[i]) == records[i];
+    }
+    checkPassFail(intact, true);
+}
+
+void test20() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test20_slot_bitmap" << std::endl;
+
+    // Many small records: deleting every third and inserting again reuses
+    // exactly the freed slots, lowest first.
+    {
+        Page page;
+        std::vector<RecordId> rids;
+        while (page.hasSpaceForRecord("r")) {
+            rids.push_back(page.insertRecord("r"));
+        }
+        std::vector<SlotId> freed;
+        for (std::size_t i = 0; i + 1 < rids.size(); i += 3) {
+            page.deleteRecord(rids[i]);
+            freed.push_back(rids[i].slot_number);
+        }
+        std::size_t numLeft = 0;
+        for (PageIterator iter = page.begin(); iter != page.end(); ++iter) {
+            numLeft++;
+        }
+        checkPassFail(numLeft, rids.size() - freed.size());
+        bool reused = true;
+        for (std::size_t i = 0; i < freed.size(); i++) {
+            reused = reused && page.insertRecord("s").slot_number == freed[i];
+        }
+        checkPassFail(reused, true);
+    }
+
+    // The bitmap takes space only for the slots there are: one word for each
+    // group of slots, added with the group's first slot.
+    {
+        Page page;
+        const std::string record = "rec";
+        bool sizesMatch = true;
+        for (std::size_t i = 0; i < 2 * Page::SLOTS_PER_WORD + 1; i++) {
+            const std::uint16_t freeBefore = page.getFreeSpace();
+            page.insertRecord(record);
+            const std::size_t expected = record.length() + sizeof(PageSlot) +
+                (i % Page::SLOTS_PER_WORD == 0 ? sizeof(std::uint32_t) : 0);
+            sizesMatch = sizesMatch &&
+                         std::size_t(freeBefore - page.getFreeSpace()) == expected;
+        }
+        checkPassFail(sizesMatch, true);
+
+        // Deleting the last slots gives back their group's word too.
+        const std::uint16_t freeBefore = page.getFreeSpace();
+        const PageId pageNo = page.page_number();
+        page.deleteRecord(RecordId{pageNo, SlotId(2 * Page::SLOTS_PER_WORD + 1)});
+        const std::size_t freed = page.getFreeSpace() - freeBefore;
+        checkPassFail(freed, record.length() + sizeof(PageSlot) + sizeof(std::uint32_t));
+        const RecordId rid = page.insertRecord(record);
+        checkPassFail(rid.slot_number, SlotId(2 * Page::SLOTS_PER_WORD + 1));
+        std::size_t numRecords = 0;
+        for (PageIterator iter = page.begin(); iter != page.end(); ++iter) {
+            numRecords++;
+        }
+        checkPassFail(numRecords, 2 * Page::SLOTS_PER_WORD + 1);
+    }
+}
+
+/**
+ * Creates relationName with records 0 to numRecords - 1 in order: record i has
+ * int i, double i / 2 and string "<i, five digits> string record".  Pages are
+ * fixed-length, one column per field of RECORD, if fixedLength is set.  If
+ * deleteEvery is nonzero, every record with i % deleteEvery equal to
+ * deleteEvery / 2 is deleted again.  Returns the number of pages.
+ */
+int createRelation(int numRecords, bool fixedLength, int deleteEvery) {
+    const std::vector<std::uint16_t> columns = {
+        sizeof(int), offsetof(RECORD, d) - sizeof(int), sizeof(double), 64};
+    PageFile file = PageFile::create(relationName);
+    int numPages = 1;
+    PageId pageNo;
+    Page page = file.allocatePage(pageNo);
+    if (fixedLength) {
+        page.setFixedLengthFormat(columns);
+    }
+    RECORD record;
+    memset(&record, 0, sizeof(record));
+    for (int i = 0; i < numRecords; i++) {
+        record.i = i;
+        record.d = i * 0.5;
+        sprintf(record.s, "%05d string record", i);
+        const std::string data(reinterpret_cast<char*>(&record), sizeof(record));
+        if (!page.hasSpaceForRecord(data)) {
+            file.writePage(pageNo, page);
+            page = file.allocatePage(pageNo);
+            numPages++;
+            if (fixedLength) {
+                page.setFixedLengthFormat(columns);
+            }
+        }
+        const RecordId rid = page.insertRecord(data);
+        if (deleteEvery != 0 && i % deleteEvery == deleteEvery / 2) {
+            page.deleteRecord(rid);
+        }
+    }
+    file.writePage(pageNo, page);
+    return numPages;
+}
+
+/**
+ * Returns how many records of RECORD an empty slotted page holds.
+ */
+int recordsPerPage() {
+    Page page;
+    const std::string data(sizeof(RECORD), 'x');
+    int numRecords = 0;
+    while (page.hasSpaceForRecord(data)) {
+        page.insertRecord(data);
+        numRecords++;
+    }
+    return numRecords;
+}
+
+void test21() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test21_fixed_length_pages" << std::endl;
+
+    // RECORD split into columns: i, padding, d and s.
+    const std::vector<std::uint16_t> columns = {
+        sizeof(int), offsetof(RECORD, d) - sizeof(int), sizeof(double), 64};
+    RECORD record;
+    memset(&record, 0, sizeof(record));
+
+    // A page holds more fixed-length records than slotted ones, and keeps
+    // each column contiguous.
+    {
+        Page slotted;
+        int slottedCapacity = 0;
+        const std::string recordData(sizeof(RECORD), 'x');
+        while (slotted.hasSpaceForRecord(recordData)) {
+            slotted.insertRecord(recordData);
+            slottedCapacity++;
+        }
+
+        Page page;
+        page.setFixedLengthFormat(columns);
+        std::vector<RecordId> rids;
+        for (int i = 0; ; i++) {
+            record.i = i;
+            record.d = i * 0.5;
+            sprintf(record.s, "%05d string record", i);
+            const std::string data(reinterpret_cast<char*>(&record), sizeof(record));
+            if (!page.hasSpaceForRecord(data)) {
+                break;
+            }
+            rids.push_back(page.insertRecord(data));
+        }
+        const bool denser = (int)rids.size() > slottedCapacity;
+        checkPassFail(denser, true);
+
+        const int* keys = reinterpret_cast<const int*>(page.getColumnData(0));
+        bool contiguous = true;
+        for (std::size_t n = 0; n < rids.size(); n++) {
+            contiguous = contiguous && keys[rids[n].slot_number - 1] == (int)n;
+        }
+        checkPassFail(contiguous, true);
+
+        RECORD back = *reinterpret_cast<const RECORD*>(page.getRecord(rids[7]).data());
+        bool same = back.i == 7 && back.d == 3.5 &&
+                    strcmp(back.s, "00007 string record") == 0;
+        checkPassFail(same, true);
+        std::string_view d = page.getAttributeView(rids[7], offsetof(RECORD, d), sizeof(double));
+        same = *reinterpret_cast<const double*>(d.data()) == 3.5;
+        checkPassFail(same, true);
+
+        page.deleteRecord(rids[3]);
+        int numLeft = 0;
+        for (PageIterator iter = page.begin(); iter != page.end(); ++iter) {
+            numLeft++;
+        }
+        checkPassFail(numLeft, (int)rids.size() - 1);
+
+        bool rejected = false;
+        try {
+            page.insertRecord("too short");
+        } catch (const PageFormatException &e) {
+            rejected = true;
+        }
+        checkPassFail(rejected, true);
+    }
+
+    // A relation of fixed-length pages can be scanned and indexed.
+    const int numRecords = 3000;
+    deleteRelation();
+    createRelation(numRecords, true /* fixedLength */);
+    {
+        FileScan scan(relationName, bufMgr);
+        int numSeen = 0;
+        bool inOrder = true;
+        try {
+            RecordId rid;
+            while (true) {
+                scan.scanNext(rid);
+                const RECORD* rec = reinterpret_cast<const RECORD*>(scan.getRecordView().data());
+                int key = *reinterpret_cast<const int*>(
+                    scan.getAttributeView(offsetof(RECORD, i), sizeof(int)).data());
+                inOrder = inOrder && rec->i == numSeen && key == numSeen;
+                numSeen++;
+            }
+        } catch (const EndOfFileException &e) {
+        }
+        checkPassFail(numSeen, numRecords);
+        checkPassFail(inOrder, true);
+    }
+    {
+        try {
+            File::remove(intIndexName);
+        } catch (const FileNotFoundException &e) {
+        }
+        BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(tuple, i), INTEGER);
+        int low = 100;
+        int high = 200;
+        index.startScan(&low, GTE, &high, LT);
+        int numFound = 0;
+        try {
+            RecordId rid;
+            while (true) {
+                index.scanNext(rid);
+                numFound++;
+            }
+        } catch (const IndexScanCompletedException &e) {
+        }
+        index.endScan();
+        checkPassFail(numFound, 100);
+    }
+    File::remove(intIndexName);
+    File::remove(relationName);
+}
+
+void test22() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test22_update_in_place" << std::endl;
+
+    Page page;
+    std::vector<RecordId> rids;
+    std::vector<std::string> records;
+    for (int i = 0; page.hasSpaceForRecord(std::string(100, 'a')); i++) {
+        records.push_back(std::string(100, 'a' + i % 26));
+        rids.push_back(page.insertRecord(records.back()));
+    }
+
+    // Same-size and shrinking updates overwrite the record where it is, and
+    // a shrinking one frees the difference.
+    const char *before = page.getRecordView(rids[5]).data();
+    records[5] = std::string(100, '5');
+    page.updateRecord(rids[5], records[5]);
+    bool inPlace = page.getRecordView(rids[5]).data() == before;
+    checkPassFail(inPlace, true);
+    const std::uint16_t freeBefore = page.getFreeSpace();
+    records[6] = std::string(40, '6');
+    page.updateRecord(rids[6], records[6]);
+    const std::uint16_t freed = page.getFreeSpace() - freeBefore;
+    checkPassFail(freed, (std::uint16_t)60);
+
+    // Growing the record back needs the bytes it gave up.
+    records[6] = std::string(100, '6');
+    page.updateRecord(rids[6], records[6]);
+    bool intact = true;
+    for (std::size_t i = 0; i < rids.size(); i++) {
+        intact = intact && page.getRecord(rids[i]) == records[i];
+    }
+    checkPassFail(intact, true);
+
+    // A batch shrinking every other record and growing the rest into the
+    // space freed is applied as a whole.
+    std::vector<std::string> versions;
+    for (std::size_t i = 0; i < rids.size(); i++) {
+        versions.push_back(std::string(i % 2 == 0 ? 50 : 150, 'A' + i % 26));
+    }
+    page.updateRecords(rids, versions);
+    intact = true;
+    for (std::size_t i = 0; i < rids.size(); i++) {
+        intact = intact && page.getRecord(rids[i]) == versions[i];
+    }
+    checkPassFail(intact, true);
+
+    // A batch the page cannot hold changes nothing.
+    std::vector<std::string> tooBig(rids.size(), std::string(200, 'x'));
+    bool thrown = false;
+    try {
+        page.updateRecords(rids, tooBig);
+    } catch (const InsufficientSpaceException &e) {
+        thrown = true;
+    }
+    checkPassFail(thrown, true);
+    intact = true;
+    for (std::size_t i = 0; i < rids.size(); i++) {
+        intact = intact && page.getRecord(rids[i]) == versions[i];
+    }
+    checkPassFail(intact, true);
+
+    // A same-size batch overwrites the records where they are, keeping the
+    // last version of a record given twice, unless an ID is invalid.
+    std::vector<RecordId> sameRids = {rids[0], rids[1], rids[0]};
+    std::vector<std::string> sameVersions = {std::string(50, '0'),
+                                             std::string(150, '1'),
+                                             std::string(50, '2')};
+    before = page.getRecordView(rids[1]).data();
+    page.updateRecords(sameRids, sameVersions);
+    versions[0] = sameVersions[2];
+    versions[1] = sameVersions[1];
+    inPlace = page.getRecordView(rids[1]).data() == before;
+    checkPassFail(inPlace, true);
+    sameRids.push_back(RecordId{page.page_number(), Page::INVALID_SLOT, 0});
+    sameVersions.push_back(std::string(50, '3'));
+    sameVersions[0] = std::string(50, '4');
+    thrown = false;
+    try {
+        page.updateRecords(sameRids, sameVersions);
+    } catch (const InvalidRecordException &e) {
+        thrown = true;
+    }
+    checkPassFail(thrown, true);
+    intact = true;
+    for (std::size_t i = 0; i < rids.size(); i++) {
+        intact = intact && page.getRecord(rids[i]) == versions[i];
+    }
+    checkPassFail(intact, true);
+}
+
+/**
+ * Counts the records of relationName a scan with the given predicate returns,
+ * checking that each has its int in [low, high).
+ */
+int predicateScan(std::size_t offset, Datatype type, const void *lowVal,
+                  Operator lowOp, const void *highVal, Operator highOp,
+                  std::size_t length, int low, int high, bool &inRange) {
+    FileScan scan(relationName, bufMgr);
+    scan.setPredicate(offset, type, lowVal, lowOp, highVal, highOp, length);
+    int numFound = 0;
+    try {
+        RecordId rid;
+        while (true) {
+            scan.scanNext(rid);
+            const RECORD *rec = reinterpret_cast<const RECORD *>(scan.getRecordView().data());
+            inRange = inRange && rec->i >= low && rec->i < high;
+            numFound++;
+        }
+    } catch (const EndOfFileException &e) {
+    }
+    return numFound;
+}
+
+void test23() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test23_predicate_scan" << std::endl;
+
+    const int numRecords = 3000;
+    // The same relation in slotted and in fixed-length pages, with every
+    // tenth record deleted.
+    for (int fixedLength = 0; fixedLength < 2; fixedLength++) {
+        deleteRelation();
+        createRelation(numRecords, fixedLength, 10 /* deleteEvery */);
+
+        bool inRange = true;
+        int low = 100;
+        int high = 200;
+        int numFound = predicateScan(offsetof(RECORD, i), INTEGER, &low, GTE,
+                                     &high, LT, 0, 100, 200, inRange);
+        checkPassFail(numFound, 90);
+
+        // Open bounds, doubles and strings.
+        double dLow = 1400.0;
+        numFound = predicateScan(offsetof(RECORD, d), DOUBLE, &dLow, GT,
+                                 NULL, LT, 0, 2801, numRecords, inRange);
+        checkPassFail(numFound, 179);
+        numFound = predicateScan(offsetof(RECORD, s), STRING, NULL, GTE,
+                                 "00010", LTE, 5, 0, 11, inRange);
+        checkPassFail(numFound, 10);
+        numFound = predicateScan(offsetof(RECORD, s), STRING, "00042", GTE,
+                                 "00042", LTE, 5, 42, 43, inRange);
+        checkPassFail(numFound, 1);
+        checkPassFail(inRange, true);
+    }
+
+    // A predicate set in the middle of a scan applies to the records after
+    // the current one.
+    {
+        FileScan scan(relationName, bufMgr);
+        RecordId rid;
+        for (int i = 0; i < 5; i++) {
+            scan.scanNext(rid);
+        }
+        int high = 1000;
+        scan.setPredicate(offsetof(RECORD, i), INTEGER, NULL, GTE, &high, LT);
+        int numFound = 0;
+        try {
+            while (true) {
+                scan.scanNext(rid);
+                numFound++;
+            }
+        } catch (const EndOfFileException &e) {
+        }
+        checkPassFail(numFound, 895);
+    }
+
+    bool thrown = false;
+    try {
+        FileScan scan(relationName, bufMgr);
+        int low = 5;
+        scan.setPredicate(offsetof(RECORD, i), INTEGER, &low, LT, NULL, LT);
+    } catch (const BadOpcodesException &e) {
+        thrown = true;
+    }
+    checkPassFail(thrown, true);
+    deleteRelation();
+}
+
+void test24() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test24_parallel_scan" << std::endl;
+
+    const int numRecords = 5000;
+    deleteRelation();
+    createRelation(numRecords);
+
+    // Every record is seen exactly once, with morsels and with fixed ranges.
+    const std::uint32_t numWorkers = 4;
+    for (std::uint32_t morselPages = 0; morselPages <= 3; morselPages += 3) {
+        std::vector<std::vector<int> > keys(numWorkers);
+        ParallelFileScan scan(relationName, bufMgr, numWorkers, morselPages);
+        const std::size_t numScanned = scan.run(
+            [&keys](const std::uint32_t worker, const Page &page,
+                    const std::vector<RecordId> &rids) {
+                for (std::size_t r = 0; r < rids.size(); r++) {
+                    keys[worker].push_back(*reinterpret_cast<const int *>(
+                        page.getRecordView(rids[r]).data()));
+                }
+            });
+        checkPassFail(numScanned, (std::size_t)numRecords);
+        std::vector<int> all;
+        for (std::uint32_t w = 0; w < numWorkers; w++) {
+            all.insert(all.end(), keys[w].begin(), keys[w].end());
+        }
+        std::sort(all.begin(), all.end());
+        bool once = all.size() == (std::size_t)numRecords;
+        for (std::size_t n = 0; once && n < all.size(); n++) {
+            once = all[n] == (int)n;
+        }
+        checkPassFail(once, true);
+    }
+
+    // Only records meeting the predicate are handed over.
+    {
+        ParallelFileScan scan(relationName, bufMgr, numWorkers);
+        int low = 1000;
+        int high = 1500;
+        scan.setPredicate(offsetof(RECORD, i), INTEGER, &low, GTE, &high, LT);
+        std::atomic<int> numOutside(0);
+        const std::size_t numFound = scan.run(
+            [&numOutside, low, high](const std::uint32_t worker, const Page &page,
+                                     const std::vector<RecordId> &rids) {
+                for (std::size_t r = 0; r < rids.size(); r++) {
+                    const int key = *reinterpret_cast<const int *>(
+                        page.getRecordView(rids[r]).data());
+                    if (key < low || key >= high) {
+                        numOutside++;
+                    }
+                }
+            });
+        checkPassFail(numFound, (std::size_t)500);
+        checkPassFail(numOutside.load(), 0);
+    }
+
+    // An exception of the consumer stops the scan and reaches the caller,
+    // with no page left pinned.
+    {
+        ParallelFileScan scan(relationName, bufMgr, numWorkers, 1);
+        bool thrown = false;
+        try {
+            scan.run([](const std::uint32_t worker, const Page &page,
+                        const std::vector<RecordId> &rids) {
+                if (page.page_number() == 3) {
+                    throw EndOfFileException();
+                }
+            });
+        } catch (const EndOfFileException &e) {
+            thrown = true;
+        }
+        checkPassFail(thrown, true);
+    }
+    deleteRelation();
+}
+
+void test25() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test25_batch_scan" << std::endl;
+
+    const int numRecords = 3000;
+    // Slotted and fixed-length pages, with every tenth record deleted.
+    for (int fixedLength = 0; fixedLength < 2; fixedLength++) {
+        deleteRelation();
+        createRelation(numRecords, fixedLength, 10 /* deleteEvery */);
+
+        // Batches return every record in order, each from a single page.
+        const std::size_t maxBatch = 7;
+        RecordId rids[maxBatch];
+        std::string_view recs[maxBatch];
+        {
+            FileScan scan(relationName, bufMgr);
+            int expected = 0;
+            bool inOrder = true;
+            bool samePage = true;
+            std::size_t count;
+            while ((count = scan.nextBatch(rids, recs, maxBatch)) > 0) {
+                for (std::size_t r = 0; r < count; r++) {
+                    const RECORD *rec = reinterpret_cast<const RECORD *>(recs[r].data());
+                    char s[64];
+                    sprintf(s, "%05d string record", expected);
+                    inOrder = inOrder && recs[r].size() == sizeof(RECORD) &&
+                              rec->i == expected && strcmp(rec->s, s) == 0;
+                    samePage = samePage && rids[r].page_number == rids[0].page_number;
+                    expected += expected % 10 == 4 ? 2 : 1;
+                }
+            }
+            checkPassFail(expected, numRecords);
+            checkPassFail(inOrder, true);
+            checkPassFail(samePage, true);
+            count = scan.nextBatch(rids, recs, maxBatch);
+            checkPassFail(count, (std::size_t)0);
+        }
+
+        // Batches and single records mix, and batches honour the predicate.
+        {
+            FileScan scan(relationName, bufMgr);
+            RecordId rid;
+            for (int i = 0; i < 3; i++) {
+                scan.scanNext(rid);
+            }
+            std::size_t count = scan.nextBatch(rids, recs, 2);
+            const int key = reinterpret_cast<const RECORD *>(recs[1].data())->i;
+            checkPassFail(key, 4);
+            scan.scanNext(rid);
+            const int next = reinterpret_cast<const RECORD *>(scan.getRecordView().data())->i;
+            checkPassFail(next, 6);
+
+            int low = 100;
+            int high = 200;
+            scan.setPredicate(offsetof(RECORD, i), INTEGER, &low, GTE, &high, LT);
+            int numFound = 0;
+            bool inRange = true;
+            while ((count = scan.nextBatch(rids, recs, maxBatch)) > 0) {
+                for (std::size_t r = 0; r < count; r++) {
+                    const int i = reinterpret_cast<const RECORD *>(recs[r].data())->i;
+                    inRange = inRange && i >= low && i < high;
+                    numFound++;
+                }
+            }
+            checkPassFail(numFound, 90);
+            checkPassFail(inRange, true);
+        }
+    }
+    deleteRelation();
+}
+
+void test26() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test26_projecting_scan" << std::endl;
+
+    const int numRecords = 3000;
+    for (int fixedLength = 0; fixedLength < 2; fixedLength++) {
+        deleteRelation();
+        createRelation(numRecords, fixedLength);
+
+        // Every key comes out with the ID of its record, for int, double and
+        // string attributes.
+        std::vector<RecordId> ridsSeen;
+        {
+            FileScan scan(relationName, bufMgr);
+            try {
+                RecordId rid;
+                while (true) {
+                    scan.scanNext(rid);
+                    ridsSeen.push_back(rid);
+                }
+            } catch (const EndOfFileException &e) {
+            }
+        }
+        const std::size_t maxKeys = 100;
+        RecordId rids[maxKeys];
+        int intKeys[maxKeys];
+        double doubleKeys[maxKeys];
+        char stringKeys[maxKeys * 5];
+        bool match = true;
+        int numKeys[3] = {0, 0, 0};
+        for (int type = 0; type < 3; type++) {
+            FileScan scan(relationName, bufMgr);
+            std::size_t count;
+            while ((count = type == 0 ? scan.nextKeys(offsetof(RECORD, i), INTEGER, intKeys, rids, maxKeys)
+                          : type == 1 ? scan.nextKeys(offsetof(RECORD, d), DOUBLE, doubleKeys, rids, maxKeys)
+                          : scan.nextKeys(offsetof(RECORD, s), STRING, stringKeys, rids, maxKeys, 5)) > 0) {
+                for (std::size_t k = 0; k < count; k++) {
+                    const int i = numKeys[type]++;
+                    char s[6];
+                    sprintf(s, "%05d", i);
+                    match = match && rids[k] == ridsSeen[i] &&
+                            (type == 0 ? intKeys[k] == i
+                             : type == 1 ? doubleKeys[k] == i * 0.5
+                             : memcmp(stringKeys + k * 5, s, 5) == 0);
+                }
+            }
+        }
+        checkPassFail(numKeys[0], numRecords);
+        checkPassFail(numKeys[1], numRecords);
+        checkPassFail(numKeys[2], numRecords);
+        checkPassFail(match, true);
+
+        // Only the keys of records meeting the predicate come out.
+        {
+            FileScan scan(relationName, bufMgr);
+            int low = 2990;
+            scan.setPredicate(offsetof(RECORD, i), INTEGER, &low, GTE, NULL, LT);
+            std::size_t count = scan.nextKeys(offsetof(RECORD, i), INTEGER, intKeys, rids, maxKeys);
+            checkPassFail(count, (std::size_t)10);
+            const int first = intKeys[0];
+            checkPassFail(first, low);
+        }
+    }
+
+    bool thrown = false;
+    try {
+        FileScan scan(relationName, bufMgr);
+        RecordId rid;
+        char key[8];
+        scan.nextKeys(0, STRING, key, &rid, 1);
+    } catch (const BadScanParamException &e) {
+        thrown = true;
+    }
+    checkPassFail(thrown, true);
+    deleteRelation();
+}
+
+/**
+ * Moves a scan on by one record and counts the record's key, returning false
+ * once the scan has reached the end.
+ */
+bool scanNextKey(FileScan &scan, std::vector<int> &seen) {
+    try {
+        RecordId rid;
+        scan.scanNext(rid);
+        seen[reinterpret_cast<const RECORD *>(scan.getRecordView().data())->i]++;
+        return true;
+    } catch (const EndOfFileException &e) {
+        return false;
+    }
+}
+
+void test27() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test27_shared_scans" << std::endl;
+
+    const int numRecords = 5000;
+    deleteRelation();
+    const int numPages = createRelation(numRecords);
+
+    // Three scans starting together read each page once between them.
+    {
+        BufMgr smallBufMgr(8);
+        FileScan scan1(relationName, &smallBufMgr);
+        FileScan scan2(relationName, &smallBufMgr);
+        FileScan scan3(relationName, &smallBufMgr);
+        scan1.setShared(true);
+        scan2.setShared(true);
+        scan3.setShared(true);
+        std::vector<int> seen(numRecords, 0);
+        bool more = true;
+        while (more) {
+            more = scanNextKey(scan1, seen);
+            more = scanNextKey(scan2, seen) || more;
+            more = scanNextKey(scan3, seen) || more;
+        }
+        const bool allThrice = std::count(seen.begin(), seen.end(), 3) == numRecords;
+        checkPassFail(allThrice, true);
+        checkPassFail(smallBufMgr.getBufStats().diskreads, numPages);
+    }
+
+    // A scan joining halfway starts where the first one is, wraps around
+    // for the pages it missed, and outlives it.
+    {
+        BufMgr smallBufMgr(8);
+        std::unique_ptr<FileScan> scan1(new FileScan(relationName, &smallBufMgr));
+        scan1->setShared(true);
+        std::vector<int> seen(numRecords, 0);
+        RecordId leaderRid;
+        for (int i = 0; i < numRecords / 2; i++) {
+            scan1->scanNext(leaderRid);
+            seen[i]++;
+        }
+        FileScan scan2(relationName, &smallBufMgr);
+        scan2.setShared(true);
+        RecordId rid;
+        scan2.scanNext(rid);
+        seen[reinterpret_cast<const RECORD *>(scan2.getRecordView().data())->i]++;
+        checkPassFail(rid.page_number, leaderRid.page_number);
+        while (scanNextKey(*scan1, seen)) {
+            scanNextKey(scan2, seen);
+        }
+        scan1.reset();
+        while (scanNextKey(scan2, seen)) {
+        }
+        const bool allTwice = std::count(seen.begin(), seen.end(), 2) == numRecords;
+        checkPassFail(allTwice, true);
+        const bool fewerReads = smallBufMgr.getBufStats().diskreads < 2 * numPages;
+        checkPassFail(fewerReads, true);
+    }
+    deleteRelation();
+}
+
+void test28() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test28_resumable_scan" << std::endl;
+
+    const int numRecords = 5000;
+    deleteRelation();
+    const int numPages = createRelation(numRecords);
+    std::vector<RecordId> all;
+    {
+        FileScan scan(relationName, bufMgr);
+        try {
+            RecordId rid;
+            while (true) {
+                scan.scanNext(rid);
+                all.push_back(rid);
+            }
+        } catch (const EndOfFileException &e) {
+        }
+    }
+
+    // Scans of three pages each, every one resuming where the last stopped,
+    // return the records of a full scan.
+    {
+        std::vector<RecordId> chunked;
+        std::string token;
+        int numChunks = 0;
+        bool finished = false;
+        while (!finished) {
+            FileScan scan(relationName, bufMgr);
+            if (!token.empty()) {
+                scan.startAt(token);
+            }
+            scan.setPageBudget(3);
+            try {
+                RecordId rid;
+                while (true) {
+                    scan.scanNext(rid);
+                    chunked.push_back(rid);
+                }
+            } catch (const EndOfFileException &e) {
+            }
+            token = scan.getResumeToken();
+            finished = scan.reachedEnd();
+            numChunks++;
+        }
+        const bool same = chunked == all;
+        checkPassFail(same, true);
+        checkPassFail(numChunks, (numPages + 2) / 3);
+    }
+
+    // A scan resumes in the middle of a page, by batches too.
+    {
+        std::string token;
+        {
+            FileScan scan(relationName, bufMgr);
+            RecordId rid;
+            for (int i = 0; i < 100; i++) {
+                scan.scanNext(rid);
+            }
+            token = scan.getResumeToken();
+        }
+        FileScan scan(relationName, bufMgr);
+        scan.startAt(token);
+        RecordId rids[2];
+        std::string_view recs[2];
+        const std::size_t count = scan.nextBatch(rids, recs, 2);
+        const bool resumed = count == 2 && rids[0] == all[100] && rids[1] == all[101];
+        checkPassFail(resumed, true);
+    }
+
+    // A scan starts at a given page; not at one that is not used.
+    {
+        FileScan scan(relationName, bufMgr);
+        scan.startAtPage(all.back().page_number);
+        RecordId rid;
+        scan.scanNext(rid);
+        const bool atPage = rid.page_number == all.back().page_number;
+        checkPassFail(atPage, true);
+    }
+    bool thrown = false;
+    try {
+        FileScan scan(relationName, bufMgr);
+        scan.startAtPage(all.back().page_number + 1);
+        RecordId rid;
+        scan.scanNext(rid);
+    } catch (const InvalidPageException &e) {
+        thrown = true;
+    }
+    checkPassFail(thrown, true);
+    thrown = false;
+    try {
+        FileScan scan(relationName, bufMgr);
+        scan.startAt("not a token");
+    } catch (const BadScanParamException &e) {
+        thrown = true;
+    }
+    checkPassFail(thrown, true);
+    deleteRelation();
+}
+
+/**
+ * Runs a sampling scan of relationName, returning the keys of the records it
+ * returns and setting the pages read and the weight of the records.
+ */
+std::vector<int> sampleScan(FileScan::SampleMethod method, double rate,
+                            std::uint64_t seed, std::set<PageId> &pages,
+                            double &weight) {
+    FileScan scan(relationName, bufMgr);
+    scan.setSample(method, rate, seed);
+    std::vector<int> keys;
+    try {
+        RecordId rid;
+        while (true) {
+            scan.scanNext(rid);
+            keys.push_back(reinterpret_cast<const RECORD *>(scan.getRecordView().data())->i);
+            pages.insert(rid.page_number);
+        }
+    } catch (const EndOfFileException &e) {
+    }
+    weight = scan.getSampleWeight();
+    return keys;
+}
+
+void test29() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test29_sampling_scan" << std::endl;
+
+    // About 200 pages at any page size, enough for the estimates below.
+    const int numRecords = 200 * recordsPerPage();
+    deleteRelation();
+    const int numPages = createRelation(numRecords);
+
+    // A reservoir sample reads exactly its share of the pages, and the
+    // weighted count of its records estimates the size of the relation.
+    std::set<PageId> pages;
+    double weight;
+    std::vector<int> keys = sampleScan(FileScan::RESERVOIR, 0.25, 42, pages, weight);
+    const int numSampled = (int)(numPages * 0.25 + 0.5);
+    const int numRead = pages.size();
+    checkPassFail(numRead, numSampled);
+    checkPassFail(weight, (double)numPages / numSampled);
+    const double estimate = keys.size() * weight;
+    const bool close = estimate > numRecords * 0.9 && estimate < numRecords * 1.1;
+    checkPassFail(close, true);
+
+    // The same seed samples the same records, another seed others.
+    std::set<PageId> samePages;
+    std::vector<int> sameKeys = sampleScan(FileScan::RESERVOIR, 0.25, 42, samePages, weight);
+    const bool same = sameKeys == keys;
+    checkPassFail(same, true);
+    std::set<PageId> otherPages;
+    sampleScan(FileScan::RESERVOIR, 0.25, 43, otherPages, weight);
+    const bool samePagesAgain = otherPages == pages;
+    checkPassFail(samePagesAgain, false);
+
+    // Choosing the sample reads no page headers, as the used list comes from
+    // the file's page directory: the scan reads the sampled pages and no
+    // others.  The scan shares the file opened here, and with it the backend
+    // that counts the accesses.
+    {
+        SimulatedDiskBackend* backend = NULL;
+        DiskProfile profile = DiskProfile::nvme();
+        profile.sleep = false;
+        const BackendFactory factory =
+            [&backend, &profile](const std::string& name, const bool create_new) {
+                backend = new SimulatedDiskBackend(
+                    FileBackend::open(name, create_new), profile);
+                return backend;
+            };
+        PageFile file = PageFile::open(relationName, factory);
+        const SimulatedDiskStats before = backend->stats();
+        std::set<PageId> countedPages;
+        sampleScan(FileScan::RESERVOIR, 0.25, 42, countedPages, weight);
+        const std::uint64_t numReads = backend->stats().reads - before.reads;
+        checkPassFail(numReads, (std::uint64_t)numSampled);
+        bufMgr->flushFile(&file);
+    }
+
+    // A Bernoulli sample reads about its share of the pages.
+    pages.clear();
+    keys = sampleScan(FileScan::BERNOULLI, 0.5, 7, pages, weight);
+    checkPassFail(weight, 2.0);
+    const bool aboutHalf = pages.size() > numPages * 0.3 && pages.size() < numPages * 0.7;
+    checkPassFail(aboutHalf, true);
+
+    // With a predicate, the weighted count estimates how many records are in
+    // the range.
+    {
+        FileScan scan(relationName, bufMgr);
+        scan.setSample(FileScan::RESERVOIR, 0.25, 42);
+        int low = 0;
+        int high = numRecords / 2;
+        scan.setPredicate(offsetof(RECORD, i), INTEGER, &low, GTE, &high, LT);
+        int numFound = 0;
+        try {
+            RecordId rid;
+            while (true) {
+                scan.scanNext(rid);
+                numFound++;
+            }
+        } catch (const EndOfFileException &e) {
+        }
+        const double inRange = numFound * scan.getSampleWeight();
+        const bool near = inRange > high * 0.7 && inRange < high * 1.3;
+        checkPassFail(near, true);
+    }
+
+    bool thrown = false;
+    try {
+        FileScan scan(relationName, bufMgr);
+        scan.setSample(FileScan::BERNOULLI, 0, 1);
+    } catch (const BadScanParamException &e) {
+        thrown = true;
+    }
+    checkPassFail(thrown, true);
+    deleteRelation();
+}
+
+/**
+ * Scans relationName for the records with keys in [low, high), returning
+ * their keys in scan order and setting the number of pages read from disk.
+ */
+std::vector<int> zoneScan(int low, int high, int &diskReads) {
+    bufMgr->clearBufStats();
+    FileScan scan(relationName, bufMgr);
+    scan.setPredicate(offsetof(RECORD, i), INTEGER, &low, GTE, &high, LT);
+    std::vector<int> keys;
+    try {
+        RecordId rid;
+        while (true) {
+            scan.scanNext(rid);
+            keys.push_back(reinterpret_cast<const RECORD *>(scan.getRecordView().data())->i);
+        }
+    } catch (const EndOfFileException &e) {
+    }
+    diskReads = bufMgr->getBufStats().diskreads;
+    return keys;
+}
+
+void test30() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test30_zone_maps" << std::endl;
+
+    const int numRecords = 20000;
+    deleteRelation();
+    const int numPages = createRelation(numRecords);
+    PageFile *file = new PageFile(relationName, false);
+    std::vector<int> expected;
+    for (int i = 5000; i < 5100; i++) {
+        expected.push_back(i);
+    }
+
+    // Without a zone map a range scan reads every page.
+    int diskReads;
+    std::vector<int> keys = zoneScan(5000, 5100, diskReads);
+    bool same = keys == expected;
+    checkPassFail(same, true);
+    checkPassFail(diskReads, numPages);
+
+    // With one, it reads only the pages holding the range (the records are
+    // in key order, recordsPerPage() to a page) and finds the same records.
+    const int perPage = recordsPerPage();
+    const int rangePages = (5100 - 1) / perPage - 5000 / perPage + 1;
+    std::vector<ZoneAttribute> attributes;
+    attributes.push_back(ZoneAttribute{offsetof(RECORD, i), INTEGER, 0});
+    attributes.push_back(ZoneAttribute{offsetof(RECORD, d), DOUBLE, 0});
+    file->createZoneMap(attributes);
+    keys = zoneScan(5000, 5100, diskReads);
+    same = keys == expected;
+    checkPassFail(same, true);
+    checkPassFail(diskReads, rangePages);
+    keys = zoneScan(numRecords, numRecords + 10, diskReads);
+    checkPassFail(diskReads, 0);
+
+    // Records changed, added and deleted through the buffer pool are found
+    // before and after the pages are written back.
+    RecordId moved;
+    {
+        Page *page;
+        const PageId lastPage = file->getFirstPageNo() + numPages - 1;
+        bufMgr->readPage(file, lastPage, page);
+        moved = RecordId{lastPage, page->getNextUsedSlot(Page::INVALID_SLOT), 0};
+        RECORD record;
+        memcpy(&record, page->getRecordView(moved).data(), sizeof(record));
+        record.i = 5050;
+        page->updateRecord(moved, std::string(reinterpret_cast<char*>(&record), sizeof(record)));
+        bufMgr->unPinPage(file, lastPage, true);
+
+        PageId newPage;
+        bufMgr->allocPage(file, newPage, page);
+        record.i = 5060;
+        page->insertRecord(std::string(reinterpret_cast<char*>(&record), sizeof(record)));
+        bufMgr->unPinPage(file, newPage, true);
+    }
+    expected.push_back(5050);
+    expected.push_back(5060);
+    keys = zoneScan(5000, 5100, diskReads);
+    same = keys == expected;
+    checkPassFail(same, true);
+    keys = zoneScan(5000, 5100, diskReads);
+    same = keys == expected;
+    checkPassFail(same, true);
+    // The changed last page and the new one may be read as well.
+    const bool stillFew = diskReads <= rangePages + 2;
+    checkPassFail(stillFew, true);
+    {
+        Page *page;
+        bufMgr->readPage(file, moved.page_number, page);
+        page->deleteRecord(moved);
+        bufMgr->unPinPage(file, moved.page_number, true);
+    }
+    expected.erase(expected.end() - 2);
+    keys = zoneScan(5000, 5100, diskReads);
+    same = keys == expected;
+    checkPassFail(same, true);
+
+    // Changed pages may hold anything until they are written, which sets
+    // their entries from their records again: the last page no longer holds
+    // a key in the range, and the new page does.
+    bufMgr->flushFile(file);
+    keys = zoneScan(5000, 5100, diskReads);
+    same = keys == expected;
+    checkPassFail(same, true);
+    checkPassFail(diskReads, rangePages + 1);
+
+    // The zone map is kept with the file and used again when it is reopened.
+    delete file;
+    {
+        PageFile again = PageFile::open(relationName);
+        const bool kept = again.hasZoneMap();
+        checkPassFail(kept, true);
+        keys = zoneScan(5000, 5100, diskReads);
+        const bool stillSkips = diskReads <= rangePages + 2;
+        checkPassFail(stillSkips, true);
+        again.dropZoneMap();
+        keys = zoneScan(5000, 5100, diskReads);
+        checkPassFail(diskReads, numPages + 1);
+        again.createZoneMap(attributes);
+    }
+    deleteRelation();
+    const bool removed = !ZoneMap::exists(relationName);
+    checkPassFail(removed, true);
+}
+
+void test31() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test31_metadata_cache" << std::endl;
+
+    const int numPages = 50;
+    deleteRelation();
+
+    // Count the accesses that reach the file through a simulated disk.
+    SimulatedDiskBackend* backend = NULL;
+    DiskProfile profile = DiskProfile::nvme();
+    profile.sleep = false;
+    const BackendFactory factory =
+        [&backend, &profile](const std::string& name, const bool create_new) {
+            backend = new SimulatedDiskBackend(
+                FileBackend::open(name, create_new), profile);
+            return backend;
+        };
+    std::vector<PageId> pages;
+    {
+        // Allocating writes each new page once and reads nothing.
+        PageFile file = PageFile::create(relationName, factory);
+        for (int i = 0; i < numPages; i++) {
+            PageId pageNo;
+            file.allocatePage(pageNo);
+            pages.push_back(pageNo);
+        }
+        SimulatedDiskStats stats = backend->stats();
+        checkPassFail(stats.reads, (std::uint64_t)0);
+        checkPassFail(stats.writes, (std::uint64_t)numPages);
+
+        // Reading and writing a page is one access each.
+        Page page = file.readPage(pages[10]);
+        page.insertRecord("cached");
+        file.writePage(pages[10], page);
+        const SimulatedDiskStats after = backend->stats();
+        checkPassFail(after.reads - stats.reads, (std::uint64_t)1);
+        checkPassFail(after.writes - stats.writes, (std::uint64_t)1);
+    }
+
+    // After reopening, the page directory has the used list, so walking it,
+    // deleting pages and allocating them again does no I/O until the
+    // metadata is flushed.
+    {
+        PageFile file = PageFile::open(relationName, factory);
+        SimulatedDiskStats before = backend->stats();
+        int numUsed = 0;
+        for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+            numUsed++;
+        }
+        checkPassFail(numUsed, numPages);
+        SimulatedDiskStats after = backend->stats();
+        checkPassFail(after.reads - before.reads, (std::uint64_t)0);
+
+        before = after;
+        for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+        }
+        for (int i = 0; i < numPages; i += 2) {
+            file.deletePage(pages[i]);
+        }
+        after = backend->stats();
+        checkPassFail(after.reads - before.reads, (std::uint64_t)0);
+        checkPassFail(after.writes - before.writes, (std::uint64_t)0);
+
+        // Reused pages are written once each, like new ones.
+        before = after;
+        for (int i = 0; i < numPages; i += 2) {
+            PageId pageNo;
+            file.allocatePage(pageNo);
+        }
+        after = backend->stats();
+        checkPassFail(after.reads - before.reads, (std::uint64_t)0);
+        checkPassFail(after.writes - before.writes, (std::uint64_t)(numPages / 2));
+    }
+
+    // Without its page directory, as after recovery, a file reads the file
+    // header and each page header once as it is opened to rebuild it, and
+    // walking the used list reads nothing more.
+    PageDirectory::remove(relationName);
+    {
+        PageFile file = PageFile::open(relationName, factory);
+        const SimulatedDiskStats opened = backend->stats();
+        checkPassFail(opened.reads, (std::uint64_t)numPages + 1);
+        PageId last = Page::INVALID_NUMBER;
+        bool inOrder = true;
+        int numUsed = 0;
+        for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+            inOrder = inOrder && iter.getCurrentPageNo() > last;
+            last = iter.getCurrentPageNo();
+            numUsed++;
+        }
+        checkPassFail(numUsed, numPages);
+        checkPassFail(inOrder, true);
+        checkPassFail(backend->stats().reads, opened.reads);
+    }
+    const bool rebuilt = PageDirectory::exists(relationName);
+    checkPassFail(rebuilt, true);
+    File::remove(relationName);
+    const bool removed = !PageDirectory::exists(relationName);
+    checkPassFail(removed, true);
+}
+
+void test32() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test32_file_ids" << std::endl;
+
+    const std::string otherName = relationName + "_other";
+    deleteRelation();
+    if (File::exists(otherName)) {
+        File::remove(otherName);
+    }
+
+    FileId firstId;
+    {
+        // File objects on the same file share its id, and iterators over
+        // them compare by it.
+        PageFile file = PageFile::create(relationName);
+        PageId pageNo;
+        file.allocatePage(pageNo);
+        PageFile again = PageFile::open(relationName);
+        firstId = file.fileId();
+        checkPassFail(again.fileId(), firstId);
+        const bool sameBegin = file.begin() == again.begin();
+        checkPassFail(sameBegin, true);
+        const bool sameEnd = file.end() == again.end();
+        checkPassFail(sameEnd, true);
+
+        // Reading the page through the pool leaves a clean frame behind
+        // once the files are closed.
+        Page* page;
+        bufMgr->readPage(&file, pageNo, page);
+        bufMgr->unPinPage(&file, pageNo, false);
+    }
+
+    // The next file opened reuses the slot but gets an id of its own, so the
+    // frame left behind is not taken for its first page.
+    {
+        PageFile other = PageFile::create(otherName);
+        const bool sameId = other.fileId() == firstId;
+        checkPassFail(sameId, false);
+        checkPassFail((std::uint32_t)other.fileId(), (std::uint32_t)firstId);
+        PageId pageNo;
+        Page page = other.allocatePage(pageNo);
+        const RecordId rid = page.insertRecord("other file");
+        other.writePage(pageNo, page);
+        Page* cached;
+        bufMgr->readPage(&other, pageNo, cached);
+        const bool fromOtherFile = cached->getRecord(rid) == "other file";
+        checkPassFail(fromOtherFile, true);
+        bufMgr->unPinPage(&other, pageNo, false);
+        bufMgr->flushFile(&other);
+    }
+    File::remove(otherName);
+    File::remove(relationName);
+
+    // I/O errors other than reading past the end of a file are reported.
+    if (::access("/dev/full", W_OK) == 0) {
+        DiskBackend full("/dev/full", false);
+        bool threw = false;
+        try {
+            full.write(0 /* offset */, "x", 1);
+        } catch (const IoErrorException& e) {
+            threw = e.error() == ENOSPC;
+        }
+        checkPassFail(threw, true);
+    }
+}
+
+void test33() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test33_read_ahead" << std::endl;
+
+    const int numPages = 20;
+    const int gap = 7;
+    deleteRelation();
+
+    // Count the reads that reach the file through a simulated disk.
+    SimulatedDiskBackend* backend = NULL;
+    DiskProfile profile = DiskProfile::nvme();
+    profile.sleep = false;
+    const BackendFactory factory =
+        [&backend, &profile](const std::string& name, const bool create_new) {
+            backend = new SimulatedDiskBackend(
+                FileBackend::open(name, create_new), profile);
+            return backend;
+        };
+    {
+        PageFile file = PageFile::create(relationName, factory);
+        std::vector<PageId> pages;
+        for (int i = 0; i < numPages; i++) {
+            PageId pageNo;
+            Page page = file.allocatePage(pageNo);
+            page.insertRecord("page " + std::to_string(i));
+            file.writePage(pageNo, page);
+            pages.push_back(pageNo);
+        }
+        // The used list runs pages[0..gap-1], then pages[gap+1..] to the end.
+        file.deletePage(pages[gap]);
+
+        // A run reaching the end of the file is one read; a run past it or
+        // across the free page is rejected.
+        std::uint64_t reads = backend->stats().reads;
+        std::vector<Page> run(4);
+        file.readPages(pages[numPages - 4], 4, &run[0]);
+        bool allRead = true;
+        for (int i = 0; i < 4; i++) {
+            allRead = allRead &&
+                run[i].getRecord(RecordId{pages[numPages - 4 + i], 1}) ==
+                    "page " + std::to_string(numPages - 4 + i);
+        }
+        checkPassFail(allRead, true);
+        checkPassFail(backend->stats().reads - reads, (std::uint64_t)1);
+        bool threw = false;
+        try {
+            file.readPages(pages[numPages - 3], 4, &run[0]);
+        } catch (const InvalidPageException &e) {
+            threw = true;
+        }
+        checkPassFail(threw, true);
+        threw = false;
+        try {
+            file.readPages(pages[gap - 1], 3, &run[0]);
+        } catch (const InvalidPageException &e) {
+            threw = true;
+        }
+        checkPassFail(threw, true);
+
+        // Prefetched pages up to the end of the file are found in the pool.
+        {
+            BufMgr mgr(64);
+            reads = backend->stats().reads;
+            mgr.prefetchPages(&file, pages[numPages - 4], 4);
+            for (int i = numPages - 4; i < numPages; i++) {
+                Page* page;
+                mgr.readPage(&file, pages[i], page);
+                mgr.unPinPage(&file, pages[i], false);
+            }
+            checkPassFail(backend->stats().reads - reads, (std::uint64_t)1);
+        }
+
+        // A read-ahead scan reads each run of consecutive used pages with one
+        // read, stopping at the free page and at the end of the file, and
+        // still returns every record in order.
+        {
+            BufMgr mgr(64);
+            reads = backend->stats().reads;
+            FileScan scan(relationName, &mgr);
+            scan.setReadAhead(8);
+            int numRecords = 0;
+            bool inOrder = true;
+            try {
+                RecordId rid;
+                while (true) {
+                    scan.scanNext(rid);
+                    const int expected = numRecords < gap ? numRecords : numRecords + 1;
+                    inOrder = inOrder && scan.getRecord() == "page " + std::to_string(expected);
+                    numRecords++;
+                }
+            } catch (const EndOfFileException &e) {
+            }
+            checkPassFail(numRecords, numPages - 1);
+            checkPassFail(inOrder, true);
+            // pages[0..6], pages[8..15] and pages[16..19]
+            checkPassFail(backend->stats().reads - reads, (std::uint64_t)3);
+        }
+    }
+    File::remove(relationName);
+}
+
+void test34() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test34_group_commit" << std::endl;
+
+    const std::string logName = "relA.wal";
+    const int numThreads = 4;
+    const int commitsPerThread = 25;
+    deleteRelation();
+    ::unlink(logName.c_str());
+
+    // Every commit is durable by the time it returns, whichever thread forced
+    // the log for it.
+    {
+        LogManager log(logName);
+        Page page;
+        page.insertRecord("logged");
+        std::atomic<int> notDurable(0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < numThreads; t++) {
+            threads.push_back(std::thread([&log, &page, &notDurable] {
+                for (int i = 0; i < commitsPerThread; i++) {
+                    log.logPage(relationName, 1, page);
+                    const Lsn lsn = log.commit();
+                    if (log.durableLsn() < lsn) {
+                        notDurable++;
+                    }
+                }
+            }));
+        }
+        for (std::size_t t = 0; t < threads.size(); t++) {
+            threads[t].join();
+        }
+        checkPassFail(notDurable.load(), 0);
+        const bool shared = log.syncCount() <= std::uint32_t(numThreads * commitsPerThread);
+        checkPassFail(shared, true);
+    }
+    ::unlink(logName.c_str());
+
+    // Asynchronous commit forces the log once per group and may return
+    // before the commit is durable.
+    {
+        LogManager log(logName, 8 /* async_commit_group */);
+        const std::uint32_t syncs = log.syncCount();
+        for (int i = 0; i < 33; i++) {
+            log.commit();
+        }
+        checkPassFail(log.syncCount() - syncs, (std::uint32_t)4);
+        const bool behind = log.durableLsn() < log.lastCommitLsn();
+        checkPassFail(behind, true);
+        log.flush();
+        checkPassFail(log.durableLsn(), log.lastCommitLsn());
+    }
+    ::unlink(logName.c_str());
+
+    // The child compacts a logged file, changes it again and dies without
+    // writing the change back.  Recovery must not put the pages back under
+    // the numbers they had before compaction.
+    const int numPages = 20;
+    pid_t pid = fork();
+    if (pid == 0) {
+        LogManager log(logName);
+        BufMgr mgr(64, &log);
+        PageFile file = PageFile::create(relationName);
+        std::vector<PageId> pages;
+        for (int i = 0; i < numPages; i++) {
+            PageId pageNo;
+            Page* page;
+            mgr.allocPage(&file, pageNo, page);
+            page->insertRecord("page " + std::to_string(i));
+            mgr.unPinPage(&file, pageNo, true);
+            pages.push_back(pageNo);
+        }
+        mgr.commit();
+        for (int i = 0; i < numPages; i += 2) {
+            mgr.disposePage(&file, pages[i]);
+        }
+        mgr.commit();
+        mgr.compactFile(&file);
+
+        Page* page;
+        mgr.readPage(&file, file.getFirstPageNo(), page);
+        page->insertRecord("after compaction");
+        mgr.unPinPage(&file, file.getFirstPageNo(), true);
+        mgr.commit();
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    const bool childDone = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    checkPassFail(childDone, true);
+
+    {
+        LogManager log(logName);
+        PageFile file = PageFile::open(relationName);
+        std::vector<std::string> records;
+        PageId expectedPageNo = 1;
+        bool compacted = true;
+        for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+            compacted = compacted && iter.getCurrentPageNo() == expectedPageNo++;
+            Page page = *iter;
+            for (PageIterator rec = page.begin(); rec != page.end(); ++rec) {
+                records.push_back(*rec);
+            }
+        }
+        checkPassFail(compacted, true);
+        std::vector<std::string> expected;
+        for (int i = 1; i < numPages; i += 2) {
+            expected.push_back("page " + std::to_string(i));
+            if (i == 1) {
+                expected.push_back("after compaction");
+            }
+        }
+        const bool recovered = records == expected;
+        checkPassFail(recovered, true);
+    }
+
+    File::remove(relationName);
+    ::unlink(logName.c_str());
+}
+
+void test35() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test35_checkpoint_waits_for_commit" << std::endl;
+
+    const std::string logName = "relA.wal";
+    deleteRelation();
+    ::unlink(logName.c_str());
+    {
+        LogManager log(logName);
+        BufMgr mgr(16, &log);
+        PageFile file = PageFile::create(relationName);
+        PageId pageNo;
+        Page* page;
+        mgr.allocPage(&file, pageNo, page);
+        mgr.unPinPage(&file, pageNo, true);
+        mgr.commit();
+
+        // Another thread holds an uncommitted change for longer than the
+        // checkpoint used to wait; the checkpoint is taken once it commits.
+        std::atomic<bool> committed(false);
+        mgr.readPage(&file, pageNo, page);
+        page->insertRecord("uncommitted for a while");
+        mgr.unPinPage(&file, pageNo, true);
+        std::thread writer([&mgr, &committed] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+            committed = true;
+            mgr.commit();
+        });
+        mgr.checkpoint();
+        const bool afterCommit = committed.load();
+        checkPassFail(afterCommit, true);
+        const bool checkpointed = log.checkpointLsn() > 0;
+        checkPassFail(checkpointed, true);
+        writer.join();
+        mgr.flushFile(&file);
+    }
+    File::remove(relationName);
+    ::unlink(logName.c_str());
+}
+
+/**
+ * Returns the keys an index scan of [low, high] finds, decoded from record IDs
+ * that hold key + 1 as their page number.
+ */
+std::vector<int> indexRange(BTreeIndex &index, int low, int high, Operator highOp = LTE) {
+    std::vector<int> keys;
+    index.startScan(&low, GTE, &high, highOp);
+    try {
+        RecordId rid;
+        while (true) {
+            index.scanNext(rid);
+            keys.push_back(int(rid.page_number) - 1);
+        }
+    } catch (const IndexScanCompletedException &e) {
+    }
+    index.endScan();
+    return keys;
+}
+
+void test36() {
+    std::cout << "---------------------" << std::endl;
+    std::cout << "test36_non_leaf_split" << std::endl;
+
+    // Keys 0, 3, 6, ... go in in order until the root, a non-leaf above the
+    // leaves, is full: every leaf but the last holds half a leaf of keys.
+    const int half = INTARRAYLEAFSIZE / 2;
+    const int numKeys = INTARRAYNONLEAFSIZE * half + INTARRAYLEAFSIZE - half + 1;
+    if (numKeys > 2000000) {
+        std::cout << "Skipped: " << numKeys << " keys fill the root at this page size."
+                  << std::endl;
+        return;
+    }
+
+    // The root then splits as one of its middle leaves does, with the new
+    // child left of, right at and right of the split point.
+    const int middle = (INTARRAYNONLEAFSIZE - 1) / 2;
+    for (int leaf = middle - 1; leaf <= middle + 1; leaf++) {
+        deleteRelation();
+        createRelation(0);
+        try {
+            File::remove(intIndexName);
+        } catch (const FileNotFoundException &e) {
+        }
+        std::vector<int> expected;
+        {
+            BTreeIndex index(relationName, intIndexName, bufMgr, offsetof(RECORD, i), INTEGER);
+            for (int k = 0; k < numKeys; k++) {
+                const int key = 3 * k;
+                index.insertEntry(&key, RecordId{PageId(key) + 1, 1, 0});
+                expected.push_back(key);
+            }
+            for (int k = leaf * half; k < (leaf + 1) * half; k++) {
+                for (int key = 3 * k + 1; key <= 3 * k + 2; key++) {
+                    index.insertEntry(&key, RecordId{PageId(key) + 1, 1, 0});
+                    expected.push_back(key);
+                }
+            }
+            std::sort(expected.begin(), expected.end());
+
+            // The whole range comes back in order...
+            std::vector<int> keys = indexRange(index, 0, expected.back(), LT);
+            const bool all = keys.size() == expected.size() - 1 &&
+                             std::equal(keys.begin(), keys.end(), expected.begin());
+            checkPassFail(all, true);
+
+            // ...and so does a short range across every leaf boundary and
+            // around every key of the leaf that split.
+            std::vector<int> around;
+            for (int j = 1; j <= INTARRAYNONLEAFSIZE; j++) {
+                around.push_back(3 * j * half);
+            }
+            for (int key = 3 * leaf * half; key < 3 * (leaf + 1) * half; key++) {
+                around.push_back(key);
+            }
+            bool boundaries = true;
+            for (std::size_t n = 0; n < around.size(); n++) {
+                const int low = around[n] - 3;
+                const int high = around[n] + 3;
+                keys = indexRange(index, low, high);
+                boundaries = boundaries &&
+                    std::vector<int>(std::lower_bound(expected.begin(), expected.end(), low),
+                                     std::upper_bound(expected.begin(), expected.end(), high)) == keys;
+            }
+            checkPassFail(boundaries, true);
+        }
+        File::remove(intIndexName);
+    }
+    deleteRelation();
+}
+
 // -----------------------------------------------------------------------------
 // createRelationForward
 // -----------------------------------------------------------------------------
@@ -505,7 +2859,7 @@ int intScan(BTreeIndex * index, int lowVal, Operator lowOp, int highVal, Operato
 		{
 			index->scanNext(scanRid);
 			bufMgr->readPage(file1, scanRid.page_number, curPage);
-			RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecord(scanRid).data()));
+			RECORD myRec = *(reinterpret_cast<const RECORD*>(curPage->getRecordView(scanRid).data()));
 			bufMgr->unPinPage(file1, scanRid.page_number, false);
 
 			if( numResults < 5 )
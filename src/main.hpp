@@ -102,9 +102,9 @@
  *  badgerdb::File existing_file = badgerdb::File::open("filename.db");
  * @endcode
  *
- * Multiple File objects share the same stream to the underlying file.  The
- * stream will be automatically closed when the last File object is out of
- * scope; no explicit close command is necessary.
+ * Multiple File objects share the same descriptor for the underlying file.
+ * The descriptor will be automatically closed when the last File object is out
+ * of scope; no explicit close command is necessary.
  *
  * You can delete a file with File::remove:
  * @code
@@ -0,0 +1,205 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "mem_backend.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "exceptions/file_not_found_exception.h"
+
+namespace badgerdb {
+
+const std::size_t MemBackend::CHUNK_SIZE;
+
+std::map<std::string, std::shared_ptr<MemBackend::Arena>> MemBackend::arenas_;
+std::mutex MemBackend::arenas_mutex_;
+std::atomic<std::size_t> MemBackend::bytes_in_use_(0);
+
+MemBackend::MemBackend(const std::string& filename, const bool create_new,
+                       const std::size_t capacity)
+    : filename_(filename) {
+  std::lock_guard<std::mutex> lock(arenas_mutex_);
+  if (create_new) {
+    arena_.reset(new Arena());
+    arena_->size = 0;
+    arena_->capacity = capacity;
+    arenas_[filename] = arena_;
+    return;
+  }
+  std::map<std::string, std::shared_ptr<Arena>>::iterator entry =
+      arenas_.find(filename);
+  if (entry == arenas_.end()) {
+    throw FileNotFoundException(filename);
+  }
+  arena_ = entry->second;
+}
+
+MemBackend::Arena::~Arena() {
+  for (std::size_t i = 0; i < chunks.size(); ++i) {
+    if (chunks[i]) {
+      bytes_in_use_ -= CHUNK_SIZE;
+    }
+  }
+}
+
+void MemBackend::read(const off_t offset, void* data,
+                      const std::size_t length) {
+  std::lock_guard<std::mutex> lock(arena_->mutex);
+  if (arena_->spill) {
+    arena_->spill->read(offset, data, length);
+    return;
+  }
+  char* out = static_cast<char*>(data);
+  std::size_t done = 0;
+  while (done < length) {
+    const off_t position = offset + done;
+    const std::size_t chunk = position / CHUNK_SIZE;
+    const std::size_t start = position % CHUNK_SIZE;
+    const std::size_t count = std::min(length - done, CHUNK_SIZE - start);
+    if (position < arena_->size && chunk < arena_->chunks.size() &&
+        arena_->chunks[chunk]) {
+      memcpy(out + done, arena_->chunks[chunk].get() + start, count);
+    } else {
+      memset(out + done, 0, count);
+    }
+    done += count;
+  }
+}
+
+void MemBackend::write(const off_t offset, const void* data,
+                       const std::size_t length) {
+  std::lock_guard<std::mutex> lock(arena_->mutex);
+  const off_t end = offset + off_t(length);
+  if (!arena_->spill && arena_->capacity > 0 &&
+      std::size_t(std::max(end, arena_->size)) > arena_->capacity) {
+    spillToDisk();
+  }
+  if (arena_->spill) {
+    arena_->spill->write(offset, data, length);
+    return;
+  }
+
+  const char* in = static_cast<const char*>(data);
+  const std::size_t num_chunks = (end + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  if (arena_->chunks.size() < num_chunks) {
+    arena_->chunks.resize(num_chunks);
+  }
+  std::size_t done = 0;
+  while (done < length) {
+    const off_t position = offset + done;
+    const std::size_t chunk = position / CHUNK_SIZE;
+    const std::size_t start = position % CHUNK_SIZE;
+    const std::size_t count = std::min(length - done, CHUNK_SIZE - start);
+    if (!arena_->chunks[chunk]) {
+      arena_->chunks[chunk].reset(new char[CHUNK_SIZE]());
+      bytes_in_use_ += CHUNK_SIZE;
+    }
+    memcpy(arena_->chunks[chunk].get() + start, in + done, count);
+    done += count;
+  }
+  arena_->size = std::max(arena_->size, end);
+}
+
+void MemBackend::truncate(const off_t length) {
+  std::lock_guard<std::mutex> lock(arena_->mutex);
+  if (arena_->spill) {
+    arena_->spill->truncate(length);
+    return;
+  }
+  if (length >= arena_->size) {
+    arena_->size = length;
+    return;
+  }
+  // Free whole chunks past the end and zero the cut-off part of the last one,
+  // so growing the file again reads zeroes.
+  const std::size_t num_chunks = (length + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  std::size_t freed = 0;
+  for (std::size_t i = num_chunks; i < arena_->chunks.size(); ++i) {
+    if (arena_->chunks[i]) {
+      freed += CHUNK_SIZE;
+    }
+  }
+  arena_->chunks.resize(std::min(arena_->chunks.size(), num_chunks));
+  if (length % CHUNK_SIZE != 0 && num_chunks <= arena_->chunks.size() &&
+      arena_->chunks[num_chunks - 1]) {
+    memset(arena_->chunks[num_chunks - 1].get() + length % CHUNK_SIZE, 0,
+           CHUNK_SIZE - length % CHUNK_SIZE);
+  }
+  arena_->size = length;
+  bytes_in_use_ -= freed;
+}
+
+off_t MemBackend::size() {
+  std::lock_guard<std::mutex> lock(arena_->mutex);
+  if (arena_->spill) {
+    return arena_->spill->size();
+  }
+  return arena_->size;
+}
+
+void MemBackend::sync() {
+  std::lock_guard<std::mutex> lock(arena_->mutex);
+  if (arena_->spill) {
+    arena_->spill->sync();
+  }
+}
+
+bool MemBackend::spilled() const {
+  std::lock_guard<std::mutex> lock(arena_->mutex);
+  return arena_->spill != NULL;
+}
+
+BackendFactory MemBackend::factory(const std::size_t capacity) {
+  return [capacity](const std::string& filename, const bool create_new) {
+    return new MemBackend(filename, create_new, capacity);
+  };
+}
+
+bool MemBackend::exists(const std::string& filename) {
+  std::lock_guard<std::mutex> lock(arenas_mutex_);
+  return arenas_.find(filename) != arenas_.end();
+}
+
+void MemBackend::remove(const std::string& filename) {
+  // The chunks are freed with the last backend still open on the file.
+  std::lock_guard<std::mutex> lock(arenas_mutex_);
+  arenas_.erase(filename);
+}
+
+std::size_t MemBackend::bytesInUse() {
+  return bytes_in_use_;
+}
+
+void MemBackend::spillToDisk() {
+  std::unique_ptr<FileBackend> disk(
+      new DiskBackend(filename_, true /* create_new */));
+  std::size_t freed = 0;
+  for (std::size_t i = 0; i < arena_->chunks.size(); ++i) {
+    if (!arena_->chunks[i]) {
+      continue;
+    }
+    const off_t start = off_t(i) * CHUNK_SIZE;
+    disk->write(start, arena_->chunks[i].get(),
+                std::min<off_t>(CHUNK_SIZE, arena_->size - start));
+    freed += CHUNK_SIZE;
+  }
+  disk->truncate(arena_->size);
+  arena_->chunks.clear();
+  arena_->spill.reset(disk.release());
+  bytes_in_use_ -= freed;
+
+  // The file is found on disk from now on.
+  std::lock_guard<std::mutex> lock(arenas_mutex_);
+  std::map<std::string, std::shared_ptr<Arena>>::iterator entry =
+      arenas_.find(filename_);
+  if (entry != arenas_.end() && entry->second == arena_) {
+    arenas_.erase(entry);
+  }
+}
+
+}
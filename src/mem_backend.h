@@ -0,0 +1,170 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "file_backend.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Backend keeping the bytes of a file in memory.
+ *
+ * The contents live in an arena of fixed-size chunks registered under the
+ * file's name, so the file can be closed and opened again by name (as
+ * FileScan does) for as long as the process runs, until it is removed.
+ * File::exists() and File::remove() see in-memory files like any other.
+ *
+ * An arena may be given a capacity.  The write that would grow it beyond
+ * that spills the whole file to a plain file of the same name; from then on
+ * the file lives on disk and is opened from there.
+ */
+class MemBackend : public FileBackend {
+ public:
+  /**
+   * Size of the chunks the arena is allocated in.
+   */
+  static const std::size_t CHUNK_SIZE = 64 * 1024;
+
+  /**
+   * Opens (or creates, replacing any old contents) the in-memory file with
+   * the given name.
+   *
+   * @param filename    Name of the file.
+   * @param create_new  Whether to create the file.
+   * @param capacity    Number of bytes the file may hold in memory before it
+   *                    spills to disk; 0 for no limit.  Only used on create.
+   * @throws  FileNotFoundException   If the file is to be opened and there is
+   *                                  no in-memory file with this name.
+   */
+  MemBackend(const std::string& filename, const bool create_new,
+             const std::size_t capacity = 0);
+
+  void read(const off_t offset, void* data, const std::size_t length);
+
+  void write(const off_t offset, const void* data, const std::size_t length);
+
+  void truncate(const off_t length);
+
+  off_t size();
+
+  /**
+   * Syncs the spill file, if the file has spilled; in-memory contents are
+   * never durable.
+   */
+  void sync();
+
+  /**
+   * Returns true if the file has spilled to disk.
+   */
+  bool spilled() const;
+
+  /**
+   * Makes a backend factory for creating in-memory files.
+   *
+   * @param capacity  Number of bytes each file may hold in memory before it
+   *                  spills to disk; 0 for no limit.
+   */
+  static BackendFactory factory(const std::size_t capacity = 0);
+
+  /**
+   * Returns true if an in-memory file with the given name exists.
+   *
+   * @param filename  Name of the file.
+   */
+  static bool exists(const std::string& filename);
+
+  /**
+   * Removes an in-memory file.  Backends still open on it keep its contents
+   * until they are closed.
+   *
+   * @param filename  Name of the file.
+   */
+  static void remove(const std::string& filename);
+
+  /**
+   * Returns the number of bytes of chunks held by all in-memory files.
+   */
+  static std::size_t bytesInUse();
+
+ private:
+  /**
+   * Contents of an in-memory file.
+   */
+  struct Arena {
+    /**
+     * Gives the arena's chunks back to the count of bytes in use.
+     */
+    ~Arena();
+
+    /**
+     * Guards the arena.
+     */
+    std::mutex mutex;
+
+    /**
+     * Chunks of the file; chunks never written are NULL and read as zeroes.
+     */
+    std::vector<std::unique_ptr<char[]>> chunks;
+
+    /**
+     * Length of the file.
+     */
+    off_t size;
+
+    /**
+     * Bytes the file may hold in memory; 0 for no limit.
+     */
+    std::size_t capacity;
+
+    /**
+     * Backend holding the file once it has spilled; NULL until then.
+     */
+    std::unique_ptr<FileBackend> spill;
+  };
+
+  /**
+   * Moves the contents of the arena into a plain file; callers hold the
+   * arena's mutex.
+   */
+  void spillToDisk();
+
+  /**
+   * Name of the file.
+   */
+  std::string filename_;
+
+  /**
+   * Contents of the file, shared with the registry.
+   */
+  std::shared_ptr<Arena> arena_;
+
+  /**
+   * In-memory files by name.
+   */
+  static std::map<std::string, std::shared_ptr<Arena>> arenas_;
+
+  /**
+   * Guards arenas_.
+   */
+  static std::mutex arenas_mutex_;
+
+  /**
+   * Bytes of chunks held by all arenas.
+   */
+  static std::atomic<std::size_t> bytes_in_use_;
+};
+
+}
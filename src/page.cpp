@@ -5,12 +5,15 @@
  * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
  */
 
+#include <algorithm>
 #include <cassert>
+#include <vector>
 
 #include <iostream>
 #include "exceptions/insufficient_space_exception.h"
 #include "exceptions/invalid_record_exception.h"
 #include "exceptions/invalid_slot_exception.h"
+#include "exceptions/page_format_exception.h"
 #include "exceptions/slot_in_use_exception.h"
 #include "page_iterator.h"
 #include "page.h"
@@ -23,153 +26,557 @@ Page::Page() {
 }
 
 void Page::initialize() {
+  header_.format = SLOTTED_FORMAT;
   header_.free_space_lower_bound = 0;
   header_.free_space_upper_bound = DATA_SIZE;
   header_.num_slots = 0;
   header_.num_free_slots = 0;
+  header_.fragmented_bytes = 0;
   header_.current_page_number = INVALID_NUMBER;
   header_.next_page_number = INVALID_NUMBER;
+  header_.prev_page_number = INVALID_NUMBER;
   //data_.assign(DATA_SIZE, char());
 	memset(data_, '\0', DATA_SIZE);
 }
 
 RecordId Page::insertRecord(const std::string& record_data) {
+  checkFixedLength(record_data);
   if (!hasSpaceForRecord(record_data)) {
     throw InsufficientSpaceException(
         page_number(), record_data.length(), getFreeSpace());
   }
+  if (isFixedLength()) {
+    const SlotId slot_number = findSlot(1, header_.num_slots, false /* used */);
+    writeRow(slot_number, record_data);
+    setSlotUsed(slot_number, true);
+    --header_.num_free_slots;
+    return {page_number(), slot_number};
+  }
+  reserveContiguousSpace(record_data.length() + newSlotSize());
   const SlotId slot_number = getAvailableSlot();
   insertRecordInSlot(slot_number, record_data);
   return {page_number(), slot_number};
 }
 
 std::string Page::getRecord(const RecordId& record_id) const {
+  if (isFixedLength()) {
+    validateRecordId(record_id);
+    // Gather the record from the columns.
+    std::string record(paxHeader().record_length, '\0');
+    for (std::uint16_t c = 0; c < getNumColumns(); ++c) {
+      const PaxColumn& column = getColumn(c);
+      memcpy(&record[column.record_offset],
+             getColumnData(c) + (record_id.slot_number - 1) * column.width,
+             column.width);
+    }
+    return record;
+  }
+  return std::string(getRecordView(record_id));
+}
+
+std::string_view Page::getRecordView(const RecordId& record_id) const {
+  if (isFixedLength()) {
+    throw PageFormatException(page_number(),
+                              "records of fixed-length pages are not contiguous");
+  }
   validateRecordId(record_id);
   const PageSlot& slot = getSlot(record_id.slot_number);
-	std::string retStr = std::string(data_, DATA_SIZE).substr(slot.item_offset, slot.item_length);
+  return std::string_view(data_ + slot.item_offset, slot.item_length);
+}
 
-	return retStr;
+std::string_view Page::getAttributeView(const RecordId& record_id,
+                                        const std::size_t offset,
+                                        const std::size_t length) const {
+  if (isFixedLength()) {
+    validateRecordId(record_id);
+    const std::uint16_t c = findColumn(offset, length);
+    if (c == getNumColumns()) {
+      throw PageFormatException(page_number(),
+                                "attribute does not lie within one column");
+    }
+    const PaxColumn& column = getColumn(c);
+    return std::string_view(getColumnData(c) +
+                                (record_id.slot_number - 1) * column.width +
+                                offset - column.record_offset,
+                            length);
+  }
+  const std::string_view record = getRecordView(record_id);
+  if (offset + length > record.size()) {
+    throw PageFormatException(page_number(), "attribute is past the record");
+  }
+  return record.substr(offset, length);
 }
 
-void Page::updateRecord(const RecordId& record_id,
-                        const std::string& record_data) {
-  validateRecordId(record_id);
-  const PageSlot* slot = getSlot(record_id.slot_number);
-  const std::size_t free_space_after_delete =
-      getFreeSpace() + slot->item_length;
-  if (record_data.length() > free_space_after_delete) {
-    throw InsufficientSpaceException(
-        page_number(), record_data.length(), free_space_after_delete);
+std::size_t Page::gatherAttribute(const SlotId start,
+                                  const std::size_t offset,
+                                  const std::size_t length, SlotId* slots,
+                                  char* values, const std::size_t max) const {
+  std::size_t count = 0;
+  if (isFixedLength()) {
+    const std::uint16_t c = findColumn(offset, length);
+    if (c == getNumColumns()) {
+      throw PageFormatException(page_number(),
+                                "attribute does not lie within one column");
+    }
+    const PaxColumn& column = getColumn(c);
+    const char* data = getColumnData(c) + offset - column.record_offset;
+    for (SlotId s = getNextUsedSlot(start); s != INVALID_SLOT && count < max;
+         s = getNextUsedSlot(s), ++count) {
+      slots[count] = s;
+      memcpy(values + count * length, data + (s - 1) * column.width, length);
+    }
+    return count;
+  }
+  for (SlotId s = getNextUsedSlot(start); s != INVALID_SLOT && count < max;
+       s = getNextUsedSlot(s), ++count) {
+    const PageSlot& slot = getSlot(s);
+    if (offset + length > slot.item_length) {
+      throw PageFormatException(page_number(), "attribute is past the record");
+    }
+    slots[count] = s;
+    memcpy(values + count * length, data_ + slot.item_offset + offset, length);
   }
-  // We have to disallow slot compaction here because we're going to place the
-  // record data in the same slot, and compaction might delete the slot if we
-  // permit it.
-  deleteRecord(record_id, false /* allow_slot_compaction */);
-  insertRecordInSlot(record_id.slot_number, record_data);
+  return count;
 }
 
-void Page::deleteRecord(const RecordId& record_id) {
-  deleteRecord(record_id, true /* allow_slot_compaction */);
+void Page::gatherAttribute(const RecordId* record_ids, const std::size_t count,
+                           const std::size_t offset, const std::size_t length,
+                           char* values) const {
+  if (isFixedLength()) {
+    const std::uint16_t c = findColumn(offset, length);
+    if (c == getNumColumns()) {
+      throw PageFormatException(page_number(),
+                                "attribute does not lie within one column");
+    }
+    const PaxColumn& column = getColumn(c);
+    const char* data = getColumnData(c) + offset - column.record_offset;
+    for (std::size_t i = 0; i < count; ++i) {
+      memcpy(values + i * length,
+             data + (record_ids[i].slot_number - 1) * column.width, length);
+    }
+    return;
+  }
+  for (std::size_t i = 0; i < count; ++i) {
+    const PageSlot& slot = getSlot(record_ids[i].slot_number);
+    if (offset + length > slot.item_length) {
+      throw PageFormatException(page_number(), "attribute is past the record");
+    }
+    memcpy(values + i * length, data_ + slot.item_offset + offset, length);
+  }
 }
 
-void Page::deleteRecord(const RecordId& record_id,
-                        const bool allow_slot_compaction) {
+void Page::gatherRecords(const RecordId* record_ids, const std::size_t count,
+                         std::string_view* records, char* buffer) const {
+  if (!isFixedLength()) {
+    for (std::size_t i = 0; i < count; ++i) {
+      const PageSlot& slot = getSlot(record_ids[i].slot_number);
+      records[i] = std::string_view(data_ + slot.item_offset, slot.item_length);
+    }
+    return;
+  }
+  // Column by column, so that each minipage is read in one pass.
+  const std::size_t record_length = paxHeader().record_length;
+  for (std::uint16_t c = 0; c < getNumColumns(); ++c) {
+    const PaxColumn& column = getColumn(c);
+    const char* data = getColumnData(c);
+    for (std::size_t i = 0; i < count; ++i) {
+      memcpy(buffer + i * record_length + column.record_offset,
+             data + (record_ids[i].slot_number - 1) * column.width,
+             column.width);
+    }
+  }
+  for (std::size_t i = 0; i < count; ++i) {
+    records[i] = std::string_view(buffer + i * record_length, record_length);
+  }
+}
+
+void Page::setFixedLengthFormat(
+    const std::vector<std::uint16_t>& column_widths) {
+  if (header_.num_slots != header_.num_free_slots) {
+    throw PageFormatException(page_number(),
+                              "page with records cannot change its format");
+  }
+  std::size_t record_length = 0;
+  for (std::size_t c = 0; c < column_widths.size(); ++c) {
+    record_length += column_widths[c];
+  }
+  // The header and columns, then the bitmap and the minipages, each 8-byte
+  // aligned.  Take as many rows as fit.
+  const std::size_t columns_end =
+      (sizeof(PaxHeader) + column_widths.size() * sizeof(PaxColumn) + 7) & ~7;
+  if (record_length == 0 || columns_end >= DATA_SIZE) {
+    throw PageFormatException(page_number(), "columns do not fit a page");
+  }
+  std::size_t capacity = (DATA_SIZE - columns_end) * 8 / (record_length * 8 + 1);
+  std::size_t layout_end;
+  for (;; --capacity) {
+    layout_end = columns_end + ((capacity + 63) / 64) * 8;
+    for (std::size_t c = 0; c < column_widths.size(); ++c) {
+      layout_end += (capacity * column_widths[c] + 7) & ~std::size_t(7);
+    }
+    if (layout_end <= DATA_SIZE || capacity == 0) {
+      break;
+    }
+  }
+  if (capacity == 0) {
+    throw PageFormatException(page_number(), "records do not fit a page");
+  }
+
+  memset(data_, '\0', DATA_SIZE);
+  PaxHeader* pax = reinterpret_cast<PaxHeader*>(data_);
+  pax->record_length = record_length;
+  pax->num_columns = column_widths.size();
+  pax->capacity = capacity;
+  pax->bitmap_offset = columns_end;
+  PaxColumn* columns = reinterpret_cast<PaxColumn*>(&data_[sizeof(PaxHeader)]);
+  std::size_t record_offset = 0;
+  std::size_t minipage_offset = columns_end + ((capacity + 63) / 64) * 8;
+  for (std::size_t c = 0; c < column_widths.size(); ++c) {
+    columns[c].width = column_widths[c];
+    columns[c].record_offset = record_offset;
+    columns[c].minipage_offset = minipage_offset;
+    record_offset += column_widths[c];
+    minipage_offset += (capacity * column_widths[c] + 7) & ~std::size_t(7);
+  }
+
+  header_.format = FIXED_LENGTH_FORMAT;
+  header_.num_slots = capacity;
+  header_.num_free_slots = capacity;
+  header_.free_space_lower_bound = layout_end;
+  header_.free_space_upper_bound = layout_end;
+  header_.fragmented_bytes = 0;
+}
+
+std::uint16_t Page::findColumn(const std::size_t offset,
+                               const std::size_t length) const {
+  for (std::uint16_t c = 0; c < getNumColumns(); ++c) {
+    const PaxColumn& column = getColumn(c);
+    if (offset >= column.record_offset &&
+        offset + length <= std::size_t(column.record_offset) + column.width) {
+      return c;
+    }
+  }
+  return getNumColumns();
+}
+
+void Page::checkFixedLength(const std::string& record_data) const {
+  if (isFixedLength() && record_data.length() != paxHeader().record_length) {
+    throw PageFormatException(page_number(),
+                              "record length differs from the page's");
+  }
+}
+
+void Page::writeRow(const SlotId slot_number, const std::string& record_data) {
+  for (std::uint16_t c = 0; c < getNumColumns(); ++c) {
+    const PaxColumn& column = getColumn(c);
+    memcpy(&data_[column.minipage_offset] + (slot_number - 1) * column.width,
+           &record_data[column.record_offset], column.width);
+  }
+}
+
+void Page::updateRecord(const RecordId& record_id,
+                        const std::string& record_data) {
   validateRecordId(record_id);
+  checkFixedLength(record_data);
+  if (isFixedLength()) {
+    writeRow(record_id.slot_number, record_data);
+    return;
+  }
   PageSlot* slot = getSlot(record_id.slot_number);
+  if (!updateRecordInPlace(slot, record_data)) {
+    const std::size_t free_space_after_delete =
+        getFreeSpace() + slot->item_length;
+    if (record_data.length() > free_space_after_delete) {
+      throw InsufficientSpaceException(
+          page_number(), record_data.length(), free_space_after_delete);
+    }
+    freeRecordSpace(slot);
+    reserveContiguousSpace(record_data.length());
+    placeRecord(slot, record_data);
+  }
+}
 
-	for(int i = 0; i < slot->item_length; i++)
-		data_[i + slot->item_offset] = '\0';
-
-  //data_.replace(slot->item_offset, slot->item_length, slot->item_length, '\0');
-
-  // Compact the data by removing the hole left by this record (if necessary).
-  std::uint16_t move_offset = slot->item_offset; 
-  std::size_t move_bytes = 0;
-  for (SlotId i = 1; i <= header_.num_slots; ++i) {
-    PageSlot* other_slot = getSlot(i);
-    if (other_slot->used && other_slot->item_offset < slot->item_offset) {
-      if (other_slot->item_offset < move_offset) {
-        move_offset = other_slot->item_offset;
+void Page::updateRecords(const std::vector<RecordId>& record_ids,
+                         const std::vector<std::string>& records) {
+  assert(record_ids.size() == records.size());
+  const bool fixed_length = isFixedLength();
+  bool same_lengths = true;
+  for (std::size_t i = 0; i < record_ids.size(); ++i) {
+    const RecordId& record_id = record_ids[i];
+    const std::string& record_data = records[i];
+    validateRecordId(record_id);
+    checkFixedLength(record_data);
+    same_lengths =
+        same_lengths &&
+        (fixed_length ||
+         record_data.length() == getSlot(record_id.slot_number)->item_length);
+  }
+  if (same_lengths) {
+    // Every version overwrites the old one where it is, so applying them in
+    // turn keeps the last version of a record given more than once.
+    for (std::size_t i = 0; i < record_ids.size(); ++i) {
+      const SlotId slot_number = record_ids[i].slot_number;
+      const std::string& record_data = records[i];
+      if (fixed_length) {
+        writeRow(slot_number, record_data);
+      } else {
+        memcpy(&data_[getSlot(slot_number)->item_offset], record_data.data(),
+               record_data.length());
       }
-      move_bytes += other_slot->item_length;
-      // Update the slot for the other data to reflect the soon-to-be-new
-      // location.
-      other_slot->item_offset += slot->item_length;
     }
+    return;
+  }
+
+  // Index of the version each slot ends up with, or -1.
+  std::vector<int> last_update(header_.num_slots + 1, -1);
+  for (std::size_t i = 0; i < record_ids.size(); ++i) {
+    last_update[record_ids[i].slot_number] = i;
+  }
+
+  std::size_t old_length = 0;
+  std::size_t new_length = 0;
+  for (std::size_t i = 0; i < record_ids.size(); ++i) {
+    if (last_update[record_ids[i].slot_number] == int(i)) {
+      old_length += getSlot(record_ids[i].slot_number)->item_length;
+      new_length += records[i].length();
+    }
+  }
+  if (new_length > old_length + getFreeSpace()) {
+    throw InsufficientSpaceException(page_number(), new_length - old_length,
+                                     getFreeSpace());
   }
-  // If we have data to move, shift it to the right.
-  if (move_bytes > 0) {
-    const std::string& data_to_move = std::string(data_, DATA_SIZE).substr(move_offset, move_bytes);
 
-		for(std::uint16_t i = 0; i < move_bytes; i++)
-			data_[i + move_offset + slot->item_length] = data_to_move[i];
+  // Versions that fit in place go there; the old bytes of the others are
+  // freed before any is placed, so a single compaction makes room for all.
+  std::vector<std::size_t> moved;
+  std::size_t moved_length = 0;
+  for (std::size_t i = 0; i < record_ids.size(); ++i) {
+    const SlotId slot_number = record_ids[i].slot_number;
+    if (last_update[slot_number] != int(i)) {
+      continue;
+    }
+    PageSlot* slot = getSlot(slot_number);
+    if (!updateRecordInPlace(slot, records[i])) {
+      freeRecordSpace(slot);
+      moved.push_back(i);
+      moved_length += records[i].length();
+    }
+  }
+  reserveContiguousSpace(moved_length);
+  for (std::size_t i = 0; i < moved.size(); ++i) {
+    placeRecord(getSlot(record_ids[moved[i]].slot_number), records[moved[i]]);
+  }
+}
+
+void Page::deleteRecord(const RecordId& record_id) {
+  deleteRecord(record_id, true /* allow_slot_compaction */);
+}
 
-    //data_.replace(move_offset + slot->item_length, move_bytes, data_to_move);
+void Page::deleteRecord(const RecordId& record_id,
+                        const bool allow_slot_compaction) {
+  validateRecordId(record_id);
+  if (isFixedLength()) {
+    setSlotUsed(record_id.slot_number, false);
+    ++header_.num_free_slots;
+    return;
   }
-  header_.free_space_upper_bound += slot->item_length;
+  PageSlot* slot = getSlot(record_id.slot_number);
+  freeRecordSpace(slot);
 
   // Mark slot as unused.
-  slot->used = false;
-  slot->item_offset = 0;
-  slot->item_length = 0;
+  setSlotUsed(record_id.slot_number, false);
   ++header_.num_free_slots;
 
   if (allow_slot_compaction && record_id.slot_number == header_.num_slots) {
     // Last slot in the list, so we need to free any unused slots that are at
-    // the end of the slot list.
-    int num_slots_to_delete = 1;
-    for (SlotId i = 1; i < header_.num_slots; ++i) {
-      // Traverse list backwards, looking for unused slots.
-      const PageSlot* other_slot = getSlot(header_.num_slots - i);
-      if (!other_slot->used) {
-        ++num_slots_to_delete;
-      } else {
-        // Stop at the first used slot we find, since we can't move used slots
-        // without affecting record IDs.
-        break;
-      }
-    }
+    // the end of the slot list.  Stop at the last used slot, since we can't
+    // move used slots without affecting record IDs.
+    const int num_slots_to_delete =
+        header_.num_slots - getPrevUsedSlot(header_.num_slots);
     header_.num_slots -= num_slots_to_delete;
     header_.num_free_slots -= num_slots_to_delete;
-    header_.free_space_lower_bound -= sizeof(PageSlot) * num_slots_to_delete;
+    header_.free_space_lower_bound = slotArraySize(header_.num_slots);
   }
 }
 
+void Page::freeRecordSpace(PageSlot* slot) {
+  // The record's bytes become free at once if it is the lowest on the page;
+  // otherwise they are left in place until the page is compacted.
+  if (slot->item_offset == header_.free_space_upper_bound) {
+    memset(&data_[slot->item_offset], '\0', slot->item_length);
+    header_.free_space_upper_bound += slot->item_length;
+  } else {
+    header_.fragmented_bytes += slot->item_length;
+  }
+  slot->item_offset = 0;
+  slot->item_length = 0;
+}
+
+bool Page::updateRecordInPlace(PageSlot* slot,
+                               const std::string& record_data) {
+  const std::uint16_t length = record_data.length();
+  const bool lowest = slot->item_offset == header_.free_space_upper_bound;
+  std::uint16_t offset;
+  if (length <= slot->item_length) {
+    // Keep the end of the record where it is, so the bytes freed are in front
+    // of it and go straight back to the free space if it is the lowest.
+    offset = slot->item_offset + (slot->item_length - length);
+    if (lowest) {
+      memset(&data_[slot->item_offset], '\0', offset - slot->item_offset);
+      header_.free_space_upper_bound = offset;
+    } else {
+      header_.fragmented_bytes += offset - slot->item_offset;
+    }
+  } else if (lowest && length - slot->item_length <=
+                           header_.free_space_upper_bound -
+                               header_.free_space_lower_bound) {
+    offset = slot->item_offset - (length - slot->item_length);
+    header_.free_space_upper_bound = offset;
+  } else {
+    return false;
+  }
+  slot->item_offset = offset;
+  slot->item_length = length;
+  memcpy(&data_[offset], record_data.data(), length);
+  return true;
+}
+
+void Page::placeRecord(PageSlot* slot, const std::string& record_data) {
+  slot->item_length = record_data.length();
+  slot->item_offset = header_.free_space_upper_bound - slot->item_length;
+  header_.free_space_upper_bound = slot->item_offset;
+  memcpy(&data_[slot->item_offset], record_data.data(), slot->item_length);
+}
+
 bool Page::hasSpaceForRecord(const std::string& record_data) const {
-  std::size_t record_size = record_data.length();
-  if (header_.num_free_slots == 0) {
-    record_size += sizeof(PageSlot);
+  if (isFixedLength()) {
+    return record_data.length() == paxHeader().record_length &&
+           header_.num_free_slots > 0;
   }
-  return record_size <= getFreeSpace();
+  return record_data.length() + newSlotSize() <= getFreeSpace();
+}
+
+std::size_t Page::newSlotSize() const {
+  if (header_.num_free_slots > 0) {
+    return 0;
+  }
+  return slotArraySize(header_.num_slots + 1) -
+         slotArraySize(header_.num_slots);
+}
+
+void Page::reserveContiguousSpace(const std::size_t length) {
+  if (std::size_t(header_.free_space_upper_bound - header_.free_space_lower_bound) <
+      length) {
+    compact();
+  }
+}
+
+void Page::compact(const bool force) {
+  if (header_.fragmented_bytes == 0 && !force) {
+    return;
+  }
+  // Move the records, highest first, so each lands next to the one above it.
+  std::vector<PageSlot*> slots;
+  for (SlotId i = getNextUsedSlot(INVALID_SLOT); i != INVALID_SLOT;
+       i = getNextUsedSlot(i)) {
+    slots.push_back(getSlot(i));
+  }
+  std::sort(slots.begin(), slots.end(),
+            [](const PageSlot* a, const PageSlot* b) {
+              return a->item_offset > b->item_offset;
+            });
+  std::uint16_t end = DATA_SIZE;
+  for (std::size_t i = 0; i < slots.size(); ++i) {
+    end -= slots[i]->item_length;
+    if (slots[i]->item_offset != end) {
+      memmove(&data_[end], &data_[slots[i]->item_offset], slots[i]->item_length);
+      slots[i]->item_offset = end;
+    }
+  }
+  memset(&data_[header_.free_space_upper_bound], '\0',
+         end - header_.free_space_upper_bound);
+  header_.free_space_upper_bound = end;
+  header_.fragmented_bytes = 0;
+}
+
+void Page::setSlotUsed(const SlotId slot_number, const bool used) {
+  std::uint32_t& word = usedWord((slot_number - 1) / SLOTS_PER_WORD);
+  const std::uint32_t bit =
+      std::uint32_t(1) << ((slot_number - 1) % SLOTS_PER_WORD);
+  if (used) {
+    word |= bit;
+  } else {
+    word &= ~bit;
+  }
+}
+
+SlotId Page::findSlot(const SlotId first, const SlotId last,
+                      const bool used) const {
+  if (first > last) {
+    return INVALID_SLOT;
+  }
+  // Look a word of the bitmap at a time, inverted when looking for unused
+  // slots, for the lowest set bit.
+  const std::size_t first_bit = first - 1;
+  const std::size_t last_bit = last - 1;
+  for (std::size_t word = first_bit / SLOTS_PER_WORD;
+       word <= last_bit / SLOTS_PER_WORD; ++word) {
+    std::uint32_t bits = used ? usedWord(word) : ~usedWord(word);
+    if (word == first_bit / SLOTS_PER_WORD) {
+      bits &= ~std::uint32_t(0) << (first_bit % SLOTS_PER_WORD);
+    }
+    if (bits != 0) {
+      const std::size_t bit = word * SLOTS_PER_WORD + __builtin_ctz(bits);
+      return bit <= last_bit ? SlotId(bit + 1) : INVALID_SLOT;
+    }
+  }
+  return INVALID_SLOT;
+}
+
+SlotId Page::getPrevUsedSlot(const SlotId slot_number) const {
+  // The highest set bit below the slot's, a word at a time.
+  const std::size_t end_bit = slot_number - 1;
+  for (std::size_t word = (end_bit + SLOTS_PER_WORD - 1) / SLOTS_PER_WORD;
+       word-- > 0;) {
+    std::uint32_t bits = usedWord(word);
+    if (word == end_bit / SLOTS_PER_WORD) {
+      bits &= (std::uint32_t(1) << (end_bit % SLOTS_PER_WORD)) - 1;
+    }
+    if (bits != 0) {
+      return SlotId(word * SLOTS_PER_WORD + 31 - __builtin_clz(bits) + 1);
+    }
+  }
+  return INVALID_SLOT;
 }
 
 PageSlot* Page::getSlot(const SlotId slot_number) {
-  return reinterpret_cast<PageSlot*>(&data_[(slot_number - 1) * sizeof(PageSlot)]);
+  // A slot ends where a slot array of that many slots would.
+  return reinterpret_cast<PageSlot*>(
+      &data_[slotArraySize(slot_number) - sizeof(PageSlot)]);
 }
 
 const PageSlot& Page::getSlot(const SlotId slot_number) const {
-  return *reinterpret_cast<const PageSlot*>(&data_[(slot_number - 1) * sizeof(PageSlot)]);
+  return *reinterpret_cast<const PageSlot*>(
+      &data_[slotArraySize(slot_number) - sizeof(PageSlot)]);
 }
 
 SlotId Page::getAvailableSlot() {
   SlotId slot_number = INVALID_SLOT;
   if (header_.num_free_slots > 0) {
-    // Have an allocated but unused slot that we can reuse.
-    for (SlotId i = 1; i <= header_.num_slots; ++i) {
-      const PageSlot* slot = getSlot(i);
-      if (!slot->used) {
-        // We don't decrement the number of free slots until someone actually
-        // puts data in the slot.
-        slot_number = i;
-        break;
-      }
-    }
+    // Have an allocated but unused slot that we can reuse.  We don't
+    // decrement the number of free slots until someone actually puts data in
+    // the slot.
+    slot_number = findSlot(1, header_.num_slots, false /* used */);
   } else {
     // Have to allocate a new slot.
     slot_number = header_.num_slots + 1;
     ++header_.num_slots;
     ++header_.num_free_slots;
-    header_.free_space_lower_bound = sizeof(PageSlot) * header_.num_slots;
+    header_.free_space_lower_bound = slotArraySize(header_.num_slots);
+    if ((slot_number - 1) % SLOTS_PER_WORD == 0) {
+      // first slot of a new group, behind its used-slot word
+      usedWord((slot_number - 1) / SLOTS_PER_WORD) = 0;
+    }
   }
   assert(slot_number != INVALID_SLOT);
   return slot_number;
@@ -181,12 +588,12 @@ void Page::insertRecordInSlot(const SlotId slot_number,
       slot_number == INVALID_SLOT) {
     throw InvalidSlotException(page_number(), slot_number);
   }
-  PageSlot* slot = getSlot(slot_number);
-  if (slot->used) {
+  if (isSlotUsed(slot_number)) {
     throw SlotInUseException(page_number(), slot_number);
   }
+  PageSlot* slot = getSlot(slot_number);
   const int record_length = record_data.length();
-  slot->used = true;
+  setSlotUsed(slot_number, true);
   slot->item_length = record_length;
   slot->item_offset = header_.free_space_upper_bound - record_length;
   header_.free_space_upper_bound = slot->item_offset;
@@ -202,8 +609,9 @@ void Page::validateRecordId(const RecordId& record_id) const {
   if (record_id.page_number != page_number()) {
     throw InvalidRecordException(record_id, page_number());
   }
-  const PageSlot& slot = getSlot(record_id.slot_number);
-  if (!slot.used) {
+  const SlotId slot_number = record_id.slot_number;
+  if (slot_number == INVALID_SLOT || slot_number > header_.num_slots ||
+      !isSlotUsed(slot_number)) {
     throw InvalidRecordException(record_id, page_number());
   }
 }
@@ -11,10 +11,21 @@
 #include <stdint.h>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 //#include <gtest/gtest.h>
 #include "types.h"
 
+/**
+ * Page size in bytes, chosen at build time (e.g. make PAGE_SIZE=16384): a
+ * power of two from 4 KB to 64 KB.  Page offsets are 16 bits wide, which is
+ * what bounds it from above.
+ */
+#ifndef BADGERDB_PAGE_SIZE
+#define BADGERDB_PAGE_SIZE 8192
+#endif
+
 namespace badgerdb {
 
 /**
@@ -48,6 +59,18 @@ struct PageHeader {
    */
   SlotId num_free_slots;
 
+  /**
+   * Number of bytes of deleted records left between the records still on the
+   * page.  They count as free space, but are only usable after compaction.
+   */
+  std::uint16_t fragmented_bytes;
+
+  /**
+   * Layout of the page's data: Page::SLOTTED_FORMAT or
+   * Page::FIXED_LENGTH_FORMAT.
+   */
+  std::uint16_t format;
+
   /**
    * Number of the page within the file.
    */
@@ -58,6 +81,12 @@ struct PageHeader {
    */
   PageId next_page_number;
 
+  /**
+   * Number of the previous used page in the file.  Lets a page be unlinked
+   * from the used list without walking the list to find its predecessor.
+   */
+  PageId prev_page_number;
+
   /**
    * Returns true if this page header is equal to the other.
    *
@@ -67,21 +96,20 @@ struct PageHeader {
   bool operator==(const PageHeader& rhs) const {
     return num_slots == rhs.num_slots &&
         num_free_slots == rhs.num_free_slots &&
+        fragmented_bytes == rhs.fragmented_bytes &&
         current_page_number == rhs.current_page_number &&
-        next_page_number == rhs.next_page_number;
+        next_page_number == rhs.next_page_number &&
+        prev_page_number == rhs.prev_page_number;
   }
 };
 
 /**
  * @brief Slot metadata that tracks where a record is in the data space.
+ *
+ * Whether the slot holds a record is kept in the used-slot word of its group
+ * of slots (see Page).
  */
 struct PageSlot {
-  /**
-   * Whether the slot currently holds data.  May be false if this slot's
-   * record has been deleted after insertion.
-   */
-  bool used;
-
   /**
    * Offset of the data item in the page.
    */
@@ -93,6 +121,56 @@ struct PageSlot {
   std::uint16_t item_length;
 };
 
+/**
+ * @brief Layout of a page of fixed-length records, at the start of its data
+ *        area.
+ *
+ * Such a page stores its records PAX style: the data area holds a bitmap of
+ * the used rows and one minipage per column, in which the column's values of
+ * all rows are contiguous.  Row <n> holds the record of slot <n + 1>.
+ */
+struct PaxHeader {
+  /**
+   * Length of every record, the sum of the column widths.
+   */
+  std::uint16_t record_length;
+
+  /**
+   * Number of columns; a PaxColumn for each follows this header.
+   */
+  std::uint16_t num_columns;
+
+  /**
+   * Number of rows the page holds.
+   */
+  std::uint16_t capacity;
+
+  /**
+   * Offset of the used-row bitmap in the data area.
+   */
+  std::uint16_t bitmap_offset;
+};
+
+/**
+ * @brief Column of a page of fixed-length records.
+ */
+struct PaxColumn {
+  /**
+   * Width of the column's values.
+   */
+  std::uint16_t width;
+
+  /**
+   * Offset of the column's value in a record.
+   */
+  std::uint16_t record_offset;
+
+  /**
+   * Offset of the column's minipage in the data area.
+   */
+  std::uint16_t minipage_offset;
+};
+
 class PageIterator;
 
 /**
@@ -103,15 +181,23 @@ class PageIterator;
  * slots and identified by a RecordId.  Although a record's actual contents may
  * be moved on the page, accessing a record by its slot is consistent.
  *
+ * The slot array grows from the start of the data area in groups of
+ * SLOTS_PER_WORD slots, each group preceded by a 32-bit word whose bit <n> is
+ * set if the group's slot <n> is used; records grow down from the end of the
+ * data area.  So the used-slot bitmap takes space only for the slots there
+ * are.  Files written by earlier versions of BadgerDB, with other page or file
+ * header layouts, are not supported.
+ *
  * @warning This class is not threadsafe.
  */
 class Page {
  public:
   /**
-   * Page size in bytes.  If this is changed, database files created with a
-   * different page size value will be unreadable by the resulting binaries.
+   * Page size in bytes; see BADGERDB_PAGE_SIZE.  If this is changed, database
+   * files created with a different page size value will be unreadable by the
+   * resulting binaries.
    */
-  static const std::size_t SIZE = 8192;
+  static const std::size_t SIZE = BADGERDB_PAGE_SIZE;
 
   /**
    * Size of page free space area in bytes.
@@ -128,6 +214,22 @@ class Page {
    */
   static const SlotId INVALID_SLOT = 0;
 
+  /**
+   * Number of slots whose used flags share one word of the bitmap.
+   */
+  static const std::size_t SLOTS_PER_WORD = 32;
+
+  /**
+   * Value of PageHeader::format for slotted pages of variable-length records.
+   */
+  static const std::uint16_t SLOTTED_FORMAT = 0;
+
+  /**
+   * Value of PageHeader::format for pages of fixed-length records stored in
+   * column minipages.
+   */
+  static const std::uint16_t FIXED_LENGTH_FORMAT = 0xC01A;
+
   /**
    * Constructs a new, uninitialized page.
    */
@@ -151,20 +253,127 @@ class Page {
    */
   std::string getRecord(const RecordId& record_id) const;
 
+  /**
+   * Returns the record with the given ID without copying it.  The view points
+   * into the page, so it is valid only while the page is (for a page in the
+   * buffer pool, while it stays pinned) and until the page is changed.
+   *
+   * @see getRecord
+   * @param record_id  ID of the record to return.
+   * @return  View of the record's bytes.
+   * @throws  PageFormatException   For a page of fixed-length records, whose
+   *                                records are split over the columns.
+   */
+  std::string_view getRecordView(const RecordId& record_id) const;
+
+  /**
+   * Returns part of the record with the given ID without copying it; the view
+   * is valid as long as one from getRecordView() is.  On a page of
+   * fixed-length records the part must lie within one column.
+   *
+   * @param record_id  ID of the record.
+   * @param offset     Offset of the part in the record.
+   * @param length     Length of the part.
+   * @return  View of the part's bytes.
+   * @throws  PageFormatException   If the part is not within the record or
+   *                                not within one column.
+   */
+  std::string_view getAttributeView(const RecordId& record_id,
+                                    const std::size_t offset,
+                                    const std::size_t length) const;
+
+  /**
+   * Copies part of each of the next records, such as one attribute, into a
+   * packed array, so that a predicate can test many records at once.
+   *
+   * @param start   Slot to start after; INVALID_SLOT for the first.
+   * @param offset  Offset of the part in the record.
+   * @param length  Length of the part.
+   * @param slots   Receives the slot numbers of the records.
+   * @param values  Receives the parts, <length> bytes each, in slot order.
+   * @param max     Largest number of records to copy.
+   * @return  Number of records copied; fewer than <max> only if no used slot
+   *          is left.
+   * @throws  PageFormatException   If the part is not within a record or not
+   *                                within one column.
+   */
+  std::size_t gatherAttribute(const SlotId start, const std::size_t offset,
+                              const std::size_t length, SlotId* slots,
+                              char* values, const std::size_t max) const;
+
+  /**
+   * Copies part of each of the given records into a packed array, as the
+   * other form does for the records after a slot.  The records must be in
+   * use; their IDs are not checked.
+   *
+   * @param record_ids  IDs of the records.
+   * @param count       Number of records.
+   * @param offset      Offset of the part in the record.
+   * @param length      Length of the part.
+   * @param values      Receives the parts, <length> bytes each, in the order
+   *                    of the IDs.
+   * @throws  PageFormatException   If the part is not within a record or not
+   *                                within one column.
+   */
+  void gatherAttribute(const RecordId* record_ids, const std::size_t count,
+                       const std::size_t offset, const std::size_t length,
+                       char* values) const;
+
+  /**
+   * Returns views of many records at once, as getRecordView() would, except
+   * that the records of a page of fixed-length records are gathered from the
+   * columns into a buffer of the caller's.  The records must be in use; their
+   * IDs are not checked.
+   *
+   * @param record_ids  IDs of the records.
+   * @param count       Number of records.
+   * @param records     Receives the records, in the same order.
+   * @param buffer      For a page of fixed-length records, room for <count>
+   *                    records of getRecordLength() bytes, which the views
+   *                    then point into; not used for other pages.
+   */
+  void gatherRecords(const RecordId* record_ids, const std::size_t count,
+                     std::string_view* records, char* buffer) const;
+
   /**
    * Updates the record with the given ID, replacing its data with a new
    * version.  This is equivalent to deleting the old record and inserting a
    * new one, with the exception that the record ID will not change.
    *
+   * A new version no longer than the old one overwrites it in place, as does
+   * a longer one of the lowest record on the page if the free space below it
+   * holds the difference.  Other versions go to the free space, and the page
+   * is compacted only if that is too fragmented to hold them.
+   *
    * @param record_id   ID of record to update.
    * @param record_data Updated bytes that compose the record.
+   * @throws  InsufficientSpaceException  If the page cannot hold the new
+   *                                      version.
    */
   void updateRecord(const RecordId& record_id, const std::string& record_data);
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array.
+   * Updates many records of this page, with the same result as calling
+   * updateRecord() for each in turn but compacting the page at most once.
+   * Either all records are updated or, if an ID is invalid or the page cannot
+   * hold the new versions, none is.
+   *
+   * @param record_ids    IDs of the records to update; if one appears more
+   *                      than once, its last version is kept.
+   * @param records       Updated bytes of each record, in the same order.
+   * @throws  InvalidRecordException      If an ID is not valid for this page.
+   * @throws  InsufficientSpaceException  If the page cannot hold the new
+   *                                      versions.
+   */
+  void updateRecords(const std::vector<RecordId>& record_ids,
+                     const std::vector<std::string>& records);
+
+  /**
+   * Deletes the record with the given ID.  The slot is marked free and,
+   * unless the record is the lowest on the page, its bytes are only counted
+   * in fragmented_bytes: the page is compacted lazily, by the next insert or
+   * update that needs contiguous space.  Slot array is compacted if the slot
+   * deleted is at the end of the slot array.
    *
    * @param record_id   ID of the record to delete.
    */
@@ -179,12 +388,77 @@ class Page {
   bool hasSpaceForRecord(const std::string& record_data) const;
 
   /**
-   * Returns this page's free space in bytes.
+   * Returns this page's free space in bytes, including the space of deleted
+   * records not yet reclaimed by compaction.  For a page of fixed-length
+   * records, this is the space of its free rows.
    *
    * @return  Free space in bytes.
    */
-  std::uint16_t getFreeSpace() const { return header_.free_space_upper_bound -
-                                              header_.free_space_lower_bound; }
+  std::uint16_t getFreeSpace() const {
+    if (isFixedLength()) {
+      return header_.num_free_slots * paxHeader().record_length;
+    }
+    return header_.free_space_upper_bound - header_.free_space_lower_bound +
+           header_.fragmented_bytes;
+  }
+
+  /**
+   * Turns this empty page into a page of fixed-length records, whose columns
+   * have the given widths.  Every record inserted must then be as long as the
+   * widths add up to, and its columns are stored in separate minipages so
+   * that a column of all records can be read contiguously.
+   *
+   * @param column_widths   Widths of the columns, in record order.
+   * @throws  PageFormatException   If the page holds records or the columns
+   *                                do not fit the page.
+   */
+  void setFixedLengthFormat(const std::vector<std::uint16_t>& column_widths);
+
+  /**
+   * Returns whether this is a page of fixed-length records.
+   */
+  bool isFixedLength() const { return header_.format == FIXED_LENGTH_FORMAT; }
+
+  /**
+   * Returns the number of columns of a page of fixed-length records.
+   */
+  std::uint16_t getNumColumns() const { return paxHeader().num_columns; }
+
+  /**
+   * Returns the length of every record of a page of fixed-length records.
+   */
+  std::uint16_t getRecordLength() const { return paxHeader().record_length; }
+
+  /**
+   * Returns a column of a page of fixed-length records.
+   *
+   * @param column  Number of the column, from 0.
+   */
+  const PaxColumn& getColumn(const std::uint16_t column) const {
+    return paxColumns()[column];
+  }
+
+  /**
+   * Returns the column of a page of fixed-length records holding the given
+   * part of the records, or getNumColumns() if no single column holds it.
+   *
+   * @param offset  Offset of the part in the record.
+   * @param length  Length of the part.
+   */
+  std::uint16_t findColumn(const std::size_t offset,
+                           const std::size_t length) const;
+
+  /**
+   * Returns the values of a column of a page of fixed-length records: the
+   * value of slot <n> is the column's width bytes at (n - 1) * width.  Values
+   * of unused slots are meaningless; see getNextUsedSlot().
+   *
+   * @param column  Number of the column, from 0.
+   * @return  Start of the column's minipage.
+   */
+  const char* getColumnData(const std::uint16_t column) const {
+    return &data_[paxColumns()[column].minipage_offset];
+  }
 
   /**
    * Returns this page's number in its file.
@@ -200,6 +474,33 @@ class Page {
    */
   PageId next_page_number() const { return header_.next_page_number; }
 
+  /**
+   * Returns the number of the previous used page before this page in its file.
+   *
+   * @return  Page number of previous used page in file.
+   */
+  PageId prev_page_number() const { return header_.prev_page_number; }
+
+  /**
+   * Returns the first used slot after the given one, or INVALID_SLOT if there
+   * is none.
+   *
+   * @param start   Slot to start search after; INVALID_SLOT for the first.
+   * @return  Next used slot after <start> or INVALID_SLOT.
+   */
+  SlotId getNextUsedSlot(const SlotId start) const {
+    // Most of the time the next used slot is in the same word of the bitmap.
+    if (start < header_.num_slots) {
+      const std::uint32_t bits =
+          usedWord(start / SLOTS_PER_WORD) >> (start % SLOTS_PER_WORD);
+      if (bits != 0) {
+        const SlotId slot_number = start + __builtin_ctz(bits) + 1;
+        return slot_number <= header_.num_slots ? slot_number : INVALID_SLOT;
+      }
+    }
+    return findSlot(start + 1, header_.num_slots, true /* used */);
+  }
+
   /**
    * Returns an iterator at the first record in the page.
    *
@@ -240,10 +541,19 @@ class Page {
   }
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array and
-   * <allow_slot_compaction> is set.
+   * Sets the number of the previous used page before this page in its file.
+   *
+   * @param prev_page_number  Page number of previous used page in file.
+   */
+  void set_prev_page_number(const PageId new_prev_page_number) {
+    header_.prev_page_number = new_prev_page_number;
+  }
+
+  /**
+   * Deletes the record with the given ID.  The record's bytes are only
+   * counted as fragmented; compact() reclaims them when an insert needs the
+   * space.  Slot array is compacted if the slot deleted is at the end of the
+   * slot array and <allow_slot_compaction> is set.
    *
    * @param record_id             ID of the record to delete.
    * @param allow_slot_compaction If true, the slot array will be compacted if
@@ -252,6 +562,152 @@ class Page {
   void deleteRecord(const RecordId& record_id,
                     const bool allow_slot_compaction);
 
+  /**
+   * Frees the bytes of the record in the given slot, leaving the slot in use
+   * with an empty record.  The bytes go back to the free space if the record
+   * is the lowest on the page and are counted as fragmented otherwise.
+   *
+   * @param slot  Slot of the record.
+   */
+  void freeRecordSpace(PageSlot* slot);
+
+  /**
+   * Replaces the record in the given slot without moving it to the free
+   * space: a version no longer than the old one is written over its end, and
+   * a longer version of the lowest record grows down into the free space.
+   *
+   * @param slot          Slot of the record.
+   * @param record_data   New version of the record.
+   * @return  Whether the record was replaced; if not, the page is unchanged.
+   */
+  bool updateRecordInPlace(PageSlot* slot, const std::string& record_data);
+
+  /**
+   * Writes a record at the top of the free space and points the given slot at
+   * it.  Callers make sure the free space is contiguous enough.
+   *
+   * @param slot          Slot of the record.
+   * @param record_data   Bytes that compose the record.
+   */
+  void placeRecord(PageSlot* slot, const std::string& record_data);
+
+  /**
+   * Returns the size of a slot array of the given number of slots, used-slot
+   * words included.
+   *
+   * @param num_slots   Number of slots.
+   */
+  static std::size_t slotArraySize(const std::size_t num_slots) {
+    return num_slots * sizeof(PageSlot) +
+           (num_slots + SLOTS_PER_WORD - 1) / SLOTS_PER_WORD *
+               sizeof(std::uint32_t);
+  }
+
+  /**
+   * Returns a word of the used-slot bitmap: bit <n> of word <w> is set if
+   * slot <w * SLOTS_PER_WORD + n + 1> is used.  Slotted pages keep each word
+   * in front of its group of slots, pages of fixed-length records keep the
+   * words together after their columns.
+   *
+   * @param word  Number of the word.
+   */
+  std::uint32_t& usedWord(const std::size_t word) {
+    return const_cast<std::uint32_t&>(
+        static_cast<const Page*>(this)->usedWord(word));
+  }
+  const std::uint32_t& usedWord(const std::size_t word) const {
+    const std::size_t offset =
+        isFixedLength()
+            ? paxHeader().bitmap_offset + word * sizeof(std::uint32_t)
+            : word * slotArraySize(SLOTS_PER_WORD);
+    return *reinterpret_cast<const std::uint32_t*>(&data_[offset]);
+  }
+
+  /**
+   * Returns whether a slot is used.
+   *
+   * @param slot_number   Number of the slot.
+   */
+  bool isSlotUsed(const SlotId slot_number) const {
+    return (usedWord((slot_number - 1) / SLOTS_PER_WORD) >>
+            ((slot_number - 1) % SLOTS_PER_WORD)) & 1;
+  }
+
+  /**
+   * Returns the layout of a page of fixed-length records.
+   */
+  const PaxHeader& paxHeader() const {
+    return *reinterpret_cast<const PaxHeader*>(data_);
+  }
+
+  /**
+   * Returns the columns of a page of fixed-length records.
+   */
+  const PaxColumn* paxColumns() const {
+    return reinterpret_cast<const PaxColumn*>(&data_[sizeof(PaxHeader)]);
+  }
+
+  /**
+   * Returns the space a new slot takes if inserting a record has to add one:
+   * the slot, and the used-slot word of a new group of slots.
+   */
+  std::size_t newSlotSize() const;
+
+  /**
+   * Marks a slot used or unused in the bitmap.
+   *
+   * @param slot_number   Number of the slot.
+   * @param used          Whether the slot is used.
+   */
+  void setSlotUsed(const SlotId slot_number, const bool used);
+
+  /**
+   * Returns the first slot from <first> to <last> whose used flag equals
+   * <used>, or INVALID_SLOT if there is none.
+   *
+   * @param first   First slot to look at.
+   * @param last    Last slot to look at.
+   * @param used    Whether to look for a used or an unused slot.
+   */
+  SlotId findSlot(const SlotId first, const SlotId last, const bool used) const;
+
+  /**
+   * Returns the last used slot before <slot_number>, or INVALID_SLOT if there
+   * is none.
+   */
+  SlotId getPrevUsedSlot(const SlotId slot_number) const;
+
+  /**
+   * Throws PageFormatException if this is a page of fixed-length records and
+   * the record does not have their length.
+   */
+  void checkFixedLength(const std::string& record_data) const;
+
+  /**
+   * Scatters a record over the columns of a page of fixed-length records.
+   *
+   * @param slot_number   Slot of the record.
+   * @param record_data   Bytes that compose the record.
+   */
+  void writeRow(const SlotId slot_number, const std::string& record_data);
+
+  /**
+   * Makes sure the space between the slot array and the records holds at least
+   * <length> bytes, compacting the records if it does not.  Callers are
+   * responsible for checking that the page has that much free space.
+   *
+   * @param length  Number of contiguous free bytes needed.
+   */
+  void reserveContiguousSpace(const std::size_t length);
+
+  /**
+   * Moves the records to the end of the data area so the space of deleted
+   * records joins the free space between the slot array and the records.
+   *
+   * @param force   Whether to compact even without fragmented bytes.
+   */
+  void compact(const bool force = false);
+
   /**
    * Returns the slot with the given number.  This method will return
    * unallocated slots if requested; it is up to the caller to ensure they
@@ -343,5 +799,8 @@ static_assert(Page::SIZE > sizeof(PageHeader),
               "Page size must be large enough to hold header and data.");
 static_assert(Page::DATA_SIZE > 0,
               "Page must have some space to hold data.");
+static_assert(Page::SIZE >= 4096 && Page::SIZE <= 65536 &&
+                  (Page::SIZE & (Page::SIZE - 1)) == 0,
+              "Page size must be a power of two from 4 KB to 64 KB.");
 
 }
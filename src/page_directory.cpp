@@ -0,0 +1,222 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "page_directory.h"
+
+#include <unistd.h>
+
+#include "file.h"
+#include "mem_backend.h"
+#include "page.h"
+
+namespace badgerdb {
+
+/**
+ * Identifies a page directory sidecar ("BDBD").
+ */
+static const std::uint32_t DIRECTORY_MAGIC = 0x44424442;
+
+/**
+ * Number of pages in a word of the directory.
+ */
+static const PageId WORD_PAGES = 64;
+
+/**
+ * @brief Header at the start of a page directory sidecar, followed by the
+ *        words.
+ */
+struct PageDirectoryHeader {
+  /**
+   * DIRECTORY_MAGIC.
+   */
+  std::uint32_t magic;
+
+  /**
+   * Whether the words on disk are complete; cleared before the first change
+   * after a flush.
+   */
+  std::uint32_t clean;
+
+  /**
+   * Header of the file when the words were written.
+   */
+  FileHeader file_header;
+};
+
+static std::string directoryName(const std::string& filename) {
+  return filename + ".pdir";
+}
+
+PageDirectory::PageDirectory(const std::string& filename, const bool create_new,
+                             const FileHeader& header)
+    : complete_(false), dirty_(true) {
+  const std::string name = directoryName(filename);
+  const bool create = create_new || !File::exists(name);
+  if (MemBackend::exists(filename) || MemBackend::exists(name)) {
+    storage_.reset(new MemBackend(name, create));
+  } else {
+    storage_.reset(new DiskBackend(name, create));
+  }
+
+  PageDirectoryHeader image = {DIRECTORY_MAGIC, 0 /* clean */, header};
+  if (create) {
+    storage_->write(0 /* offset */, &image, sizeof(image));
+    return;
+  }
+  const off_t size = storage_->size();
+  if (size < off_t(sizeof(image))) {
+    return;
+  }
+  storage_->read(0 /* offset */, &image, sizeof(image));
+  if (image.magic != DIRECTORY_MAGIC || !image.clean ||
+      !(image.file_header == header)) {
+    // Pages may have been allocated or deleted after the words were last
+    // written, so none of them can be trusted.
+    return;
+  }
+  words_.resize((size - sizeof(image)) / sizeof(std::uint64_t));
+  if (!words_.empty()) {
+    storage_->read(sizeof(image), &words_[0],
+                   words_.size() * sizeof(std::uint64_t));
+  }
+  complete_ = true;
+  dirty_ = false;
+}
+
+bool PageDirectory::exists(const std::string& filename) {
+  return File::exists(directoryName(filename));
+}
+
+void PageDirectory::remove(const std::string& filename) {
+  const std::string name = directoryName(filename);
+  if (MemBackend::exists(name)) {
+    MemBackend::remove(name);
+  } else {
+    ::unlink(name.c_str());
+  }
+}
+
+void PageDirectory::clear() {
+  beginChange();
+  words_.clear();
+}
+
+bool PageDirectory::isUsed(const PageId page_number) const {
+  const std::size_t word = page_number / WORD_PAGES;
+  return word < words_.size() &&
+         (words_[word] >> (page_number % WORD_PAGES) & 1) != 0;
+}
+
+void PageDirectory::setUsed(const PageId page_number, const bool used) {
+  beginChange();
+  const std::size_t word = page_number / WORD_PAGES;
+  if (word >= words_.size()) {
+    words_.resize(word + 1, 0);
+  }
+  const std::uint64_t bit = std::uint64_t(1) << (page_number % WORD_PAGES);
+  if (used) {
+    words_[word] |= bit;
+  } else {
+    words_[word] &= ~bit;
+  }
+}
+
+PageId PageDirectory::nextUsed(const PageId page_number) const {
+  std::size_t word = (std::size_t(page_number) + 1) / WORD_PAGES;
+  if (word >= words_.size()) {
+    return Page::INVALID_NUMBER;
+  }
+  std::uint64_t bits =
+      words_[word] & (~std::uint64_t(0) << ((page_number + 1) % WORD_PAGES));
+  while (bits == 0) {
+    if (++word == words_.size()) {
+      return Page::INVALID_NUMBER;
+    }
+    bits = words_[word];
+  }
+  return PageId(word * WORD_PAGES + __builtin_ctzll(bits));
+}
+
+PageId PageDirectory::prevUsed(const PageId page_number) const {
+  if (page_number == 0 || words_.empty()) {
+    return Page::INVALID_NUMBER;
+  }
+  std::size_t word = (page_number - 1) / WORD_PAGES;
+  std::uint64_t bits;
+  if (word >= words_.size()) {
+    word = words_.size() - 1;
+    bits = words_[word];
+  } else {
+    const PageId last = (page_number - 1) % WORD_PAGES;
+    bits = words_[word] & (~std::uint64_t(0) >> (WORD_PAGES - 1 - last));
+  }
+  while (bits == 0) {
+    if (word == 0) {
+      return Page::INVALID_NUMBER;
+    }
+    bits = words_[--word];
+  }
+  return PageId(word * WORD_PAGES + WORD_PAGES - 1 - __builtin_clzll(bits));
+}
+
+PageId PageDirectory::usedPageNear(const PageId page_number) const {
+  const std::size_t home = page_number / WORD_PAGES;
+  if (home >= words_.size()) {
+    return prevUsed(page_number);
+  }
+  const PageId offset = page_number % WORD_PAGES;
+  for (std::size_t distance = 0;
+       distance <= home || home + distance < words_.size(); ++distance) {
+    std::uint64_t below = distance <= home ? words_[home - distance] : 0;
+    std::uint64_t above =
+        home + distance < words_.size() ? words_[home + distance] : 0;
+    if (distance == 0) {
+      below &= (std::uint64_t(1) << offset) - 1;
+      above &= ~std::uint64_t(1) << offset;
+    }
+    if (below != 0) {
+      return PageId((home - distance) * WORD_PAGES + WORD_PAGES - 1 -
+                    __builtin_clzll(below));
+    }
+    if (above != 0) {
+      return PageId((home + distance) * WORD_PAGES + __builtin_ctzll(above));
+    }
+  }
+  return Page::INVALID_NUMBER;
+}
+
+void PageDirectory::flush(const FileHeader& header) {
+  if (!dirty_) {
+    return;
+  }
+  if (!words_.empty()) {
+    storage_->write(sizeof(PageDirectoryHeader), &words_[0],
+                    words_.size() * sizeof(std::uint64_t));
+  }
+  storage_->truncate(sizeof(PageDirectoryHeader) +
+                     off_t(words_.size() * sizeof(std::uint64_t)));
+  // The words have to be on disk before the sidecar says they are complete.
+  storage_->sync();
+  const PageDirectoryHeader image = {DIRECTORY_MAGIC, 1 /* clean */, header};
+  storage_->write(0 /* offset */, &image, sizeof(image));
+  dirty_ = false;
+}
+
+void PageDirectory::beginChange() {
+  if (dirty_) {
+    return;
+  }
+  PageDirectoryHeader image;
+  storage_->read(0 /* offset */, &image, sizeof(image));
+  image.clean = 0;
+  storage_->write(0 /* offset */, &image, sizeof(image));
+  // Page links must not reach disk while the sidecar still claims to be clean.
+  storage_->sync();
+  dirty_ = true;
+}
+
+}
@@ -0,0 +1,154 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "file_backend.h"
+#include "types.h"
+
+namespace badgerdb {
+
+struct FileHeader;
+
+/**
+ * @brief Which pages of a file are in use, one bit per page.
+ *
+ * The used list of a PageFile is in page number order, so the bits alone give
+ * every used page's place in it: the used pages around a page are found a
+ * word (64 pages) at a time, without reading any page headers.
+ *
+ * A page directory is kept in a sidecar file next to the file it describes
+ * (the file's name with ".pdir" appended; in memory for in-memory files), on
+ * the terms of a ZoneMap: changes are kept in memory and written when the
+ * file's metadata is flushed, and the sidecar is marked unclean on disk before
+ * the first change after a flush.  The sidecar also records the file header it
+ * was written with; one that is unclean or was written with another header is
+ * not complete(), and the file rebuilds it from its page headers.  The
+ * caller serializes access (File does so under the file's mutex).
+ */
+class PageDirectory {
+ public:
+  /**
+   * Opens the page directory of a file, creating an empty one if asked to
+   * (replacing any old one) or if the file has none.
+   *
+   * @param filename    Name of the file the page directory describes.
+   * @param create_new  Whether to create the page directory.
+   * @param header      Header of the file as read from disk.
+   */
+  PageDirectory(const std::string& filename, const bool create_new,
+                const FileHeader& header);
+
+  /**
+   * Returns true if the given file has a page directory.
+   *
+   * @param filename  Name of the file.
+   */
+  static bool exists(const std::string& filename);
+
+  /**
+   * Deletes the page directory of the given file, if it has one.
+   *
+   * @param filename  Name of the file.
+   */
+  static void remove(const std::string& filename);
+
+  /**
+   * Returns whether the directory holds the used pages of the file: false if
+   * it was just created, or read from a sidecar that was unclean or written
+   * with another file header.
+   */
+  bool complete() const { return complete_; }
+
+  /**
+   * Marks every page as free, e.g. ahead of rebuilding the directory.
+   */
+  void clear();
+
+  /**
+   * Returns whether a page is in use.
+   *
+   * @param page_number   Number of the page.
+   */
+  bool isUsed(const PageId page_number) const;
+
+  /**
+   * Records whether a page is in use.
+   *
+   * @param page_number   Number of the page.
+   * @param used          Whether it is in use.
+   */
+  void setUsed(const PageId page_number, const bool used);
+
+  /**
+   * Returns the first used page after the given one.
+   *
+   * @param page_number   Number of the page.
+   * @return  Number of the used page, or Page::INVALID_NUMBER if there is none.
+   */
+  PageId nextUsed(const PageId page_number) const;
+
+  /**
+   * Returns the last used page before the given one.
+   *
+   * @param page_number   Number of the page.
+   * @return  Number of the used page, or Page::INVALID_NUMBER if there is none.
+   */
+  PageId prevUsed(const PageId page_number) const;
+
+  /**
+   * Returns a used page near the given one, searching outwards from it a word
+   * at a time on both sides, so that the search ends as soon as either side
+   * has a used page.
+   *
+   * @param page_number   Number of the page.
+   * @return  Number of the used page, or Page::INVALID_NUMBER if there is none.
+   */
+  PageId usedPageNear(const PageId page_number) const;
+
+  /**
+   * Writes the directory if it changed since the last flush and marks the
+   * sidecar clean.
+   *
+   * @param header  Header of the file as it is being written to disk.
+   */
+  void flush(const FileHeader& header);
+
+ private:
+  /**
+   * Marks the sidecar unclean on disk ahead of the first change since it was
+   * last flushed.
+   */
+  void beginChange();
+
+  /**
+   * Storage of the sidecar.
+   */
+  std::unique_ptr<FileBackend> storage_;
+
+  /**
+   * One bit per page, set for used pages; bit i of word w is page 64w + i.
+   */
+  std::vector<std::uint64_t> words_;
+
+  /**
+   * Whether the directory holds the used pages of the file.
+   */
+  bool complete_;
+
+  /**
+   * Whether the directory changed since it was last flushed.
+   */
+  bool dirty_;
+};
+
+}
@@ -101,6 +101,16 @@ class PageIterator {
 		return page_->getRecord(current_record_); 
 	}
 
+  /**
+   * Returns the current record in the page without copying it; the view is
+   * valid as long as the page is.
+   *
+   * @return  View of the record in page.
+   */
+  inline std::string_view view() const {
+    return page_->getRecordView(current_record_);
+  }
+
   /**
    * Returns the next used slot in the page after the given slot or
    * Page::INVALID_SLOT if no slots are used after the given slot.
@@ -109,18 +119,10 @@ class PageIterator {
    * @return  Next used slot after given slot or Page::INVALID_SLOT.
    */
   SlotId getNextUsedSlot(const SlotId start) const {
-    SlotId slot_number = Page::INVALID_SLOT;
-    for (SlotId i = start + 1; i <= page_->header_.num_slots; ++i) {
-      const PageSlot* slot = page_->getSlot(i);
-      if (slot->used) {
-        slot_number = i;
-        break;
-      }
-    }
-    return slot_number;
+    return page_->getNextUsedSlot(start);
   }
 
-	RecordId getCurrentRecord()
+	RecordId getCurrentRecord() const
 	{
 		return current_record_;
 	}
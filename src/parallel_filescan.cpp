@@ -0,0 +1,150 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "parallel_filescan.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "file_iterator.h"
+
+namespace badgerdb {
+
+ParallelFileScan::ParallelFileScan(const std::string& name, BufMgr* bufMgr,
+                                   const std::uint32_t numWorkers,
+                                   const std::uint32_t morselPages)
+    : file(new PageFile(name, false)),
+      bufMgr(bufMgr),
+      numWorkers(std::max<std::uint32_t>(numWorkers, 1)),
+      morselPages(morselPages),
+      nextPage(0),
+      numRecords(0),
+      failed(false) {
+  // The used list comes from the page directory loaded as the file is
+  // opened, so this reads no page headers.  (Only a file whose directory is
+  // missing or unclean reads each header once, as it is opened, to rebuild
+  // it.)
+  for (FileIterator iter = file->begin(); iter != file->end(); ++iter) {
+    pageNos.push_back(iter.getCurrentPageNo());
+  }
+}
+
+ParallelFileScan::~ParallelFileScan() {
+  bufMgr->flushFile(file);
+  delete file;
+}
+
+void ParallelFileScan::setPredicate(const std::size_t attrByteOffset,
+                                    const Datatype attrType,
+                                    const void* lowVal, const Operator lowOp,
+                                    const void* highVal, const Operator highOp,
+                                    const std::size_t attrLength) {
+  predicate.reset(new ScanPredicate(attrByteOffset, attrType, lowVal, lowOp,
+                                    highVal, highOp, attrLength));
+}
+
+void ParallelFileScan::clearPredicate() {
+  predicate.reset();
+}
+
+std::size_t ParallelFileScan::run(const Consumer& consumer) {
+  nextPage = 0;
+  numRecords = 0;
+  failed = false;
+  error = std::exception_ptr();
+
+  std::vector<std::thread> threads;
+  for (std::uint32_t w = 1; w < numWorkers; ++w) {
+    threads.push_back(std::thread(&ParallelFileScan::work, this, w,
+                                  std::cref(consumer)));
+  }
+  work(0, consumer);
+  for (std::size_t t = 0; t < threads.size(); ++t) {
+    threads[t].join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return numRecords;
+}
+
+void ParallelFileScan::work(const std::uint32_t worker,
+                            const Consumer& consumer) {
+  try {
+    if (morselPages == 0) {
+      // One fixed range per worker, read DEFAULT_MORSEL_PAGES at a time.
+      const std::size_t rangePages =
+          (pageNos.size() + numWorkers - 1) / numWorkers;
+      const std::size_t end =
+          std::min(pageNos.size(), (worker + 1) * rangePages);
+      for (std::size_t first = worker * rangePages; first < end && !failed;
+           first += DEFAULT_MORSEL_PAGES) {
+        scanMorsel(worker, consumer, first,
+                   std::min(end, first + DEFAULT_MORSEL_PAGES));
+      }
+      return;
+    }
+    while (!failed) {
+      const std::size_t first = nextPage.fetch_add(morselPages);
+      if (first >= pageNos.size()) {
+        return;
+      }
+      scanMorsel(worker, consumer, first,
+                 std::min(pageNos.size(), first + morselPages));
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(errorMutex);
+    if (!error) {
+      error = std::current_exception();
+    }
+    failed = true;
+  }
+}
+
+void ParallelFileScan::scanMorsel(const std::uint32_t worker,
+                                  const Consumer& consumer,
+                                  const std::size_t first,
+                                  const std::size_t last) {
+  const std::vector<PageId> morsel(pageNos.begin() + first,
+                                   pageNos.begin() + last);
+  std::vector<Page*> pages;
+  bufMgr->readPages(file, morsel, pages);
+
+  std::vector<SlotId> slots;
+  std::vector<char> values;
+  std::vector<RecordId> rids;
+  std::size_t p = 0;
+  try {
+    for (; p < pages.size(); ++p) {
+      const Page& page = *pages[p];
+      rids.clear();
+      if (predicate) {
+        predicate->select(page, Page::INVALID_SLOT, slots, values);
+        for (std::size_t s = 0; s < slots.size(); ++s) {
+          rids.push_back(RecordId{morsel[p], slots[s], 0});
+        }
+      } else {
+        for (SlotId s = page.getNextUsedSlot(Page::INVALID_SLOT);
+             s != Page::INVALID_SLOT; s = page.getNextUsedSlot(s)) {
+          rids.push_back(RecordId{morsel[p], s, 0});
+        }
+      }
+      if (!rids.empty()) {
+        consumer(worker, page, rids);
+        numRecords += rids.size();
+      }
+      bufMgr->unPinPage(file, morsel[p], false);
+    }
+  } catch (...) {
+    for (; p < pages.size(); ++p) {
+      bufMgr->unPinPage(file, morsel[p], false);
+    }
+    throw;
+  }
+}
+
+}
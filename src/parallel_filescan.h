@@ -0,0 +1,167 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+#include "scan_predicate.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Scans the records of a relation with several worker threads.
+ *
+ * The relation's pages, in file order, are cut into morsels of consecutive
+ * pages.  A worker takes the next morsel whenever it is done with its last,
+ * so the work evens out however long each page takes.  With a morsel size of
+ * zero, each worker is given one fixed range of about the same number of
+ * pages instead.
+ *
+ * Workers share the buffer manager.  Each reads a morsel with one call to
+ * BufMgr::readPages(), so its pages are read as one batch outside the buffer
+ * pool's lock and stay pinned until the worker is done with them; the pool
+ * must hold numWorkers morsels at once.  For every page with records left
+ * after the predicate (if one is set), the worker hands the page and the IDs
+ * of those records to the consumer.  Records of one page arrive in slot
+ * order, but pages arrive in no particular order.
+ */
+class ParallelFileScan {
+ public:
+  /**
+   * Takes the records of one page: the number of the worker calling, the
+   * pinned page and the IDs of the page's records.  Called on the workers'
+   * threads, so calls of different workers may run at the same time; the
+   * page and the IDs are valid only during the call.
+   */
+  typedef std::function<void(const std::uint32_t worker, const Page& page,
+                             const std::vector<RecordId>& rids)>
+      Consumer;
+
+  /**
+   * Number of pages of a morsel by default.
+   */
+  static const std::uint32_t DEFAULT_MORSEL_PAGES = 16;
+
+  /**
+   * Opens a relation for scanning.
+   *
+   * @param name          Name of the relation's file.
+   * @param bufMgr        Buffer manager to read pages through.
+   * @param numWorkers    Number of worker threads, the calling one included.
+   * @param morselPages   Number of pages a worker takes at a time, or 0 to
+   *                      give each worker one fixed range.
+   */
+  ParallelFileScan(const std::string& name, BufMgr* bufMgr,
+                   const std::uint32_t numWorkers,
+                   const std::uint32_t morselPages = DEFAULT_MORSEL_PAGES);
+
+  ~ParallelFileScan();
+
+  /**
+   * Makes the scan hand over only records whose attribute is within the
+   * given bounds; see FileScan::setPredicate().
+   */
+  void setPredicate(const std::size_t attrByteOffset, const Datatype attrType,
+                    const void* lowVal, const Operator lowOp,
+                    const void* highVal, const Operator highOp,
+                    const std::size_t attrLength = 0);
+
+  /**
+   * Makes the scan hand over every record again.
+   */
+  void clearPredicate();
+
+  /**
+   * Scans the relation, returning once every page has been handled.  If the
+   * consumer throws, or a page cannot be read, the workers stop taking pages
+   * and the first exception is rethrown here.
+   *
+   * @param consumer  Takes the records of each page.
+   * @return  Number of records handed to the consumer.
+   */
+  std::size_t run(const Consumer& consumer);
+
+ private:
+  /**
+   * Body of a worker.
+   *
+   * @param worker    Number of the worker, from 0.
+   * @param consumer  Takes the records of each page.
+   */
+  void work(const std::uint32_t worker, const Consumer& consumer);
+
+  /**
+   * Reads pages [first, last) of pageNos and hands their records over.
+   */
+  void scanMorsel(const std::uint32_t worker, const Consumer& consumer,
+                  const std::size_t first, const std::size_t last);
+
+  /**
+   * File which is being scanned.
+   */
+  PageFile* file;
+
+  /**
+   * Buffer manager the workers read pages through.
+   */
+  BufMgr* bufMgr;
+
+  /**
+   * Number of worker threads.
+   */
+  std::uint32_t numWorkers;
+
+  /**
+   * Number of pages a worker takes at a time; zero for fixed ranges.
+   */
+  std::uint32_t morselPages;
+
+  /**
+   * Numbers of the relation's pages, in file order.
+   */
+  std::vector<PageId> pageNos;
+
+  /**
+   * Condition records must meet to be handed over; none if NULL.
+   */
+  std::unique_ptr<ScanPredicate> predicate;
+
+  /**
+   * Index in pageNos of the next morsel to hand out.
+   */
+  std::atomic<std::size_t> nextPage;
+
+  /**
+   * Number of records handed to the consumer so far.
+   */
+  std::atomic<std::size_t> numRecords;
+
+  /**
+   * Set once a worker has failed, to stop the others.
+   */
+  std::atomic<bool> failed;
+
+  /**
+   * First exception of a worker, and the mutex guarding it.
+   */
+  std::exception_ptr error;
+  std::mutex errorMutex;
+};
+
+}
@@ -0,0 +1,201 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "scan_predicate.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <cassert>
+#include <cstring>
+
+#include "exceptions/bad_opcodes_exception.h"
+#include "exceptions/bad_scan_param_exception.h"
+#include "exceptions/bad_scanrange_exception.h"
+
+namespace badgerdb {
+
+ScanPredicate::ScanPredicate(const std::size_t offset, const Datatype type,
+                             const void* low_val, const Operator low_op,
+                             const void* high_val, const Operator high_op,
+                             const std::size_t length)
+    : offset_(offset),
+      type_(type),
+      length_(type == INTEGER ? sizeof(int)
+                              : type == DOUBLE ? sizeof(double) : length),
+      has_low_(low_val != NULL),
+      has_high_(high_val != NULL),
+      low_inclusive_(low_op == GTE),
+      high_inclusive_(high_op == LTE),
+      low_int_(0),
+      high_int_(0),
+      low_double_(0),
+      high_double_(0) {
+  if ((has_low_ && low_op != GT && low_op != GTE) ||
+      (has_high_ && high_op != LT && high_op != LTE)) {
+    throw BadOpcodesException();
+  }
+  if (length_ == 0) {
+    throw BadScanParamException();
+  }
+  if (has_low_ && type == INTEGER) {
+    memcpy(&low_int_, low_val, sizeof(int));
+  } else if (has_low_ && type == DOUBLE) {
+    memcpy(&low_double_, low_val, sizeof(double));
+  } else if (has_low_) {
+    low_string_.assign(static_cast<const char*>(low_val), length_);
+  }
+  if (has_high_ && type == INTEGER) {
+    memcpy(&high_int_, high_val, sizeof(int));
+  } else if (has_high_ && type == DOUBLE) {
+    memcpy(&high_double_, high_val, sizeof(double));
+  } else if (has_high_) {
+    high_string_.assign(static_cast<const char*>(high_val), length_);
+  }
+  if (has_low_ && has_high_ &&
+      (type == INTEGER ? low_int_ > high_int_
+                       : type == DOUBLE ? low_double_ > high_double_
+                                        : low_string_ > high_string_)) {
+    throw BadScanrangeException();
+  }
+}
+
+bool ScanPredicate::matches(const char* value) const {
+  int below_low;
+  int above_high;
+  if (type_ == INTEGER) {
+    int v;
+    memcpy(&v, value, sizeof(v));
+    below_low = v < low_int_ ? -1 : v > low_int_;
+    above_high = v < high_int_ ? -1 : v > high_int_;
+  } else if (type_ == DOUBLE) {
+    double v;
+    memcpy(&v, value, sizeof(v));
+    if (v != v) {
+      return false;  // NaN is in no range
+    }
+    below_low = v < low_double_ ? -1 : v > low_double_;
+    above_high = v < high_double_ ? -1 : v > high_double_;
+  } else {
+    below_low = has_low_ ? memcmp(value, low_string_.data(), length_) : 1;
+    above_high = has_high_ ? memcmp(value, high_string_.data(), length_) : -1;
+  }
+  return (!has_low_ || below_low > 0 || (below_low == 0 && low_inclusive_)) &&
+         (!has_high_ || above_high < 0 || (above_high == 0 && high_inclusive_));
+}
+
+bool ScanPredicate::overlaps(const char* min, const char* max) const {
+  // The ranges meet unless <max> is below the low bound or <min> is above the
+  // high one.
+  int max_to_low;
+  int min_to_high;
+  if (type_ == INTEGER) {
+    int lo;
+    int hi;
+    memcpy(&lo, min, sizeof(lo));
+    memcpy(&hi, max, sizeof(hi));
+    max_to_low = hi < low_int_ ? -1 : hi > low_int_;
+    min_to_high = lo < high_int_ ? -1 : lo > high_int_;
+  } else if (type_ == DOUBLE) {
+    double lo;
+    double hi;
+    memcpy(&lo, min, sizeof(lo));
+    memcpy(&hi, max, sizeof(hi));
+    if (lo != lo || hi != hi) {
+      return true;
+    }
+    max_to_low = hi < low_double_ ? -1 : hi > low_double_;
+    min_to_high = lo < high_double_ ? -1 : lo > high_double_;
+  } else {
+    max_to_low = has_low_ ? memcmp(max, low_string_.data(), length_) : 1;
+    min_to_high = has_high_ ? memcmp(min, high_string_.data(), length_) : -1;
+  }
+  return (!has_low_ || max_to_low > 0 || (max_to_low == 0 && low_inclusive_)) &&
+         (!has_high_ || min_to_high < 0 ||
+          (min_to_high == 0 && high_inclusive_));
+}
+
+std::uint64_t ScanPredicate::evaluate(const char* values,
+                                      const std::size_t count) const {
+  assert(count <= BATCH_SIZE);
+  std::uint64_t mask = 0;
+  std::size_t i = 0;
+#ifdef __SSE2__
+  if (type_ == INTEGER) {
+    // Four values per compare; each lane ends up all ones if in range.
+    const __m128i low = _mm_set1_epi32(low_int_);
+    const __m128i high = _mm_set1_epi32(high_int_);
+    const __m128i all = _mm_set1_epi32(-1);
+    for (; i + 4 <= count; i += 4) {
+      const __m128i v = _mm_loadu_si128(
+          reinterpret_cast<const __m128i*>(values + i * sizeof(int)));
+      __m128i in = all;
+      if (has_low_) {
+        in = _mm_cmpgt_epi32(v, low);
+        if (low_inclusive_) {
+          in = _mm_or_si128(in, _mm_cmpeq_epi32(v, low));
+        }
+      }
+      if (has_high_) {
+        __m128i below = _mm_cmplt_epi32(v, high);
+        if (high_inclusive_) {
+          below = _mm_or_si128(below, _mm_cmpeq_epi32(v, high));
+        }
+        in = _mm_and_si128(in, below);
+      }
+      mask |= std::uint64_t(_mm_movemask_ps(_mm_castsi128_ps(in))) << i;
+    }
+  } else if (type_ == DOUBLE) {
+    // Two values per compare; comparisons with NaN are false, as in matches().
+    const __m128d low = _mm_set1_pd(low_double_);
+    const __m128d high = _mm_set1_pd(high_double_);
+    for (; i + 2 <= count; i += 2) {
+      const __m128d v = _mm_loadu_pd(
+          reinterpret_cast<const double*>(values + i * sizeof(double)));
+      __m128d in = _mm_cmpeq_pd(v, v);
+      if (has_low_) {
+        in = _mm_and_pd(in, low_inclusive_ ? _mm_cmpge_pd(v, low)
+                                           : _mm_cmpgt_pd(v, low));
+      }
+      if (has_high_) {
+        in = _mm_and_pd(in, high_inclusive_ ? _mm_cmple_pd(v, high)
+                                            : _mm_cmplt_pd(v, high));
+      }
+      mask |= std::uint64_t(_mm_movemask_pd(in)) << i;
+    }
+  }
+#endif
+  for (; i < count; ++i) {
+    if (matches(values + i * length_)) {
+      mask |= std::uint64_t(1) << i;
+    }
+  }
+  return mask;
+}
+
+void ScanPredicate::select(const Page& page, const SlotId start,
+                           std::vector<SlotId>& slots,
+                           std::vector<char>& values) const {
+  slots.clear();
+  values.resize(BATCH_SIZE * length_);
+  SlotId batch[BATCH_SIZE];
+  SlotId last = start;
+  std::size_t count;
+  do {
+    count = page.gatherAttribute(last, offset_, length_, batch, &values[0],
+                                 BATCH_SIZE);
+    for (std::uint64_t mask = evaluate(&values[0], count); mask != 0;
+         mask &= mask - 1) {
+      slots.push_back(batch[__builtin_ctzll(mask)]);
+    }
+    if (count > 0) {
+      last = batch[count - 1];
+    }
+  } while (count == BATCH_SIZE);
+}
+
+}
@@ -0,0 +1,149 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief A range condition on one attribute of a relation's records, bounded
+ *        like the key range of BTreeIndex::startScan(), for FileScan to
+ *        evaluate on page bytes.
+ *
+ * The attribute is an int, a double or a fixed-length string (compared byte
+ * by byte, as memcmp() does) at a fixed offset in the record.  Either bound
+ * may be left open.
+ *
+ * Records are tested in batches: the attribute's values of up to BATCH_SIZE
+ * records, packed one after another, go in and a bit mask of the ones in
+ * range comes out.  INTEGER and DOUBLE values are compared several at a time
+ * with SSE2 instructions where the target has them.
+ */
+class ScanPredicate {
+ public:
+  /**
+   * Largest number of values evaluate() takes at once.
+   */
+  static const std::size_t BATCH_SIZE = 64;
+
+  /**
+   * Makes a predicate.
+   *
+   * @param offset    Byte offset of the attribute in the record.
+   * @param type      Type of the attribute.
+   * @param low_val   Low bound, or NULL for none.
+   * @param low_op    GT or GTE; ignored without a low bound.
+   * @param high_val  High bound, or NULL for none.
+   * @param high_op   LT or LTE; ignored without a high bound.
+   * @param length    Length of a STRING attribute; INTEGER and DOUBLE
+   *                  attributes have the length of their type.
+   * @throws  BadOpcodesException     If an operator does not fit its bound.
+   * @throws  BadScanrangeException   If the low bound is above the high one.
+   * @throws  BadScanParamException   If a STRING attribute has no length.
+   */
+  ScanPredicate(const std::size_t offset, const Datatype type,
+                const void* low_val, const Operator low_op,
+                const void* high_val, const Operator high_op,
+                const std::size_t length = 0);
+
+  /**
+   * Returns the byte offset of the attribute in the record.
+   */
+  std::size_t offset() const { return offset_; }
+
+  /**
+   * Returns the type of the attribute.
+   */
+  Datatype type() const { return type_; }
+
+  /**
+   * Returns the length of the attribute.
+   */
+  std::size_t length() const { return length_; }
+
+  /**
+   * Returns whether a value of the attribute is in range.
+   *
+   * @param value   The value's <length()> bytes.
+   */
+  bool matches(const char* value) const;
+
+  /**
+   * Returns whether some value between two others is in range, e.g. whether
+   * a page whose values lie between the two may hold a match.
+   *
+   * @param min   The smaller value's <length()> bytes.
+   * @param max   The larger value's <length()> bytes.
+   */
+  bool overlaps(const char* min, const char* max) const;
+
+  /**
+   * Tests packed values of the attribute.
+   *
+   * @param values  <count> values of <length()> bytes each, back to back.
+   * @param count   Number of values, at most BATCH_SIZE.
+   * @return  Mask with bit <i> set if value <i> is in range.
+   */
+  std::uint64_t evaluate(const char* values, const std::size_t count) const;
+
+  /**
+   * Tests the records of a page after the given slot, BATCH_SIZE at a time.
+   *
+   * @param page    Page of the records.
+   * @param start   Slot to start after; Page::INVALID_SLOT for the first.
+   * @param slots   Receives the slots of the records in range, in order.
+   * @param values  Scratch space for packed values; may be shared by the
+   *                calls of one thread.
+   * @throws  PageFormatException   If a record has no such attribute.
+   */
+  void select(const Page& page, const SlotId start, std::vector<SlotId>& slots,
+              std::vector<char>& values) const;
+
+ private:
+  /**
+   * Byte offset of the attribute in the record.
+   */
+  std::size_t offset_;
+
+  /**
+   * Type of the attribute.
+   */
+  Datatype type_;
+
+  /**
+   * Length of the attribute.
+   */
+  std::size_t length_;
+
+  /**
+   * Whether each bound is there, and whether it includes its own value.
+   */
+  bool has_low_;
+  bool has_high_;
+  bool low_inclusive_;
+  bool high_inclusive_;
+
+  /**
+   * The bounds, in the member of their type.
+   */
+  int low_int_;
+  int high_int_;
+  double low_double_;
+  double high_double_;
+  std::string low_string_;
+  std::string high_string_;
+};
+
+}
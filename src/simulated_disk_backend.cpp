@@ -0,0 +1,171 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "simulated_disk_backend.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace badgerdb {
+
+DiskProfile DiskProfile::hdd() {
+  DiskProfile profile;
+  profile.seek_micros = 8000;
+  profile.access_micros = 100;
+  profile.bandwidth = 150 * 1024 * 1024;
+  profile.queue_depth = 1;
+  profile.jitter_micros = 2000;
+  profile.sync_micros = 10000;
+  profile.seed = 1;
+  profile.sleep = false;
+  return profile;
+}
+
+DiskProfile DiskProfile::nvme() {
+  DiskProfile profile;
+  profile.seek_micros = 0;
+  profile.access_micros = 20;
+  profile.bandwidth = std::uint64_t(2) * 1024 * 1024 * 1024;
+  profile.queue_depth = 32;
+  profile.jitter_micros = 5;
+  profile.sync_micros = 50;
+  profile.seed = 1;
+  profile.sleep = false;
+  return profile;
+}
+
+SimulatedDiskBackend::SimulatedDiskBackend(FileBackend* inner,
+                                           const DiskProfile& profile)
+    : inner_(inner),
+      profile_(profile),
+      slot_free_(std::max<std::uint32_t>(profile.queue_depth, 1), 0),
+      start_(std::chrono::steady_clock::now()),
+      head_(0),
+      random_(profile.seed) {
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+SimulatedDiskBackend::~SimulatedDiskBackend() {
+}
+
+void SimulatedDiskBackend::read(const off_t offset, void* data,
+                                const std::size_t length) {
+  access(offset, length, false /* is_write */);
+  inner_->read(offset, data, length);
+}
+
+void SimulatedDiskBackend::readv(const off_t offset, void* const* buffers,
+                                 const std::size_t buffer_length,
+                                 const std::uint32_t count) {
+  access(offset, buffer_length * count, false /* is_write */);
+  inner_->readv(offset, buffers, buffer_length, count);
+}
+
+void SimulatedDiskBackend::write(const off_t offset, const void* data,
+                                 const std::size_t length) {
+  access(offset, length, true /* is_write */);
+  inner_->write(offset, data, length);
+}
+
+void SimulatedDiskBackend::truncate(const off_t length) {
+  inner_->truncate(length);
+}
+
+off_t SimulatedDiskBackend::size() {
+  return inner_->size();
+}
+
+void SimulatedDiskBackend::sync() {
+  std::uint64_t done;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.syncs;
+    done = book(profile_.sync_micros);
+  }
+  if (profile_.sleep) {
+    std::this_thread::sleep_until(start_ + std::chrono::microseconds(done));
+  }
+  inner_->sync();
+}
+
+SimulatedDiskStats SimulatedDiskBackend::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+BackendFactory SimulatedDiskBackend::factory(const DiskProfile& profile,
+                                             const BackendFactory& inner) {
+  return [profile, inner](const std::string& filename, const bool create_new) {
+    FileBackend* backend = inner ? inner(filename, create_new)
+                                 : FileBackend::open(filename, create_new);
+    return new SimulatedDiskBackend(backend, profile);
+  };
+}
+
+void SimulatedDiskBackend::access(const off_t offset,
+                                  const std::size_t length,
+                                  const bool is_write) {
+  std::uint64_t done;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::uint64_t service = profile_.access_micros;
+    if (offset == head_) {
+      ++stats_.sequential_accesses;
+    } else {
+      ++stats_.random_accesses;
+      service += profile_.seek_micros;
+    }
+    if (profile_.bandwidth > 0) {
+      service += std::uint64_t(length) * 1000000 / profile_.bandwidth;
+    }
+    if (profile_.jitter_micros > 0) {
+      service += random_() % (profile_.jitter_micros + 1);
+    }
+    head_ = offset + length;
+    if (is_write) {
+      ++stats_.writes;
+      stats_.bytes_written += length;
+    } else {
+      ++stats_.reads;
+      stats_.bytes_read += length;
+    }
+    done = book(service);
+  }
+  if (profile_.sleep) {
+    std::this_thread::sleep_until(start_ + std::chrono::microseconds(done));
+  }
+}
+
+std::uint64_t SimulatedDiskBackend::book(const std::uint64_t service_micros) {
+  // A caller waits for each of its accesses, so it issues the next one when
+  // the last completes (or, when sleeping, now).  The access goes to the slot
+  // that frees up first and starts once that slot is free.
+  std::map<std::thread::id, std::uint64_t>::iterator caller =
+      thread_clock_.find(std::this_thread::get_id());
+  if (caller == thread_clock_.end()) {
+    // A thread's first access is issued once a queue slot is free.
+    caller = thread_clock_.insert(std::make_pair(
+        std::this_thread::get_id(),
+        *std::min_element(slot_free_.begin(), slot_free_.end()))).first;
+  }
+  std::uint64_t& issued = caller->second;
+  if (profile_.sleep) {
+    issued = std::chrono::duration_cast<std::chrono::microseconds>(
+                 std::chrono::steady_clock::now() - start_).count();
+  }
+  std::vector<std::uint64_t>::iterator slot =
+      std::min_element(slot_free_.begin(), slot_free_.end());
+  const std::uint64_t start = std::max(*slot, issued);
+  *slot = start + service_micros;
+  issued = *slot;
+  stats_.busy_micros += service_micros;
+  stats_.elapsed_micros = std::max(stats_.elapsed_micros, *slot);
+  return *slot;
+}
+
+}
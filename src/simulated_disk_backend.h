@@ -0,0 +1,258 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "file_backend.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Timing model of a simulated device.
+ */
+struct DiskProfile {
+  /**
+   * Positioning time of an access that does not continue where the previous
+   * one ended, in microseconds.
+   */
+  std::uint32_t seek_micros;
+
+  /**
+   * Fixed cost of every access (command overhead), in microseconds.
+   */
+  std::uint32_t access_micros;
+
+  /**
+   * Transfer rate, in bytes per second.
+   */
+  std::uint64_t bandwidth;
+
+  /**
+   * Number of accesses the device serves at the same time.
+   */
+  std::uint32_t queue_depth;
+
+  /**
+   * Largest random delay added to an access, in microseconds; 0 for none.
+   */
+  std::uint32_t jitter_micros;
+
+  /**
+   * Cost of forcing writes to stable storage, in microseconds.
+   */
+  std::uint32_t sync_micros;
+
+  /**
+   * Seed of the jitter, so runs are reproducible.
+   */
+  std::uint32_t seed;
+
+  /**
+   * Whether accesses take their simulated time in real time.  Otherwise they
+   * return at once and only the simulated clock advances.
+   */
+  bool sleep;
+
+  /**
+   * Returns a profile like a single hard disk.
+   */
+  static DiskProfile hdd();
+
+  /**
+   * Returns a profile like an NVMe flash drive.
+   */
+  static DiskProfile nvme();
+};
+
+/**
+ * @brief Access counts and simulated time of a SimulatedDiskBackend.
+ */
+struct SimulatedDiskStats {
+  /**
+   * Number of read accesses; a vectored read is one access.
+   */
+  std::uint64_t reads;
+
+  /**
+   * Number of write accesses.
+   */
+  std::uint64_t writes;
+
+  /**
+   * Number of syncs.
+   */
+  std::uint64_t syncs;
+
+  /**
+   * Accesses that started where the previous one ended.
+   */
+  std::uint64_t sequential_accesses;
+
+  /**
+   * Accesses that needed a seek.
+   */
+  std::uint64_t random_accesses;
+
+  /**
+   * Bytes read.
+   */
+  std::uint64_t bytes_read;
+
+  /**
+   * Bytes written.
+   */
+  std::uint64_t bytes_written;
+
+  /**
+   * Sum of the service times of all accesses, in microseconds.
+   */
+  std::uint64_t busy_micros;
+
+  /**
+   * Simulated time from the first access to the end of the last, in
+   * microseconds.  Less than busy_micros when accesses overlap in the queue.
+   */
+  std::uint64_t elapsed_micros;
+};
+
+/**
+ * @brief Backend wrapping another one and charging each access the time a
+ *        simulated device would take for it.
+ *
+ * An access costs the profile's access time, a seek unless it starts where
+ * the previous access ended, its transfer time at the profile's bandwidth and
+ * an optional random jitter.  The device serves up to queue_depth accesses at
+ * once: an access starts when a queue slot is free and its thread has issued
+ * it, i.e. when the thread's previous access completed.  Accesses of
+ * different threads (e.g. prefetching, background writeback) thus overlap,
+ * while a single thread waits for every access in turn.  Time is kept on a
+ * simulated clock and, if the profile asks for it, also spent in real time by
+ * sleeping.
+ *
+ * The wrapped backend does the actual reading and writing.  A file opened by
+ * name without the simulated factory (as FileScan does) gets the simulation
+ * only while it is already open with it.
+ */
+class SimulatedDiskBackend : public FileBackend {
+ public:
+  /**
+   * Wraps a backend.
+   *
+   * @param inner     Backend storing the bytes; owned by this one.
+   * @param profile   Timing model.
+   */
+  SimulatedDiskBackend(FileBackend* inner, const DiskProfile& profile);
+
+  ~SimulatedDiskBackend();
+
+  void read(const off_t offset, void* data, const std::size_t length);
+
+  /**
+   * Reads the ranges as a single access.
+   */
+  void readv(const off_t offset, void* const* buffers,
+             const std::size_t buffer_length, const std::uint32_t count);
+
+  void write(const off_t offset, const void* data, const std::size_t length);
+
+  void truncate(const off_t length);
+
+  off_t size();
+
+  void sync();
+
+  /**
+   * Returns the access counts and simulated time so far.
+   */
+  SimulatedDiskStats stats() const;
+
+  /**
+   * Makes a backend factory wrapping the backends of another factory.
+   *
+   * @param profile   Timing model.
+   * @param inner     Makes the wrapped backends; by default, as
+   *                  FileBackend::open() does.
+   */
+  static BackendFactory factory(const DiskProfile& profile,
+                                const BackendFactory& inner = BackendFactory());
+
+ private:
+  /**
+   * Charges an access and waits for it to complete in the simulation.
+   *
+   * @param offset    Offset accessed.
+   * @param length    Number of bytes transferred.
+   * @param is_write  Whether the access is a write.
+   */
+  void access(const off_t offset, const std::size_t length,
+              const bool is_write);
+
+  /**
+   * Takes the next free queue slot and books the given service time on it.
+   *
+   * @param service_micros  Time the access keeps the device busy.
+   * @return  Simulated time at which the access completes.
+   */
+  std::uint64_t book(const std::uint64_t service_micros);
+
+  /**
+   * Backend storing the bytes.
+   */
+  std::unique_ptr<FileBackend> inner_;
+
+  /**
+   * Timing model.
+   */
+  DiskProfile profile_;
+
+  /**
+   * Guards everything below.
+   */
+  mutable std::mutex mutex_;
+
+  /**
+   * Simulated time at which each queue slot becomes free.
+   */
+  std::vector<std::uint64_t> slot_free_;
+
+  /**
+   * Simulated time at which each calling thread's last access completed.
+   */
+  std::map<std::thread::id, std::uint64_t> thread_clock_;
+
+  /**
+   * Real time that simulated time 0 corresponds to, used when sleeping.
+   */
+  std::chrono::steady_clock::time_point start_;
+
+  /**
+   * Offset just past the last access.
+   */
+  off_t head_;
+
+  /**
+   * Source of jitter.
+   */
+  std::mt19937 random_;
+
+  /**
+   * Counts so far.
+   */
+  SimulatedDiskStats stats_;
+};
+
+}
@@ -24,6 +24,30 @@ typedef std::uint16_t SlotId;
  */
 typedef std::uint32_t FrameId;
 
+/**
+ * @brief Identifier for an open file: its slot in the open file table in the
+ *        low 32 bits and the number of the open in the high 32 bits, so that
+ *        a file opened in a slot that another file used before gets an
+ *        identifier of its own.
+ */
+typedef std::uint64_t FileId;
+
+/**
+ * @brief Datatype enumeration type.
+ */
+enum Datatype { INTEGER = 0, DOUBLE = 1, STRING = 2 };
+
+/**
+ * @brief Scan operations enumeration. Passed to BTreeIndex::startScan() and
+ *        FileScan::setPredicate().
+ */
+enum Operator {
+  LT,  /* Less Than */
+  LTE, /* Less Than or Equal to */
+  GTE, /* Greater Than or Equal to */
+  GT   /* Greater Than */
+};
+
 /**
  * @brief Identifier for a record in a page.
  */
@@ -0,0 +1,333 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#include "zone_map.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "exceptions/bad_scan_param_exception.h"
+#include "exceptions/page_format_exception.h"
+#include "file.h"
+#include "mem_backend.h"
+
+namespace badgerdb {
+
+/**
+ * Identifies a zone map sidecar ("BDBZ").
+ */
+static const std::uint32_t ZONE_MAGIC = 0x5a424442;
+
+/**
+ * @brief Header at the start of a zone map sidecar, followed by the
+ *        attributes and then the entries.
+ */
+struct ZoneMapHeader {
+  /**
+   * ZONE_MAGIC.
+   */
+  std::uint32_t magic;
+
+  /**
+   * Whether the entries on disk are complete; cleared before the first change
+   * after a flush.
+   */
+  std::uint32_t clean;
+
+  /**
+   * Number of attributes.
+   */
+  std::uint32_t num_attributes;
+
+  /**
+   * Padding.
+   */
+  std::uint32_t reserved;
+};
+
+/**
+ * @brief An attribute as stored in a zone map sidecar.
+ */
+struct ZoneAttributeImage {
+  std::uint32_t offset;
+  std::uint32_t type;
+  std::uint32_t length;
+};
+
+static std::string mapName(const std::string& filename) {
+  return filename + ".zmap";
+}
+
+ZoneMap::ZoneMap(const std::string& filename, const bool create_new,
+                 const std::vector<ZoneAttribute>& attributes)
+    : entry_size_(1), entries_offset_(sizeof(ZoneMapHeader)), dirty_(false) {
+  const std::string name = mapName(filename);
+  if (MemBackend::exists(filename) || MemBackend::exists(name)) {
+    storage_.reset(new MemBackend(name, create_new));
+  } else {
+    storage_.reset(new DiskBackend(name, create_new));
+  }
+
+  ZoneMapHeader header = {ZONE_MAGIC, 1 /* clean */, 0, 0};
+  std::vector<ZoneAttributeImage> images;
+  if (create_new) {
+    for (std::size_t i = 0; i < attributes.size(); ++i) {
+      ZoneAttribute attribute = attributes[i];
+      if (attribute.type == INTEGER) {
+        attribute.length = sizeof(int);
+      } else if (attribute.type == DOUBLE) {
+        attribute.length = sizeof(double);
+      } else if (attribute.length == 0) {
+        throw BadScanParamException();
+      }
+      attributes_.push_back(attribute);
+      const ZoneAttributeImage image = {attribute.offset,
+                                        std::uint32_t(attribute.type),
+                                        attribute.length};
+      images.push_back(image);
+    }
+    header.num_attributes = images.size();
+    storage_->write(0 /* offset */, &header, sizeof(header));
+    if (!images.empty()) {
+      storage_->write(sizeof(header), &images[0],
+                      images.size() * sizeof(ZoneAttributeImage));
+    }
+  } else {
+    storage_->read(0 /* offset */, &header, sizeof(header));
+    if (header.magic == ZONE_MAGIC) {
+      images.resize(header.num_attributes);
+      if (!images.empty()) {
+        storage_->read(sizeof(header), &images[0],
+                       images.size() * sizeof(ZoneAttributeImage));
+      }
+      for (std::size_t i = 0; i < images.size(); ++i) {
+        const ZoneAttribute attribute = {images[i].offset,
+                                         Datatype(images[i].type),
+                                         images[i].length};
+        attributes_.push_back(attribute);
+      }
+    } else {
+      // Not a zone map; start over with one that keeps no bounds.
+      header.clean = 0;
+    }
+  }
+
+  std::size_t max_length = 0;
+  for (std::size_t i = 0; i < attributes_.size(); ++i) {
+    bound_offsets_.push_back(entry_size_);
+    entry_size_ += 2 * attributes_[i].length;
+    max_length = std::max<std::size_t>(max_length, attributes_[i].length);
+  }
+  entries_offset_ += attributes_.size() * sizeof(ZoneAttributeImage);
+  values_.resize(ScanPredicate::BATCH_SIZE * max_length);
+
+  if (!create_new) {
+    if (header.clean) {
+      const off_t size = storage_->size();
+      if (size > entries_offset_) {
+        entries_.resize((size - entries_offset_) / entry_size_ * entry_size_);
+        storage_->read(entries_offset_, &entries_[0], entries_.size());
+      }
+    } else {
+      // Pages may have changed after the entries were last written, so none
+      // of them can be trusted; the next flush writes the map out afresh.
+      dirty_ = true;
+    }
+  }
+}
+
+ZoneMap::~ZoneMap() {
+  flush();
+}
+
+bool ZoneMap::exists(const std::string& filename) {
+  return File::exists(mapName(filename));
+}
+
+void ZoneMap::remove(const std::string& filename) {
+  const std::string name = mapName(filename);
+  if (MemBackend::exists(name)) {
+    MemBackend::remove(name);
+  } else {
+    ::unlink(name.c_str());
+  }
+}
+
+void ZoneMap::set(const PageId page_number, const Page& page) {
+  beginChange();
+  computeBounds(page, entry(page_number));
+}
+
+void ZoneMap::setEmpty(const PageId page_number) {
+  beginChange();
+  entry(page_number)[0] = EMPTY;
+}
+
+void ZoneMap::forget(const PageId page_number) {
+  const std::size_t position = std::size_t(page_number) * entry_size_;
+  if (position >= entries_.size() || entries_[position] == UNKNOWN) {
+    return;
+  }
+  beginChange();
+  entries_[position] = UNKNOWN;
+}
+
+void ZoneMap::remap(const std::vector<PageRemap>& remap,
+                    const PageId num_pages) {
+  beginChange();
+  const std::vector<char> old_entries = entries_;
+  entries_.resize(std::size_t(num_pages) * entry_size_, UNKNOWN);
+  for (std::size_t i = 0; i < remap.size(); ++i) {
+    char* target = entry(remap[i].new_page_number);
+    const std::size_t source =
+        std::size_t(remap[i].old_page_number) * entry_size_;
+    if (source < old_entries.size()) {
+      memcpy(target, &old_entries[source], entry_size_);
+    } else {
+      target[0] = UNKNOWN;
+    }
+  }
+}
+
+bool ZoneMap::mayMatch(const PageId page_number,
+                       const ScanPredicate& predicate) const {
+  const std::size_t position = std::size_t(page_number) * entry_size_;
+  if (position >= entries_.size()) {
+    return true;
+  }
+  const char* bounds = &entries_[position];
+  if (bounds[0] == UNKNOWN) {
+    return true;
+  }
+  if (bounds[0] == EMPTY) {
+    return false;
+  }
+  for (std::size_t i = 0; i < attributes_.size(); ++i) {
+    const ZoneAttribute& attribute = attributes_[i];
+    if (attribute.offset == predicate.offset() &&
+        attribute.type == predicate.type() &&
+        attribute.length == predicate.length()) {
+      const char* min = bounds + bound_offsets_[i];
+      return predicate.overlaps(min, min + attribute.length);
+    }
+  }
+  return true;
+}
+
+void ZoneMap::flush() {
+  if (!dirty_) {
+    return;
+  }
+  if (!entries_.empty()) {
+    storage_->write(entries_offset_, &entries_[0], entries_.size());
+  }
+  storage_->truncate(entries_offset_ + off_t(entries_.size()));
+  // The entries have to be on disk before the sidecar says they are complete.
+  storage_->sync();
+  const ZoneMapHeader header = {ZONE_MAGIC, 1 /* clean */,
+                                std::uint32_t(attributes_.size()), 0};
+  storage_->write(0 /* offset */, &header, sizeof(header));
+  dirty_ = false;
+}
+
+char* ZoneMap::entry(const PageId page_number) {
+  const std::size_t position = std::size_t(page_number) * entry_size_;
+  if (position >= entries_.size()) {
+    entries_.resize(position + entry_size_, UNKNOWN);
+  }
+  return &entries_[position];
+}
+
+void ZoneMap::computeBounds(const Page& page, char* bounds) {
+  bounds[0] = EMPTY;
+  SlotId slots[ScanPredicate::BATCH_SIZE];
+  try {
+    for (std::size_t i = 0; i < attributes_.size(); ++i) {
+      const ZoneAttribute& attribute = attributes_[i];
+      char* min = bounds + bound_offsets_[i];
+      char* max = min + attribute.length;
+      bool seen = false;
+      if (attribute.type == DOUBLE) {
+        // A page of nothing but NaNs gets bounds no range overlaps.
+        const double infinity = std::numeric_limits<double>::infinity();
+        const double negative_infinity = -infinity;
+        memcpy(min, &infinity, sizeof(double));
+        memcpy(max, &negative_infinity, sizeof(double));
+      }
+      SlotId last = Page::INVALID_SLOT;
+      std::size_t count;
+      do {
+        count = page.gatherAttribute(last, attribute.offset, attribute.length,
+                                     slots, &values_[0],
+                                     ScanPredicate::BATCH_SIZE);
+        for (std::size_t j = 0; j < count; ++j) {
+          const char* value = &values_[j * attribute.length];
+          if (attribute.type == DOUBLE) {
+            double v;
+            memcpy(&v, value, sizeof(v));
+            if (v != v) {
+              continue;
+            }
+          } else if (!seen) {
+            memcpy(min, value, attribute.length);
+            memcpy(max, value, attribute.length);
+            seen = true;
+            continue;
+          }
+          if (compare(attribute, value, min) < 0) {
+            memcpy(min, value, attribute.length);
+          }
+          if (compare(attribute, value, max) > 0) {
+            memcpy(max, value, attribute.length);
+          }
+        }
+        if (count > 0) {
+          last = slots[count - 1];
+          bounds[0] = BOUNDED;
+        }
+      } while (count == ScanPredicate::BATCH_SIZE);
+    }
+  } catch (const PageFormatException&) {
+    bounds[0] = UNKNOWN;
+  }
+}
+
+void ZoneMap::beginChange() {
+  if (dirty_) {
+    return;
+  }
+  ZoneMapHeader header;
+  storage_->read(0 /* offset */, &header, sizeof(header));
+  header.clean = 0;
+  storage_->write(0 /* offset */, &header, sizeof(header));
+  // Pages must not reach disk while the sidecar still claims to be clean.
+  storage_->sync();
+  dirty_ = true;
+}
+
+int ZoneMap::compare(const ZoneAttribute& attribute, const char* a,
+                     const char* b) {
+  if (attribute.type == INTEGER) {
+    int x;
+    int y;
+    memcpy(&x, a, sizeof(x));
+    memcpy(&y, b, sizeof(y));
+    return x < y ? -1 : x > y;
+  }
+  if (attribute.type == DOUBLE) {
+    double x;
+    double y;
+    memcpy(&x, a, sizeof(x));
+    memcpy(&y, b, sizeof(y));
+    return x < y ? -1 : x > y;
+  }
+  return memcmp(a, b, attribute.length);
+}
+
+}
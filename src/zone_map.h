@@ -0,0 +1,231 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "file_backend.h"
+#include "page.h"
+#include "scan_predicate.h"
+#include "types.h"
+
+namespace badgerdb {
+
+struct PageRemap;
+
+/**
+ * @brief An attribute of a relation's records a zone map keeps bounds of.
+ */
+struct ZoneAttribute {
+  /**
+   * Byte offset of the attribute in the record.
+   */
+  std::uint32_t offset;
+
+  /**
+   * Type of the attribute.
+   */
+  Datatype type;
+
+  /**
+   * Length of a STRING attribute; INTEGER and DOUBLE attributes have the
+   * length of their type.
+   */
+  std::uint32_t length;
+};
+
+/**
+ * @brief The smallest and largest value of some attributes on each page of a
+ *        file, for scans to skip the pages a range predicate cannot match.
+ *
+ * A zone map is kept in a sidecar file next to the file it describes (the
+ * file's name with ".zmap" appended; in memory for in-memory files).  It is a
+ * hint: an entry is only ever allowed to be wider than the page's contents,
+ * and a page without an entry may hold anything.  Changes are kept in memory
+ * and written when the file's metadata is flushed; the sidecar is marked
+ * unclean on disk before the first change after a flush, and the entries of
+ * an unclean sidecar are ignored when it is opened again.
+ *
+ * Strings are compared byte by byte, as ScanPredicate does; NaN doubles are in
+ * no range and are left out of the bounds.  The caller serializes access (File
+ * does so under the file's mutex).
+ */
+class ZoneMap {
+ public:
+  /**
+   * Opens the zone map of a file, or creates an empty one (replacing any old
+   * one).
+   *
+   * @param filename    Name of the file the zone map describes.
+   * @param create_new  Whether to create the zone map.
+   * @param attributes  Attributes to keep bounds of; only used on create.
+   * @throws  BadScanParamException   If a STRING attribute has no length.
+   * @throws  FileNotFoundException   If the zone map is to be opened and does
+   *                                  not exist.
+   */
+  ZoneMap(const std::string& filename, const bool create_new,
+          const std::vector<ZoneAttribute>& attributes =
+              std::vector<ZoneAttribute>());
+
+  /**
+   * Flushes the zone map and closes its sidecar.
+   */
+  ~ZoneMap();
+
+  /**
+   * Returns true if the given file has a zone map.
+   *
+   * @param filename  Name of the file.
+   */
+  static bool exists(const std::string& filename);
+
+  /**
+   * Deletes the zone map of the given file, if it has one.
+   *
+   * @param filename  Name of the file.
+   */
+  static void remove(const std::string& filename);
+
+  /**
+   * Returns the attributes the zone map keeps bounds of.
+   */
+  const std::vector<ZoneAttribute>& attributes() const { return attributes_; }
+
+  /**
+   * Sets a page's entry to the bounds of its records, e.g. as the page is
+   * written.  A page whose records lack an attribute gets no entry.
+   *
+   * @param page_number   Number of the page.
+   * @param page          The page's contents.
+   */
+  void set(const PageId page_number, const Page& page);
+
+  /**
+   * Records that a page holds no records, as a newly allocated page doesn't.
+   *
+   * @param page_number   Number of the page.
+   */
+  void setEmpty(const PageId page_number);
+
+  /**
+   * Drops a page's entry, so that the page may hold anything, e.g. as a
+   * changed page is released to a buffer pool; writing the page sets it
+   * again.
+   *
+   * @param page_number   Number of the page.
+   */
+  void forget(const PageId page_number);
+
+  /**
+   * Moves entries along with the pages compaction moved.
+   *
+   * @param remap       Pages that moved, as returned by PageFile::compact().
+   * @param num_pages   Number of pages in the file after compaction.
+   */
+  void remap(const std::vector<PageRemap>& remap, const PageId num_pages);
+
+  /**
+   * Returns whether a page may hold records a predicate matches: false only
+   * if the page's entry rules that out.
+   *
+   * @param page_number   Number of the page.
+   * @param predicate     The predicate.
+   */
+  bool mayMatch(const PageId page_number, const ScanPredicate& predicate) const;
+
+  /**
+   * Writes the entries changed since the last flush and marks the sidecar
+   * clean.
+   */
+  void flush();
+
+ private:
+  /**
+   * State of a page's entry.
+   */
+  enum EntryState : char { UNKNOWN = 0, EMPTY = 1, BOUNDED = 2 };
+
+  /**
+   * Returns the entry of a page, adding (unknown) entries up to it.
+   *
+   * @param page_number   Number of the page.
+   */
+  char* entry(const PageId page_number);
+
+  /**
+   * Computes the bounds of a page's records into an entry.
+   *
+   * @param page    The page.
+   * @param bounds  Entry to fill in.
+   */
+  void computeBounds(const Page& page, char* bounds);
+
+  /**
+   * Marks the sidecar unclean on disk ahead of the first change since it was
+   * last flushed.
+   */
+  void beginChange();
+
+  /**
+   * Compares two values of an attribute.
+   *
+   * @param attribute   The attribute.
+   * @param a           A value.
+   * @param b           Another value.
+   * @return  Negative, zero or positive as <a> is below, equal to or above
+   *          <b>.
+   */
+  static int compare(const ZoneAttribute& attribute, const char* a,
+                     const char* b);
+
+  /**
+   * Storage of the sidecar.
+   */
+  std::unique_ptr<FileBackend> storage_;
+
+  /**
+   * Attributes kept bounds of.
+   */
+  std::vector<ZoneAttribute> attributes_;
+
+  /**
+   * Offset of each attribute's minimum in an entry; its maximum follows.
+   */
+  std::vector<std::size_t> bound_offsets_;
+
+  /**
+   * Size of an entry: the state byte and both bounds of every attribute.
+   */
+  std::size_t entry_size_;
+
+  /**
+   * Offset of the first entry in the sidecar.
+   */
+  off_t entries_offset_;
+
+  /**
+   * Entries indexed by page number, back to back.
+   */
+  std::vector<char> entries_;
+
+  /**
+   * Whether the entries changed since they were last flushed.
+   */
+  bool dirty_;
+
+  /**
+   * Scratch space for one batch of gathered values.
+   */
+  std::vector<char> values_;
+};
+
+}